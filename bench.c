@@ -0,0 +1,1488 @@
+// Benchmark harness for the EEE Helper CLI calculator.
+// Build with "make bench.out".
+//
+// ./bench.out [rows]
+//   Times the same formulas three ways over identical random inputs:
+//     native   the hand-written forward functions from the formula registry
+//     interp   the user formula language, bytecode interpreter only
+//     jit      the user formula language, native code backend
+//   and checks that all three agree, and that interp and jit agree exactly
+//   on a set of other expressions (exit status 1 if not). Then, per row of
+//   each, the hardware counters of the best run (cycles, instructions and
+//   IPC, cache and branch misses, from perf_event_open) and the bytes of
+//   input and output touched, with the rate that makes: a kernel near
+//   memory bandwidth with low IPC is memory-bound, one with high IPC and
+//   few misses is compute-bound. "batch"
+//   is formula_solve_batch (what batch files use) on the same rows. Last,
+//   the analysis kernels behind the file modes of menus 3-5 (power
+//   statistics, FFT harmonics, RC curve fits, three-phase totals) get the
+//   same per-sample table, on a synthetic 50 Hz capture whose answers are
+//   known and checked (exit status 1 if one is off by more than 1%). Where
+//   the counters cannot be opened (most VMs, or perf_event_paranoid > 2)
+//   their columns show "-" and the reason is printed once.
+//
+// ./bench.out daemon [requests] [connections] [depth]
+// ./bench.out http [requests] [connections] [depth]
+//   Starts the calculation daemon on a temporary socket (or the HTTP server
+//   on a free local port) and drives it with a load generator: each
+//   connection keeps `depth` pipelined requests in flight. Reports throughput
+//   and p50/p90/p99/max latency. The HTTP run also times the batch endpoint.
+//
+// ./bench.out shm [requests] [spin]
+//   Round trips through the shared-memory transport, one at a time, with
+//   the given busy-poll budget (default: by CPU count; 0 = always futex).
+//
+// ./bench.out memo [requests] [distinct] [entries]
+//   Answers requests drawn at random from `distinct` different ones with
+//   daemon_handle, first without and then with the memoisation cache, and
+//   checks that both give the same answers.
+//
+// ./bench.out worksheet [cells]
+//   Builds a worksheet of that many cells as small independent circuits and
+//   times single edits, then times an edit at the head of one long chain
+//   (every cell recomputed).
+//
+// ./bench.out session [cells] [file]
+//   Saves a workspace with a worksheet of that many cells, then times
+//   loading it: mapped in place, mapped elsewhere (pointers moved) and, for
+//   comparison, re-entering every cell from text. The first two include
+//   unmapping the snapshot loaded before; a fresh process has nothing to
+//   drop (main.out prints its own load time). Checks that the loaded
+//   worksheet computes the same values as the original.
+//
+// ./bench.out replay [calcs]
+//   Generates a keystroke script of that many calculations, round robin
+//   over the calculation menus 1-5 and 8-11 (every calculation answered
+//   with 'b', then Quit), and pipes it through main.out in a scratch
+//   directory, reading its output as a scripted user would. Reports
+//   calculations per second for the whole session, the latency of each
+//   calculation (menu_calc scopes, from a second, traced run of the same
+//   script) overall and per menu, and how the session's time splits
+//   between math, logging, input parsing and the rest: prompts, fgets and
+//   printf (stdio). main.out must be built.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <errno.h>
+#include <stdarg.h>
+#include <signal.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <limits.h>
+#include <stdint.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/epoll.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include "formulas.h"
+#include "funcs.h"
+#include "power.h"
+#include "fft.h"
+#include "threephase.h"
+#include "fit.h"
+#include "expr.h"
+#include "daemon.h"
+#include "http.h"
+#include "shm.h"
+#include "memo.h"
+#include "worksheet.h"
+#include "session.h"
+#include "stats.h"
+
+typedef struct {
+    int formula;            // FORMULA_* id
+    const char *src;        // the same equation in the formula language
+    double lo[FORMULA_MAX_VARS], hi[FORMULA_MAX_VARS];   // input ranges, vars[1..]
+} bench_case_t;
+
+static const bench_case_t CASES[] = {
+    { FORMULA_DIVIDER,   "Vin * R2 / (R1 + R2)",         { 0, 1, 10, 10 },     { 0, 24, 1e5, 1e5 } },
+    { FORMULA_PARALLEL,  "R1 * R2 / (R1 + R2)",          { 0, 10, 10 },        { 0, 1e5, 1e5 } },
+    { FORMULA_XC,        "1 / (2 * PI * f * C)",         { 0, 10, 1e-9 },      { 0, 1e6, 1e-3 } },
+    { FORMULA_F0,        "1 / (2 * PI * sqrt(L * C))",   { 0, 1e-6, 1e-9 },    { 0, 1, 1e-3 } },
+    { FORMULA_RC_CHARGE, "100 * (1 - exp(-t / (R * C)))", { 0, 100, 1e-9, 0 }, { 0, 1e5, 1e-3, 1 } },
+    { FORMULA_POWER,     "V * I",                        { 0, -400, -50 },     { 0, 400, 50 } },
+};
+
+static double now_s(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// Hardware counters, read around each timed run. One group, so all four
+// count over exactly the same instructions; user space of this thread only,
+// which perf_event_paranoid 2 still allows.
+enum { HW_CYCLES, HW_INSTRUCTIONS, HW_CACHE_MISSES, HW_BRANCH_MISSES, HW_COUNT };
+
+static const uint64_t HW_CONFIG[HW_COUNT] = {
+    PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS,
+    PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES,
+};
+
+typedef struct {
+    double v[HW_COUNT];     // NAN where not counted
+} hw_count_t;
+
+static int hw_fd[HW_COUNT] = { -1, -1, -1, -1 };
+static int hw_slot[HW_COUNT];   // position in the group's read, -1 if not open
+static int hw_members;          // 0: no counters
+static char hw_why[160];        // why not, if so
+
+static void hw_open(void)
+{
+    static int tried;
+    if (tried) return;
+    tried = 1;
+
+    for (int k = 0; k < HW_COUNT; ++k) {
+        struct perf_event_attr a;
+        memset(&a, 0, sizeof a);
+        a.type = PERF_TYPE_HARDWARE;
+        a.size = sizeof a;
+        a.config = HW_CONFIG[k];
+        a.disabled = k == 0;                  // the leader starts the group
+        a.exclude_kernel = 1;
+        a.exclude_hv = 1;
+        a.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+        hw_fd[k] = (int)syscall(SYS_perf_event_open, &a, 0, -1, k ? hw_fd[0] : -1, 0);
+        hw_slot[k] = hw_fd[k] >= 0 ? hw_members++ : -1;
+        if (k == 0 && hw_fd[0] < 0) {
+            snprintf(hw_why, sizeof hw_why, "perf_event_open: %s", strerror(errno));
+            return;
+        }
+    }
+}
+
+static void hw_start(void)
+{
+    if (!hw_members) return;
+    ioctl(hw_fd[0], PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+    ioctl(hw_fd[0], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+}
+
+static void hw_stop(hw_count_t *c)
+{
+    for (int k = 0; k < HW_COUNT; ++k) c->v[k] = NAN;
+    if (!hw_members) return;
+    ioctl(hw_fd[0], PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+
+    uint64_t buf[3 + HW_COUNT];         // nr, time enabled, time running, values
+    if (read(hw_fd[0], buf, sizeof buf) < (ssize_t)(3 * sizeof(uint64_t)) || buf[2] == 0) return;
+    // Scaled up if the group shared the counters with other events.
+    double scale = (double)buf[1] / (double)buf[2];
+    for (int k = 0; k < HW_COUNT; ++k)
+        if (hw_slot[k] >= 0 && (uint64_t)hw_slot[k] < buf[0]) c->v[k] = (double)buf[3 + hw_slot[k]] * scale;
+}
+
+// Best of a few runs, in ns per row; *hw gets the counters of that run.
+#define BENCH_RUNS 5
+
+static double time_native(const formula_t *fm, double *const *cols, size_t n, double *out, hw_count_t *hw)
+{
+    double best = 1e30;
+    for (int run = 0; run < BENCH_RUNS; ++run) {
+        hw_count_t c;
+        hw_start();
+        double t0 = now_s();
+        double v[FORMULA_MAX_VARS] = { 0 };
+        for (size_t k = 0; k < n; ++k) {
+            for (int i = 1; i < fm->nvars; ++i) v[i] = cols[i - 1][k];
+            out[k] = fm->forward(v);
+        }
+        double t = now_s() - t0;
+        hw_stop(&c);
+        if (t < best) { best = t; *hw = c; }
+    }
+    return best * 1e9 / (double)n;
+}
+
+static double time_batch(const formula_t *fm, const double *const *vals, size_t n, double *out, hw_count_t *hw)
+{
+    double best = 1e30;
+    for (int run = 0; run < BENCH_RUNS; ++run) {
+        hw_count_t c;
+        hw_start();
+        double t0 = now_s();
+        formula_solve_batch(fm, 0, vals, n, out);
+        double t = now_s() - t0;
+        hw_stop(&c);
+        if (t < best) { best = t; *hw = c; }
+    }
+    return best * 1e9 / (double)n;
+}
+
+static double time_expr(expr_t *e, const double *const *cols, size_t n, double *out, hw_count_t *hw)
+{
+    double best = 1e30;
+    for (int run = 0; run < BENCH_RUNS; ++run) {
+        hw_count_t c;
+        hw_start();
+        double t0 = now_s();
+        expr_eval(e, cols, n, out);
+        double t = now_s() - t0;
+        hw_stop(&c);
+        if (t < best) { best = t; *hw = c; }
+    }
+    return best * 1e9 / (double)n;
+}
+
+// Per row; "-" for what was not counted.
+static void print_counters(const char *formula, const char *kernel, double ns, const hw_count_t *hw,
+                           size_t n, double bytes)
+{
+    char f[HW_COUNT][16], ipc[16];
+    for (int k = 0; k < HW_COUNT; ++k) {
+        if (isnan(hw->v[k])) snprintf(f[k], sizeof f[k], "-");
+        else snprintf(f[k], sizeof f[k], "%.3g", hw->v[k] / (double)n);
+    }
+    if (isnan(hw->v[HW_CYCLES]) || isnan(hw->v[HW_INSTRUCTIONS]) || hw->v[HW_CYCLES] <= 0.0) snprintf(ipc, sizeof ipc, "-");
+    else snprintf(ipc, sizeof ipc, "%.2f", hw->v[HW_INSTRUCTIONS] / hw->v[HW_CYCLES]);
+    printf("%-14s %-7s %9.2f %9s %9s %6s %10s %11s %7.0f %8.2f\n", formula, kernel, ns, f[HW_CYCLES],
+           f[HW_INSTRUCTIONS], ipc, f[HW_CACHE_MISSES], f[HW_BRANCH_MISSES], bytes, isnan(ns) ? NAN : bytes / ns);
+}
+
+static double max_rel_diff(const double *a, const double *b, size_t n)
+{
+    double worst = 0.0;
+    for (size_t k = 0; k < n; ++k) {
+        double d = fabs(a[k] - b[k]) / (fabs(a[k]) > 1e-300 ? fabs(a[k]) : 1.0);
+        if (d > worst || d != d) worst = d;
+    }
+    return worst;
+}
+
+// Expressions outside the registry, for operand orders and shapes the
+// registry does not use (a register reused as the destination of ^, nested
+// calls, constants on either side). Every variable ranges over lo..hi.
+static const struct {
+    const char *src;
+    double lo, hi;
+} JIT_CHECKS[] = {
+    { "x ^ (y + 1)",                   0.5, 4 },
+    { "(x + 1) ^ (y * 0.5)",           0.5, 4 },
+    { "2 ^ x - x ^ 2",                 -3, 3 },
+    { "x ^ y ^ 0.5",                   0.5, 4 },
+    { "sqrt(abs(x - y)) * -x / (y + 3)", -10, 10 },
+    { "exp(-x) * sin(y) + cos(x) ^ 2", -5, 5 },
+    { "log(x * y + 1) - tan(x / 7)",   0.1, 10 },
+    { "(x - y) / (x + y) ^ (x / 4)",   0.5, 8 },
+};
+
+// Interpreter and native code must agree exactly (nan = nan) on every row,
+// including a tail that is not a multiple of 4 rows. Returns the number of
+// expressions that do not, after printing them.
+static int check_jit(void)
+{
+    enum { ROWS = 1003 };
+    static double x[ROWS], y[ROWS], a[ROWS], b[ROWS];
+    int bad = 0;
+
+    for (size_t c = 0; c < sizeof JIT_CHECKS / sizeof JIT_CHECKS[0]; ++c) {
+        char err[128];
+        expr_t *e = expr_compile(JIT_CHECKS[c].src, err, sizeof err);
+        if (!e) { printf("Error: %s: %s\n", JIT_CHECKS[c].src, err); bad++; continue; }
+        for (size_t k = 0; k < ROWS; ++k) {
+            x[k] = JIT_CHECKS[c].lo + (JIT_CHECKS[c].hi - JIT_CHECKS[c].lo) * rand() / (double)RAND_MAX;
+            y[k] = JIT_CHECKS[c].lo + (JIT_CHECKS[c].hi - JIT_CHECKS[c].lo) * rand() / (double)RAND_MAX;
+        }
+        const double *cols[EXPR_MAX_VARS];
+        for (int i = 0; i < expr_nvars(e); ++i) cols[i] = expr_var_name(e, i)[0] == 'x' ? x : y;
+
+        expr_set_jit(e, 0);
+        expr_eval(e, cols, ROWS, a);
+        if (expr_set_jit(e, 1)) {
+            expr_eval(e, cols, ROWS, b);
+            for (size_t k = 0; k < ROWS; ++k) {
+                if (memcmp(&a[k], &b[k], sizeof a[k]) == 0 || (isnan(a[k]) && isnan(b[k]))) continue;
+                printf("MISMATCH %s at x=%.17g y=%.17g: interp %.17g, jit %.17g\n", JIT_CHECKS[c].src,
+                       x[k], y[k], a[k], b[k]);
+                bad++;
+                break;
+            }
+        }
+        expr_free(e);
+    }
+    return bad;
+}
+
+// Analysis kernels, on a capture of 50 Hz at 64 samples per cycle: v has a
+// 5% third harmonic, i lags by 30 degrees, the three phases are balanced and
+// the RC curves are 64-point steps with tau = 1 ms and a little noise.
+#define AK_DT     (1.0 / 3200.0)
+#define AK_WINDOW 1024                  // FFT window: 16 whole cycles
+#define AK_CURVE  64                    // points per RC curve
+
+enum { AK_POWER, AK_FFT, AK_RC, AK_3PH, AK_COUNT };
+
+static const struct {
+    const char *name, *what;
+    double bytes;                       // input read per sample
+    double expect;
+} AKERNEL[AK_COUNT] = {
+    { "power",  "mean P (W)",      24, 325.0 * 10.0 / 2.0 * 0.86602540378443865 },
+    { "fft",    "THD of v",        16, 0.05 },
+    { "rc-fit", "mean tau (s)",    16, 1e-3 },
+    { "3phase", "total P (W)",     48, 3.0 * 325.0 * 10.0 / 2.0 * 0.86602540378443865 },
+};
+
+typedef struct {
+    double *t, *v, *i, *ph[6], *tc, *y;
+    size_t n;
+} ak_data_t;
+
+static void ak_fill(ak_data_t *d)
+{
+    const double w = 2.0 * 3.14159265358979323846 * 50.0, lag = 3.14159265358979323846 / 6.0;
+    for (size_t k = 0; k < d->n; ++k) {
+        double t = (double)k * AK_DT;
+        d->t[k] = t;
+        d->v[k] = 325.0 * sin(w * t) + 16.25 * sin(3.0 * w * t);
+        d->i[k] = 10.0 * sin(w * t - lag);
+        for (int p = 0; p < 3; ++p) {
+            double shift = 2.0 * 3.14159265358979323846 / 3.0 * p;
+            d->ph[p][k] = 325.0 * sin(w * t - shift);
+            d->ph[3 + p][k] = 10.0 * sin(w * t - shift - lag);
+        }
+        d->tc[k] = (double)(k % AK_CURVE) * 1e-4;
+        d->y[k] = 5.0 * (1.0 - exp(-d->tc[k] / 1e-3)) + 1e-3 * (rand() / (double)RAND_MAX - 0.5);
+    }
+}
+
+static double ak_run(int kernel, const ak_data_t *d)
+{
+    const double *ph[6] = { d->ph[0], d->ph[1], d->ph[2], d->ph[3], d->ph[4], d->ph[5] };
+    switch (kernel) {
+        case AK_POWER: return kernel_power(d->t, d->v, d->i, d->n);
+        case AK_FFT:   return kernel_harmonics(d->v, d->i, d->n, AK_WINDOW, AK_DT, 50.0);
+        case AK_RC:    return kernel_rc_fit(d->tc, d->y, d->n, AK_CURVE);
+        default:       return kernel_threephase(ph, d->n);
+    }
+}
+
+static double time_analysis(int kernel, const ak_data_t *d, double *result, hw_count_t *hw)
+{
+    double best = 1e30;
+    for (int run = 0; run < BENCH_RUNS; ++run) {
+        hw_count_t c;
+        hw_start();
+        double t0 = now_s();
+        *result = ak_run(kernel, d);
+        double t = now_s() - t0;
+        hw_stop(&c);
+        if (t < best) { best = t; *hw = c; }
+    }
+    return best * 1e9 / (double)d->n;
+}
+
+// Times every analysis kernel on up to `rows` samples (whole FFT windows).
+// Returns the number of kernels whose result is off by more than 1%.
+static int bench_analysis(size_t rows)
+{
+    ak_data_t d;
+    d.n = rows < (1u << 20) ? rows : (1u << 20);
+    d.n = d.n < AK_WINDOW ? AK_WINDOW : d.n - d.n % AK_WINDOW;
+
+    double **cols[] = { &d.t, &d.v, &d.i, &d.ph[0], &d.ph[1], &d.ph[2], &d.ph[3], &d.ph[4], &d.ph[5], &d.tc, &d.y };
+    enum { NCOLS = sizeof cols / sizeof cols[0] };
+    int ok = 1;
+    for (int c = 0; c < NCOLS; ++c) ok &= (*cols[c] = malloc(d.n * sizeof(double))) != NULL;
+    if (!ok) {
+        printf("Error: out of memory.\n");
+        for (int c = 0; c < NCOLS; ++c) free(*cols[c]);
+        return 1;
+    }
+    ak_fill(&d);
+
+    double ns[AK_COUNT], res[AK_COUNT];
+    hw_count_t hw[AK_COUNT];
+    int bad = 0;
+
+    printf("\nAnalysis kernels of menus 3-5, %zu samples, best of %d runs, ns/sample\n\n", d.n, BENCH_RUNS);
+    printf("%-14s %10s  %-14s %14s %14s\n", "kernel", "ns", "result", "value", "expected");
+    for (int k = 0; k < AK_COUNT; ++k) {
+        ns[k] = time_analysis(k, &d, &res[k], &hw[k]);
+        int off = !(fabs(res[k] - AKERNEL[k].expect) <= 0.01 * AKERNEL[k].expect);
+        bad += off;
+        printf("%-14s %10.2f  %-14s %14.6g %14.6g%s\n", AKERNEL[k].name, ns[k], AKERNEL[k].what, res[k],
+               AKERNEL[k].expect, off ? "  WRONG" : "");
+    }
+
+    printf("\n%-14s %-7s %9s %9s %9s %6s %10s %11s %7s %8s\n", "analysis", "kernel", "ns", "cycles", "instr",
+           "IPC", "cache-miss", "branch-miss", "bytes", "GB/s");
+    for (int k = 0; k < AK_COUNT; ++k)
+        print_counters(k ? "" : "per sample", AKERNEL[k].name, ns[k], &hw[k], d.n, AKERNEL[k].bytes);
+
+    for (int c = 0; c < NCOLS; ++c) free(*cols[c]);
+    return bad;
+}
+
+static int bench_formulas(int argc, char **argv)
+{
+    size_t n = argc > 1 ? strtoul(argv[1], NULL, 10) : 1000000;
+    if (n == 0) { printf("Error: rows must be > 0.\n"); return 1; }
+
+    double *cols[FORMULA_MAX_VARS];
+    int ok = n <= SIZE_MAX / sizeof(double), rc = 1;
+    for (int i = 0; i < FORMULA_MAX_VARS; ++i) ok &= (cols[i] = ok ? malloc(n * sizeof(double)) : NULL) != NULL;
+    double *ref = ok ? malloc(n * sizeof(double)) : NULL;
+    double *got = ok ? malloc(n * sizeof(double)) : NULL;
+    if (!ref || !got) {
+        printf("Error: out of memory.\n");
+        goto done;
+    }
+
+    enum { KERNELS = 4 };
+    static const char *const KERNEL[KERNELS] = { "native", "batch", "interp", "jit" };
+    enum { NCASES = sizeof CASES / sizeof CASES[0] };
+    double ns[NCASES][KERNELS];
+    hw_count_t hw[NCASES][KERNELS];
+    hw_open();
+
+    srand(2645);
+    printf("%zu rows, best of %d runs, ns/row\n\n", n, BENCH_RUNS);
+    printf("%-14s %10s %10s %10s %10s  %s\n", "formula", "native", "interp", "jit", "speedup", "max rel diff");
+
+    for (size_t c = 0; c < sizeof CASES / sizeof CASES[0]; ++c) {
+        const bench_case_t *bc = &CASES[c];
+        const formula_t *fm = &FORMULAS[bc->formula];
+        char err[128];
+
+        expr_t *e = expr_compile(bc->src, err, sizeof err);
+        if (!e) { printf("Error: %s: %s\n", bc->src, err); goto done; }
+
+        // Columns in the order the expression uses its variables.
+        const double *ecols[FORMULA_MAX_VARS];
+        for (int i = 1; i < fm->nvars; ++i) {
+            for (size_t k = 0; k < n; ++k)
+                cols[i - 1][k] = bc->lo[i] + (bc->hi[i] - bc->lo[i]) * rand() / (double)RAND_MAX;
+        }
+        for (int i = 0; i < expr_nvars(e); ++i) {
+            int vi = formula_var_index(fm, expr_var_name(e, i));
+            if (vi < 1) {
+                printf("Error: %s: unknown variable %s\n", fm->name, expr_var_name(e, i));
+                expr_free(e);
+                goto done;
+            }
+            ecols[i] = cols[vi - 1];
+        }
+
+        // formula_solve_batch takes a column per variable; the result's is unused.
+        const double *bcols[FORMULA_MAX_VARS] = { ref };
+        for (int i = 1; i < fm->nvars; ++i) bcols[i] = cols[i - 1];
+
+        double t_native = time_native(fm, cols, n, ref, &hw[c][0]);
+
+        ns[c][1] = time_batch(fm, bcols, n, got, &hw[c][1]);
+        double d_batch = max_rel_diff(ref, got, n);
+
+        expr_set_jit(e, 0);
+        double t_interp = time_expr(e, ecols, n, got, &hw[c][2]);
+        double d_interp = max_rel_diff(ref, got, n);
+
+        double t_jit = NAN, d_jit = 0.0;
+        for (int k = 0; k < HW_COUNT; ++k) hw[c][3].v[k] = NAN;
+        if (expr_set_jit(e, 1)) {
+            t_jit = time_expr(e, ecols, n, got, &hw[c][3]);
+            d_jit = max_rel_diff(ref, got, n);
+        }
+        ns[c][0] = t_native;
+        ns[c][2] = t_interp;
+        ns[c][3] = t_jit;
+
+        double worst = d_interp > d_jit ? d_interp : d_jit;
+        if (d_batch > worst || d_batch != d_batch) worst = d_batch;
+        printf("%-14s %10.2f %10.2f %10.2f %9.2fx  %.1e\n", fm->name, t_native, t_interp,
+               t_jit, t_interp / t_jit, worst);
+        expr_free(e);
+    }
+
+    printf("\nspeedup = interp / jit. jit shows nan when the native backend is unavailable.\n");
+    printf("max rel diff also covers batch (formula_solve_batch on the same rows).\n");
+
+    int mismatches = check_jit();
+    printf("jit = interp on %d other expressions: %s\n", (int)(sizeof JIT_CHECKS / sizeof JIT_CHECKS[0]),
+           mismatches ? "NO" : "yes");
+
+    // Bytes per row: every input column read once and the result written once.
+    printf("\nPer row, best run: hardware counters, and bytes touched at that rate (GB/s)\n\n");
+    printf("%-14s %-7s %9s %9s %9s %6s %10s %11s %7s %8s\n", "formula", "kernel", "ns", "cycles", "instr",
+           "IPC", "cache-miss", "branch-miss", "bytes", "GB/s");
+    for (int c = 0; c < NCASES; ++c) {
+        const formula_t *fm = &FORMULAS[CASES[c].formula];
+        for (int k = 0; k < KERNELS; ++k)
+            print_counters(k ? "" : fm->name, KERNEL[k], ns[c][k], &hw[c][k], n, 8.0 * fm->nvars);
+    }
+
+    int wrong = bench_analysis(n);
+    if (!hw_members) printf("\nHardware counters unavailable (%s); only times are shown.\n", hw_why);
+
+    rc = mismatches || wrong ? 1 : 0;
+done:
+    for (int i = 0; i < FORMULA_MAX_VARS; ++i) free(cols[i]);
+    free(ref);
+    free(got);
+    return rc;
+}
+
+// ----------------------------- SERVERS -----------------------------
+
+// Request i: formula i % FORMULA_COUNT, solving for each variable in turn,
+// from typical inputs for each domain made consistent by a forward solve.
+static void bench_request(uint32_t i, eee_msg_t *msg)
+{
+    const formula_t *fm = &FORMULAS[i % FORMULA_COUNT];
+    memset(msg, 0, sizeof *msg);
+    msg->len = EEE_MSG_LEN;
+    msg->id = i;
+    msg->op = EEE_OP_SOLVE;
+    msg->formula = (uint8_t)(i % FORMULA_COUNT);
+    msg->nvars = (uint8_t)fm->nvars;
+    msg->var = (uint8_t)((i / FORMULA_COUNT) % (uint32_t)fm->nvars);
+
+    for (int j = 1; j < fm->nvars; ++j) {
+        switch (fm->vars[j].domain) {
+            case DOM_POS:    msg->v[j] = 0.01 * j; break;
+            case DOM_NONNEG: msg->v[j] = 0.001 * (j + 1); break;
+            case DOM_PCT:    msg->v[j] = 50.0; break;
+            case DOM_ANGLE:  msg->v[j] = 30.0; break;
+            default:         msg->v[j] = 12.0 + j; break;
+        }
+    }
+    msg->v[0] = fm->forward(msg->v);
+    msg->v[msg->var] = 0.0;
+}
+
+static int cmp_double(const void *a, const void *b)
+{
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+// A protocol for the load generator: build request `id` into buf (returns
+// its length), and measure one complete response at the start of buf
+// (returns its length, 0 if incomplete; *ok is cleared on an error status).
+typedef struct {
+    size_t (*build)(uint32_t id, char *buf, size_t cap);
+    size_t (*parse)(const char *buf, size_t len, int *ok);
+    size_t max_request;
+} bench_proto_t;
+
+static size_t daemon_build(uint32_t id, char *buf, size_t cap)
+{
+    eee_msg_t msg;
+    (void)cap;
+    bench_request(id, &msg);
+    memcpy(buf, &msg, sizeof msg);
+    return sizeof msg;
+}
+
+static size_t daemon_parse(const char *buf, size_t len, int *ok)
+{
+    eee_msg_t msg;
+    if (len < sizeof msg) return 0;
+    memcpy(&msg, buf, sizeof msg);
+    *ok = msg.status == EEE_ST_OK;
+    return sizeof msg;
+}
+
+// Requests repeat with this period (formula, then variable to solve for), so
+// the load generator formats each distinct one only once.
+#define BENCH_PERIOD (FORMULA_COUNT * 12)
+
+// GET /<formula>?<known variables>
+static size_t http_build(uint32_t id, char *buf, size_t cap)
+{
+    static char cache[BENCH_PERIOD][512];
+    static size_t cache_len[BENCH_PERIOD];
+    uint32_t slot = id % BENCH_PERIOD;
+    if (cache_len[slot]) {
+        memcpy(buf, cache[slot], cache_len[slot]);
+        return cache_len[slot];
+    }
+
+    eee_msg_t msg;
+    bench_request(id, &msg);
+    const formula_t *fm = &FORMULAS[msg.formula];
+
+    int n = snprintf(buf, cap, "GET /%s?", fm->name);
+    for (int j = 0, first = 1; j < fm->nvars; ++j) {
+        if (j == msg.var) continue;
+        n += snprintf(buf + n, cap - (size_t)n, "%s%s=%.17g", first ? "" : "&", fm->vars[j].name, msg.v[j]);
+        first = 0;
+    }
+    n += snprintf(buf + n, cap - (size_t)n, " HTTP/1.1\r\nHost: localhost\r\n\r\n");
+    memcpy(cache[slot], buf, (size_t)n);
+    cache_len[slot] = (size_t)n;
+    return (size_t)n;
+}
+
+#define BENCH_BATCH 100
+
+// POST /batch with the first BENCH_BATCH requests (the same every time).
+static size_t http_build_batch(uint32_t id, char *buf, size_t cap)
+{
+    static char body[16384];
+    static size_t blen;
+    (void)id;
+    if (blen > 0) goto send;
+
+    body[blen++] = '[';
+    for (uint32_t k = 0; k < BENCH_BATCH; ++k) {
+        eee_msg_t msg;
+        bench_request(k, &msg);
+        const formula_t *fm = &FORMULAS[msg.formula];
+        blen += (size_t)snprintf(body + blen, sizeof body - blen, "%s{\"formula\":\"%s\"", k ? "," : "", fm->name);
+        for (int j = 0; j < fm->nvars; ++j)
+            if (j != msg.var)
+                blen += (size_t)snprintf(body + blen, sizeof body - blen, ",\"%s\":%.17g", fm->vars[j].name, msg.v[j]);
+        body[blen++] = '}';
+    }
+    body[blen++] = ']';
+
+send:;
+    int n = snprintf(buf, cap, "POST /batch HTTP/1.1\r\nHost: localhost\r\nContent-Length: %zu\r\n\r\n", blen);
+    memcpy(buf + n, body, blen);
+    return (size_t)n + blen;
+}
+
+static size_t http_parse_response(const char *buf, size_t len, int *ok)
+{
+    const char *end = NULL;
+    for (size_t k = 0; k + 3 < len; ++k)
+        if (memcmp(buf + k, "\r\n\r\n", 4) == 0) { end = buf + k + 4; break; }
+    if (!end) return 0;
+
+    const char *cl = strstr(buf, "Content-Length: ");
+    if (!cl || cl > end) return 0;
+    size_t head = (size_t)(end - buf), clen = strtoul(cl + 16, NULL, 10);
+    if (len < head + clen) return 0;
+    *ok = memcmp(buf, "HTTP/1.1 200", 12) == 0;
+    return head + clen;
+}
+
+typedef struct {
+    int fd;
+    uint32_t sent, recvd, quota;
+    size_t inlen;
+    char in[1 << 20];
+} bench_conn_t;
+
+// Runs `total` requests over `nconn` connections with up to `depth` in flight
+// on each. lat[] receives the latency of each request in seconds.
+// Returns the number of requests answered.
+static uint32_t bench_drive(const struct sockaddr *addr, socklen_t alen, const bench_proto_t *proto,
+                            uint32_t total, int nconn, uint32_t depth, double *lat,
+                            double *secs, uint32_t *failed)
+{
+    double *sent_at = malloc(total * sizeof(double));
+    bench_conn_t *conns = calloc((size_t)nconn, sizeof *conns);
+    char *out = malloc(depth * proto->max_request);
+    if (!sent_at || !conns || !out) { printf("Error: out of memory.\n"); exit(1); }
+
+    int ep = epoll_create1(0);
+    for (int c = 0; c < nconn; ++c) {
+        bench_conn_t *bc = &conns[c];
+        bc->quota = total / (uint32_t)nconn + ((uint32_t)c < total % (uint32_t)nconn);
+        bc->fd = socket(addr->sa_family, SOCK_STREAM, 0);
+        int tries = 0;
+        while (connect(bc->fd, addr, alen) != 0 && tries++ < 200)
+            usleep(10000);                      // wait for the server to start
+        if (tries > 200) { printf("Error: cannot connect to the server.\n"); exit(1); }
+        struct epoll_event ev = { .events = EPOLLIN | EPOLLOUT, .data.ptr = bc };
+        epoll_ctl(ep, EPOLL_CTL_ADD, bc->fd, &ev);
+    }
+
+    // Request ids are interleaved: connection c sends c, c + nconn, ...
+    // Responses come back in order, so the k-th answer is for the k-th send.
+    uint32_t done = 0;
+    struct epoll_event evs[64];
+    *failed = 0;
+    double t0 = now_s();
+    while (done < total) {
+        int n = epoll_wait(ep, evs, 64, 2000);
+        if (n <= 0) { printf("Error: the server stopped answering.\n"); break; }
+
+        for (int k = 0; k < n; ++k) {
+            bench_conn_t *bc = evs[k].data.ptr;
+            int c = (int)(bc - conns);
+
+            if (evs[k].events & EPOLLIN) {
+                ssize_t got = read(bc->fd, bc->in + bc->inlen, sizeof bc->in - bc->inlen);
+                if (got <= 0) { printf("Error: connection closed by the server.\n"); done = total; break; }
+                bc->inlen += (size_t)got;
+
+                double now = now_s();
+                size_t pos = 0, used;
+                int ok = 1;
+                while ((used = proto->parse(bc->in + pos, bc->inlen - pos, &ok)) > 0) {
+                    uint32_t id = (uint32_t)c + bc->recvd * (uint32_t)nconn;
+                    lat[done] = now - sent_at[id];
+                    if (!ok) (*failed)++;
+                    ok = 1;
+                    pos += used;
+                    bc->recvd++;
+                    done++;
+                }
+                memmove(bc->in, bc->in + pos, bc->inlen - pos);
+                bc->inlen -= pos;
+            }
+
+            // Top the pipeline back up to `depth` in one send (blocking
+            // socket; `depth` requests always fit in the socket buffer).
+            uint32_t room = depth - (bc->sent - bc->recvd);
+            if (bc->sent + room > bc->quota) room = bc->quota - bc->sent;
+            size_t len = 0;
+            double now = now_s();
+            for (uint32_t r = 0; r < room; ++r) {
+                uint32_t id = (uint32_t)c + (bc->sent + r) * (uint32_t)nconn;
+                len += proto->build(id, out + len, proto->max_request);
+                sent_at[id] = now;
+            }
+            for (size_t off = 0; off < len;) {
+                ssize_t w = send(bc->fd, out + off, len - off, MSG_NOSIGNAL);
+                if (w < 0) { if (errno == EINTR) continue; break; }
+                off += (size_t)w;
+            }
+            bc->sent += room;
+            if (bc->sent == bc->quota) {
+                struct epoll_event ev = { .events = EPOLLIN, .data.ptr = bc };
+                epoll_ctl(ep, EPOLL_CTL_MOD, bc->fd, &ev);
+            }
+        }
+    }
+    *secs = now_s() - t0;
+
+    for (int c = 0; c < nconn; ++c) close(conns[c].fd);
+    close(ep);
+    free(sent_at);
+    free(conns);
+    free(out);
+    return done < total ? done : total;
+}
+
+static void print_latency(const char *what, double *lat, uint32_t m, double secs, uint32_t failed)
+{
+    printf("%-16s %10.0f req/s  (%.2f us/req)\n", what, m / secs, secs * 1e6 / m);
+    if (m > 0) {
+        qsort(lat, m, sizeof *lat, cmp_double);
+        printf("%-16s p50 %.1f  p90 %.1f  p99 %.1f  max %.1f us\n", "",
+               lat[m / 2] * 1e6, lat[(size_t)(m * 0.90)] * 1e6, lat[(size_t)(m * 0.99)] * 1e6, lat[m - 1] * 1e6);
+    }
+    if (failed) printf("%-16s (%u answered with an error status)\n", "", failed);
+}
+
+// A server in a child process, on a Unix socket or a free local TCP port.
+typedef struct {
+    pid_t pid;
+    struct sockaddr_un un;
+    struct sockaddr_in in;
+    const struct sockaddr *addr;
+    socklen_t alen;
+} bench_server_t;
+
+static int server_start(bench_server_t *sv, int http)
+{
+    int lfd = -1;
+    memset(sv, 0, sizeof *sv);
+    if (http) {
+        int port;
+        if ((lfd = http_listen(0, &port)) < 0) return 0;
+        sv->in.sin_family = AF_INET;
+        sv->in.sin_port = htons((unsigned short)port);
+        sv->in.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        sv->addr = (const struct sockaddr *)&sv->in;
+        sv->alen = sizeof sv->in;
+    }
+    else {
+        sv->un.sun_family = AF_UNIX;
+        snprintf(sv->un.sun_path, sizeof sv->un.sun_path, "/tmp/eee_bench_%d.sock", (int)getpid());
+        sv->addr = (const struct sockaddr *)&sv->un;
+        sv->alen = sizeof sv->un;
+    }
+
+    fflush(stdout);
+    sv->pid = fork();
+    if (sv->pid < 0) { printf("Error: fork failed.\n"); return 0; }
+    if (sv->pid == 0) {
+        if (!freopen("/dev/null", "w", stdout)) _exit(1);
+        _exit(http ? http_serve(lfd) : (daemon_run(sv->un.sun_path) == 0 ? 0 : 1));
+    }
+    if (lfd >= 0) close(lfd);
+    return 1;
+}
+
+// Stops the server and returns the CPU seconds it used.
+static double server_stop(bench_server_t *sv)
+{
+    struct rusage ru;
+    kill(sv->pid, SIGTERM);
+    if (wait4(sv->pid, NULL, 0, &ru) < 0) return 0.0;
+    return ru.ru_utime.tv_sec + ru.ru_stime.tv_sec + (ru.ru_utime.tv_usec + ru.ru_stime.tv_usec) * 1e-6;
+}
+
+static int bench_server(int argc, char **argv, int http)
+{
+    uint32_t total = argc > 2 ? (uint32_t)strtoul(argv[2], NULL, 10) : 200000;
+    int nconn = argc > 3 ? atoi(argv[3]) : 4;
+    uint32_t depth = argc > 4 ? (uint32_t)strtoul(argv[4], NULL, 10) : 32;
+    if (total == 0 || nconn < 1 || nconn > 256 || depth < 1 || depth > 1024) {
+        printf("Usage: %s %s [requests] [connections 1-256] [depth 1-1024]\n", argv[0], argv[1]);
+        return 1;
+    }
+
+    double *lat = malloc(total * sizeof(double));
+    if (!lat) { printf("Error: out of memory.\n"); return 1; }
+
+    // In-process cost of the same solves, for comparison.
+    eee_msg_t msg;
+    double t0 = now_s();
+    for (uint32_t i = 0; i < total; ++i) {
+        bench_request(i, &msg);
+        daemon_handle(&msg);
+    }
+    double t_inproc = now_s() - t0;
+
+    printf("%u requests, %d connection(s), %u in flight each\n", total, nconn, depth);
+    printf("server cpu is the server process's user + system time per solve\n\n");
+    printf("%-16s %10.0f req/s  (%.2f us/req)\n", "in-process", total / t_inproc, t_inproc * 1e6 / total);
+
+    static const bench_proto_t daemon_proto = { daemon_build, daemon_parse, sizeof(eee_msg_t) };
+    static const bench_proto_t http_proto = { http_build, http_parse_response, 512 };
+    static const bench_proto_t batch_proto = { http_build_batch, http_parse_response, 16384 + 256 };
+
+    bench_server_t sv;
+    double secs;
+    uint32_t failed;
+    if (!server_start(&sv, http)) return 1;
+    uint32_t m = bench_drive(sv.addr, sv.alen, http ? &http_proto : &daemon_proto, total, nconn, depth,
+                             lat, &secs, &failed);
+    double cpu = server_stop(&sv);
+    print_latency(http ? "http" : "daemon", lat, m, secs, failed);
+    printf("%-16s server cpu %.2f us/solve\n", "", cpu * 1e6 / total);
+
+    if (http) {
+        // Batch endpoint: the same number of solves, BENCH_BATCH per request.
+        uint32_t nb = total / BENCH_BATCH ? total / BENCH_BATCH : 1;
+        if (!server_start(&sv, 1)) return 1;
+        m = bench_drive(sv.addr, sv.alen, &batch_proto, nb, 1, 4, lat, &secs, &failed);
+        cpu = server_stop(&sv);
+        printf("%-16s %10.0f solves/s  (%u requests of %d)\n", "http batch",
+               (double)m * BENCH_BATCH / secs, m, BENCH_BATCH);
+        printf("%-16s server cpu %.2f us/solve\n", "", cpu * 1e6 / ((double)m * BENCH_BATCH));
+    }
+
+    free(lat);
+    return 0;
+}
+
+// ------------------------------ SHM ------------------------------
+
+static int bench_shm(int argc, char **argv)
+{
+    uint32_t total = argc > 2 ? (uint32_t)strtoul(argv[2], NULL, 10) : 200000;
+    int spin = argc > 3 ? atoi(argv[3]) : -1;
+    if (total == 0) { printf("Usage: %s shm [requests] [spin]\n", argv[0]); return 1; }
+
+    double *lat = malloc(total * sizeof(double));
+    if (!lat) { printf("Error: out of memory.\n"); return 1; }
+
+    char name[64];
+    snprintf(name, sizeof name, "eee_bench_%d", (int)getpid());
+    fflush(stdout);
+    pid_t child = fork();
+    if (child < 0) { printf("Error: fork failed.\n"); return 1; }
+    if (child == 0) {
+        if (!freopen("/dev/null", "w", stdout)) _exit(1);
+        _exit(shm_serve(name, spin) == 0 ? 0 : 1);
+    }
+
+    // Wait for the server to publish the segment.
+    shm_client_t *c = NULL;
+    char err[160];
+    for (int tries = 0; !c && tries < 200; ++tries) {
+        if (!(c = shm_connect(name, spin, err, sizeof err))) usleep(10000);
+    }
+    if (!c) { printf("Error: %s.\n", err); kill(child, SIGTERM); return 1; }
+
+    eee_msg_t msg;
+    uint32_t failed = 0;
+    double t0 = now_s();
+    for (uint32_t i = 0; i < total; ++i) {
+        bench_request(i, &msg);
+        double t = now_s();
+        shm_call(c, &msg);
+        lat[i] = now_s() - t;
+        if (msg.status != EEE_ST_OK) failed++;
+    }
+    double secs = now_s() - t0;
+
+    shm_disconnect(c);
+    kill(child, SIGTERM);
+    waitpid(child, NULL, 0);
+
+    printf("%u round trips, spin %d (%ld CPU(s) online)\n\n", total, spin, sysconf(_SC_NPROCESSORS_ONLN));
+    print_latency("shm", lat, total, secs, failed);
+    free(lat);
+    return 0;
+}
+
+// ------------------------------ MEMO ------------------------------
+
+static double time_handle(const eee_msg_t *reqs, const uint32_t *pick, uint32_t total, eee_msg_t *res)
+{
+    double t0 = now_s();
+    for (uint32_t i = 0; i < total; ++i) {
+        res[i] = reqs[pick[i]];
+        daemon_handle(&res[i]);
+    }
+    return now_s() - t0;
+}
+
+static int bench_memo(int argc, char **argv)
+{
+    uint32_t total = argc > 2 ? (uint32_t)strtoul(argv[2], NULL, 10) : 1000000;
+    uint32_t distinct = argc > 3 ? (uint32_t)strtoul(argv[3], NULL, 10) : 1000;
+    size_t entries = argc > 4 ? strtoul(argv[4], NULL, 10) : 4096;
+    if (total == 0 || distinct == 0 || entries == 0) {
+        printf("Usage: %s memo [requests] [distinct] [entries]\n", argv[0]);
+        return 1;
+    }
+
+    eee_msg_t *reqs = malloc(distinct * sizeof *reqs);
+    eee_msg_t *plain = malloc(total * sizeof *plain), *memo = malloc(total * sizeof *memo);
+    uint32_t *pick = malloc(total * sizeof *pick);
+    if (!reqs || !plain || !memo || !pick) { printf("Error: out of memory.\n"); return 1; }
+
+    // Request k is bench_request(k) with its inputs scaled, so every one differs.
+    for (uint32_t k = 0; k < distinct; ++k) {
+        bench_request(k, &reqs[k]);
+        const formula_t *fm = &FORMULAS[reqs[k].formula];
+        double scale = 1.0 + 1e-6 * k;
+        for (int j = 1; j < fm->nvars; ++j)
+            if (j != reqs[k].var && fm->vars[j].domain != DOM_PCT && fm->vars[j].domain != DOM_ANGLE)
+                reqs[k].v[j] *= scale;
+    }
+    srand(1);
+    for (uint32_t i = 0; i < total; ++i) pick[i] = (uint32_t)rand() % distinct;
+
+    memo_configure(0);
+    double t_plain = time_handle(reqs, pick, total, plain);
+    if (memo_configure(entries) != 0) { printf("Error: out of memory.\n"); return 1; }
+    double t_memo = time_handle(reqs, pick, total, memo);
+
+    uint32_t diff = 0;
+    for (uint32_t i = 0; i < total; ++i)
+        if (plain[i].status != memo[i].status || memcmp(plain[i].v, memo[i].v, sizeof plain[i].v) != 0) diff++;
+
+    printf("%u requests drawn from %u distinct\n\n", total, distinct);
+    printf("no cache    %8.1f ns/request\n", 1e9 * t_plain / total);
+    printf("memo cache  %8.1f ns/request  (%.2fx)\n", 1e9 * t_memo / total, t_plain / t_memo);
+    memo_print();
+    printf("%u answer(s) differ\n", diff);
+
+    free(reqs);
+    free(plain);
+    free(memo);
+    free(pick);
+    return diff ? 1 : 0;
+}
+
+// ---------------------------- WORKSHEET ----------------------------
+
+static int bench_worksheet(int argc, char **argv)
+{
+    long cells = argc > 2 ? strtol(argv[2], NULL, 10) : 100000;
+    if (cells < 10) { printf("Usage: %s worksheet [cells >= 10]\n", argv[0]); return 1; }
+
+    // Blocks of five cells: Vin, R1, R2, Vout = divider, P = Vout^2 / R2.
+    long blocks = cells / 5;
+    worksheet_t *ws = ws_new();
+    char line[160], err[200];
+    double t0 = now_s();
+    for (long b = 0; b < blocks; ++b) {
+        snprintf(line, sizeof line, "Vout%ld = Vin%ld * R2_%ld / (R1_%ld + R2_%ld)", b, b, b, b, b);
+        if (ws_assign(ws, line, err, sizeof err) < 0) { printf("Error: %s.\n", err); return 1; }
+        snprintf(line, sizeof line, "P%ld = Vout%ld^2 / R2_%ld", b, b, b);
+        ws_assign(ws, line, err, sizeof err);
+        snprintf(line, sizeof line, "Vin%ld = %ld", b, 5 + b % 20);
+        ws_assign(ws, line, err, sizeof err);
+        snprintf(line, sizeof line, "R1_%ld = %ldk", b, 1 + b % 100);
+        ws_assign(ws, line, err, sizeof err);
+        snprintf(line, sizeof line, "R2_%ld = 4.7k", b);
+        ws_assign(ws, line, err, sizeof err);
+    }
+    double build = now_s() - t0;
+
+    enum { EDITS = 100000 };
+    double *lat = malloc(EDITS * sizeof(double));
+    if (!lat) { printf("Error: out of memory.\n"); return 1; }
+    long updated = 0;
+    srand(1);
+    double t1 = now_s();
+    for (int k = 0; k < EDITS; ++k) {
+        long b = rand() % blocks;
+        snprintf(line, sizeof line, "Vin%ld = %d", b, 1 + k % 50);
+        double t = now_s();
+        updated += ws_assign(ws, line, err, sizeof err);
+        lat[k] = now_s() - t;
+    }
+    double edits = now_s() - t1;
+
+    printf("%d cells built in %.1f ms (%.2f us/cell)\n", ws_count(ws), build * 1e3, build * 1e6 / ws_count(ws));
+    printf("%d edits, %.2f cells updated per edit\n\n", EDITS, (double)updated / EDITS);
+    print_latency("edit", lat, EDITS, edits, 0);
+    ws_free(ws);
+    free(lat);
+
+    // One chain: c0 = value, c_k = c_(k-1) + 1, so a head edit changes every cell.
+    ws = ws_new();
+    ws_assign(ws, "c0 = 1", err, sizeof err);
+    for (long k = 1; k < cells; ++k) {
+        snprintf(line, sizeof line, "c%ld = c%ld + 1", k, k - 1);
+        ws_assign(ws, line, err, sizeof err);
+    }
+    double t2 = now_s();
+    long n = ws_assign(ws, "c0 = 3", err, sizeof err);
+    double chain = now_s() - t2;
+    printf("\nchain of %d cells: head edit updated %ld cell(s) in %.3f ms (%.1f ns/cell)\n",
+           ws_count(ws), n, chain * 1e3, chain * 1e9 / (double)n);
+    ws_free(ws);
+    return 0;
+}
+
+// ----------------------------- SESSION -----------------------------
+
+// Same value bit for bit in every cell (nan = nan).
+static int ws_same(const worksheet_t *a, const worksheet_t *b)
+{
+    if (ws_count(a) != ws_count(b)) return 0;
+    for (int c = 0; c < ws_count(a); ++c) {
+        double x = ws_value(a, c), y = ws_value(b, c);
+        if (memcmp(&x, &y, sizeof x) != 0 || strcmp(ws_name(a, c), ws_name(b, c)) != 0) return 0;
+    }
+    return 1;
+}
+
+static int bench_session(int argc, char **argv)
+{
+    long cells = argc > 2 ? strtol(argv[2], NULL, 10) : 100000;
+    const char *path = argc > 3 ? argv[3] : "/tmp/eee_bench.ws";
+    if (cells < 10) { printf("Usage: %s session [cells >= 10] [file]\n", argv[0]); return 1; }
+
+    // Divider blocks as in the worksheet benchmark, plus a text copy.
+    worksheet_t *ws = session_worksheet();
+    char text_path[600], line[160], err[200];
+    snprintf(text_path, sizeof text_path, "%.500s.txt", path);
+    FILE *fp = fopen(text_path, "w");
+    if (!ws || !fp) { printf("Error: cannot create '%s'.\n", text_path); return 1; }
+    for (long b = 0; b < cells / 5; ++b) {
+        fprintf(fp, "Vout%ld = Vin%ld * R2_%ld / (R1_%ld + R2_%ld)\n", b, b, b, b, b);
+        fprintf(fp, "P%ld = Vout%ld^2 / R2_%ld\n", b, b, b);
+        fprintf(fp, "Vin%ld = %ld\nR1_%ld = %ldk\nR2_%ld = 4.7k\n", b, 5 + b % 20, b, 1 + b % 100, b);
+    }
+    fclose(fp);
+    if (ws_load(ws, text_path, err, sizeof err) < 0) { printf("Error: %s.\n", err); return 1; }
+
+    double t0 = now_s();
+    if (session_save(path, err, sizeof err) != 0) { printf("Error: %s.\n", err); return 1; }
+    double save = now_s() - t0;
+
+    // Reference copy, built from text (the slow way in).
+    worksheet_t *ref = ws_new();
+    double t1 = now_s();
+    ws_load(ref, text_path, err, sizeof err);
+    double text = now_s() - t1;
+
+    // The first load also frees the worksheet built above. It maps at the
+    // preferred address, so the second one lands elsewhere and moves the
+    // pointers; the third finds the address free again.
+    if (session_load(path, err, sizeof err) != 0) { printf("Error: %s.\n", err); return 1; }
+    int same = ws_same(session_worksheet(), ref);
+    double t2 = now_s();
+    session_load(path, err, sizeof err);
+    double moved = now_s() - t2;
+    same = same && ws_same(session_worksheet(), ref);
+    double t3 = now_s();
+    session_load(path, err, sizeof err);
+    double fixed = now_s() - t3;
+    same = same && ws_same(session_worksheet(), ref);
+
+    // Edits work on the mapped worksheet exactly as on a built one.
+    for (long k = 0; k < 1000 && same; ++k) {
+        snprintf(line, sizeof line, "Vin%ld = %ld", (k * 7919) % (cells / 5), k % 30);
+        long a = ws_assign(session_worksheet(), line, err, sizeof err);
+        same = a > 0 && ws_assign(ref, line, err, sizeof err) == a;
+    }
+    same = same && ws_same(session_worksheet(), ref);
+
+    struct stat st;
+    stat(path, &st);
+    printf("%d cells, snapshot %.1f MB, saved in %.1f ms\n", ws_count(ref), st.st_size / 1048576.0, save * 1e3);
+    printf("load, mapped in place:     %8.3f ms\n", fixed * 1e3);
+    printf("load, mapped elsewhere:    %8.3f ms\n", moved * 1e3);
+    printf("re-entered from text:      %8.3f ms\n", text * 1e3);
+    printf("values and edits match: %s\n", same ? "yes" : "NO");
+    ws_free(ref);
+    unlink(text_path);
+    return same ? 0 : 1;
+}
+
+// ----------------------------- REPLAY -----------------------------
+
+// Keystrokes of one calculation in menus 1-5: the menu, its selections and
+// the values it asks for; "A..B" is a number drawn log-uniformly from A..B.
+static const char *const REPLAY_FORMS[][8] = {
+    { "1", "1", "1..24", "100..1e5", "100..1e5" },
+    { "1", "3", "12..24", "1..6", "100..1e5" },
+    { "2", "1", "1", "3", "10..1e5", "10..1e5", "10..1e5" },
+    { "2", "2", "1", "10..1e5", "10..1e5" },
+    { "3", "1", "1", "10..1e6", "1e-6..1" },
+    { "3", "2", "1", "10..1e6", "1e-9..1e-3" },
+    { "3", "3", "1", "1e-6..1", "1e-9..1e-3" },
+    { "4", "1", "100..1e5", "1e-9..1e-3", "1e-6..1" },
+    { "4", "2", "100..1e5", "1e-9..1e-3", "1..99" },
+    { "5", "1", "1..400", "0.01..50" },
+    { "5", "6", "1..400", "0.01..50", "1..60" },
+};
+
+// Worksheet edits, in order at first (so the formulas find their inputs),
+// then one of the three values at random.
+static const char *const REPLAY_CELLS[] = {
+    "Vin = %.4g", "R1 = %.4gk", "R2 = %.4gk", "Vout = Vin * R2 / (R1 + R2)", "P = Vout^2 / R2",
+};
+
+// Scratch files of main.out, removed afterwards.
+static const char *const REPLAY_FILES[] = {
+    "eee_log.txt", "eee_log.bin", "sweep.csv", "metrics.prom", "trace.json",
+};
+
+typedef struct {
+    char *buf;
+    size_t len, cap;
+} replay_text_t;
+
+static void replay_put(replay_text_t *t, const char *fmt, ...)
+{
+    for (;;) {
+        va_list ap;
+        va_start(ap, fmt);
+        int n = vsnprintf(t->buf + t->len, t->cap - t->len, fmt, ap);
+        va_end(ap);
+        if (n < 0) return;
+        if ((size_t)n < t->cap - t->len) { t->len += (size_t)n; return; }
+        size_t cap = t->cap ? t->cap * 2 : 1 << 20;
+        while (cap - t->len <= (size_t)n) cap *= 2;
+        char *b = realloc(t->buf, cap);
+        if (!b) { printf("Error: out of memory.\n"); exit(1); }
+        t->buf = b;
+        t->cap = cap;
+    }
+}
+
+static double replay_draw(double lo, double hi)
+{
+    return lo * pow(hi / lo, rand() / (double)RAND_MAX);
+}
+
+// The calculation menus, in the order the script visits them (6 and 7 are
+// View log and Quit, 12 is Stats).
+static const int REPLAY_MENUS[] = { 1, 2, 3, 4, 5, 8, 9, 10, 11 };
+enum { REPLAY_NMENUS = sizeof REPLAY_MENUS / sizeof REPLAY_MENUS[0] };
+
+// Calculation k uses menu REPLAY_MENUS[k % REPLAY_NMENUS].
+static void replay_script(long calcs, expr_t *const *exprs, replay_text_t *t)
+{
+    enum { NFORMS = sizeof REPLAY_FORMS / sizeof REPLAY_FORMS[0], NCASES = sizeof CASES / sizeof CASES[0] };
+
+    for (long k = 0; k < calcs; ++k) {
+        int menu = REPLAY_MENUS[k % REPLAY_NMENUS];
+        long visit = k / REPLAY_NMENUS;
+
+        if (menu <= 5) {
+            int forms[NFORMS], nf = 0;
+            for (int f = 0; f < NFORMS; ++f)
+                if (REPLAY_FORMS[f][0][0] - '0' == menu) forms[nf++] = f;
+            const char *const *form = REPLAY_FORMS[forms[visit % nf]];
+            for (int i = 0; i < 8 && form[i]; ++i) {
+                const char *dots = strstr(form[i], "..");
+                if (dots) replay_put(t, "%.6g\n", replay_draw(strtod(form[i], NULL), strtod(dots + 2, NULL)));
+                else replay_put(t, "%s\n", form[i]);
+            }
+        }
+        else if (menu == 8) {
+            eee_msg_t msg;
+            bench_request((uint32_t)visit, &msg);
+            replay_put(t, "8\n%d\n%d\n1\n", msg.formula + 1, msg.var + 1);
+            for (int j = 0; j < msg.nvars; ++j)
+                if (j != msg.var) replay_put(t, "%.17g\n", msg.v[j]);
+        }
+        else if (menu == 9) {
+            const bench_case_t *bc = &CASES[visit % NCASES];
+            const formula_t *fm = &FORMULAS[bc->formula];
+            expr_t *e = exprs[visit % NCASES];
+            replay_put(t, "9\n%s\n1\n", bc->src);
+            for (int i = 0; i < expr_nvars(e); ++i) {
+                int vi = formula_var_index(fm, expr_var_name(e, i));
+                replay_put(t, "%.9g\n", bc->lo[vi] + (bc->hi[vi] - bc->lo[vi]) * rand() / (double)RAND_MAX);
+            }
+        }
+        else if (menu == 10) {
+            replay_put(t, "10\nsweep R in 1k..100k log 16; eval rc.charge(C=%.3gu, t=1m)\nsweep.csv\n",
+                       replay_draw(0.01, 1.0));
+        }
+        else {
+            int c = visit < 5 ? (int)visit : rand() % 3;
+            replay_put(t, "11\n");
+            replay_put(t, REPLAY_CELLS[c], replay_draw(1.0, 100.0));
+            replay_put(t, "\n\n");
+        }
+        replay_put(t, "b\n");
+    }
+    replay_put(t, "7\n");
+}
+
+// Runs main.out (with the given extra argument, or none) in dir, writing the
+// script to its stdin and draining its stdout. Returns the exit status, or
+// -1 if it could not be started.
+static int replay_run(const char *main_path, const char *dir, const char *arg1, const char *arg2,
+                      const replay_text_t *script, double *secs, size_t *out_bytes)
+{
+    int in[2], out[2];
+    if (pipe(in) != 0) return -1;
+    if (pipe(out) != 0) { close(in[0]); close(in[1]); return -1; }
+
+    double t0 = now_s();
+    pid_t pid = fork();
+    if (pid < 0) return -1;
+    if (pid == 0) {
+        if (chdir(dir) != 0) _exit(127);
+        setenv("EEE_METRICS", "metrics.prom", 1);
+        unsetenv("EEE_WORKSPACE");
+        unsetenv("EEE_MEMO");
+        unsetenv("EEE_CACHE_DIR");
+        dup2(in[0], 0);
+        dup2(out[1], 1);
+        close(in[0]); close(in[1]); close(out[0]); close(out[1]);
+        execl(main_path, "main.out", arg1, arg2, (char *)NULL);
+        _exit(127);
+    }
+    close(in[0]);
+    close(out[1]);
+    fcntl(in[1], F_SETFL, O_NONBLOCK);
+
+    static char buf[1 << 16];
+    size_t sent = 0;
+    *out_bytes = 0;
+    for (;;) {
+        struct pollfd p[2] = { { out[0], POLLIN, 0 }, { in[1], POLLOUT, 0 } };
+        if (poll(p, sent < script->len ? 2 : 1, -1) < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+        if (sent < script->len && (p[1].revents & (POLLOUT | POLLERR | POLLHUP))) {
+            ssize_t w = write(in[1], script->buf + sent, script->len - sent);
+            if (w > 0) sent += (size_t)w;
+            else if (w < 0 && errno != EAGAIN && errno != EINTR) sent = script->len;   // it has gone
+            if (sent == script->len) close(in[1]);
+        }
+        if (p[0].revents & (POLLIN | POLLHUP | POLLERR)) {
+            ssize_t r = read(out[0], buf, sizeof buf);
+            if (r == 0) break;
+            if (r > 0) *out_bytes += (size_t)r;
+            else if (errno != EINTR) break;
+        }
+    }
+    if (sent < script->len) close(in[1]);
+    close(out[0]);
+
+    int status;
+    waitpid(pid, &status, 0);
+    *secs = now_s() - t0;
+    return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+}
+
+// Total seconds and calls of each probe from main.out's metrics file.
+static int replay_metrics(const char *path, double *sum, double *count)
+{
+    static const char *const NAMES[STAT_COUNT] = {
+#define REPLAY_NAME(id, name, cat) name,
+        STATS_PROBES(REPLAY_NAME)
+#undef REPLAY_NAME
+    };
+    FILE *fp = fopen(path, "r");
+    if (!fp) return -1;
+    char line[256], name[64];
+    double v;
+    for (int k = 0; k < STAT_COUNT; ++k) sum[k] = count[k] = 0.0;
+    while (fgets(line, sizeof line, fp)) {
+        double *to = NULL;
+        if (sscanf(line, "eee_latency_seconds_sum{path=\"%63[^\"]\"} %lf", name, &v) == 2) to = sum;
+        else if (sscanf(line, "eee_latency_seconds_count{path=\"%63[^\"]\"} %lf", name, &v) == 2) to = count;
+        for (int k = 0; to && k < STAT_COUNT; ++k)
+            if (strcmp(name, NAMES[k]) == 0) to[k] = v;
+    }
+    fclose(fp);
+    return 0;
+}
+
+// Durations of the menu_calc events in a trace, in order, in seconds.
+static long replay_latencies(const char *path, double *lat, long max)
+{
+    FILE *fp = fopen(path, "r");
+    if (!fp) return -1;
+    char line[512];
+    long n = 0;
+    double ts, dur;
+    while (n < max && fgets(line, sizeof line, fp))
+        if (sscanf(line, "{\"name\":\"menu_calc\",\"cat\":\"%*[^\"]\",\"ph\":\"X\",\"ts\":%lf,\"dur\":%lf", &ts, &dur) == 2)
+            lat[n++] = dur * 1e-6;
+    fclose(fp);
+    return n;
+}
+
+static int bench_replay(int argc, char **argv)
+{
+    long calcs = argc > 2 ? strtol(argv[2], NULL, 10) : 45000;
+    if (calcs < 9) { printf("Usage: %s replay [calcs >= 9]\n", argv[0]); return 1; }
+
+    // main.out next to bench.out; the child runs in a scratch directory.
+    char guess[PATH_MAX], main_path[PATH_MAX], dir[] = "/tmp/eee_replay.XXXXXX";
+    const char *slash = strrchr(argv[0], '/');
+    snprintf(guess, sizeof guess, "%.*smain.out", slash ? (int)(slash - argv[0] + 1) : 0, argv[0]);
+    if (!realpath(guess, main_path) || access(main_path, X_OK) != 0) {
+        printf("Error: cannot find %s (make main.out first).\n", guess);
+        return 1;
+    }
+    if (!mkdtemp(dir)) { printf("Error: cannot create a scratch directory: %s.\n", strerror(errno)); return 1; }
+
+    enum { NCASES = sizeof CASES / sizeof CASES[0] };
+    expr_t *exprs[NCASES];
+    char err[128];
+    for (int c = 0; c < NCASES; ++c)
+        if (!(exprs[c] = expr_compile(CASES[c].src, err, sizeof err))) { printf("Error: %s\n", err); return 1; }
+
+    replay_text_t script = { 0 };
+    srand(2645);
+    replay_script(calcs, exprs, &script);
+    for (int c = 0; c < NCASES; ++c) expr_free(exprs[c]);
+
+    struct sigaction sa;
+    memset(&sa, 0, sizeof sa);
+    sa.sa_handler = SIG_IGN;
+    sigaction(SIGPIPE, &sa, NULL);
+
+    // First run: the time. Second run, traced: each calculation's latency
+    // (the trace is written at exit, so it would distort the first).
+    double secs, traced_secs, sum[STAT_COUNT], count[STAT_COUNT];
+    size_t out_bytes, traced_bytes;
+    char path[PATH_MAX + 32];
+    int rc = replay_run(main_path, dir, NULL, NULL, &script, &secs, &out_bytes);
+    snprintf(path, sizeof path, "%s/metrics.prom", dir);
+    int have_metrics = rc == 0 && replay_metrics(path, sum, count) == 0;
+    for (size_t f = 0; f < sizeof REPLAY_FILES / sizeof REPLAY_FILES[0]; ++f) {
+        snprintf(path, sizeof path, "%s/%s", dir, REPLAY_FILES[f]);
+        unlink(path);
+    }
+    int rc2 = rc == 0 ? replay_run(main_path, dir, "--trace", "trace.json", &script, &traced_secs, &traced_bytes) : rc;
+
+    double *lat = malloc((size_t)calcs * sizeof *lat);
+    snprintf(path, sizeof path, "%s/trace.json", dir);
+    long m = rc2 == 0 && lat ? replay_latencies(path, lat, calcs) : -1;
+
+    for (size_t f = 0; f < sizeof REPLAY_FILES / sizeof REPLAY_FILES[0]; ++f) {
+        snprintf(path, sizeof path, "%s/%s", dir, REPLAY_FILES[f]);
+        unlink(path);
+    }
+    rmdir(dir);
+
+    if (rc != 0 || rc2 != 0) {
+        printf("Error: %s exited with status %d.\n", main_path, rc != 0 ? rc : rc2);
+        free(script.buf);
+        free(lat);
+        return 1;
+    }
+
+    printf("%ld calculations (menus 1-5, 8-11 in turn), %.1f MB of keystrokes, through %s\n\n",
+           calcs, script.len / 1048576.0, main_path);
+    printf("session            %8.3f s   %10.0f calcs/s   (%.2f us/calc, start-up to Bye)\n",
+           secs, calcs / secs, secs * 1e6 / calcs);
+    printf("stdout             %8.1f MB  %10.0f bytes/calc\n", out_bytes / 1048576.0, (double)out_bytes / calcs);
+
+    if (m == calcs) {
+        // Calculation k came from menu REPLAY_MENUS[k % REPLAY_NMENUS].
+        double *by_menu = malloc((size_t)calcs * sizeof *by_menu);
+        printf("\nper calculation, us (traced run, menu_calc scopes: the menu's prompts, input,\n"
+               "math, output and logging; not the main menu or the 'b' prompt)\n\n");
+        printf("%-10s %8s %9s %9s %9s %9s\n", "menu", "calcs", "p50", "p90", "p99", "max");
+        for (int i = -1; i < REPLAY_NMENUS && by_menu; ++i) {
+            int menu = i < 0 ? 0 : REPLAY_MENUS[i];
+            long n = 0;
+            for (long k = 0; k < calcs; ++k)
+                if (i < 0 || k % REPLAY_NMENUS == i) by_menu[n++] = lat[k];
+            qsort(by_menu, (size_t)n, sizeof *by_menu, cmp_double);
+            char label[16];
+            snprintf(label, sizeof label, menu ? "%d" : "all", menu);
+            printf("%-10s %8ld %9.2f %9.2f %9.2f %9.2f\n", label, n, by_menu[n / 2] * 1e6,
+                   by_menu[(size_t)(n * 0.90)] * 1e6, by_menu[(size_t)(n * 0.99)] * 1e6, by_menu[n - 1] * 1e6);
+        }
+        free(by_menu);
+    }
+    else {
+        printf("\n(no per-calculation latencies: %s)\n",
+               m < 0 ? "the trace could not be read (built with -DEEE_NO_STATS?)" : "the trace is incomplete");
+    }
+
+    if (have_metrics) {
+        // Math: the timed calculation paths that do not nest in each other
+        // here (a sweep's solves are its formula_solve calls, and menu_math
+        // is the arithmetic of menus 1-5).
+        double math = sum[STAT_FORMULA_SOLVE] + sum[STAT_EXPR_COMPILE] + sum[STAT_EXPR_EVAL] + sum[STAT_WORKSHEET_SET] +
+                      sum[STAT_MENU_MATH];
+        double logging = sum[STAT_LOG_WRITE], parsing = sum[STAT_INPUT_PARSE], files = sum[STAT_BATCH_FORMAT];
+        double in_calcs = sum[STAT_MENU_CALC];
+        double rest = secs - math - logging - parsing - files;
+        printf("\nwhere the session's time went (untraced run)        ms    %% of session   us/calc\n");
+        printf("  math (menus, solves, expressions, sheet)  %10.1f %10.1f%% %10.2f\n", math * 1e3, 100 * math / secs, math * 1e6 / calcs);
+        printf("  logging (eee_log.txt / .bin appends)      %10.1f %10.1f%% %10.2f\n", logging * 1e3, 100 * logging / secs, logging * 1e6 / calcs);
+        printf("  input parsing (strtol / strtod)           %10.1f %10.1f%% %10.2f\n", parsing * 1e3, 100 * parsing / secs, parsing * 1e6 / calcs);
+        printf("  sweep CSV output                          %10.1f %10.1f%% %10.2f\n", files * 1e3, 100 * files / secs, files * 1e6 / calcs);
+        printf("  stdio and the rest (prompts, fgets, printf, start-up)\n");
+        printf("                                            %10.1f %10.1f%% %10.2f\n", rest * 1e3, 100 * rest / secs, rest * 1e6 / calcs);
+        printf("  of which between calculations (main menu, 'b')\n");
+        printf("                                            %10.1f %10.1f%% %10.2f\n", (secs - in_calcs) * 1e3,
+               100 * (secs - in_calcs) / secs, (secs - in_calcs) * 1e6 / calcs);
+        if (count[STAT_MENU_CALC] != calcs) printf("(main.out counted %.0f calculations)\n", count[STAT_MENU_CALC]);
+    }
+    else {
+        printf("\n(no time split: main.out wrote no metrics; built with -DEEE_NO_STATS?)\n");
+    }
+
+    free(script.buf);
+    free(lat);
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc > 1 && strcmp(argv[1], "replay") == 0) return bench_replay(argc, argv);
+    if (argc > 1 && strcmp(argv[1], "session") == 0) return bench_session(argc, argv);
+    if (argc > 1 && strcmp(argv[1], "worksheet") == 0) return bench_worksheet(argc, argv);
+    if (argc > 1 && strcmp(argv[1], "memo") == 0) return bench_memo(argc, argv);
+    if (argc > 1 && strcmp(argv[1], "shm") == 0) return bench_shm(argc, argv);
+    if (argc > 1 && strcmp(argv[1], "daemon") == 0) return bench_server(argc, argv, 0);
+    if (argc > 1 && strcmp(argv[1], "http") == 0) return bench_server(argc, argv, 1);
+    return bench_formulas(argc, argv);
+}
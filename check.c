@@ -0,0 +1,1191 @@
+// Behaviour tests for the EEE Helper CLI calculator.
+// Build with "make check.out"; "make test" builds it and test.sh runs it.
+//
+// ./check.out [test ...]
+//   Runs every test (or the named ones), each in a child process of its own
+//   and in a fresh scratch directory, so environment settings read once per
+//   process (EEE_MEMO, EEE_CACHE_DIR) and files left behind cannot leak from
+//   one test into the next. Prints the checks that failed and one PASS or
+//   FAIL line per test. Exit status 1 if any test failed.
+//
+//   batch       formula_solve_batch: rows in and out of range, in any order
+//   batch_csv   menu 8's CSV mode on a file with rows out of range (main.out
+//               must be built)
+//   jit         the native code backend gives the interpreter's results, bit
+//               for bit, on every operator and function and on special values
+//   sweep       sweep scripts: ranges, E-series, lists, unsolvable points, a
+//               sweep longer than one chunk, script files and script errors
+//   daemon      pipelined round trips to the socket daemon: solves, errors,
+//               a broken frame, and a clean shutdown
+//   http        pipelined HTTP/1.1 requests: GET and POST solves, the batch
+//               endpoint, the formula list and error statuses
+//   shm         round trips through the shared-memory ring, from this process
+//               and from several client processes at once
+//   memo        the memo cache: sizing, hits, CLOCK eviction with a second
+//               chance for entries used since, and cached errors
+//   dcache      the disk cache: misses, hits, replaced and damaged entries,
+//               least recently used entries deleted past EEE_CACHE_MB, and
+//               sweeps answered from it
+//   worksheet   edits recompute exactly the cells that depend on them, in
+//               dependency order; forward references, cycles and bad edits
+//   snapshot    workspace snapshots: loaded in place, relocated, and from
+//               another build; damaged files; EEE_WORKSPACE in main.out
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <stdint.h>
+#include <errno.h>
+#include <limits.h>
+#include <dirent.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include "formulas.h"
+#include "funcs.h"
+#include "expr.h"
+#include "sweep.h"
+#include "daemon.h"
+#include "http.h"
+#include "shm.h"
+#include "memo.h"
+#include "diskcache.h"
+#include "stats.h"
+#include "worksheet.h"
+#include "session.h"
+
+// ----------------------------- HARNESS -----------------------------
+
+static int check_failed;                // failed checks in the current test
+static char check_main[PATH_MAX];       // absolute path of main.out, "" if not built
+
+#define CHECK(cond, ...)                                                    \
+    do {                                                                    \
+        if (!(cond)) {                                                      \
+            printf("    line %d: ", __LINE__);                              \
+            printf(__VA_ARGS__);                                            \
+            printf("\n");                                                   \
+            check_failed++;                                                 \
+        }                                                                   \
+    } while (0)
+
+// |a - b| within rel of |b|, or both nan.
+static int close_to(double a, double b, double rel)
+{
+    if (isnan(a) || isnan(b)) return isnan(a) && isnan(b);
+    return fabs(a - b) <= rel * fabs(b);
+}
+
+static int write_text(const char *path, const char *text)
+{
+    FILE *fp = fopen(path, "w");
+    if (!fp) return 0;
+    int ok = fputs(text, fp) >= 0;
+    return fclose(fp) == 0 && ok;
+}
+
+// Whole file as a string (free() it), or NULL.
+static char *read_text(const char *path)
+{
+    FILE *fp = fopen(path, "rb");
+    if (!fp) return NULL;
+    size_t len = 0, cap = 4096;
+    char *s = malloc(cap);
+    size_t got;
+    while (s && (got = fread(s + len, 1, cap - len - 1, fp)) > 0) {
+        len += got;
+        if (cap - len == 1) {
+            char *ns = realloc(s, cap *= 2);
+            if (!ns) { free(s); s = NULL; }
+            else s = ns;
+        }
+    }
+    fclose(fp);
+    if (s) s[len] = '\0';
+    return s;
+}
+
+// Runs main.out with `input` as its keystrokes, its output going to out_path.
+// Returns its exit status, or -1 if it could not be run.
+static int run_main(const char *input, const char *out_path)
+{
+    if (!check_main[0] || !write_text("keys.txt", input)) return -1;
+    char cmd[PATH_MAX + 128];
+    snprintf(cmd, sizeof cmd, "'%s' < keys.txt > '%s' 2>&1", check_main, out_path);
+    int status = system(cmd);
+    return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+}
+
+static int write_full(int fd, const void *buf, size_t n)
+{
+    for (size_t done = 0; done < n;) {
+        ssize_t w = write(fd, (const char *)buf + done, n - done);
+        if (w < 0 && errno == EINTR) continue;
+        if (w <= 0) return 0;
+        done += (size_t)w;
+    }
+    return 1;
+}
+
+// Reads exactly n bytes. Returns 0 at the end of the stream or on an error.
+static int read_full(int fd, void *buf, size_t n)
+{
+    for (size_t done = 0; done < n;) {
+        ssize_t r = read(fd, (char *)buf + done, n - done);
+        if (r < 0 && errno == EINTR) continue;
+        if (r <= 0) return 0;
+        done += (size_t)r;
+    }
+    return 1;
+}
+
+// Forks a server running serve(arg), its output discarded. Returns its pid, or -1.
+static pid_t server_spawn(int (*serve)(void *arg), void *arg)
+{
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid == 0) {
+        if (!freopen("/dev/null", "w", stdout)) _exit(1);
+        _exit(serve(arg));
+    }
+    return pid;
+}
+
+// Stops a server from server_spawn() as Ctrl+C would. Returns its exit
+// status, or -1 if it did not exit by itself.
+static int server_stop(pid_t pid)
+{
+    int status;
+    kill(pid, SIGINT);
+    while (waitpid(pid, &status, 0) < 0 && errno == EINTR) {}
+    return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+}
+
+// A solve request (v[var] is the hint).
+static eee_msg_t solve_msg(uint32_t id, int formula, int var, const double *v)
+{
+    eee_msg_t m;
+    memset(&m, 0, sizeof m);
+    m.len = EEE_MSG_LEN;
+    m.id = id;
+    m.op = EEE_OP_SOLVE;
+    m.formula = (uint8_t)formula;
+    m.var = (uint8_t)var;
+    m.nvars = (uint8_t)FORMULAS[formula].nvars;
+    memcpy(m.v, v, (size_t)m.nvars * sizeof *v);
+    return m;
+}
+
+// Requests with every kind of answer: ping, a solve, an input out of range,
+// no solution and an unknown formula.
+enum { SERVER_REQS = 5 };
+
+static void server_requests(eee_msg_t req[SERVER_REQS])
+{
+    static const double rc[] = { 0, 1000, 1e-6, 1e-3 }, rc_bad[] = { 0, -1000, 1e-6, 1e-3 };
+    static const double div[] = { 20, 12, 10e3, 0 };
+    memset(req, 0, sizeof *req);
+    req[0].len = EEE_MSG_LEN;
+    req[0].id = 100;
+    req[0].op = EEE_OP_PING;
+    req[1] = solve_msg(101, FORMULA_RC_CHARGE, 0, rc);
+    req[2] = solve_msg(102, FORMULA_RC_CHARGE, 0, rc_bad);
+    req[3] = solve_msg(103, FORMULA_DIVIDER, 3, div);
+    req[4] = solve_msg(104, FORMULA_COUNT, 0, rc);
+}
+
+// Checks answers to server_requests(), in order.
+static void server_check(const eee_msg_t res[SERVER_REQS], const char *via)
+{
+    static const int want[SERVER_REQS] = { EEE_ST_OK, EEE_ST_OK, EEE_ST_DOMAIN, EEE_ST_NOSOLUTION, EEE_ST_BADREQ };
+    for (int k = 0; k < SERVER_REQS; ++k)
+        CHECK(res[k].id == 100u + (unsigned)k && res[k].status == want[k],
+              "%s: answer %d has id %u, status %d; expected id %d, status %d", via, k,
+              res[k].id, res[k].status, 100 + k, want[k]);
+    CHECK(close_to(res[1].v[0], 63.212055882855765, 1e-14) && res[1].v[1] == 1000 && res[1].v[2] == 1e-6 &&
+          res[1].v[3] == 1e-3, "%s: rc.charge answered %.17g (inputs %g, %g, %g)", via,
+          res[1].v[0], res[1].v[1], res[1].v[2], res[1].v[3]);
+}
+
+// ------------------------------ BATCH ------------------------------
+
+// rc.charge solved for C: the answers of rows in range, nan for the rest,
+// and the same answers whatever row came before (rows warm-start each other).
+static void test_batch(void)
+{
+    const formula_t *fm = &FORMULAS[FORMULA_RC_CHARGE];
+    static const double charge[] = { 50, 63.2120558828558, 50, 150, 99 };
+    static const double R[]      = { 1000, 1000, -1000, 1000, 2200 };
+    static const double t[]      = { 1e-3, 1e-3, 1e-3, 1e-3, 5e-3 };
+    enum { N = 5 };
+    const double want[N] = { 1e-3 / (1000 * log(2.0)), 1e-6, NAN, NAN, 5e-3 / (2200 * log(100.0)) };
+
+    double unused[N], out[N];
+    const double *cols[] = { charge, R, unused, t };
+    size_t solved = formula_solve_batch(fm, 2, cols, N, out);
+    CHECK(solved == 3, "%zu rows solved, expected 3", solved);
+    for (int k = 0; k < N; ++k)
+        CHECK(close_to(out[k], want[k], 1e-9), "row %d: C = %.17g, expected %.17g", k, out[k], want[k]);
+
+    // Backwards, and one row at a time: the same answers.
+    double rc[N], rr[N], rt[N], rout[N], one;
+    for (int k = 0; k < N; ++k) { rc[k] = charge[N - 1 - k]; rr[k] = R[N - 1 - k]; rt[k] = t[N - 1 - k]; }
+    const double *rcols[] = { rc, rr, unused, rt };
+    formula_solve_batch(fm, 2, rcols, N, rout);
+    for (int k = 0; k < N; ++k) {
+        CHECK(close_to(rout[N - 1 - k], out[k], 1e-12), "row %d backwards: %.17g, forwards %.17g",
+              k, rout[N - 1 - k], out[k]);
+        const double *ocols[] = { &charge[k], &R[k], unused, &t[k] };
+        formula_solve_batch(fm, 2, ocols, 1, &one);
+        CHECK(close_to(one, out[k], 1e-12), "row %d alone: %.17g, in the batch %.17g", k, one, out[k]);
+    }
+
+    // A formula with a closed-form inverse: phi from PF, with |PF| > 1 unsolvable.
+    fm = &FORMULAS[FORMULA_POWER_AC_PF];
+    static const double pf[] = { 0.5, 1.0, 1.5 };
+    double phi[3];
+    const double *pcols[] = { pf, unused };
+    solved = formula_solve_batch(fm, 1, pcols, 3, phi);
+    CHECK(solved == 2 && close_to(phi[0], 60, 1e-12) && close_to(phi[1], 0, 0) && isnan(phi[2]),
+          "power.ac.pf: phi = %g, %g, %g (%zu solved), expected 60, 0, nan", phi[0], phi[1], phi[2], solved);
+}
+
+// Menu 8, rc.charge solved for C from a CSV with a header, a row with R out
+// of range, a row with charge out of range and a line that is not numbers.
+static void test_batch_csv(void)
+{
+    write_text("cases.csv",
+               "charge,R,t\n"
+               "50,1000,0.001\n"
+               "50,-1000,0.001\n"
+               "150,1000,0.001\n"
+               "oops\n"
+               "63.2120558828558,1000,0.001\n");
+    int status = run_main("8\n6\n3\n2\ncases.csv\nsolved.csv\nb\n7\n", "menu.txt");
+    CHECK(status == 0, "main.out exit status %d (is it built?)", status);
+
+    char *menu = read_text("menu.txt");
+    CHECK(menu && strstr(menu, "4 row(s) written to solved.csv (2 without a solution)"),
+          "menu 8 did not report 4 rows, 2 unsolved");
+    CHECK(menu && strstr(menu, "(2 line(s) skipped)"), "menu 8 did not report 2 skipped lines");
+    free(menu);
+
+    char *csv = read_text("solved.csv");
+    const char *want = "charge,R,C,t\n"
+                       "50,1000,1.44269504e-06,0.001\n"
+                       "50,-1000,nan,0.001\n"
+                       "150,1000,nan,0.001\n"
+                       "63.2120559,1000,1e-06,0.001\n";
+    CHECK(csv && strcmp(csv, want) == 0, "solved.csv is\n%s\nexpected\n%s", csv ? csv : "(missing)", want);
+    free(csv);
+}
+
+// ------------------------------- JIT -------------------------------
+
+// Every operator and function, constants on either side, registers reused,
+// and the same constant with either sign (0 and -0 are different registers).
+static const char *const JIT_EXPRS[] = {
+    "x + y", "x - y", "x * y", "x / y", "-x", "x ^ y", "x ^ 2", "2 ^ x", "x ^ 0.5",
+    "exp(x)", "log(x)", "sqrt(x)", "sin(x)", "cos(x)", "tan(x)", "abs(x)",
+    "(x + 1) * (x - 1) / (y * y + 1)",
+    "x ^ y ^ 0.5 - (y - x) ^ (x / 4)",
+    "exp(-x) * sin(y) + cos(x) ^ 2 - log(abs(y) + 1) * tan(x / 7)",
+    "sqrt(abs(x - y)) * -x / (y + 3) + PI",
+    "1 / (x * 0) - 1 / (x * -0)",
+};
+
+// Finite values spread over many decades, then 0, -0, inf, -inf and nan.
+static double jit_value(size_t k)
+{
+    static const double special[] = { 0.0, -0.0, 1.0, -1.0, 0.5, 1e308, -1e-310, INFINITY, -INFINITY, NAN };
+    if (k % 7 == 0) return special[(k / 7) % (sizeof special / sizeof special[0])];
+    double m = (double)(k * 2654435761u % 20001) / 1000.0 - 10.0;
+    return m * pow(10.0, (double)(int)(k % 13) - 6);
+}
+
+static void test_jit(void)
+{
+    enum { ROWS = 1003 };               // not a multiple of 4: the tail is done separately
+    static double x[ROWS], y[ROWS], a[ROWS], b[ROWS];
+    for (size_t k = 0; k < ROWS; ++k) {
+        x[k] = jit_value(k);
+        y[k] = jit_value(k * 31 + 5);
+    }
+
+    int native = 0;
+    for (size_t c = 0; c < sizeof JIT_EXPRS / sizeof JIT_EXPRS[0]; ++c) {
+        char err[128];
+        expr_t *e = expr_compile(JIT_EXPRS[c], err, sizeof err);
+        CHECK(e != NULL, "%s: %s", JIT_EXPRS[c], err);
+        if (!e) continue;
+
+        const double *cols[EXPR_MAX_VARS];
+        for (int i = 0; i < expr_nvars(e); ++i) cols[i] = strcmp(expr_var_name(e, i), "x") == 0 ? x : y;
+
+        expr_set_jit(e, 0);
+        expr_eval(e, cols, ROWS, a);
+        for (size_t k = 0; k < ROWS; k += 97) {
+            double vals[2] = { cols[0][k], expr_nvars(e) > 1 ? cols[1][k] : 0.0 };
+            double one = expr_eval1(e, vals);
+            CHECK(memcmp(&one, &a[k], sizeof one) == 0 || (isnan(one) && isnan(a[k])),
+                  "%s row %zu: one row %.17g, a column %.17g", JIT_EXPRS[c], k, one, a[k]);
+        }
+
+        if (expr_set_jit(e, 1)) {
+            native = 1;
+            for (size_t n = 0; n <= 5; ++n) {           // short runs: only a tail, or none
+                expr_eval(e, cols, n, b);
+                for (size_t k = 0; k < n; ++k)
+                    CHECK(memcmp(&a[k], &b[k], sizeof a[k]) == 0 || (isnan(a[k]) && isnan(b[k])),
+                          "%s, %zu rows, row %zu: interp %.17g, jit %.17g", JIT_EXPRS[c], n, k, a[k], b[k]);
+            }
+            expr_eval(e, cols, ROWS, b);
+            size_t k = 0;
+            while (k < ROWS && (memcmp(&a[k], &b[k], sizeof a[k]) == 0 || (isnan(a[k]) && isnan(b[k])))) k++;
+            CHECK(k == ROWS, "%s at x=%.17g y=%.17g: interp %.17g, jit %.17g", JIT_EXPRS[c],
+                  x[k], y[k], a[k], b[k]);
+        }
+        expr_free(e);
+    }
+    if (!native) printf("    (no native code backend on this machine: interpreter only)\n");
+
+    // 1 / (x * 0) and 1 / (x * -0) are inf and -inf: the two zeros stay apart.
+    expr_t *e = expr_compile("1 / (x * 0) - 1 / (x * -0)", NULL, 0);
+    double two = 2.0;
+    CHECK(e && isinf(expr_eval1(e, &two)) && expr_eval1(e, &two) > 0, "0 and -0 were merged");
+    expr_free(e);
+
+    // EEE_NO_JIT turns the backend off for expressions compiled after it.
+    setenv("EEE_NO_JIT", "1", 1);
+    e = expr_compile("x * 2", NULL, 0);
+    CHECK(e && !expr_jit_active(e), "EEE_NO_JIT=1 did not turn the native backend off");
+    expr_free(e);
+}
+
+// ------------------------------ SWEEP ------------------------------
+
+// Runs a sweep into a string (free() it). Returns NULL if the script does
+// not parse, with the message in err.
+static char *sweep_text(const char *script, unsigned long long *rows, unsigned long long *unsolved,
+                        char *err, size_t errlen)
+{
+    sweep_t *s = sweep_open(script, err, errlen);
+    if (!s) return NULL;
+    char *text = NULL;
+    size_t len = 0;
+    FILE *mem = open_memstream(&text, &len);
+    if (mem) {
+        *rows = sweep_run(s, mem, unsolved);
+        fclose(mem);
+    }
+    sweep_free(s);
+    return text;
+}
+
+static const struct {
+    const char *script, *csv;
+    unsigned long long rows, unsolved;
+} SWEEP_CASES[] = {
+    { "sweep R in 1k, 2k; sweep C in 1u, 2u; eval rc.charge(t=1ms); eval rc.discharge(t=1ms)",
+      "R,C,charge,discharge\n1000,1e-06,63.2120559,36.7879441\n1000,2e-06,39.346934,60.653066\n"
+      "2000,1e-06,39.346934,60.653066\n2000,2e-06,22.1199217,77.8800783\n", 4, 0 },
+    { "sweep R2 in E3(1k..10k); eval divider.vout(Vin=12, R1=10k)",
+      "R2,Vout\n1000,1.09090909\n2200,2.16393443\n4700,3.83673469\n10000,6\n", 4, 0 },
+    { "sweep f in 10..1k log 3; eval ac.xc(C=1u)",
+      "f,XC\n10,15915.4943\n100,1591.54943\n1000,159.154943\n", 3, 0 },
+    { "sweep t in 0..2m step 1m; eval rc.charge(R=1k, C=1u)",
+      "t,charge\n0,0\n0.001,63.2120559\n0.002,86.4664717\n", 3, 0 },
+    { "sweep Vout in 6, 20; eval divider.vout(Vin=12, R1=10k)",
+      "Vout,R2\n6,10000\n20,nan\n", 2, 1 },
+};
+
+static void test_sweep(void)
+{
+    char err[200];
+    unsigned long long rows = 0, unsolved = 0;
+    for (size_t c = 0; c < sizeof SWEEP_CASES / sizeof SWEEP_CASES[0]; ++c) {
+        char *csv = sweep_text(SWEEP_CASES[c].script, &rows, &unsolved, err, sizeof err);
+        CHECK(csv && strcmp(csv, SWEEP_CASES[c].csv) == 0, "%s gave\n%s\nexpected\n%s",
+              SWEEP_CASES[c].script, csv ? csv : err, SWEEP_CASES[c].csv);
+        CHECK(rows == SWEEP_CASES[c].rows && unsolved == SWEEP_CASES[c].unsolved,
+              "%s: %llu rows, %llu unsolved", SWEEP_CASES[c].script, rows, unsolved);
+        free(csv);
+    }
+
+    // More points than one chunk: every row present, in order, and right.
+    enum { N = 10007 };
+    char *csv = sweep_text("sweep R1 in 1..10007 lin 10007; eval parallel.req(R2=1k)", &rows, &unsolved,
+                           err, sizeof err);
+    CHECK(csv && rows == N && unsolved == 0, "long sweep: %llu rows, %llu unsolved", rows, unsolved);
+    const char *p = csv ? strchr(csv, '\n') : NULL;
+    long k = 0;
+    for (; p && p[1]; ++k) {
+        char *end;
+        double r1 = strtod(p + 1, &end), req = *end == ',' ? strtod(end + 1, &end) : NAN;
+        if (!close_to(r1, (double)(k + 1), 1e-9) || !close_to(req, 1000.0 * r1 / (r1 + 1000.0), 1e-8)) break;
+        p = strchr(end, '\n');
+    }
+    CHECK(k == N, "long sweep: row %ld is wrong or missing", k + 1);
+    free(csv);
+
+    // From a file, with comments and blank lines.
+    write_text("study.txt", "# study\nsweep R1 in 1k, 2k\n\neval parallel.req(R2=1k)  # Req\n");
+    csv = sweep_text("@study.txt", &rows, &unsolved, err, sizeof err);
+    CHECK(csv && strcmp(csv, "R1,Req\n1000,500\n2000,666.666667\n") == 0, "@study.txt gave\n%s",
+          csv ? csv : err);
+    free(csv);
+
+    // Scripts that must be rejected, with the statement named.
+    static const char *const bad[][2] = {
+        { "eval nosuch(R=1)", "statement 1: unknown formula 'nosuch'" },
+        { "sweep t in 0, 1m; eval rc.charge(R=1k, C=1u, charge=150)", "statement 2: charge is out of range" },
+        { "sweep R2 in 0, 10k; eval divider.vout(Vin=12, R1=10k)", "statement 2: swept R2 is out of range" },
+        { "sweep R in 1k; eval rc.charge(t=1)", "statement 2: give or sweep all but one of the 4 variables" },
+    };
+    for (size_t c = 0; c < sizeof bad / sizeof bad[0]; ++c) {
+        sweep_t *s = sweep_open(bad[c][0], err, sizeof err);
+        CHECK(!s && strstr(err, bad[c][1]), "%s: expected \"%s\", got \"%s\"", bad[c][0], bad[c][1],
+              s ? "(accepted)" : err);
+        sweep_free(s);
+    }
+
+    double v;
+    const char *end;
+    CHECK(sweep_parse_value("4.7k", &v, &end) && v == 4700 && !*end, "4.7k");
+    CHECK(sweep_parse_value("100nF", &v, &end) && close_to(v, 100e-9, 1e-15) && !*end, "100nF");
+    CHECK(sweep_parse_value("2meg", &v, &end) && v == 2e6 && !*end, "2meg");
+    CHECK(!sweep_parse_value("ohm", &v, &end), "ohm parsed as a number");
+
+    double e[96];
+    CHECK(sweep_eseries("E12", e) == 12 && e[0] == 1.0 && e[1] == 1.2 && e[11] == 8.2, "E12 series");
+    CHECK(sweep_eseries("E7", e) == 0, "E7 accepted");
+}
+
+// ----------------------------- DAEMON -----------------------------
+
+static int daemon_child(void *path)
+{
+    return daemon_run(path) == 0 ? 0 : 1;
+}
+
+// Connects to the daemon's socket, waiting up to 2 s for it to appear.
+static int daemon_connect(const char *path)
+{
+    struct sockaddr_un un;
+    memset(&un, 0, sizeof un);
+    un.sun_family = AF_UNIX;
+    snprintf(un.sun_path, sizeof un.sun_path, "%s", path);
+    for (int tries = 0; tries < 200; ++tries) {
+        int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd >= 0 && connect(fd, (struct sockaddr *)&un, sizeof un) == 0) return fd;
+        if (fd >= 0) close(fd);
+        usleep(10000);
+    }
+    return -1;
+}
+
+static void test_daemon(void)
+{
+    pid_t pid = server_spawn(daemon_child, "eee.sock");
+    CHECK(pid > 0, "fork failed");
+    if (pid <= 0) return;
+    int fd = daemon_connect("eee.sock");
+    CHECK(fd >= 0, "cannot connect to the daemon");
+
+    if (fd >= 0) {
+        // All requests in one write, twice over: answers come back in order.
+        eee_msg_t req[2 * SERVER_REQS], res[2 * SERVER_REQS];
+        server_requests(req);
+        server_requests(req + SERVER_REQS);
+        CHECK(write_full(fd, req, sizeof req) && read_full(fd, res, sizeof res), "round trip failed");
+        server_check(res, "daemon");
+        server_check(res + SERVER_REQS, "daemon, repeated");
+
+        // The same answers as in-process.
+        for (int k = 0; k < SERVER_REQS; ++k) {
+            daemon_handle(&req[k]);
+            CHECK(memcmp(&req[k], &res[k], sizeof req[k]) == 0, "answer %d differs from daemon_handle", k);
+        }
+
+        // A frame of the wrong length closes the connection.
+        eee_msg_t broken = req[0];
+        broken.len = 3;
+        char byte;
+        CHECK(write_full(fd, &broken, sizeof broken) && read(fd, &byte, 1) == 0,
+              "a frame of the wrong length did not close the connection");
+        close(fd);
+
+        // Other clients are still served.
+        fd = daemon_connect("eee.sock");
+        server_requests(req);
+        CHECK(fd >= 0 && write_full(fd, req, sizeof *req) && read_full(fd, res, sizeof *res) &&
+              res[0].status == EEE_ST_OK, "no answer on a new connection");
+        if (fd >= 0) close(fd);
+    }
+
+    int status = server_stop(pid);
+    CHECK(status == 0, "daemon exit status %d", status);
+    CHECK(access("eee.sock", F_OK) != 0, "the daemon left its socket behind");
+}
+
+// ------------------------------ HTTP ------------------------------
+
+static int http_child(void *lfd)
+{
+    return http_serve(*(int *)lfd);
+}
+
+typedef struct {
+    int fd;
+    size_t len;
+    char buf[1 << 16];                  // received and not yet returned, NUL-terminated
+} http_conn_t;
+
+// Reads the next response on a keep-alive connection into body (at most cap
+// - 1 bytes, NUL-terminated). Returns its status, or -1.
+static int http_next(http_conn_t *c, char *body, size_t cap)
+{
+    for (;;) {
+        char *end = strstr(c->buf, "\r\n\r\n");
+        const char *cl = end ? strstr(c->buf, "Content-Length: ") : NULL;
+        int status;
+        if (end && cl && cl < end && sscanf(c->buf, "HTTP/1.1 %d", &status) == 1) {
+            size_t head = (size_t)(end + 4 - c->buf), blen = strtoul(cl + 16, NULL, 10);
+            if (blen >= cap || head + blen >= sizeof c->buf) return -1;
+            if (c->len >= head + blen) {
+                memcpy(body, c->buf + head, blen);
+                body[blen] = '\0';
+                c->len -= head + blen;
+                memmove(c->buf, c->buf + head + blen, c->len + 1);
+                return status;
+            }
+        }
+        if (c->len + 1 >= sizeof c->buf) return -1;
+        ssize_t r = read(c->fd, c->buf + c->len, sizeof c->buf - 1 - c->len);
+        if (r <= 0) return -1;
+        c->len += (size_t)r;
+        c->buf[c->len] = '\0';
+    }
+}
+
+static void test_http(void)
+{
+    int port, lfd = http_listen(0, &port);
+    CHECK(lfd >= 0, "cannot listen on a local port");
+    if (lfd < 0) return;
+    pid_t pid = server_spawn(http_child, &lfd);
+    close(lfd);
+    CHECK(pid > 0, "fork failed");
+    if (pid <= 0) return;
+
+    static http_conn_t c;
+    struct sockaddr_in in;
+    memset(&in, 0, sizeof in);
+    in.sin_family = AF_INET;
+    in.sin_port = htons((unsigned short)port);
+    in.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    c.fd = socket(AF_INET, SOCK_STREAM, 0);
+    CHECK(c.fd >= 0 && connect(c.fd, (struct sockaddr *)&in, sizeof in) == 0, "cannot connect to port %d", port);
+
+    static const char batch[] = "[{\"formula\": \"power.p\", \"V\": 2, \"I\": 3},"
+                                " {\"formula\": \"rc.charge\", \"R\": -1, \"C\": 1, \"t\": 1},"
+                                " {\"formula\": \"nosuch\", \"x\": 1}]";
+    char req[2048];
+    int n = snprintf(req, sizeof req,
+                     "GET /rc.charge?R=1k&C=1u&t=1m HTTP/1.1\r\nHost: check\r\n\r\n"
+                     "POST /power.p HTTP/1.1\r\nContent-Length: 16\r\n\r\n{\"V\": 2, \"I\": 3}"
+                     "POST /batch HTTP/1.1\r\nContent-Length: %zu\r\n\r\n%s"
+                     "GET /nosuch?x=1 HTTP/1.1\r\n\r\n"
+                     "GET /rc.charge?R=1k HTTP/1.1\r\n\r\n"
+                     "GET /formulas HTTP/1.1\r\n\r\n",
+                     sizeof batch - 1, batch);
+    CHECK(c.fd >= 0 && write_full(c.fd, req, (size_t)n), "cannot send the requests");
+
+    static const struct {
+        int status;
+        const char *body;               // exact, or a part of it if it ends in "..."
+    } want[] = {
+        { 200, "{\"formula\":\"rc.charge\",\"solved\":\"charge\",\"unit\":\"%\",\"values\":"
+               "{\"charge\":63.212055882855765,\"R\":1000,\"C\":9.9999999999999995e-07,\"t\":0.001}}" },
+        { 200, "{\"formula\":\"power.p\",\"solved\":\"P\",\"unit\":\"W\",\"values\":{\"P\":6,\"V\":2,\"I\":3}}" },
+        { 200, "[{\"formula\":\"power.p\",\"solved\":\"P\",\"unit\":\"W\",\"values\":{\"P\":6,\"V\":2,\"I\":3}},"
+               "{\"error\":\"value out of range\"},{\"error\":\"unknown formula\"}]" },
+        { 404, "{\"error\":\"unknown formula\"}" },
+        { 400, "{\"error\":\"give all but one variable\"}" },
+        { 200, "[{\"name\":\"divider.vout\",\"equation\":\"Vout = Vin * R2 / (R1 + R2)\",..." },
+    };
+    static char body[1 << 15];
+    for (size_t k = 0; c.fd >= 0 && k < sizeof want / sizeof want[0]; ++k) {
+        int status = http_next(&c, body, sizeof body);
+        size_t len = strlen(want[k].body);
+        int prefix = len > 3 && strcmp(want[k].body + len - 3, "...") == 0;
+        CHECK(status == want[k].status &&
+              (prefix ? strncmp(body, want[k].body, len - 3) == 0 : strcmp(body, want[k].body) == 0),
+              "response %zu: %d %s\nexpected %d %s", k, status, status < 0 ? "" : body,
+              want[k].status, want[k].body);
+    }
+    if (c.fd >= 0) close(c.fd);
+
+    int status = server_stop(pid);
+    CHECK(status == 0, "HTTP server exit status %d", status);
+}
+
+// ------------------------------- SHM -------------------------------
+
+static const char *shm_name;
+static int shm_spin;
+
+static int shm_child(void *name)
+{
+    return shm_serve(name, shm_spin) == 0 ? 0 : 1;
+}
+
+// Client processes calling at once, and the calls each makes.
+enum { SHM_CLIENTS = 4, SHM_CALLS = 2000 };
+
+// One client process: solves P = V * I for values no other client uses.
+// Returns the number of wrong answers.
+static int shm_client_run(int id)
+{
+    char err[160];
+    shm_client_t *c = shm_connect(shm_name, shm_spin, err, sizeof err);
+    if (!c) return SHM_CALLS;
+    int wrong = 0;
+    for (int k = 0; k < SHM_CALLS; ++k) {
+        double v[] = { 0, (double)(id * SHM_CALLS + k), 0.5 };
+        eee_msg_t m = solve_msg((uint32_t)k, FORMULA_POWER, 0, v);
+        shm_call(c, &m);
+        wrong += m.status != EEE_ST_OK || m.id != (uint32_t)k || m.v[0] != v[1] * 0.5;
+    }
+    shm_disconnect(c);
+    return wrong;
+}
+
+static void shm_round_trips(int spin)
+{
+    char name[64];
+    snprintf(name, sizeof name, "eee_check_%d_%d", (int)getpid(), spin);
+    shm_name = name;
+    shm_spin = spin;
+    pid_t pid = server_spawn(shm_child, name);
+    CHECK(pid > 0, "fork failed");
+    if (pid <= 0) return;
+
+    shm_client_t *c = NULL;
+    char err[160] = "";
+    for (int tries = 0; !c && tries < 200; ++tries)
+        if (!(c = shm_connect(name, spin, err, sizeof err))) usleep(10000);
+    CHECK(c != NULL, "spin %d: %s", spin, err);
+
+    if (c) {
+        eee_msg_t req[SERVER_REQS], res[SERVER_REQS];
+        server_requests(req);
+        for (int k = 0; k < SERVER_REQS; ++k) {
+            res[k] = req[k];
+            shm_call(c, &res[k]);
+            daemon_handle(&req[k]);
+            CHECK(memcmp(&req[k], &res[k], sizeof req[k]) == 0, "spin %d: answer %d differs from daemon_handle",
+                  spin, k);
+        }
+        server_check(res, spin ? "shm (spinning)" : "shm");
+        shm_disconnect(c);
+
+        // A second server cannot take over a segment in use.
+        pid_t second = server_spawn(shm_child, name);
+        int status = -1;
+        if (second > 0) waitpid(second, &status, 0);
+        CHECK(second > 0 && WIFEXITED(status) && WEXITSTATUS(status) == 1,
+              "a second server started on a segment in use");
+
+        pid_t client[SHM_CLIENTS];
+        for (int id = 0; id < SHM_CLIENTS; ++id) {
+            fflush(stdout);
+            if ((client[id] = fork()) == 0) _exit(shm_client_run(id) ? 1 : 0);
+        }
+        for (int id = 0; id < SHM_CLIENTS; ++id) {
+            status = -1;
+            if (client[id] > 0) waitpid(client[id], &status, 0);
+            CHECK(client[id] > 0 && WIFEXITED(status) && WEXITSTATUS(status) == 0,
+                  "spin %d: client %d got wrong answers", spin, id);
+        }
+    }
+
+    int status = server_stop(pid);
+    CHECK(status == 0, "spin %d: shm server exit status %d", spin, status);
+    char path[96];
+    snprintf(path, sizeof path, "/dev/shm/%s", name);
+    CHECK(access(path, F_OK) != 0, "the server left %s behind", path);
+}
+
+// Both ways of waiting: futex only, and busy-polling first.
+static void test_shm(void)
+{
+    shm_round_trips(0);
+    shm_round_trips(1000);
+}
+
+// ------------------------------- MEMO -------------------------------
+
+// P = V * I for V = key, I = 2, through the cache. Returns the status.
+static int memo_power(double key, double *P)
+{
+    double v[FORMULA_MAX_VARS] = { 0, key, 2 };
+    int bad, cf;
+    int st = memo_solve(&FORMULAS[FORMULA_POWER], 0, v, 0.0, &bad, &cf);
+    *P = v[0];
+    return st;
+}
+
+static void test_memo(void)
+{
+    memo_stats_t st;
+    double P;
+
+    // EEE_MEMO sizes the cache on first use, rounded up to a power of two.
+    setenv("EEE_MEMO", "1000", 1);
+    memo_power(1, &P);
+    memo_stats(&st);
+    CHECK(st.capacity == 1024 && st.misses == 1, "EEE_MEMO=1000: capacity %zu, misses %llu", st.capacity, st.misses);
+    memo_configure(5);
+    memo_stats(&st);
+    CHECK(st.capacity == 8 && st.used == 0, "memo_configure(5): capacity %zu, used %zu", st.capacity, st.used);
+
+    // Eight answers fill it; asking again hits every one, with the same bits.
+    for (int k = 0; k < 8; ++k) memo_power(k + 1, &P);
+    memo_stats(&st);
+    CHECK(st.misses == 8 && st.hits == 0 && st.used == 8 && st.evictions == 0,
+          "filling: misses %llu, hits %llu, used %zu, evictions %llu", st.misses, st.hits, st.used, st.evictions);
+    for (int k = 0; k < 8; ++k)
+        CHECK(memo_power(k + 1, &P) == MEMO_OK && P == 2.0 * (k + 1), "key %d answered %g", k + 1, P);
+    memo_stats(&st);
+    CHECK(st.hits == 8 && st.misses == 8, "asking again: hits %llu, misses %llu", st.hits, st.misses);
+
+    // Full, with nothing used since it was stored except key 1: a new answer
+    // evicts another entry, and key 1 (second chance) is still there.
+    memo_configure(8);
+    for (int k = 0; k < 8; ++k) memo_power(k + 1, &P);
+    memo_power(1, &P);
+    memo_power(100, &P);
+    memo_stats(&st);
+    CHECK(st.evictions == 1 && st.used == 8, "one more answer: evictions %llu, used %zu", st.evictions, st.used);
+    unsigned long long hits = st.hits;
+    memo_power(1, &P);
+    memo_power(100, &P);
+    memo_stats(&st);
+    CHECK(st.hits == hits + 2, "key 1 (used since stored) or the new key was evicted");
+
+    // The table never grows: every new answer from here on evicts one.
+    for (int k = 0; k < 100; ++k) memo_power(1000 + k, &P);
+    memo_stats(&st);
+    CHECK(st.evictions == 101 && st.used == 8 && st.capacity == 8,
+          "100 more answers: evictions %llu, used %zu, capacity %zu", st.evictions, st.used, st.capacity);
+
+    // Errors are cached too, and so is which input was out of range.
+    const formula_t *rc = &FORMULAS[FORMULA_RC_CHARGE], *div = &FORMULAS[FORMULA_DIVIDER];
+    memo_configure(64);
+    for (int pass = 0; pass < 2; ++pass) {
+        double v[FORMULA_MAX_VARS] = { 0, 1000, -1e-6, 1e-3 }, w[FORMULA_MAX_VARS] = { 20, 12, 10e3, 0 };
+        int bad = -1, cf;
+        CHECK(memo_solve(rc, 0, v, 0.0, &bad, &cf) == MEMO_DOMAIN && bad == 2, "pass %d: C < 0 not out of range", pass);
+        CHECK(memo_solve(div, 3, w, 0.0, &bad, &cf) == MEMO_NOSOLUTION, "pass %d: Vout > Vin solved", pass);
+    }
+    memo_stats(&st);
+    CHECK(st.hits == 2 && st.misses == 2, "errors: hits %llu, misses %llu", st.hits, st.misses);
+
+    // Keys are bit patterns: -0 is not 0, and the hint is part of the key.
+    CHECK(memo_power(-0.0, &P) == MEMO_OK && signbit(P), "V = -0 answered %g", P);
+    CHECK(memo_power(0.0, &P) == MEMO_OK && !signbit(P), "V = 0 answered the cached -0");
+    double v[FORMULA_MAX_VARS] = { 0, 3, 2 };
+    int bad, cf;
+    memo_power(3, &P);
+    memo_stats(&st);
+    hits = st.hits;
+    memo_solve(&FORMULAS[FORMULA_POWER], 0, v, 1.0, &bad, &cf);
+    memo_power(3, &P);
+    memo_stats(&st);
+    CHECK(st.hits == hits + 1, "a different hint hit the cache, or the same one missed");
+
+    memo_configure(0);
+    memo_stats(&st);
+    CHECK(st.capacity == 0 && memo_power(4, &P) == MEMO_OK && P == 8, "with the cache off: capacity %zu, P %g",
+          st.capacity, P);
+}
+
+// ----------------------------- DCACHE -----------------------------
+
+// Calls so far of one probe.
+static uint64_t probe_calls(int probe)
+{
+    static stats_probe_t p[STAT_COUNT];
+    stats_read(p);
+    return p[probe].calls;
+}
+
+// 1 if `key` is cached with every byte equal to fill.
+static int dcache_holds(const char *key, size_t len, int fill)
+{
+    dcache_blob_t b;
+    if (!dcache_get("check", key, strlen(key), &b)) return 0;
+    int ok = b.len == len && ((uintptr_t)b.data & 7) == 0;
+    for (size_t k = 0; ok && k < len; ++k) ok = ((const unsigned char *)b.data)[k] == fill;
+    dcache_release(&b);
+    return ok;
+}
+
+// Runs a sweep and checks its text. Returns 1 if the answer came from the
+// cache (nothing was solved and nothing stored).
+static int dcache_sweep(const char *script, const char *want)
+{
+    uint64_t solves = probe_calls(STAT_FORMULA_BATCH), puts = probe_calls(STAT_DCACHE_PUT);
+    char err[200];
+    unsigned long long rows, unsolved;
+    char *csv = sweep_text(script, &rows, &unsolved, err, sizeof err);
+    CHECK(csv && strcmp(csv, want) == 0, "%s gave\n%s", script, csv ? csv : err);
+    free(csv);
+    return probe_calls(STAT_FORMULA_BATCH) == solves && probe_calls(STAT_DCACHE_PUT) == puts;
+}
+
+static void test_dcache(void)
+{
+    enum { KB = 1024 };
+    static unsigned char data[220 * KB];
+    size_t max_entry;
+
+    setenv("EEE_CACHE_DIR", "cache", 1);
+    setenv("EEE_CACHE_MB", "1", 1);
+    CHECK(dcache_enabled(&max_entry) && max_entry == 256 * KB, "cache off, or largest entry %zu", max_entry);
+
+    // Miss, store, hit; other kinds and keys (even a prefix) miss.
+    CHECK(!dcache_holds("a", 10, 'a'), "hit in an empty cache");
+    memset(data, 'a', sizeof data);
+    CHECK(dcache_put("check", "a", 1, data, 10) == 0, "cannot store");
+    CHECK(dcache_holds("a", 10, 'a'), "stored entry not found");
+    dcache_blob_t b;
+    CHECK(!dcache_get("other", "a", 1, &b) && !dcache_get("check", "ab", 2, &b) && !dcache_get("check", "", 0, &b),
+          "hit on another kind or key");
+    memset(data, 'A', sizeof data);
+    CHECK(dcache_put("check", "a", 1, data, 20) == 0 && dcache_holds("a", 20, 'A'), "entry not replaced");
+    CHECK(dcache_put("check", "big", 3, data, max_entry + 1) != 0, "stored more than the largest entry");
+
+    // Past 1 MB the least recently used entries go: after a, b, c, d, reading
+    // a makes b the oldest, and storing e deletes b only. (Entries are aged
+    // by mtime, which may only tick every few ms.)
+    const char *keys = "abcde";
+    for (int k = 0; k < 5; ++k) {
+        char key[2] = { keys[k], 0 };
+        memset(data, key[0], sizeof data);
+        usleep(20000);
+        if (k == 4) {
+            CHECK(dcache_holds("a", sizeof data, 'a'), "a is gone before the cache is full");
+            usleep(20000);
+        }
+        CHECK(dcache_put("check", key, 1, data, sizeof data) == 0, "cannot store %s", key);
+    }
+    CHECK(!dcache_holds("b", sizeof data, 'b'), "the least recently used entry was kept");
+    for (int k = 0; k < 5; ++k) {
+        char key[2] = { keys[k], 0 };
+        if (k != 1) CHECK(dcache_holds(key, sizeof data, key[0]), "%s was deleted", key);
+    }
+
+    // Sweeps: the first run is solved and stored, a rerun (however its
+    // numbers are written) is copied from the cache, another sweep is not.
+    const char *s1 = "sweep R1 in 1k, 2k; eval parallel.req(R2=1k)";
+    const char *s2 = "sweep R1 in 1000, 2000 ; eval parallel.req(R2 = 1000)";
+    const char *want = "R1,Req\n1000,500\n2000,666.666667\n";
+    CHECK(!dcache_sweep(s1, want), "first run of a sweep came from the cache");
+    CHECK(dcache_sweep(s1, want), "rerun of a sweep was not a hit");
+    CHECK(dcache_sweep(s2, want), "the same sweep written differently was not a hit");
+    CHECK(!dcache_sweep("sweep R1 in 1k, 3k; eval parallel.req(R2=1k)", "R1,Req\n1000,500\n3000,750\n"),
+          "a different sweep came from the cache");
+
+    // A damaged entry is a miss: the sweep is solved again and stored again.
+    DIR *d = opendir("cache");
+    struct dirent *de;
+    int damaged = 0;
+    while (d && (de = readdir(d))) {
+        char path[600];
+        snprintf(path, sizeof path, "cache/%s", de->d_name);
+        if (strncmp(de->d_name, "sweep-", 6) == 0) damaged += truncate(path, 40) == 0;
+    }
+    if (d) closedir(d);
+    CHECK(damaged == 2, "%d sweep entries on disk, expected 2", damaged);
+    CHECK(!dcache_sweep(s1, want), "a damaged entry was used");
+    CHECK(dcache_sweep(s1, want), "the entry was not stored again");
+}
+
+// ---------------------------- WORKSHEET ----------------------------
+
+static double ws_get(const worksheet_t *ws, const char *name)
+{
+    int c = ws_find(ws, name);
+    return c < 0 ? NAN : ws_value(ws, c);
+}
+
+// Sets a cell and checks that exactly the cells in `want` (space separated,
+// in that order) were recomputed.
+static void ws_expect(worksheet_t *ws, const char *name, const char *text, const char *want)
+{
+    char err[200] = "", got[200] = "";
+    long n = ws_set(ws, name, text, err, sizeof err);
+    size_t m = 0;
+    const int *cells = ws_last_update(ws, &m);
+    for (size_t k = 0; n > 0 && k < m; ++k)
+        snprintf(got + strlen(got), sizeof got - strlen(got), "%s%s", k ? " " : "", ws_name(ws, cells[k]));
+    CHECK(n == (long)m && strcmp(got, want) == 0, "%s = %s recomputed \"%s\" (%ld), expected \"%s\" %s",
+          name, text, got, n, want, err);
+}
+
+static void test_worksheet(void)
+{
+    worksheet_t *ws = ws_new();
+    CHECK(ws != NULL, "out of memory");
+    if (!ws) return;
+    char err[200];
+
+    ws_expect(ws, "Vin", "12", "Vin");
+    ws_expect(ws, "R1", "10k", "R1");
+    ws_expect(ws, "R2", "10k", "R2");
+    ws_expect(ws, "Vout", "Vin * R2 / (R1 + R2)", "Vout");
+    ws_expect(ws, "P", "Vout ^ 2 / R2", "P");
+    ws_expect(ws, "X", "5", "X");
+    CHECK(ws_get(ws, "Vout") == 6 && close_to(ws_get(ws, "P"), 3.6e-3, 1e-15), "Vout %g, P %g",
+          ws_get(ws, "Vout"), ws_get(ws, "P"));
+
+    // An edit reaches its dependents and nothing else.
+    ws_expect(ws, "R1", "30k", "R1 Vout P");
+    CHECK(ws_get(ws, "Vout") == 3 && close_to(ws_get(ws, "P"), 9e-4, 1e-15), "after R1 = 30k: Vout %g, P %g",
+          ws_get(ws, "Vout"), ws_get(ws, "P"));
+    ws_expect(ws, "X", "7", "X");
+
+    // A diamond: D is computed once, after both B and C.
+    ws_expect(ws, "A", "1", "A");
+    ws_expect(ws, "B", "A * 2", "B");
+    ws_expect(ws, "C", "A + 1", "C");
+    ws_expect(ws, "D", "B + C", "D");
+    char err2[200], got[64] = "";
+    long n = ws_set(ws, "A", "2", err2, sizeof err2);
+    size_t m;
+    const int *cells = ws_last_update(ws, &m);
+    for (size_t k = 0; k < m; ++k) strncat(got, ws_name(ws, cells[k]), sizeof got - strlen(got) - 1);
+    CHECK(n == 4 && (strcmp(got, "ABCD") == 0 || strcmp(got, "ACBD") == 0) && ws_get(ws, "D") == 7,
+          "A = 2 recomputed %s, D = %g", got, ws_get(ws, "D"));
+
+    // A cell whose value does not change stops the update there.
+    ws_expect(ws, "K", "1", "K");
+    ws_expect(ws, "L", "K - K", "L");
+    ws_expect(ws, "M", "L + 1", "M");
+    ws_expect(ws, "K", "2", "K L");
+
+    // Forward references read as nan until the cell is defined.
+    ws_expect(ws, "E", "F * 2", "E");
+    CHECK(isnan(ws_get(ws, "E")), "E = F * 2 before F: %g", ws_get(ws, "E"));
+    ws_expect(ws, "F", "1.5", "F E");
+    CHECK(ws_get(ws, "E") == 3, "E = %g after F = 1.5", ws_get(ws, "E"));
+
+    // Cycles and bad formulas are rejected and change nothing.
+    CHECK(ws_set(ws, "A", "D + 1", err, sizeof err) < 0 && strstr(err, "circular reference"),
+          "A = D + 1 accepted (%s)", err);
+    CHECK(ws_set(ws, "A", "A", err, sizeof err) < 0, "A = A accepted");
+    CHECK(ws_set(ws, "B", "A * (2", err, sizeof err) < 0, "B = A * (2 accepted");
+    CHECK(ws_kind(ws, ws_find(ws, "A")) == WS_VALUE && ws_get(ws, "A") == 2 &&
+          strcmp(ws_text(ws, ws_find(ws, "B")), "A * 2") == 0, "a rejected edit changed the worksheet");
+    n = ws_set(ws, "A", "4", err, sizeof err);
+    CHECK(n == 4 && ws_get(ws, "D") == 13, "A = 4 after rejected edits: %ld recomputed, D = %g", n, ws_get(ws, "D"));
+
+    // A formula replaced by a value no longer follows its old inputs.
+    ws_expect(ws, "Vout", "1", "Vout P");
+    ws_expect(ws, "Vin", "24", "Vin");
+    CHECK(close_to(ws_get(ws, "P"), 1e-4, 1e-15), "P = %g after Vout = 1", ws_get(ws, "P"));
+
+    ws_free(ws);
+}
+
+// ----------------------------- SNAPSHOT -----------------------------
+
+// Copies a file, keeping only its first `keep` bytes (all of it if 0) and
+// then overwriting `n` bytes at `at` with `patch` (if n > 0).
+static int copy_file(const char *from, const char *to, size_t keep, size_t at, const void *patch, size_t n)
+{
+    FILE *in = fopen(from, "rb"), *out = fopen(to, "wb");
+    int ok = in && out;
+    int ch;
+    for (size_t k = 0; ok && (keep == 0 || k < keep) && (ch = fgetc(in)) != EOF; ++k)
+        ok = fputc(k >= at && k < at + n ? ((const unsigned char *)patch)[k - at] : ch, out) != EOF;
+    if (in) fclose(in);
+    if (out && fclose(out) != 0) ok = 0;
+    return ok;
+}
+
+// The session saved by test_snapshot(), whichever way it was loaded.
+static void snapshot_check(const char *how)
+{
+    worksheet_t *ws = session_worksheet();
+    CHECK(ws && ws_count(ws) == 5 && ws_find(ws, "Z") < 0, "%s: %d cells", how, ws ? ws_count(ws) : -1);
+    if (!ws) return;
+    CHECK(ws_get(ws, "Vout") == 6 && close_to(ws_get(ws, "P"), 3.6e-3, 1e-15) &&
+          strcmp(ws_text(ws, ws_find(ws, "Vout")), "Vin * R2 / (R1 + R2)") == 0,
+          "%s: Vout %g, P %g", how, ws_get(ws, "Vout"), ws_get(ws, "P"));
+    const session_result_t *r = session_recent(0);
+    CHECK(r && strcmp(r->formula, "rc.charge") == 0 && r->var == 0 && r->v[1] == 1000 && !session_recent(1),
+          "%s: recent results not restored", how);
+
+    // The loaded worksheet takes edits: dependents follow, new cells work.
+    char err[200];
+    long n = ws_set(ws, "R1", "30k", err, sizeof err);
+    CHECK(n == 3 && ws_get(ws, "Vout") == 3, "%s: R1 = 30k recomputed %ld, Vout %g", how, n, ws_get(ws, "Vout"));
+    n = ws_set(ws, "Q", "P * 2", err, sizeof err);
+    CHECK(n == 1 && close_to(ws_get(ws, "Q"), 1.8e-3, 1e-15), "%s: new cell Q = %g", how, ws_get(ws, "Q"));
+}
+
+static void test_snapshot(void)
+{
+    char err[200];
+    worksheet_t *ws = session_worksheet();
+    CHECK(ws != NULL, "out of memory");
+    if (!ws) return;
+    const char *cells[] = { "Vin = 12", "R1 = 10k", "R2 = 10k", "Vout = Vin * R2 / (R1 + R2)", "P = Vout ^ 2 / R2" };
+    for (size_t k = 0; k < sizeof cells / sizeof cells[0]; ++k) ws_assign(ws, cells[k], err, sizeof err);
+    double v[FORMULA_MAX_VARS] = { 63.2120558828558, 1000, 1e-6, 1e-3 };
+    session_note(&FORMULAS[FORMULA_RC_CHARGE], 0, v);
+    CHECK(session_save("ws.eee", err, sizeof err) == 0, "save: %s", err);
+
+    // Changes made after the save are gone once it is loaded.
+    ws_set(ws, "R1", "1", err, sizeof err);
+    ws_set(ws, "Z", "1", err, sizeof err);
+    session_note(&FORMULAS[FORMULA_POWER], 0, v);
+
+    // At the address it was laid out for, then elsewhere (that address is
+    // now in use), then as written by another build (cells re-entered).
+    CHECK(session_load("ws.eee", err, sizeof err) == 0, "load: %s", err);
+    snapshot_check("in place");
+    CHECK(session_load("ws.eee", err, sizeof err) == 0, "second load: %s", err);
+    snapshot_check("relocated");
+    static const char other_build[32] = "another build";
+    CHECK(copy_file("ws.eee", "other.eee", 0, 8, other_build, sizeof other_build), "cannot copy ws.eee");
+    CHECK(session_load("other.eee", err, sizeof err) == 0, "load from another build: %s", err);
+    snapshot_check("another build");
+
+    // Damaged or missing files are refused and leave the session as it was.
+    struct stat st;
+    CHECK(stat("ws.eee", &st) == 0 && copy_file("ws.eee", "short.eee", (size_t)st.st_size - 8, 0, NULL, 0),
+          "cannot copy ws.eee");
+    CHECK(session_load("short.eee", err, sizeof err) != 0 && strstr(err, "damaged"), "a truncated file loaded");
+    CHECK(session_load("missing.eee", err, sizeof err) != 0, "a missing file loaded");
+    CHECK(session_load("ws.eee.none", err, sizeof err) != 0 && ws_get(session_worksheet(), "Q") > 0 &&
+          ws_get(session_worksheet(), "Vout") == 3, "a failed load changed the session");
+
+    // main.out loads EEE_WORKSPACE at start-up and saves it on Quit.
+    setenv("EEE_WORKSPACE", "ws.eee", 1);
+    int status = run_main("7\n", "menu.txt");
+    char *menu = read_text("menu.txt");
+    CHECK(status == 0 && menu && strstr(menu, "Workspace ws.eee: 5 cell(s), 1 recent result(s), loaded in") &&
+          strstr(menu, "Workspace saved to ws.eee"), "main.out with EEE_WORKSPACE printed\n%s",
+          menu ? menu : "(nothing)");
+    free(menu);
+    CHECK(session_load("ws.eee", err, sizeof err) == 0, "load after main.out saved: %s", err);
+    snapshot_check("saved by main.out");
+}
+
+// ------------------------------ MAIN ------------------------------
+
+static const struct {
+    const char *name;
+    void (*run)(void);
+} TESTS[] = {
+    { "batch",     test_batch },
+    { "batch_csv", test_batch_csv },
+    { "jit",       test_jit },
+    { "sweep",     test_sweep },
+    { "daemon",    test_daemon },
+    { "http",      test_http },
+    { "shm",       test_shm },
+    { "memo",      test_memo },
+    { "dcache",    test_dcache },
+    { "worksheet", test_worksheet },
+    { "snapshot",  test_snapshot },
+};
+#define NTESTS (int)(sizeof TESTS / sizeof TESTS[0])
+
+// Deletes a directory and everything in it.
+static void remove_tree(const char *path)
+{
+    DIR *d = opendir(path);
+    struct dirent *de;
+    char sub[PATH_MAX];
+    while (d && (de = readdir(d))) {
+        if (strcmp(de->d_name, ".") == 0 || strcmp(de->d_name, "..") == 0) continue;
+        snprintf(sub, sizeof sub, "%s/%s", path, de->d_name);
+        struct stat st;
+        if (lstat(sub, &st) == 0 && S_ISDIR(st.st_mode)) remove_tree(sub);
+        else unlink(sub);
+    }
+    if (d) closedir(d);
+    rmdir(path);
+}
+
+// Runs test k in a child process, in its own directory under the scratch
+// directory. Returns 1 if it passed.
+static int run_test(int k)
+{
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid < 0) { printf("Error: fork failed.\n"); return 0; }
+    if (pid == 0) {
+        if (mkdir(TESTS[k].name, 0700) != 0 || chdir(TESTS[k].name) != 0) _exit(2);
+        alarm(60);                      // a server that never answers fails the test
+        TESTS[k].run();
+        fflush(stdout);
+        _exit(check_failed ? 1 : 0);
+    }
+
+    int status;
+    while (waitpid(pid, &status, 0) < 0 && errno == EINTR) {}
+    if (WIFEXITED(status) && WEXITSTATUS(status) == 0) { printf("PASS %s\n", TESTS[k].name); return 1; }
+    if (WIFSIGNALED(status)) printf("FAIL %s (signal %d)\n", TESTS[k].name, WTERMSIG(status));
+    else printf("FAIL %s\n", TESTS[k].name);
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    for (int a = 1; a < argc; ++a) {
+        int found = 0;
+        for (int k = 0; k < NTESTS; ++k) found |= strcmp(argv[a], TESTS[k].name) == 0;
+        if (!found) {
+            printf("Usage: %s [test ...]\nTests:", argv[0]);
+            for (int k = 0; k < NTESTS; ++k) printf(" %s", TESTS[k].name);
+            printf("\n");
+            return 1;
+        }
+    }
+
+    if (!realpath("main.out", check_main)) check_main[0] = '\0';
+    static const char *const env[] = { "EEE_MEMO", "EEE_CACHE_DIR", "EEE_CACHE_MB", "EEE_WORKSPACE",
+                                       "EEE_NO_JIT", "EEE_METRICS" };
+    for (size_t k = 0; k < sizeof env / sizeof env[0]; ++k) unsetenv(env[k]);
+
+    char dir[] = "/tmp/eee_check_XXXXXX";
+    if (!mkdtemp(dir) || chdir(dir) != 0) {
+        printf("Error: cannot create a scratch directory: %s.\n", strerror(errno));
+        return 1;
+    }
+
+    int passed = 0, ran = 0;
+    for (int k = 0; k < NTESTS; ++k) {
+        int wanted = argc == 1;
+        for (int a = 1; a < argc; ++a) wanted |= strcmp(argv[a], TESTS[k].name) == 0;
+        if (!wanted) continue;
+        passed += run_test(k);
+        ran++;
+    }
+
+    remove_tree(dir);
+    printf("%d of %d test(s) passed\n", passed, ran);
+    return passed == ran ? 0 : 1;
+}
@@ -0,0 +1,247 @@
+// Unix-socket calculation daemon.
+// Design notes:
+// One thread, one epoll set, non-blocking sockets. Each connection has an
+// input and an output buffer: every complete request frame in the input is
+// answered straight into the output, and the output is flushed with as few
+// send() calls as possible, so pipelined requests cost one system call per
+// batch rather than per calculation. When a client stops reading and its
+// output buffer fills, the daemon stops reading from it too (backpressure).
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/epoll.h>
+#include "daemon.h"
+#include "funcs.h"
+#include "memo.h"
+#include "stats.h"
+
+#define CONN_BUF   (64 * 1024)
+#define MAX_EVENTS 64
+
+typedef struct {
+    int fd;
+    unsigned events;                    // epoll interest currently registered
+    int eof;                            // client stopped sending: answer, then close
+    size_t inlen;
+    size_t outpos, outlen;
+    unsigned char in[CONN_BUF];
+    unsigned char out[CONN_BUF];
+} conn_t;
+
+static volatile sig_atomic_t daemon_stop;
+
+static void daemon_signal(int sig)
+{
+    (void)sig;
+    daemon_stop = 1;
+}
+
+void daemon_handle(eee_msg_t *msg)
+{
+    STATS_SCOPE(STAT_REQUEST);
+    if (msg->op == EEE_OP_PING) { msg->status = EEE_ST_OK; return; }
+    if (msg->op != EEE_OP_SOLVE || msg->formula >= FORMULA_COUNT) { msg->status = EEE_ST_BADREQ; return; }
+
+    const formula_t *fm = &FORMULAS[msg->formula];
+    if (msg->nvars != fm->nvars || msg->var >= fm->nvars) { msg->status = EEE_ST_BADREQ; return; }
+
+    int bad, cf;
+    switch (memo_solve(fm, msg->var, msg->v, msg->v[msg->var], &bad, &cf)) {
+        case MEMO_OK:     msg->status = EEE_ST_OK; break;
+        case MEMO_DOMAIN: msg->status = EEE_ST_DOMAIN; break;
+        default:          msg->status = EEE_ST_NOSOLUTION; break;
+    }
+}
+
+// Answers every complete frame that fits in the output buffer.
+// Returns -1 if the client broke the framing.
+static int conn_process(conn_t *c, unsigned long long *requests)
+{
+    size_t pos = 0;
+    eee_msg_t msg;
+
+    if (c->outpos > 0) {
+        memmove(c->out, c->out + c->outpos, c->outlen - c->outpos);
+        c->outlen -= c->outpos;
+        c->outpos = 0;
+    }
+    while (c->inlen - pos >= sizeof msg && CONN_BUF - c->outlen >= sizeof msg) {
+        memcpy(&msg, c->in + pos, sizeof msg);
+        if (msg.len != EEE_MSG_LEN) return -1;
+        daemon_handle(&msg);
+        memcpy(c->out + c->outlen, &msg, sizeof msg);
+        c->outlen += sizeof msg;
+        pos += sizeof msg;
+        (*requests)++;
+    }
+    memmove(c->in, c->in + pos, c->inlen - pos);
+    c->inlen -= pos;
+    return 0;
+}
+
+// Sends as much pending output as the socket takes. Returns -1 on error.
+static int conn_flush(conn_t *c)
+{
+    while (c->outpos < c->outlen) {
+        ssize_t n = send(c->fd, c->out + c->outpos, c->outlen - c->outpos, MSG_NOSIGNAL);
+        if (n < 0) return (errno == EAGAIN || errno == EWOULDBLOCK) ? 0 : -1;
+        c->outpos += (size_t)n;
+    }
+    c->outpos = c->outlen = 0;
+    return 0;
+}
+
+// Reads while there is room to answer, writes while there is output.
+static void conn_update(int ep, conn_t *c)
+{
+    unsigned want = 0;
+    if (!c->eof && c->inlen < CONN_BUF && CONN_BUF - c->outlen >= sizeof(eee_msg_t)) want |= EPOLLIN;
+    if (c->outpos < c->outlen) want |= EPOLLOUT;
+    if (want == c->events) return;
+
+    struct epoll_event ev = { .events = want, .data.ptr = c };
+    epoll_ctl(ep, EPOLL_CTL_MOD, c->fd, &ev);
+    c->events = want;
+}
+
+static int set_nonblocking(int fd)
+{
+    int flags = fcntl(fd, F_GETFL, 0);
+    return flags < 0 ? -1 : fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+}
+
+int daemon_run(const char *path)
+{
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof addr);
+    addr.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof addr.sun_path) { printf("Error: socket path too long.\n"); return -1; }
+    strcpy(addr.sun_path, path);
+
+    // A socket left by an earlier run is replaced; any other file is not ours.
+    struct stat st;
+    if (lstat(path, &st) == 0) {
+        if (!S_ISSOCK(st.st_mode)) {
+            printf("Error: '%s' exists and is not a socket.\n", path);
+            return -1;
+        }
+        unlink(path);
+    }
+
+    int lfd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (lfd < 0) { printf("Error: socket: %s.\n", strerror(errno)); return -1; }
+    if (bind(lfd, (struct sockaddr *)&addr, sizeof addr) != 0 || listen(lfd, 128) != 0 ||
+        set_nonblocking(lfd) != 0) {
+        printf("Error: cannot listen on '%s': %s.\n", path, strerror(errno));
+        close(lfd);
+        return -1;
+    }
+
+    int ep = epoll_create1(0);
+    struct epoll_event ev = { .events = EPOLLIN, .data.ptr = NULL };   // NULL = listener
+    if (ep < 0 || epoll_ctl(ep, EPOLL_CTL_ADD, lfd, &ev) != 0) {
+        printf("Error: epoll: %s.\n", strerror(errno));
+        close(lfd);
+        unlink(path);
+        return -1;
+    }
+
+    struct sigaction sa;
+    memset(&sa, 0, sizeof sa);
+    sa.sa_handler = daemon_signal;
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+    daemon_stop = 0;
+
+    printf("Listening on %s (Ctrl+C to stop)\n", path);
+    fflush(stdout);
+
+    unsigned long long requests = 0, connections = 0;
+    struct epoll_event evs[MAX_EVENTS];
+
+    while (!daemon_stop) {
+        int n;
+        {
+            STATS_SCOPE(STAT_QUEUE_WAIT);
+            n = epoll_wait(ep, evs, MAX_EVENTS, -1);
+        }
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            printf("Error: epoll_wait: %s.\n", strerror(errno));
+            break;
+        }
+
+        for (int k = 0; k < n; ++k) {
+            conn_t *c = evs[k].data.ptr;
+
+            if (!c) {
+                int fd;
+                while ((fd = accept(lfd, NULL, NULL)) >= 0) {
+                    conn_t *nc = malloc(sizeof *nc);
+                    if (!nc || set_nonblocking(fd) != 0) { free(nc); close(fd); continue; }
+                    nc->fd = fd;
+                    nc->events = EPOLLIN;
+                    nc->eof = 0;
+                    nc->inlen = nc->outpos = nc->outlen = 0;
+                    struct epoll_event cev = { .events = EPOLLIN, .data.ptr = nc };
+                    if (epoll_ctl(ep, EPOLL_CTL_ADD, fd, &cev) != 0) { free(nc); close(fd); continue; }
+                    connections++;
+                }
+                continue;
+            }
+
+            int dead = (evs[k].events & (EPOLLERR | EPOLLHUP)) && !(evs[k].events & EPOLLIN);
+            if (!dead && (evs[k].events & EPOLLIN)) {
+                ssize_t got = read(c->fd, c->in + c->inlen, CONN_BUF - c->inlen);
+                if (got > 0) c->inlen += (size_t)got;
+                else if (got == 0) c->eof = 1;
+                else if (errno != EAGAIN && errno != EINTR) dead = 1;
+            }
+            // Answer and send until the socket is full or no whole frame is
+            // left. After the client's FIN nothing more can arrive, so the
+            // connection closes once every answer is out.
+            while (!dead) {
+                size_t had = c->inlen;
+                dead = conn_process(c, &requests) != 0 || conn_flush(c) != 0;
+                if (c->outlen > 0 || c->inlen == had) break;
+            }
+            if (!dead && c->eof && c->outlen == 0) dead = 1;
+
+            if (dead) {
+                close(c->fd);               // also removes it from the epoll set
+                free(c);
+            }
+            else {
+                conn_update(ep, c);
+            }
+        }
+    }
+
+    close(ep);
+    close(lfd);
+    unlink(path);
+    printf("\nStopped: %llu connection(s), %llu request(s)\n", connections, requests);
+    memo_print();
+
+    char line[256];
+    snprintf(line, sizeof line, "Daemon: %.150s, connections=%llu, requests=%llu", path, connections, requests);
+    log_line(line);
+    return 0;
+}
+
+int daemon_cli(int argc, char **argv)
+{
+    if (argc != 3) {
+        printf("Usage: %s --daemon SOCKET_PATH\n", argv[0]);
+        return 1;
+    }
+    return daemon_run(argv[2]) == 0 ? 0 : 1;
+}
@@ -0,0 +1,55 @@
+// Calculation daemon for the EEE Helper CLI calculator.
+// "main.out --daemon PATH" listens on a Unix domain socket and answers
+// registry solves (formulas.h) over a compact binary protocol, so a test rig
+// can issue thousands of calculations per second without the menu.
+//
+// Protocol: a stream of fixed-layout frames in host byte order, the same for
+// requests and responses. len counts the bytes after itself. A client may
+// send any number of requests before reading (pipelining); responses come
+// back in request order with the same id.
+//
+//   request:  op = EEE_OP_SOLVE, formula = index into FORMULAS, var = the
+//             variable to solve for, nvars = FORMULAS[formula].nvars,
+//             v = all variables (v[var] is used as a starting hint, or 0)
+//   response: status, and v with v[var] solved (unchanged on error)
+//
+// EEE_OP_PING is answered with status EEE_OK and nothing else. A frame with
+// the wrong length closes the connection; any other bad field gets
+// EEE_ST_BADREQ.
+//
+// With EEE_MEMO=<entries> set, repeated requests are answered from an
+// in-process cache (memo.h).
+
+#ifndef DAEMON_H
+#define DAEMON_H
+
+#include <stdint.h>
+#include "formulas.h"
+
+enum { EEE_OP_SOLVE = 1, EEE_OP_PING = 2 };
+enum { EEE_ST_OK = 0, EEE_ST_BADREQ = 1, EEE_ST_DOMAIN = 2, EEE_ST_NOSOLUTION = 3 };
+
+typedef struct {
+    uint32_t len;                       // sizeof(eee_msg_t) - 4
+    uint32_t id;                        // chosen by the client, echoed back
+    uint8_t  op;
+    uint8_t  formula;
+    uint8_t  var;
+    uint8_t  nvars;
+    int32_t  status;                    // response only
+    double   v[FORMULA_MAX_VARS];
+} eee_msg_t;
+
+#define EEE_MSG_LEN ((uint32_t)(sizeof(eee_msg_t) - 4))
+
+// Answers one request in place (turns msg into its response).
+void daemon_handle(eee_msg_t *msg);
+
+// Serves on a Unix socket at path until SIGINT or SIGTERM.
+// Returns 0 on a clean shutdown, -1 if the socket cannot be set up.
+int daemon_run(const char *path);
+
+// Command line: "main.out --daemon PATH".
+int daemon_cli(int argc, char **argv);
+
+#endif
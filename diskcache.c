@@ -0,0 +1,274 @@
+// Content-addressed on-disk result cache.
+// Design notes:
+// One file per result, named KIND-HASH.bin, where HASH is a 64-bit FNV-1a
+// of the source checksum, the kind and the job key. The file is a fixed header,
+// the full key (so a hash collision is a miss, not a wrong answer) and the
+// payload at an 8-byte aligned offset; a hit maps the file and hands out a
+// pointer into it, with no parsing or copying.
+// Writers build the file under a temporary name and rename() it into place,
+// so readers in other processes see either the old file or the new one,
+// never a partial one. A hit touches the file's mtime; eviction deletes the
+// oldest files first under an flock() on the directory's lock file, so two
+// processes never trim at the same time. Deleting a file that another
+// process still has mapped is safe: its mapping stays valid.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "diskcache.h"
+#include "stats.h"
+
+#define DCACHE_MAGIC   0x43444545u      // "EEDC"
+#define DCACHE_VERSION 1
+
+// Results are only reused by a program built from the same sources: the
+// Makefile passes a checksum of them as EEE_SOURCE_HASH. A build without it
+// stores results but never reads any back. DCACHE_VERSION covers the layout
+// of the file itself.
+#ifdef EEE_SOURCE_HASH
+static const char DCACHE_BUILD[32] = EEE_SOURCE_HASH;
+#else
+static const char DCACHE_BUILD[32] = "";
+#endif
+
+typedef struct {
+    uint32_t magic, version;
+    char build[32];
+    uint64_t keylen, datalen;
+    uint64_t data_off;                  // from the start of the file
+} dcache_hdr_t;
+
+#define DCACHE_MAX_MB (1ul << 20)       // 1 TiB; keeps the byte count in range
+
+static int dcache_state = -1;           // -1 = not read from the environment yet
+static char dcache_dir[512];
+static size_t dcache_max;
+
+// EEE_CACHE_MB: a plain decimal size; anything else leaves the cache off.
+static size_t dcache_env_mb(void)
+{
+    const char *env = getenv("EEE_CACHE_MB");
+    if (!env || !*env) return 256;
+
+    char *end = NULL;
+    errno = 0;
+    unsigned long long mb = strtoull(env, &end, 10);
+    if (*env < '0' || *env > '9' || *end != '\0') {
+        printf("Error: EEE_CACHE_MB must be a number of megabytes, not '%s' (cache off).\n", env);
+        return 0;
+    }
+    if (errno == ERANGE || mb > DCACHE_MAX_MB) {
+        printf("EEE_CACHE_MB=%s is more than %lu MB; using %lu.\n", env, DCACHE_MAX_MB, DCACHE_MAX_MB);
+        return DCACHE_MAX_MB;
+    }
+    return (size_t)mb;
+}
+
+static int dcache_init(void)
+{
+    if (dcache_state >= 0) return dcache_state;
+    dcache_state = 0;
+
+    const char *dir = getenv("EEE_CACHE_DIR");
+    if (!dir || !*dir || strlen(dir) >= sizeof dcache_dir - 64) return 0;
+    if (mkdir(dir, 0700) != 0 && errno != EEXIST) return 0;
+    snprintf(dcache_dir, sizeof dcache_dir, "%s", dir);
+
+    dcache_max = dcache_env_mb() << 20;
+    dcache_state = dcache_max > 0;
+    return dcache_state;
+}
+
+int dcache_enabled(size_t *max_entry)
+{
+    int on = dcache_init();
+    if (max_entry) *max_entry = on ? dcache_max / 4 : 0;
+    return on;
+}
+
+static uint64_t fnv1a(uint64_t h, const void *p, size_t n)
+{
+    const unsigned char *b = p;
+    for (size_t k = 0; k < n; ++k) h = (h ^ b[k]) * 0x100000001B3ull;
+    return h;
+}
+
+static void dcache_path(char *path, size_t size, const char *kind, const void *key, size_t keylen)
+{
+    uint64_t h = 0xCBF29CE484222325ull;
+    h = fnv1a(h, DCACHE_BUILD, sizeof DCACHE_BUILD);
+    h = fnv1a(h, kind, strlen(kind) + 1);
+    h = fnv1a(h, key, keylen);
+    snprintf(path, size, "%s/%s-%016llx.bin", dcache_dir, kind, (unsigned long long)h);
+}
+
+int dcache_get(const char *kind, const void *key, size_t keylen, dcache_blob_t *b)
+{
+    memset(b, 0, sizeof *b);
+    if (!dcache_init()) return 0;
+    STATS_SCOPE(STAT_DCACHE_GET);
+
+    char path[800];
+    dcache_path(path, sizeof path, kind, key, keylen);
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return 0;
+
+    struct stat st;
+    void *map = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && (size_t)st.st_size >= sizeof(dcache_hdr_t))
+        map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    if (map == MAP_FAILED) { close(fd); return 0; }
+
+    const dcache_hdr_t *h = map;
+    size_t size = (size_t)st.st_size;
+    int ok = h->magic == DCACHE_MAGIC && h->version == DCACHE_VERSION && DCACHE_BUILD[0] &&
+             memcmp(h->build, DCACHE_BUILD, sizeof h->build) == 0 &&
+             h->keylen == keylen && sizeof *h + keylen <= h->data_off &&
+             h->data_off <= size && h->datalen == size - h->data_off &&
+             memcmp((const char *)map + sizeof *h, key, keylen) == 0;
+    if (!ok) { munmap(map, size); close(fd); return 0; }
+
+    futimens(fd, NULL);                 // most recently used
+    close(fd);
+    b->map = map;
+    b->maplen = size;
+    b->data = (const char *)map + h->data_off;
+    b->len = h->datalen;
+    return 1;
+}
+
+void dcache_release(dcache_blob_t *b)
+{
+    if (b->map) munmap(b->map, b->maplen);
+    memset(b, 0, sizeof *b);
+}
+
+typedef struct {
+    char name[256];
+    off_t size;
+    struct timespec mtime;
+} dcache_file_t;
+
+static int cmp_mtime(const void *a, const void *b)
+{
+    const struct timespec *x = &((const dcache_file_t *)a)->mtime, *y = &((const dcache_file_t *)b)->mtime;
+    if (x->tv_sec != y->tv_sec) return x->tv_sec < y->tv_sec ? -1 : 1;
+    return (x->tv_nsec > y->tv_nsec) - (x->tv_nsec < y->tv_nsec);
+}
+
+// Deletes the least recently used entries until the cache is down to 7/8 of
+// its bound (so the next puts do not rescan at once) and stores the exact
+// total in the lock file. The caller holds the lock.
+static void dcache_trim(int lock)
+{
+    char path[800];
+    DIR *d = opendir(dcache_dir);
+    dcache_file_t *files = NULL;
+    size_t n = 0, cap = 0;
+    unsigned long long total = 0;
+    struct dirent *de;
+    while (d && (de = readdir(d))) {
+        size_t len = strlen(de->d_name);
+        struct stat st;
+        snprintf(path, sizeof path, "%s/%s", dcache_dir, de->d_name);
+        if (strncmp(de->d_name, "tmp-", 4) == 0) {
+            // Left behind by a writer that died; anything older than an hour.
+            if (stat(path, &st) == 0 && st.st_mtime < time(NULL) - 3600) unlink(path);
+            continue;
+        }
+        if (len < 5 || len >= sizeof files->name || strcmp(de->d_name + len - 4, ".bin") != 0) continue;
+        if (stat(path, &st) != 0) continue;
+        if (n == cap) {
+            dcache_file_t *nf = realloc(files, (cap = cap ? 2 * cap : 64) * sizeof *files);
+            if (!nf) break;
+            files = nf;
+        }
+        memcpy(files[n].name, de->d_name, len + 1);
+        files[n].size = st.st_size;
+        files[n].mtime = st.st_mtim;
+        total += (unsigned long long)st.st_size;
+        n++;
+    }
+    if (d) closedir(d);
+
+    qsort(files, n, sizeof *files, cmp_mtime);
+    if (total > dcache_max) {
+        for (size_t k = 0; k < n && total > dcache_max - dcache_max / 8; ++k) {
+            snprintf(path, sizeof path, "%s/%s", dcache_dir, files[k].name);
+            if (unlink(path) == 0) total -= (unsigned long long)files[k].size;
+        }
+    }
+    free(files);
+
+    uint64_t t = total;
+    if (pwrite(lock, &t, sizeof t, 0) != (ssize_t)sizeof t) ftruncate(lock, 0);
+}
+
+// The lock file holds the total size of the entries, updated by every put,
+// so the directory is only rescanned when a put takes the total past the
+// bound (or the total is not known yet, e.g. in a new directory).
+static void dcache_account(int64_t delta)
+{
+    char path[800];
+    snprintf(path, sizeof path, "%s/lock", dcache_dir);
+    int lock = open(path, O_RDWR | O_CREAT, 0600);
+    if (lock < 0 || flock(lock, LOCK_EX) != 0) { if (lock >= 0) close(lock); return; }
+
+    uint64_t total;
+    if (pread(lock, &total, sizeof total, 0) == (ssize_t)sizeof total) {
+        total = delta < 0 && (uint64_t)-delta > total ? 0 : total + (uint64_t)delta;
+        if (total <= dcache_max && pwrite(lock, &total, sizeof total, 0) == (ssize_t)sizeof total) {
+            close(lock);                // releases the flock
+            return;
+        }
+    }
+    dcache_trim(lock);
+    close(lock);
+}
+
+int dcache_put(const char *kind, const void *key, size_t keylen, const void *data, size_t len)
+{
+    if (!dcache_init()) return -1;
+    if (len > dcache_max / 4) return -1;
+    STATS_SCOPE(STAT_DCACHE_PUT);
+
+    static unsigned counter;
+    char path[800], tmp[800];
+    dcache_path(path, sizeof path, kind, key, keylen);
+    snprintf(tmp, sizeof tmp, "%s/tmp-%ld-%u", dcache_dir, (long)getpid(), counter++);
+
+    dcache_hdr_t h;
+    memset(&h, 0, sizeof h);
+    h.magic = DCACHE_MAGIC;
+    h.version = DCACHE_VERSION;
+    memcpy(h.build, DCACHE_BUILD, sizeof h.build);
+    h.keylen = keylen;
+    h.datalen = len;
+    h.data_off = (sizeof h + keylen + 7) & ~(uint64_t)7;
+
+    static const char pad[8];
+    FILE *fp = fopen(tmp, "wb");
+    if (!fp) return -1;
+    int ok = fwrite(&h, sizeof h, 1, fp) == 1 &&
+             fwrite(key, 1, keylen, fp) == keylen &&
+             fwrite(pad, 1, h.data_off - sizeof h - keylen, fp) == h.data_off - sizeof h - keylen &&
+             fwrite(data, 1, len, fp) == len;
+    if (fclose(fp) != 0) ok = 0;
+
+    struct stat old;
+    int64_t delta = (int64_t)(h.data_off + len);
+    if (stat(path, &old) == 0) delta -= (int64_t)old.st_size;     // replacing an entry
+    if (!ok || rename(tmp, path) != 0) { unlink(tmp); return -1; }
+
+    dcache_account(delta);
+    return 0;
+}
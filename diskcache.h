@@ -0,0 +1,40 @@
+// Persistent result cache for the EEE Helper CLI calculator.
+// Long jobs (sweep scripts, see sweep.h) store their output under a hash of
+// the job specification and the build of the program, so running the same
+// job again - in this process or any later one - returns the stored bytes
+// instead of recomputing them. A rebuilt program never reuses results of an
+// older build.
+//
+// The cache is off unless EEE_CACHE_DIR names a directory (created if
+// missing). EEE_CACHE_MB bounds its total size (default 256, at most
+// 1048576 = 1 TiB); a value that is not a plain number turns it off. The least
+// recently used entries are deleted past that. Any number of processes may
+// share one directory.
+
+#ifndef DISKCACHE_H
+#define DISKCACHE_H
+
+#include <stddef.h>
+
+typedef struct {
+    const void *data;                   // the stored bytes, read-only
+    size_t len;
+    void *map;                          // internal: the mapped file
+    size_t maplen;
+} dcache_blob_t;
+
+// 1 if the cache is on; *max_entry (may be NULL) is the largest result
+// worth storing.
+int dcache_enabled(size_t *max_entry);
+
+// Looks up the result of job `key` of the given kind (e.g. "sweep").
+// Returns 1 and maps it into *b (release with dcache_release), or 0.
+int  dcache_get(const char *kind, const void *key, size_t keylen, dcache_blob_t *b);
+void dcache_release(dcache_blob_t *b);
+
+// Stores a result, replacing any previous one for the key, and trims the
+// cache if that takes it past its size bound. Returns 0, or -1 if it could not be written
+// (the cache is only an optimisation, so callers may ignore this).
+int dcache_put(const char *kind, const void *key, size_t keylen, const void *data, size_t len);
+
+#endif
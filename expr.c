@@ -0,0 +1,689 @@
+// Expression compiler and columnar bytecode interpreter.
+// Design notes:
+// The parser is recursive descent and emits one instruction per operator.
+// Every value lives in a register: variables, constants and temporaries.
+// Constant sub-expressions are folded at compile time, and temporaries are
+// recycled so the register file stays small enough to sit in cache.
+// Evaluation runs each instruction over a block of EXPR_BLOCK rows before
+// moving on to the next, so dispatch cost is shared by the whole block.
+// On x86-64 Linux the same bytecode is also compiled to native AVX code (see
+// the JIT section), and the interpreter only handles the last few rows.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <math.h>
+#include <ctype.h>
+#include "expr.h"
+#include "stats.h"
+
+#define PI 3.14159265358979323846
+
+#define EXPR_BLOCK    256
+#define EXPR_MAX_REGS 128
+#define EXPR_MAX_CODE 512
+
+enum { OP_ADD, OP_SUB, OP_MUL, OP_DIV, OP_POW, OP_NEG,
+       OP_EXP, OP_LOG, OP_SQRT, OP_SIN, OP_COS, OP_TAN, OP_ABS };
+
+enum { REG_VAR, REG_CONST, REG_TEMP };
+
+typedef struct {
+    unsigned char op, dst, a, b;
+} instr_t;
+
+typedef struct {
+    int kind;
+    int var;          // REG_VAR: variable index
+    double value;     // REG_CONST: value
+    int free;         // REG_TEMP: available for reuse
+} reg_t;
+
+struct expr {
+    instr_t code[EXPR_MAX_CODE];
+    int ncode;
+    reg_t regs[EXPR_MAX_REGS];
+    int nregs;
+    int result;                            // register holding the result
+    char vars[EXPR_MAX_VARS][32];
+    int nvars;
+    double *store;                         // constant and temporary blocks
+    const double *ptr[EXPR_MAX_REGS];      // per-block operand pointers
+
+    // Native code, if the JIT produced any (see jit_compile).
+    void (*jit)(const double *const *cols, double *out, size_t n, double *slots);
+    void *jit_mem;
+    size_t jit_size;
+    double *slots;                         // four lanes per register, plus masks
+    int use_jit;
+};
+
+static void jit_compile(expr_t *e);
+static void jit_free(expr_t *e);
+
+// ------------------------------ PARSER ------------------------------
+
+typedef struct {
+    const char *src, *p;
+    expr_t *e;
+    char *err;
+    size_t errlen;
+    int failed;
+} parser_t;
+
+static void fail(parser_t *ps, const char *msg)
+{
+    if (ps->failed) return;
+    ps->failed = 1;
+    snprintf(ps->err, ps->errlen, "%s at position %d", msg, (int)(ps->p - ps->src) + 1);
+}
+
+static void skip_space(parser_t *ps)
+{
+    while (*ps->p == ' ' || *ps->p == '\t') ps->p++;
+}
+
+static int new_reg(parser_t *ps, int kind)
+{
+    expr_t *e = ps->e;
+
+    if (kind == REG_TEMP) {
+        for (int r = 0; r < e->nregs; ++r)
+            if (e->regs[r].kind == REG_TEMP && e->regs[r].free) {
+                e->regs[r].free = 0;
+                return r;
+            }
+    }
+    if (e->nregs == EXPR_MAX_REGS) { fail(ps, "expression too large"); return 0; }
+
+    reg_t *r = &e->regs[e->nregs];
+    memset(r, 0, sizeof *r);
+    r->kind = kind;
+    return e->nregs++;
+}
+
+static int const_reg(parser_t *ps, double v)
+{
+    expr_t *e = ps->e;
+    for (int r = 0; r < e->nregs; ++r)
+        if (e->regs[r].kind == REG_CONST && memcmp(&e->regs[r].value, &v, sizeof v) == 0) return r;
+
+    int r = new_reg(ps, REG_CONST);
+    e->regs[r].value = v;
+    return r;
+}
+
+static int var_reg(parser_t *ps, const char *name)
+{
+    expr_t *e = ps->e;
+    int i;
+
+    for (i = 0; i < e->nvars; ++i)
+        if (strcmp(e->vars[i], name) == 0) break;
+    if (i == e->nvars) {
+        if (e->nvars == EXPR_MAX_VARS) { fail(ps, "too many variables"); return 0; }
+        snprintf(e->vars[e->nvars++], sizeof e->vars[0], "%s", name);
+    }
+    for (int r = 0; r < e->nregs; ++r)
+        if (e->regs[r].kind == REG_VAR && e->regs[r].var == i) return r;
+
+    int r = new_reg(ps, REG_VAR);
+    e->regs[r].var = i;
+    return r;
+}
+
+static void release(expr_t *e, int r)
+{
+    if (e->regs[r].kind == REG_TEMP) e->regs[r].free = 1;
+}
+
+static double apply(int op, double a, double b)
+{
+    switch (op) {
+        case OP_ADD:  return a + b;
+        case OP_SUB:  return a - b;
+        case OP_MUL:  return a * b;
+        case OP_DIV:  return a / b;
+        case OP_POW:  return pow(a, b);
+        case OP_NEG:  return -a;
+        case OP_EXP:  return exp(a);
+        case OP_LOG:  return log(a);
+        case OP_SQRT: return sqrt(a);
+        case OP_SIN:  return sin(a);
+        case OP_COS:  return cos(a);
+        case OP_TAN:  return tan(a);
+        default:      return fabs(a);
+    }
+}
+
+// Emits dst = op(a, b) (b ignored for unary ops), folding constants.
+static int emit(parser_t *ps, int op, int a, int b)
+{
+    expr_t *e = ps->e;
+    int unary = op >= OP_NEG;
+
+    if (ps->failed) return 0;
+    if (e->regs[a].kind == REG_CONST && (unary || e->regs[b].kind == REG_CONST))
+        return const_reg(ps, apply(op, e->regs[a].value, unary ? 0.0 : e->regs[b].value));
+
+    release(e, a);
+    if (!unary) release(e, b);
+    int d = new_reg(ps, REG_TEMP);
+
+    if (e->ncode == EXPR_MAX_CODE) { fail(ps, "expression too large"); return 0; }
+    instr_t *in = &e->code[e->ncode++];
+    in->op = (unsigned char)op;
+    in->dst = (unsigned char)d;
+    in->a = (unsigned char)a;
+    in->b = (unsigned char)(unary ? a : b);
+    return d;
+}
+
+static int parse_expr(parser_t *ps);
+
+static int parse_primary(parser_t *ps)
+{
+    skip_space(ps);
+    const char *p = ps->p;
+
+    if (*p == '(') {
+        ps->p++;
+        int r = parse_expr(ps);
+        skip_space(ps);
+        if (*ps->p != ')') { fail(ps, "expected ')'"); return 0; }
+        ps->p++;
+        return r;
+    }
+    if (isdigit((unsigned char)*p) || *p == '.') {
+        errno = 0;
+        char *end = NULL;
+        double v = strtod(p, &end);
+        if (end == p || errno == ERANGE) { fail(ps, "invalid number"); return 0; }
+        ps->p = end;
+        return const_reg(ps, v);
+    }
+    if (isalpha((unsigned char)*p) || *p == '_') {
+        char name[32];
+        size_t n = 0;
+        while (isalnum((unsigned char)*ps->p) || *ps->p == '_') {
+            if (n + 1 < sizeof name) name[n++] = *ps->p;
+            ps->p++;
+        }
+        name[n] = '\0';
+        skip_space(ps);
+
+        if (*ps->p != '(') {
+            if (strcmp(name, "PI") == 0 || strcmp(name, "pi") == 0) return const_reg(ps, PI);
+            return var_reg(ps, name);
+        }
+
+        static const struct { const char *name; int op; } funcs[] = {
+            { "exp", OP_EXP }, { "log", OP_LOG }, { "ln", OP_LOG }, { "sqrt", OP_SQRT },
+            { "sin", OP_SIN }, { "cos", OP_COS }, { "tan", OP_TAN }, { "abs", OP_ABS },
+        };
+        int op = -1;
+        for (size_t k = 0; k < sizeof funcs / sizeof funcs[0]; ++k)
+            if (strcmp(name, funcs[k].name) == 0) op = funcs[k].op;
+        if (op < 0) { fail(ps, "unknown function"); return 0; }
+
+        ps->p++;
+        int a = parse_expr(ps);
+        skip_space(ps);
+        if (*ps->p != ')') { fail(ps, "expected ')'"); return 0; }
+        ps->p++;
+        return emit(ps, op, a, a);
+    }
+
+    fail(ps, *p ? "unexpected character" : "unexpected end of expression");
+    return 0;
+}
+
+static int parse_unary(parser_t *ps);
+
+// power := primary ['^' unary]   (right associative, binds tighter than unary minus)
+static int parse_power(parser_t *ps)
+{
+    int a = parse_primary(ps);
+    skip_space(ps);
+    if (*ps->p == '^') {
+        ps->p++;
+        int b = parse_unary(ps);
+        return emit(ps, OP_POW, a, b);
+    }
+    return a;
+}
+
+static int parse_unary(parser_t *ps)
+{
+    skip_space(ps);
+    if (*ps->p == '-') { ps->p++; return emit(ps, OP_NEG, parse_unary(ps), 0); }
+    if (*ps->p == '+') { ps->p++; return parse_unary(ps); }
+    return parse_power(ps);
+}
+
+static int parse_term(parser_t *ps)
+{
+    int a = parse_unary(ps);
+    for (;;) {
+        skip_space(ps);
+        char c = *ps->p;
+        if (c != '*' && c != '/') return a;
+        ps->p++;
+        int b = parse_unary(ps);
+        a = emit(ps, c == '*' ? OP_MUL : OP_DIV, a, b);
+    }
+}
+
+static int parse_expr(parser_t *ps)
+{
+    int a = parse_term(ps);
+    for (;;) {
+        skip_space(ps);
+        char c = *ps->p;
+        if (c != '+' && c != '-') return a;
+        ps->p++;
+        int b = parse_term(ps);
+        a = emit(ps, c == '+' ? OP_ADD : OP_SUB, a, b);
+    }
+}
+
+expr_t *expr_compile(const char *src, char *err, size_t errlen)
+{
+    STATS_SCOPE(STAT_EXPR_COMPILE);
+    expr_t *e = calloc(1, sizeof *e);
+    if (!e) { snprintf(err, errlen, "out of memory"); return NULL; }
+
+    parser_t ps = { src, src, e, err, errlen, 0 };
+    e->result = parse_expr(&ps);
+    skip_space(&ps);
+    if (!ps.failed && *ps.p != '\0' && *ps.p != '\n' && *ps.p != '\r') fail(&ps, "unexpected character");
+    if (ps.failed) { free(e); return NULL; }
+
+    // One block of storage per constant and temporary register.
+    e->store = malloc((size_t)e->nregs * EXPR_BLOCK * sizeof(double));
+    if (!e->store) { snprintf(err, errlen, "out of memory"); free(e); return NULL; }
+
+    for (int r = 0; r < e->nregs; ++r) {
+        double *blk = e->store + (size_t)r * EXPR_BLOCK;
+        if (e->regs[r].kind == REG_CONST)
+            for (int k = 0; k < EXPR_BLOCK; ++k) blk[k] = e->regs[r].value;
+        e->ptr[r] = blk;
+    }
+
+    jit_compile(e);
+    return e;
+}
+
+void expr_free(expr_t *e)
+{
+    if (!e) return;
+    jit_free(e);
+    free(e->store);
+    free(e);
+}
+
+int expr_nvars(const expr_t *e)
+{
+    return e->nvars;
+}
+
+const char *expr_var_name(const expr_t *e, int i)
+{
+    return e->vars[i];
+}
+
+// ---------------------------- INTERPRETER ----------------------------
+
+// Runs the program over rows [base, base + len) (len <= EXPR_BLOCK).
+static void run_block(expr_t *e, const double *const *cols, size_t base, size_t len, double *out)
+{
+    for (int r = 0; r < e->nregs; ++r)
+        if (e->regs[r].kind == REG_VAR) e->ptr[r] = cols[e->regs[r].var] + base;
+
+    for (int pc = 0; pc < e->ncode; ++pc) {
+        const instr_t *in = &e->code[pc];
+        double *d = e->store + (size_t)in->dst * EXPR_BLOCK;
+        const double *a = e->ptr[in->a], *b = e->ptr[in->b];
+        size_t k;
+
+        switch (in->op) {
+            case OP_ADD:  for (k = 0; k < len; ++k) d[k] = a[k] + b[k]; break;
+            case OP_SUB:  for (k = 0; k < len; ++k) d[k] = a[k] - b[k]; break;
+            case OP_MUL:  for (k = 0; k < len; ++k) d[k] = a[k] * b[k]; break;
+            case OP_DIV:  for (k = 0; k < len; ++k) d[k] = a[k] / b[k]; break;
+            case OP_POW:  for (k = 0; k < len; ++k) d[k] = pow(a[k], b[k]); break;
+            case OP_NEG:  for (k = 0; k < len; ++k) d[k] = -a[k]; break;
+            case OP_EXP:  for (k = 0; k < len; ++k) d[k] = exp(a[k]); break;
+            case OP_LOG:  for (k = 0; k < len; ++k) d[k] = log(a[k]); break;
+            case OP_SQRT: for (k = 0; k < len; ++k) d[k] = sqrt(a[k]); break;
+            case OP_SIN:  for (k = 0; k < len; ++k) d[k] = sin(a[k]); break;
+            case OP_COS:  for (k = 0; k < len; ++k) d[k] = cos(a[k]); break;
+            case OP_TAN:  for (k = 0; k < len; ++k) d[k] = tan(a[k]); break;
+            default:      for (k = 0; k < len; ++k) d[k] = fabs(a[k]); break;
+        }
+    }
+
+    const double *res = e->ptr[e->result];
+    if (e->regs[e->result].kind == REG_VAR) res = cols[e->regs[e->result].var] + base;
+    memcpy(out + base, res, len * sizeof *out);
+}
+
+void expr_eval(expr_t *e, const double *const *cols, size_t n, double *out)
+{
+    STATS_SCOPE(STAT_EXPR_EVAL);
+    size_t base = 0;
+
+    // Native code takes whole groups of four rows; the interpreter the rest.
+    if (e->jit && e->use_jit) {
+        base = n & ~(size_t)3;
+        if (base) e->jit(cols, out, base, e->slots);
+    }
+    for (; base < n; base += EXPR_BLOCK) {
+        size_t len = n - base < EXPR_BLOCK ? n - base : EXPR_BLOCK;
+        run_block(e, cols, base, len, out);
+    }
+}
+
+double expr_eval1(expr_t *e, const double *vals)
+{
+    const double *cols[EXPR_MAX_VARS];
+    double out;
+
+    for (int i = 0; i < e->nvars; ++i) cols[i] = &vals[i];
+    expr_eval(e, cols, 1, &out);
+    return out;
+}
+
+int expr_jit_active(const expr_t *e)
+{
+    return e->jit != NULL && e->use_jit;
+}
+
+int expr_set_jit(expr_t *e, int on)
+{
+    e->use_jit = on && e->jit != NULL;
+    return e->use_jit;
+}
+
+// ------------------------------ SCALAR ------------------------------
+
+typedef struct {
+    int var;                            // index into the caller's values, or -1
+    double value;                       // constants (temporaries start at 0)
+} scalar_reg_t;
+
+struct expr_scalar {
+    int nregs, ncode, result;
+    scalar_reg_t regs[];                // then ncode instr_t
+};
+
+#define SCALAR_CODE(s) ((instr_t *)((s)->regs + (s)->nregs))
+
+expr_scalar_t *expr_compile_scalar(const char *src, int (*resolve)(void *ctx, const char *name),
+                                   void *ctx, char *err, size_t errlen)
+{
+    expr_t *e = calloc(1, sizeof *e);
+    if (!e) { snprintf(err, errlen, "out of memory"); return NULL; }
+
+    parser_t ps = { src, src, e, err, errlen, 0 };
+    e->result = parse_expr(&ps);
+    skip_space(&ps);
+    if (!ps.failed && *ps.p != '\0' && *ps.p != '\n' && *ps.p != '\r') fail(&ps, "unexpected character");
+    if (ps.failed) { free(e); return NULL; }
+
+    int map[EXPR_MAX_VARS];
+    for (int i = 0; i < e->nvars; ++i) {
+        if ((map[i] = resolve(ctx, e->vars[i])) < 0) {
+            snprintf(err, errlen, "cannot use '%s' here", e->vars[i]);
+            free(e);
+            return NULL;
+        }
+    }
+
+    expr_scalar_t *s = malloc(sizeof *s + (size_t)e->nregs * sizeof(scalar_reg_t) +
+                              (size_t)e->ncode * sizeof(instr_t));
+    if (!s) { snprintf(err, errlen, "out of memory"); free(e); return NULL; }
+    s->nregs = e->nregs;
+    s->ncode = e->ncode;
+    s->result = e->result;
+    for (int r = 0; r < e->nregs; ++r) {
+        s->regs[r].var = e->regs[r].kind == REG_VAR ? map[e->regs[r].var] : -1;
+        s->regs[r].value = e->regs[r].kind == REG_CONST ? e->regs[r].value : 0.0;
+    }
+    memcpy(SCALAR_CODE(s), e->code, (size_t)e->ncode * sizeof(instr_t));
+    free(e);
+    return s;
+}
+
+double expr_scalar_eval(const expr_scalar_t *s, const double *vals)
+{
+    double r[EXPR_MAX_REGS];
+    for (int k = 0; k < s->nregs; ++k) r[k] = s->regs[k].var >= 0 ? vals[s->regs[k].var] : s->regs[k].value;
+    const instr_t *code = SCALAR_CODE(s);
+    for (int pc = 0; pc < s->ncode; ++pc) {
+        const instr_t *in = &code[pc];
+        r[in->dst] = apply(in->op, r[in->a], r[in->b]);
+    }
+    return r[s->result];
+}
+
+size_t expr_scalar_size(const expr_scalar_t *s)
+{
+    return sizeof *s + (size_t)s->nregs * sizeof(scalar_reg_t) + (size_t)s->ncode * sizeof(instr_t);
+}
+
+// ------------------------------- JIT --------------------------------
+// The program is translated to x86-64 code that evaluates four rows per loop
+// iteration in 256-bit registers. Every register has a 32-byte slot (its four
+// lanes) in e->slots; constants are broadcast into their slots once, and
+// variables are loaded straight from the input columns. Functions with no AVX
+// instruction (exp, log, sin, pow, ...) call jit_lanes() on the slot.
+//
+// Generated function: void f(cols, out, n, slots), n a multiple of 4.
+// Register use: rbx = cols, r12 = out, r13 = n, r14 = slots, r15 = row.
+//
+// Build with -DEXPR_NO_JIT, or set EEE_NO_JIT=1, to use only the interpreter.
+
+#if defined(__x86_64__) && defined(__linux__) && !defined(EXPR_NO_JIT)
+
+#include <sys/mman.h>
+
+enum { X_RAX = 0, X_R12 = 12, X_R14 = 14, X_R15 = 15 };
+
+// VEX.256.66.0F opcodes
+enum { V_LOAD = 0x10, V_STORE = 0x11, V_SQRT = 0x51, V_AND = 0x54, V_XOR = 0x57,
+       V_ADD = 0x58, V_MUL = 0x59, V_SUB = 0x5C, V_DIV = 0x5E };
+
+typedef struct {
+    unsigned char *buf;     // NULL while only measuring the size
+    size_t len;
+} jbuf_t;
+
+static void jb(jbuf_t *j, int byte)
+{
+    if (j->buf) j->buf[j->len] = (unsigned char)byte;
+    j->len++;
+}
+
+static void jb32(jbuf_t *j, unsigned int v)
+{
+    for (int k = 0; k < 4; ++k) jb(j, (v >> (8 * k)) & 0xFF);
+}
+
+static void jb64(jbuf_t *j, unsigned long long v)
+{
+    for (int k = 0; k < 8; ++k) jb(j, (int)((v >> (8 * k)) & 0xFF));
+}
+
+static void jbytes(jbuf_t *j, const char *s, int n)
+{
+    for (int k = 0; k < n; ++k) jb(j, (unsigned char)s[k]);
+}
+
+// 3-byte VEX prefix for a 256-bit, 66-prefixed, 0F-map instruction.
+// src is the vvvv operand (0 when unused, as 1111 is "no register").
+static void vex(jbuf_t *j, int op, int reg, int src, int index, int rm)
+{
+    jb(j, 0xC4);
+    jb(j, ((reg & 8) ? 0 : 0x80) | ((index & 8) ? 0 : 0x40) | ((rm & 8) ? 0 : 0x20) | 0x01);
+    jb(j, ((~src & 0xF) << 3) | 0x05);
+    jb(j, op);
+}
+
+// op ymm_reg, ymm_src, [base + index*8 + disp]   (index < 0: none)
+static void vex_mem(jbuf_t *j, int op, int reg, int src, int base, int index, int disp)
+{
+    int sib = index >= 0 || (base & 7) == 4;
+
+    vex(j, op, reg, src, index < 0 ? 0 : index, base);
+    jb(j, 0x80 | ((reg & 7) << 3) | (sib ? 4 : (base & 7)));
+    if (sib) jb(j, (index >= 0 ? 0xC0 | ((index & 7) << 3) : 0x20) | (base & 7));
+    jb32(j, (unsigned int)disp);
+}
+
+// op ymm_reg, ymm_src, ymm_rm
+static void vex_reg(jbuf_t *j, int op, int reg, int src, int rm)
+{
+    vex(j, op, reg, src, 0, rm);
+    jb(j, 0xC0 | ((reg & 7) << 3) | (rm & 7));
+}
+
+// ymm = register r for the current four rows.
+static void jit_load(jbuf_t *j, const expr_t *e, int ymm, int r)
+{
+    if (e->regs[r].kind == REG_VAR) {
+        jbytes(j, "\x48\x8B\x83", 3);                      // mov rax, [rbx + 8*var]
+        jb32(j, (unsigned int)(8 * e->regs[r].var));
+        vex_mem(j, V_LOAD, ymm, 0, X_RAX, X_R15, 0);       // vmovupd ymm, [rax + r15*8]
+    } else {
+        vex_mem(j, V_LOAD, ymm, 0, X_R14, -1, 32 * r);
+    }
+}
+
+static void jit_lanes(double *d, const double *b, int op)
+{
+    for (int k = 0; k < 4; ++k) d[k] = apply(op, d[k], b[k]);
+}
+
+static void jit_emit(jbuf_t *j, const expr_t *e)
+{
+    const int sign = e->nregs, mask = e->nregs + 1, spare = e->nregs + 2;
+
+    jbytes(j, "\x53\x41\x54\x41\x55\x41\x56\x41\x57", 9);   // push rbx, r12-r15
+    jbytes(j, "\x48\x89\xFB\x49\x89\xF4\x49\x89\xD5\x49\x89\xCE", 12);
+    jbytes(j, "\x45\x31\xFF", 3);                           // xor r15d, r15d
+
+    size_t top = j->len;
+    jbytes(j, "\x4D\x39\xEF\x0F\x83", 5);                   // cmp r15, r13; jae done
+    size_t exit_patch = j->len;
+    jb32(j, 0);
+
+    for (int pc = 0; pc < e->ncode; ++pc) {
+        const instr_t *in = &e->code[pc];
+        static const int vop[] = { V_ADD, V_SUB, V_MUL, V_DIV };
+
+        jit_load(j, e, 0, in->a);
+        switch (in->op) {
+            case OP_ADD: case OP_SUB: case OP_MUL: case OP_DIV:
+                if (e->regs[in->b].kind == REG_VAR) {
+                    jit_load(j, e, 1, in->b);
+                    vex_reg(j, vop[in->op], 0, 0, 1);
+                } else {
+                    vex_mem(j, vop[in->op], 0, 0, X_R14, -1, 32 * in->b);
+                }
+                break;
+            case OP_NEG:  vex_mem(j, V_XOR, 0, 0, X_R14, -1, 32 * sign); break;
+            case OP_ABS:  vex_mem(j, V_AND, 0, 0, X_R14, -1, 32 * mask); break;
+            case OP_SQRT: vex_reg(j, V_SQRT, 0, 0, 0); break;
+            default: {
+                // Library call: both operands go through memory. b is
+                // copied aside first, since dst may be b's register.
+                int b = in->dst;
+                if (in->op == OP_POW) {
+                    b = spare;
+                    jit_load(j, e, 1, in->b);
+                    vex_mem(j, V_STORE, 1, 0, X_R14, -1, 32 * b);
+                }
+                vex_mem(j, V_STORE, 0, 0, X_R14, -1, 32 * in->dst);
+                jbytes(j, "\xC5\xF8\x77", 3);                   // vzeroupper
+                jbytes(j, "\x49\x8D\xBE", 3);                   // lea rdi, [r14 + d]
+                jb32(j, (unsigned int)(32 * in->dst));
+                jbytes(j, "\x49\x8D\xB6", 3);                   // lea rsi, [r14 + b]
+                jb32(j, (unsigned int)(32 * b));
+                jb(j, 0xBA);                                    // mov edx, op
+                jb32(j, in->op);
+                jbytes(j, "\x48\xB8", 2);                       // mov rax, jit_lanes
+                jb64(j, (unsigned long long)(unsigned long)&jit_lanes);
+                jbytes(j, "\xFF\xD0", 2);                       // call rax
+                continue;
+            }
+        }
+        vex_mem(j, V_STORE, 0, 0, X_R14, -1, 32 * in->dst);
+    }
+
+    jit_load(j, e, 0, e->result);
+    vex_mem(j, V_STORE, 0, 0, X_R12, X_R15, 0);             // vmovupd [r12 + r15*8], ymm0
+    jbytes(j, "\x49\x83\xC7\x04", 4);                       // add r15, 4
+    jb(j, 0xE9);                                            // jmp top
+    jb32(j, (unsigned int)(int)(top - (j->len + 4)));
+
+    if (j->buf) {
+        int rel = (int)(j->len - (exit_patch + 4));
+        memcpy(j->buf + exit_patch, &rel, 4);
+    }
+    jbytes(j, "\xC5\xF8\x77", 3);                           // vzeroupper
+    jbytes(j, "\x41\x5F\x41\x5E\x41\x5D\x41\x5C\x5B\xC3", 10);
+}
+
+static void jit_compile(expr_t *e)
+{
+    const char *off = getenv("EEE_NO_JIT");
+    if (off && *off && strcmp(off, "0") != 0) return;
+    if (!__builtin_cpu_supports("avx")) return;
+
+    // Slots: one per register, then the sign bit, abs mask and a spare.
+    e->slots = aligned_alloc(32, (size_t)(e->nregs + 3) * 32);
+    if (!e->slots) return;
+    for (int r = 0; r < e->nregs; ++r)
+        for (int k = 0; k < 4; ++k) e->slots[4 * r + k] = e->regs[r].value;
+    for (int k = 0; k < 4; ++k) {
+        unsigned long long sign = 0x8000000000000000ULL, mask = ~sign;
+        memcpy(&e->slots[4 * e->nregs + k], &sign, 8);
+        memcpy(&e->slots[4 * (e->nregs + 1) + k], &mask, 8);
+    }
+
+    jbuf_t j = { NULL, 0 };
+    jit_emit(&j, e);                                        // measure
+    size_t page = 4096, size = (j.len + page - 1) / page * page;
+
+    void *mem = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (mem == MAP_FAILED) { free(e->slots); e->slots = NULL; return; }
+    j.buf = mem;
+    j.len = 0;
+    jit_emit(&j, e);
+    if (mprotect(mem, size, PROT_READ | PROT_EXEC) != 0) {
+        munmap(mem, size);
+        free(e->slots);
+        e->slots = NULL;
+        return;
+    }
+
+    e->jit_mem = mem;
+    e->jit_size = size;
+    e->jit = (void (*)(const double *const *, double *, size_t, double *))mem;
+    e->use_jit = 1;
+}
+
+static void jit_free(expr_t *e)
+{
+    if (e->jit_mem) munmap(e->jit_mem, e->jit_size);
+    free(e->slots);
+}
+
+#else
+
+static void jit_compile(expr_t *e) { (void)e; }
+static void jit_free(expr_t *e)    { (void)e; }
+
+#endif
@@ -0,0 +1,51 @@
+// User-defined formula language for the EEE Helper CLI calculator.
+// An expression such as "Vin * R2 / (R1 + R2)" is parsed once into register
+// bytecode and then evaluated over whole columns of inputs, a block of rows
+// per instruction, so the per-row cost is a few arithmetic operations.
+//
+// Syntax: numbers, variables, + - * / ^ (power), parentheses, PI, and the
+// functions exp, log (natural), sqrt, sin, cos, tan, abs.
+
+#ifndef EXPR_H
+#define EXPR_H
+
+#include <stddef.h>
+
+#define EXPR_MAX_VARS 32
+
+typedef struct expr expr_t;
+
+// Compiles src. Variables are collected in order of first use.
+// Returns NULL on a syntax error and writes a message to err.
+expr_t *expr_compile(const char *src, char *err, size_t errlen);
+void    expr_free(expr_t *e);
+
+int         expr_nvars(const expr_t *e);
+const char *expr_var_name(const expr_t *e, int i);
+
+// Evaluates n rows: cols[i][k] is variable i on row k, out[k] the result.
+void   expr_eval(expr_t *e, const double *const *cols, size_t n, double *out);
+
+// Evaluates one row: vals[i] is variable i.
+double expr_eval1(expr_t *e, const double *vals);
+
+// Compact one-row form for callers that keep many small expressions alive,
+// such as worksheet cells. Each variable is resolved once at compile time
+// through resolve(ctx, name), which returns its index into the value array
+// later passed to expr_scalar_eval (or -1 to reject the name). One malloc'd
+// block with no pointers in it: release with free(), or copy its
+// expr_scalar_size() bytes anywhere 8-byte aligned (a file, a mapping) and
+// evaluate the copy.
+typedef struct expr_scalar expr_scalar_t;
+expr_scalar_t *expr_compile_scalar(const char *src, int (*resolve)(void *ctx, const char *name),
+                                   void *ctx, char *err, size_t errlen);
+double expr_scalar_eval(const expr_scalar_t *s, const double *vals);
+size_t expr_scalar_size(const expr_scalar_t *s);
+
+// Native code backend (x86-64 Linux with AVX). expr_compile uses it when
+// available unless EEE_NO_JIT is set; expr_set_jit switches it per expression
+// and returns whether it is now in use.
+int expr_jit_active(const expr_t *e);
+int expr_set_jit(expr_t *e, int on);
+
+#endif
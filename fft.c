@@ -0,0 +1,391 @@
+// FFT harmonic and THD analysis of power captures.
+// Design notes:
+// Real-input FFT: n real samples are packed into n/2 complex values, run through
+// an iterative radix-2 FFT and split back into the n/2 + 1 positive-frequency
+// bins. Twiddle factors for a given n are computed once and cached in the plan;
+// windows of a capture are analysed in parallel, sharing the plan's tables.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "fft.h"
+#include "funcs.h"
+#include "stats.h"
+#include "pool.h"
+#include "vec4.h"
+
+#define PI 3.14159265358979323846
+
+
+typedef struct {
+    size_t n;                   // real input length (power of two, >= 4)
+    size_t m;                   // complex FFT length, n / 2
+    size_t *rev;                // bit-reversal permutation of 0..m-1
+    double *tw_re, *tw_im;      // stage twiddles: stage with half-size h uses [h-1, 2h-1)
+    double *post_re, *post_im;  // e^(-2 pi i k / n) for k = 0..m (real-input split)
+    double *zr, *zi;            // work buffers, length m
+} fft_plan_t;
+
+int fft_is_pow2(size_t n)
+{
+    return n != 0 && (n & (n - 1)) == 0;
+}
+
+static void fft_plan_free(fft_plan_t *p)
+{
+    free(p->rev);
+    free(p->tw_re);
+    free(p->tw_im);
+    free(p->post_re);
+    free(p->post_im);
+    free(p->zr);
+    free(p->zi);
+    memset(p, 0, sizeof *p);
+}
+
+// Returns a plan for real length n, reusing the cached one when n matches.
+// Returns NULL if n is not a power of two >= 4 or memory runs out.
+static fft_plan_t *fft_plan_get(size_t n)
+{
+    static fft_plan_t plan;
+
+    if (plan.n == n) return &plan;
+    if (n < 4 || !fft_is_pow2(n)) return NULL;
+
+    fft_plan_free(&plan);
+    size_t m = n / 2;
+
+    plan.rev = malloc(m * sizeof *plan.rev);
+    plan.tw_re = malloc(m * sizeof(double));
+    plan.tw_im = malloc(m * sizeof(double));
+    plan.post_re = malloc((m + 1) * sizeof(double));
+    plan.post_im = malloc((m + 1) * sizeof(double));
+    plan.zr = malloc(m * sizeof(double));
+    plan.zi = malloc(m * sizeof(double));
+    if (!plan.rev || !plan.tw_re || !plan.tw_im || !plan.post_re || !plan.post_im ||
+        !plan.zr || !plan.zi) {
+        fft_plan_free(&plan);
+        return NULL;
+    }
+
+    int bits = 0;
+    while (((size_t)1 << bits) < m) bits++;
+    for (size_t k = 0; k < m; ++k) {
+        size_t r = 0;
+        for (int b = 0; b < bits; ++b)
+            if (k & ((size_t)1 << b)) r |= (size_t)1 << (bits - 1 - b);
+        plan.rev[k] = r;
+    }
+
+    for (size_t h = 1; h < m; h *= 2) {
+        for (size_t j = 0; j < h; ++j) {
+            plan.tw_re[h - 1 + j] = cos(-PI * (double)j / (double)h);
+            plan.tw_im[h - 1 + j] = sin(-PI * (double)j / (double)h);
+        }
+    }
+    for (size_t k = 0; k <= m; ++k) {
+        plan.post_re[k] = cos(-2.0 * PI * (double)k / (double)n);
+        plan.post_im[k] = sin(-2.0 * PI * (double)k / (double)n);
+    }
+
+    plan.n = n;
+    plan.m = m;
+    return &plan;
+}
+
+// In-place complex FFT of p->zr / p->zi (length p->m, already bit-reversed).
+static void fft_complex(fft_plan_t *p)
+{
+    double *zr = p->zr, *zi = p->zi;
+    size_t m = p->m;
+
+    for (size_t h = 1; h < m; h *= 2) {
+        const double *wr = p->tw_re + h - 1, *wi = p->tw_im + h - 1;
+
+        for (size_t b = 0; b < m; b += 2 * h) {
+            double *ar = zr + b, *ai = zi + b, *br = zr + b + h, *bi = zi + b + h;
+            size_t j = 0;
+
+            // Four butterflies at a time once the stage is wide enough.
+            for (; j + 4 <= h; j += 4) {
+                v4d xr, xi, yr, yi, cr, ci;
+                V4_LOAD(xr, ar + j);
+                V4_LOAD(xi, ai + j);
+                V4_LOAD(yr, br + j);
+                V4_LOAD(yi, bi + j);
+                V4_LOAD(cr, wr + j);
+                V4_LOAD(ci, wi + j);
+                v4d tr = yr * cr - yi * ci;
+                v4d ti = yr * ci + yi * cr;
+                v4d o0r = xr + tr, o0i = xi + ti, o1r = xr - tr, o1i = xi - ti;
+                V4_STORE(ar + j, o0r);
+                V4_STORE(ai + j, o0i);
+                V4_STORE(br + j, o1r);
+                V4_STORE(bi + j, o1i);
+            }
+            for (; j < h; ++j) {
+                double tr = br[j] * wr[j] - bi[j] * wi[j];
+                double ti = br[j] * wi[j] + bi[j] * wr[j];
+                br[j] = ar[j] - tr;
+                bi[j] = ai[j] - ti;
+                ar[j] += tr;
+                ai[j] += ti;
+            }
+        }
+    }
+}
+
+// Real FFT of x (length p->n). Writes bins 0..n/2 to xr / xi (length n/2 + 1).
+static void fft_real(fft_plan_t *p, const double *x, double *xr, double *xi)
+{
+    size_t m = p->m;
+
+    for (size_t k = 0; k < m; ++k) {
+        size_t r = p->rev[k];
+        p->zr[r] = x[2 * k];
+        p->zi[r] = x[2 * k + 1];
+    }
+    fft_complex(p);
+
+    // X[k] = E[k] + W^k O[k], with E and O the spectra of the even/odd samples.
+    for (size_t k = 0; k <= m; ++k) {
+        size_t a = (k == m) ? 0 : k, b = (k == 0) ? 0 : m - k;
+        double zr = p->zr[a], zi = p->zi[a];
+        double cr = p->zr[b], ci = -p->zi[b];            // conj(Z[m-k])
+        double er = 0.5 * (zr + cr), ei = 0.5 * (zi + ci);
+        double or_ = 0.5 * (zi - ci), oi = -0.5 * (zr - cr);  // (Z - conj) / 2i
+        double wr = p->post_re[k], wi = p->post_im[k];
+        xr[k] = er + wr * or_ - wi * oi;
+        xi[k] = ei + wr * oi + wi * or_;
+    }
+}
+
+// Analyses one window of n samples spaced dt apart with fundamental f1.
+// The window should span a whole number of cycles (no leakage correction).
+// Returns 0 if the fundamental does not fall on a bin strictly between DC and
+// Nyquist (so at least h = 1 is analysed).
+static int harmonic_window(fft_plan_t *p, const double *v, const double *i, double dt,
+                           double f1, int H, double *wr, double *wi, harm_result_t *out)
+{
+    STATS_SCOPE(STAT_FFT_WINDOW);
+    size_t n = p->n, m = p->m;
+    double bin = f1 * (double)n * dt;          // fundamental, in FFT bins
+    if (bin < 0.5 || floor(bin + 0.5) >= (double)m) return 0;   // rounds to DC or Nyquist
+
+    double *vr = wr, *vi = wi, *ir = wr + m + 1, *ii = wi + m + 1;
+    fft_real(p, v, vr, vi);
+    fft_real(p, i, ir, ii);
+
+    double vsq = 0.0, isq = 0.0;
+    for (size_t k = 0; k < n; ++k) {
+        vsq += v[k] * v[k];
+        isq += i[k] * i[k];
+    }
+
+    memset(out, 0, sizeof *out);
+    out->v[0] = vr[0] / (double)n;
+    out->i[0] = ir[0] / (double)n;
+    out->p[0] = out->v[0] * out->i[0];
+    out->p_total = out->p[0];
+
+    double hv2 = 0.0, hi2 = 0.0, phase1 = 0.0;
+    int h;
+    for (h = 1; h <= H; ++h) {
+        size_t k = (size_t)floor((double)h * bin + 0.5);
+        if (k >= m) break;   // at or above Nyquist
+
+        // Bin k of a real signal holds half the amplitude: rms = sqrt(2) |X| / n.
+        double scale = sqrt(2.0) / (double)n;
+        double vm = hypot(vr[k], vi[k]) * scale, im = hypot(ir[k], ii[k]) * scale;
+        double dphi = atan2(vi[k], vr[k]) - atan2(ii[k], ir[k]);
+
+        out->v[h] = vm;
+        out->i[h] = im;
+        out->p[h] = vm * im * cos(dphi);
+        out->p_total += out->p[h];
+        if (h == 1) phase1 = dphi;
+        else { hv2 += vm * vm; hi2 += im * im; }
+    }
+    out->H = h - 1;
+
+    if (!safe_divide(sqrt(hv2), out->v[1], &out->thd_v)) out->thd_v = 0.0;
+    if (!safe_divide(sqrt(hi2), out->i[1], &out->thd_i)) out->thd_i = 0.0;
+    out->s = sqrt(vsq / (double)n) * sqrt(isq / (double)n);
+    if (!safe_divide(out->p_total, out->s, &out->pf_true)) out->pf_true = 0.0;
+    out->pf_disp = cos(phase1);
+    return 1;
+}
+
+// Windows are analysed HARM_BATCH at a time, one pool task per window. The
+// workers share the plan's tables and each has its own work buffers.
+#define HARM_BATCH 64
+
+typedef struct {
+    const fft_plan_t *plan;
+    const double *t, *v, *i;            // samples of the batch's windows
+    size_t n, hop;
+    double f1;
+    int H;
+    double *work[POOL_MAX_THREADS];     // per worker: FFT work (2 * n/2) and spectra (4 * (n/2 + 1))
+    harm_result_t r[HARM_BATCH];
+    int ok[HARM_BATCH];
+} harm_batch_t;
+
+// pool task: analyses window k of the batch, which starts at sample k * hop.
+static void harm_task(size_t k, int worker, void *ctx)
+{
+    harm_batch_t *b = ctx;
+    size_t n = b->n, m = n / 2, at = k * b->hop;
+    fft_plan_t mine = *b->plan;
+    double *w = b->work[worker];
+
+    mine.zr = w;
+    mine.zi = w + m;
+    double *wr = w + 2 * m, *wi = wr + 2 * (m + 1);
+    double dt = (b->t[at + n - 1] - b->t[at]) / (double)(n - 1);
+    b->ok[k] = dt > 0.0 && harmonic_window(&mine, b->v + at, b->i + at, dt, b->f1, b->H, wr, wi, &b->r[k]);
+}
+
+// Analyses every whole window in the fill samples held, adds them to *avg
+// and the CSV in order, and returns how many windows there were.
+static size_t harm_batch_run(harm_batch_t *b, size_t fill, FILE *csv, harm_result_t *avg, long *windows)
+{
+    size_t nw = (fill - b->n) / b->hop + 1;
+
+    pool_run(nw, harm_task, b);
+    for (size_t k = 0; k < nw; ++k) {
+        const harm_result_t *r = &b->r[k];
+        if (!b->ok[k]) continue;
+
+        if (r->H < avg->H) avg->H = r->H;
+        for (int h = 0; h <= HARM_MAX; ++h) {
+            avg->v[h] += r->v[h];
+            avg->i[h] += r->i[h];
+            avg->p[h] += r->p[h];
+        }
+        avg->thd_v += r->thd_v;
+        avg->thd_i += r->thd_i;
+        avg->p_total += r->p_total;
+        avg->s += r->s;
+        avg->pf_true += r->pf_true;
+        avg->pf_disp += r->pf_disp;
+
+        if (csv)
+            fprintf(csv, "%ld,%.9g,%.9g,%.9g,%.6f,%.6f,%.9g,%.6f,%.6f\n", *windows, b->t[k * b->hop],
+                    r->v[1], r->i[1], r->thd_v, r->thd_i, r->p_total, r->pf_true, r->pf_disp);
+        (*windows)++;
+    }
+    return nw;
+}
+
+// Slides an n-sample window (advanced by hop <= n samples) over a t,v,i
+// capture and averages the per-window results into *avg. Only the samples of
+// HARM_BATCH windows are held at once. If csv != NULL, one row per window is
+// written to it.
+// Returns the number of windows analysed, or -1 if the file cannot be opened
+// or memory runs out.
+long harmonic_file(const char *path, size_t n, size_t hop, double f1, int H,
+                   FILE *csv, harm_result_t *avg, long *skipped)
+{
+    fft_plan_t *plan = fft_plan_get(n);
+    if (!plan) return -1;
+
+    FILE *fp = fopen(path, "r");
+    if (!fp) return -1;
+
+    size_t cap = n + (HARM_BATCH - 1) * hop, m = n / 2;
+    int threads = pool_threads(), ok = 1;
+    harm_batch_t *b = calloc(1, sizeof *b);
+    double *t = malloc(cap * sizeof *t), *v = malloc(cap * sizeof *v), *i = malloc(cap * sizeof *i);
+    ok = b && t && v && i;
+    for (int w = 0; ok && w < threads; ++w)
+        ok = (b->work[w] = malloc((2 * m + 4 * (m + 1)) * sizeof(double))) != NULL;
+    if (!ok) {
+        if (b) for (int w = 0; w < threads; ++w) free(b->work[w]);
+        free(b); free(t); free(v); free(i);
+        fclose(fp);
+        return -1;
+    }
+    b->plan = plan;
+    b->t = t;
+    b->v = v;
+    b->i = i;
+    b->n = n;
+    b->hop = hop;
+    b->f1 = f1;
+    b->H = H;
+
+    if (csv) fprintf(csv, "window,t_start,V1,I1,THD_V,THD_I,P,PF_true,PF_disp\n");
+
+    char line[256];
+    double f[3];
+    size_t fill = 0;
+    long windows = 0;
+
+    memset(avg, 0, sizeof *avg);
+    avg->H = H;
+    *skipped = 0;
+
+    for (;;) {
+        int more = fgets(line, sizeof line, fp) != NULL;
+        if (more) {
+            if (parse_fields(line, f, 3) != 3) { (*skipped)++; continue; }
+            t[fill] = f[0];
+            v[fill] = f[1];
+            i[fill] = f[2];
+            if (++fill < cap) continue;
+        }
+        if (fill >= n) {
+            // Slide: keep the samples the next window needs onwards.
+            size_t used = harm_batch_run(b, fill, csv, avg, &windows) * hop;
+            fill -= used;
+            memmove(t, t + used, fill * sizeof *t);
+            memmove(v, v + used, fill * sizeof *v);
+            memmove(i, i + used, fill * sizeof *i);
+        }
+        if (!more) break;
+    }
+
+    if (windows > 0) {
+        double w = (double)windows;
+        for (int h = 0; h <= HARM_MAX; ++h) {
+            avg->v[h] /= w;
+            avg->i[h] /= w;
+            avg->p[h] /= w;
+        }
+        avg->thd_v /= w;
+        avg->thd_i /= w;
+        avg->p_total /= w;
+        avg->s /= w;
+        avg->pf_true /= w;
+        avg->pf_disp /= w;
+    }
+
+    for (int w = 0; w < threads; ++w) free(b->work[w]);
+    free(b); free(t); free(v); free(i);
+    fclose(fp);
+    return windows;
+}
+
+// Harmonic analysis of consecutive, non-overlapping windows of `window`
+// samples spaced dt apart (harmonic_file() with hop = window). Returns the
+// mean THD of v, or NAN if no window could be analysed.
+double kernel_harmonics(const double *v, const double *i, size_t n, size_t window, double dt, double f1)
+{
+    fft_plan_t *plan = fft_plan_get(window);
+    if (!plan) return NAN;
+    double *wr = malloc(2 * (window / 2 + 1) * sizeof *wr), *wi = malloc(2 * (window / 2 + 1) * sizeof *wi);
+    double thd = 0.0;
+    long windows = 0;
+    harm_result_t r;
+
+    for (size_t k = 0; wr && wi && k + window <= n; k += window)
+        if (harmonic_window(plan, v + k, i + k, dt, f1, HARM_MAX, wr, wi, &r)) {
+            thd += r.thd_v;
+            windows++;
+        }
+    free(wr);
+    free(wi);
+    return windows ? thd / (double)windows : NAN;
+}
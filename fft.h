@@ -0,0 +1,40 @@
+// FFT harmonic analysis for the EEE Helper CLI calculator (menu 5).
+// A t,v,i capture is cut into windows of a power-of-two number of samples;
+// each window's real FFT gives per-harmonic rms V and I, harmonic power,
+// THD and the true and displacement power factors, and the windows are
+// averaged. Only a batch of windows is held in memory at once.
+
+#ifndef FFT_H
+#define FFT_H
+
+#include <stdio.h>
+#include <stddef.h>
+
+// Highest harmonic that can be analysed.
+#define HARM_MAX 50
+
+// Per-window (or averaged) harmonic results. Index 0 is DC, h is the h-th harmonic.
+typedef struct {
+    int H;                                  // highest harmonic analysed
+    double v[HARM_MAX + 1], i[HARM_MAX + 1], p[HARM_MAX + 1];  // rms V, rms I, power
+    double thd_v, thd_i;                    // relative to the fundamental
+    double p_total, s, pf_true, pf_disp;
+} harm_result_t;
+
+// 1 if n is a power of two (window sizes must be, and at least 4).
+int fft_is_pow2(size_t n);
+
+// Slides an n-sample window, advanced by hop <= n samples, over a t,v,i
+// capture with fundamental f1 and averages harmonics 0..H into *avg. If
+// csv != NULL, one row per window is written to it. Lines that do not
+// parse are counted in *skipped.
+// Returns the number of windows analysed, or -1 if the file cannot be opened
+// or memory runs out.
+long harmonic_file(const char *path, size_t n, size_t hop, double f1, int H,
+                   FILE *csv, harm_result_t *avg, long *skipped);
+
+// Harmonic analysis of consecutive, non-overlapping windows of samples in
+// memory (timed by bench.out). Returns the mean THD of v, NAN if no window.
+double kernel_harmonics(const double *v, const double *i, size_t n, size_t window, double dt, double f1);
+
+#endif
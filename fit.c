@@ -0,0 +1,542 @@
+// Least-squares curve fitting: Levenberg-Marquardt and batched curve files.
+// Design notes:
+// Levenberg-Marquardt for small models (up to LM_MAX_P parameters). The model
+// callback fills the residual vector r = model - y and the Jacobian J (n rows
+// of np entries) for all n points at once. Curve files are read a batch of
+// curves at a time; the batch's fits run on the worker pool and are reported
+// in file order, so results do not depend on the thread count.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "fit.h"
+#include "funcs.h"
+#include "stats.h"
+#include "pool.h"
+#include "vec4.h"
+
+#define PI 3.14159265358979323846
+
+typedef void (*lm_model_fn)(const double *prm, const double *x, const double *y, size_t n,
+                            double *r, double *J, void *ctx);
+
+typedef struct {
+    const double *x, *y;
+    size_t n;
+    int np;
+    lm_model_fn model;
+    void *ctx;
+    double *r, *J, *r_try, *J_try;   // caller-provided work buffers (n and n * np)
+} lm_problem_t;
+
+// Solves A x = b for an n x n system (n <= LM_MAX_P) by Gaussian elimination
+// with partial pivoting. A and b are overwritten. Returns 0 if A is singular.
+static int solve_small(double A[LM_MAX_P][LM_MAX_P], double *b, int n)
+{
+    for (int c = 0; c < n; ++c) {
+        int piv = c;
+        for (int r = c + 1; r < n; ++r)
+            if (fabs(A[r][c]) > fabs(A[piv][c])) piv = r;
+        if (fabs(A[piv][c]) < 1e-300) return 0;
+
+        if (piv != c) {
+            for (int k = 0; k < n; ++k) { double t = A[c][k]; A[c][k] = A[piv][k]; A[piv][k] = t; }
+            double t = b[c]; b[c] = b[piv]; b[piv] = t;
+        }
+        for (int r = c + 1; r < n; ++r) {
+            double f = A[r][c] / A[c][c];
+            for (int k = c; k < n; ++k) A[r][k] -= f * A[c][k];
+            b[r] -= f * b[c];
+        }
+    }
+    for (int c = n - 1; c >= 0; --c) {
+        for (int k = c + 1; k < n; ++k) b[c] -= A[c][k] * b[k];
+        b[c] /= A[c][c];
+    }
+    return 1;
+}
+
+// Forms J^T J and J^T r. Returns the sum of squared residuals.
+static double lm_normal(const double *r, const double *J, size_t n, int np,
+                        double A[LM_MAX_P][LM_MAX_P], double *g)
+{
+    double cost = 0.0;
+
+    memset(A, 0, sizeof(double) * LM_MAX_P * LM_MAX_P);
+    memset(g, 0, sizeof(double) * LM_MAX_P);
+    for (size_t k = 0; k < n; ++k) {
+        const double *row = J + k * (size_t)np;
+        for (int a = 0; a < np; ++a) {
+            g[a] += row[a] * r[k];
+            for (int b = 0; b <= a; ++b) A[a][b] += row[a] * row[b];
+        }
+        cost += r[k] * r[k];
+    }
+    for (int a = 0; a < np; ++a)
+        for (int b = a + 1; b < np; ++b) A[a][b] = A[b][a];
+    return cost;
+}
+
+// Refines prm in place. Stops when the cost stops improving, after max_iter
+// iterations, or when the damping grows without finding a better step.
+static void lm_fit(lm_problem_t *pb, double *prm, int max_iter, lm_result_t *res)
+{
+    STATS_SCOPE(STAT_CURVE_FIT);
+    int np = pb->np;
+    double A[LM_MAX_P][LM_MAX_P], g[LM_MAX_P];
+    double lambda = 1e-3;
+
+    pb->model(prm, pb->x, pb->y, pb->n, pb->r, pb->J, pb->ctx);
+    double cost = lm_normal(pb->r, pb->J, pb->n, np, A, g);
+
+    memset(res, 0, sizeof *res);
+    res->ok = 1;
+
+    int it;
+    for (it = 0; it < max_iter && lambda < 1e12; ++it) {
+        double M[LM_MAX_P][LM_MAX_P], step[LM_MAX_P], trial[LM_MAX_P];
+
+        memcpy(M, A, sizeof M);
+        for (int a = 0; a < np; ++a) {
+            M[a][a] += lambda * (A[a][a] > 0.0 ? A[a][a] : 1.0);
+            step[a] = -g[a];
+        }
+        if (!solve_small(M, step, np)) { lambda *= 10.0; continue; }
+
+        for (int a = 0; a < np; ++a) trial[a] = prm[a] + step[a];
+        pb->model(trial, pb->x, pb->y, pb->n, pb->r_try, pb->J_try, pb->ctx);
+
+        double A_try[LM_MAX_P][LM_MAX_P], g_try[LM_MAX_P];
+        double cost_try = lm_normal(pb->r_try, pb->J_try, pb->n, np, A_try, g_try);
+
+        if (isfinite(cost_try) && cost_try < cost) {
+            double gain = cost - cost_try;
+            memcpy(prm, trial, sizeof(double) * (size_t)np);
+            memcpy(A, A_try, sizeof A);
+            memcpy(g, g_try, sizeof g);
+
+            double *t = pb->r; pb->r = pb->r_try; pb->r_try = t;
+            t = pb->J; pb->J = pb->J_try; pb->J_try = t;
+
+            cost = cost_try;
+            lambda *= 0.1;
+            if (gain <= 1e-14 * cost + 1e-300) { it++; break; }
+        }
+        else {
+            lambda *= 10.0;
+        }
+    }
+
+    res->cost = cost;
+    res->iterations = it;
+
+    // Covariance: columns of (J^T J)^-1 scaled by the residual variance.
+    double dof = (double)pb->n - (double)np;
+    double s2 = dof > 0.0 ? cost / dof : 0.0;
+    for (int c = 0; c < np; ++c) {
+        double M[LM_MAX_P][LM_MAX_P], e[LM_MAX_P] = {0};
+        memcpy(M, A, sizeof M);
+        e[c] = 1.0;
+        if (!solve_small(M, e, np)) { res->ok = 0; break; }
+        for (int r = 0; r < np; ++r) res->cov[r][c] = e[r] * s2;
+    }
+}
+
+// Points k..n-1 of rc_model.
+static void rc_model_points(double a, double b, double inv_tau, const double *t, const double *y,
+                            size_t k, size_t n, double *r, double *J)
+{
+    for (; k < n; ++k) {
+        double e = exp(-t[k] * inv_tau);
+        r[k] = a + b * (1.0 - e) - y[k];
+        J[3 * k + 0] = 1.0;
+        J[3 * k + 1] = 1.0 - e;
+        J[3 * k + 2] = -b * e * t[k] * inv_tau * inv_tau;
+    }
+}
+
+#if defined(__x86_64__) && defined(__GNUC__)
+// rc_model four points at a time, compiled for AVX2 so that v4d is one
+// register (with SSE2 alone the lane compares in v4_exp make this slower than
+// exp()). Returns how many points it did, a multiple of 4.
+__attribute__((target("avx2")))
+static size_t rc_model_avx2(double a, double b, double inv_tau, const double *t, const double *y,
+                            size_t n, double *r, double *J)
+{
+    size_t k = 0;
+
+    for (; k + 4 <= n; k += 4) {
+        v4d tt, yy, x, e;
+        V4_LOAD(tt, t + k);
+        V4_LOAD(yy, y + k);
+        x = -tt * inv_tau;
+        v4_exp(&e, &x);
+        v4d one_e = 1.0 - e;
+        v4d rr = a + b * one_e - yy;
+        v4d dtau = -b * e * tt * (inv_tau * inv_tau);
+        V4_STORE(r + k, rr);
+        for (int l = 0; l < 4; ++l) {
+            double *row = J + 3 * (k + (size_t)l);
+            row[0] = 1.0;
+            row[1] = one_e[l];
+            row[2] = dtau[l];
+        }
+    }
+    return k;
+}
+#endif
+
+// RC step response v(t) = a + b (1 - e^(-t / tau)), prm = { a, b, tau }.
+// Residuals and Jacobian rows are evaluated with v4d where the CPU has AVX2.
+static void rc_model(const double *prm, const double *t, const double *y, size_t n,
+                     double *r, double *J, void *ctx)
+{
+    double a = prm[0], b = prm[1], inv_tau = 1.0 / prm[2];
+    size_t k = 0;
+    (void)ctx;
+
+#if defined(__x86_64__) && defined(__GNUC__)
+    if (__builtin_cpu_supports("avx2")) k = rc_model_avx2(a, b, inv_tau, t, y, n, r, J);
+#endif
+    rc_model_points(a, b, inv_tau, t, y, k, n, r, J);
+}
+
+// Log-linear starting point for rc_model. The final value is extrapolated
+// slightly past the last sample, then tau and the amplitude come from a
+// straight-line fit of ln|v_final - v(t)| against t.
+// Returns 0 if the curve is too flat or short to give an estimate.
+static int rc_seed(const double *t, const double *y, size_t n, double prm[3])
+{
+    if (n < 4) return 0;
+
+    double lo = y[0], hi = y[0];
+    for (size_t k = 1; k < n; ++k) {
+        if (y[k] < lo) lo = y[k];
+        if (y[k] > hi) hi = y[k];
+    }
+    double range = hi - lo;
+    if (range <= 0.0) return 0;
+
+    int rising = y[n - 1] >= y[0];
+    double y_inf = rising ? hi + 0.01 * range : lo - 0.01 * range;
+
+    double sx = 0.0, sy = 0.0, sxx = 0.0, sxy = 0.0, m = 0.0;
+    for (size_t k = 0; k < n; ++k) {
+        double d = fabs(y_inf - y[k]);
+        if (d < 0.05 * range) continue;   // too close to the asymptote to trust
+        double ly = log(d);
+        sx += t[k]; sy += ly; sxx += t[k] * t[k]; sxy += t[k] * ly; m += 1.0;
+    }
+    double den = m * sxx - sx * sx;
+    if (m < 2.0 || den <= 0.0) return 0;
+
+    double slope = (m * sxy - sx * sy) / den;
+    if (slope >= 0.0) return 0;
+
+    double intercept = (sy - slope * sx) / m;
+
+    // y_inf - v(t) = b e^(-t / tau), so |b| = e^intercept and a = y_inf - b.
+    prm[2] = -1.0 / slope;
+    prm[1] = rising ? exp(intercept) : -exp(intercept);
+    prm[0] = y_inf - prm[1];
+    return 1;
+}
+
+static int curve_push(curve_buf_t *c, double t, double y, int np)
+{
+    if (c->n == c->cap) {
+        size_t cap = c->cap ? 2 * c->cap : 256;
+        double *nt = realloc(c->t, cap * sizeof *nt);
+        if (nt) c->t = nt;
+        double *ny = realloc(c->y, cap * sizeof *ny);
+        if (ny) c->y = ny;
+        double *nr = realloc(c->r, cap * sizeof *nr);
+        if (nr) c->r = nr;
+        double *nrt = realloc(c->r_try, cap * sizeof *nrt);
+        if (nrt) c->r_try = nrt;
+        double *nj = realloc(c->J, cap * (size_t)np * sizeof *nj);
+        if (nj) c->J = nj;
+        double *njt = realloc(c->J_try, cap * (size_t)np * sizeof *njt);
+        if (njt) c->J_try = njt;
+        if (!nt || !ny || !nr || !nrt || !nj || !njt) return 0;
+        c->cap = cap;
+    }
+    c->t[c->n] = t;
+    c->y[c->n] = y;
+    c->n++;
+    return 1;
+}
+
+static void curve_free(curve_buf_t *c)
+{
+    free(c->t); free(c->y); free(c->r); free(c->J); free(c->r_try); free(c->J_try);
+    memset(c, 0, sizeof *c);
+}
+
+// Fits rc_model to the buffered curve. Returns 0 if no seed could be found.
+static int rc_fit_curve(curve_buf_t *c, double prm[3], lm_result_t *res)
+{
+    if (!rc_seed(c->t, c->y, c->n, prm)) return 0;
+
+    lm_problem_t pb = { c->t, c->y, c->n, 3, rc_model, NULL, c->r, c->J, c->r_try, c->J_try };
+    lm_fit(&pb, prm, 200, res);
+
+    // lm_fit may have swapped the work buffers.
+    c->r = pb.r; c->J = pb.J; c->r_try = pb.r_try; c->J_try = pb.J_try;
+    return prm[2] > 0.0;
+}
+
+// Curves are read CURVE_BATCH at a time (fewer if they hold more than
+// CURVE_BATCH_POINTS points between them) and fitted in parallel.
+#define CURVE_BATCH        256
+#define CURVE_BATCH_POINTS (1 << 18)
+
+typedef struct {
+    curve_slot_t *slot;
+    curve_fit_fn fit;
+    const void *ctx;
+} curve_batch_t;
+
+static void curve_task(size_t k, int worker, void *ctx)
+{
+    curve_batch_t *b = ctx;
+    (void)worker;
+    b->fit(&b->slot[k], b->ctx);
+}
+
+// Fits the first n slots, reports them in order and empties them. Slots that
+// grew past a fair share of the batch give their memory back.
+static int curve_batch_flush(curve_batch_t *b, size_t n, curve_fn fn, void *ctx)
+{
+    int ok = 1;
+
+    pool_run(n, curve_task, b);
+    for (size_t k = 0; k < n; ++k) {
+        if (ok) ok = fn(&b->slot[k], ctx);
+        b->slot[k].c.n = 0;
+        if (b->slot[k].c.cap > 4 * (CURVE_BATCH_POINTS / CURVE_BATCH)) curve_free(&b->slot[k].c);
+    }
+    return ok;
+}
+
+// Reads a file of "id, x, y1..ym" rows (rows of one curve together) or of
+// "x, y1..ym" rows (a single curve, id 0). Each row pushes (x, y_j) for
+// j = 1..m, so a curve of k rows holds k * m points. Every curve is fitted
+// by fit(slot, fit_ctx) on the worker pool and passed to fn. Returns the number of curves
+// passed to fn, or -1 if the file cannot be opened, memory runs out or fn
+// fails.
+long curve_file_each(const char *path, int m, int np, curve_fit_fn fit, const void *fit_ctx,
+                     curve_fn fn, void *ctx)
+{
+    FILE *fp = fopen(path, "r");
+    if (!fp) return -1;
+
+    curve_batch_t b = { calloc(CURVE_BATCH, sizeof(curve_slot_t)), fit, fit_ctx };
+    if (!b.slot) { fclose(fp); return -1; }
+
+    char line[256];
+    double f[LM_MAX_P + 2];
+    long curves = 0;
+    size_t n = 0, points = 0;          // curves and points in the batch; slot n is being read
+    int ok = 1;
+
+    while (ok && fgets(line, sizeof line, fp)) {
+        int nf = parse_fields(line, f, m + 2);
+        if (nf != m + 1 && nf != m + 2) continue;
+
+        double this_id = (nf == m + 2) ? f[0] : 0.0;
+        const double *row = f + (nf - m - 1);
+        curve_slot_t *s = &b.slot[n];
+
+        if (s->c.n > 0 && this_id != s->id) {
+            curves++;
+            points += s->c.n;
+            if (++n == CURVE_BATCH || points >= CURVE_BATCH_POINTS) {
+                ok = curve_batch_flush(&b, n, fn, ctx);
+                n = points = 0;
+            }
+            s = &b.slot[n];
+        }
+        s->id = this_id;
+        for (int j = 1; j <= m && ok; ++j) ok = curve_push(&s->c, row[0], row[j], np);
+    }
+    if (ok && b.slot[n].c.n > 0) {
+        curves++;
+        n++;
+    }
+    if (ok && n > 0) ok = curve_batch_flush(&b, n, fn, ctx);
+
+    for (size_t k = 0; k < CURVE_BATCH; ++k) curve_free(&b.slot[k].c);
+    free(b.slot);
+    fclose(fp);
+    return ok ? curves : -1;
+}
+
+// curve_fit_fn for RC fits.
+void rc_fit_task(curve_slot_t *s, const void *ctx)
+{
+    (void)ctx;
+    s->ok = rc_fit_curve(&s->c, s->prm, &s->res);
+}
+
+// Impedance sweep models. Points come in (Re, Im) pairs: x[2k] = x[2k+1] = f
+// and y[2k] = Re Z, y[2k+1] = Im Z, so residuals stack as Re, Im, Re, Im ...
+// Residuals are relative (divided by |Z measured|) because sweeps span several
+// decades of |Z| and absolute errors near resonance would swamp the rest.
+//   ZMODEL_SERIES_RLC:   Z = R + j(wL - 1/(wC))             (C with ESR and ESL)
+//   ZMODEL_L_PARASITIC:  Z = (R + jwL) || Cp                (L with winding R and Cp)
+
+// 1 / |Z| of measured point k, or 1 if |Z| is zero.
+static double zweight(const double *y, size_t k)
+{
+    double m = hypot(y[k], y[k + 1]);
+    return m > 0.0 ? 1.0 / m : 1.0;
+}
+
+static void zmodel_series_rlc(const double *prm, const double *f, const double *y, size_t n,
+                              double *r, double *J, void *ctx)
+{
+    double R = prm[0], L = prm[1], C = prm[2];
+    (void)ctx;
+
+    for (size_t k = 0; k + 1 < n; k += 2) {
+        double w = 2.0 * PI * f[k], q = zweight(y, k);
+        r[k] = q * (R - y[k]);
+        r[k + 1] = q * (w * L - 1.0 / (w * C) - y[k + 1]);
+
+        double *jr = J + 3 * k, *ji = J + 3 * (k + 1);
+        jr[0] = q;   jr[1] = 0.0;   jr[2] = 0.0;
+        ji[0] = 0.0; ji[1] = q * w; ji[2] = q / (w * C * C);
+    }
+}
+
+// Minimal complex arithmetic for the impedance models.
+typedef struct { double re, im; } cx_t;
+
+static cx_t cx_mul(cx_t a, cx_t b)
+{
+    cx_t r = { a.re * b.re - a.im * b.im, a.re * b.im + a.im * b.re };
+    return r;
+}
+
+static cx_t cx_div(cx_t a, cx_t b)
+{
+    double d = b.re * b.re + b.im * b.im;
+    cx_t r = { (a.re * b.re + a.im * b.im) / d, (a.im * b.re - a.re * b.im) / d };
+    return r;
+}
+
+static void zmodel_l_parasitic(const double *prm, const double *f, const double *y, size_t n,
+                               double *r, double *J, void *ctx)
+{
+    double R = prm[0], L = prm[1], Cp = prm[2];
+    (void)ctx;
+
+    for (size_t k = 0; k + 1 < n; k += 2) {
+        double w = 2.0 * PI * f[k], q = zweight(y, k);
+        cx_t N = { R, w * L };
+        cx_t D = { 1.0 - w * w * L * Cp, w * Cp * R };   // 1 + jwCp N
+        cx_t Z = cx_div(N, D);
+        cx_t one = { 1.0, 0.0 };
+        cx_t inv = cx_div(one, cx_mul(D, D));
+        cx_t t = cx_mul(cx_mul(N, N), inv);
+
+        // dZ/dR = 1/D^2, dZ/dL = jw/D^2, dZ/dCp = -jw N^2 / D^2
+        r[k] = q * (Z.re - y[k]);
+        r[k + 1] = q * (Z.im - y[k + 1]);
+
+        double *jr = J + 3 * k, *ji = J + 3 * (k + 1);
+        jr[0] = q * inv.re; jr[1] = -q * w * inv.im; jr[2] = q * w * t.im;
+        ji[0] = q * inv.im; ji[1] = q * w * inv.re;  ji[2] = -q * w * t.re;
+    }
+}
+
+// Starting values. Series RLC: R = mean Re Z, and Im Z = wL - (1/C)(1/w) is
+// linear in L and 1/C, so a 2x2 least squares solve gives both.
+// L with parasitic: the same trick on the admittance gives L and Cp, and R
+// is taken from the lowest-frequency point.
+static int zmodel_seed(int model, const double *f, const double *y, size_t n, double prm[3])
+{
+    size_t pts = n / 2;
+    if (pts < 3) return 0;
+
+    if (model == ZMODEL_SERIES_RLC) {
+        double sR = 0.0, A[LM_MAX_P][LM_MAX_P] = {{0}}, b[LM_MAX_P] = {0};
+        for (size_t k = 0; k < n; k += 2) {
+            double w = 2.0 * PI * f[k], u = -1.0 / w;
+            sR += y[k];
+            A[0][0] += w * w; A[0][1] += w * u; A[1][1] += u * u;
+            b[0] += w * y[k + 1]; b[1] += u * y[k + 1];
+        }
+        A[1][0] = A[0][1];
+        if (!solve_small(A, b, 2) || b[1] <= 0.0) return 0;
+        prm[0] = sR / (double)pts;
+        prm[1] = b[0] > 0.0 ? b[0] : 1e-12;
+        prm[2] = 1.0 / b[1];
+        return 1;
+    }
+
+    // Im Y = wCp - wL / (R^2 + w^2 L^2) ~ wCp - (1/L)(1/w) once wL >> R, which is
+    // linear in Cp and 1/L. Rows are scaled by 1/|Y| to keep them relative.
+    double A[LM_MAX_P][LM_MAX_P] = {{0}}, b[LM_MAX_P] = {0};
+    size_t lo = 0;
+    for (size_t k = 0; k < n; k += 2) {
+        double m2 = y[k] * y[k] + y[k + 1] * y[k + 1];
+        if (m2 <= 0.0) continue;
+        if (f[k] < f[lo]) lo = k;
+
+        double w = 2.0 * PI * f[k], q = sqrt(m2);    // 1/|Y| = |Z|
+        double im_y = -y[k + 1] / m2;
+        double a0 = q * w, a1 = -q / w;
+        A[0][0] += a0 * a0; A[0][1] += a0 * a1; A[1][1] += a1 * a1;
+        b[0] += a0 * q * im_y; b[1] += a1 * q * im_y;
+    }
+    A[1][0] = A[0][1];
+    if (!solve_small(A, b, 2) || b[1] <= 0.0) return 0;
+
+    prm[0] = fabs(y[lo]);
+    prm[1] = 1.0 / b[1];
+    prm[2] = b[0] > 0.0 ? b[0] : 1e-15;
+    return 1;
+}
+
+// curve_fit_fn for impedance sweeps.
+void zfit_task(curve_slot_t *s, const void *ctx)
+{
+    int model = *(const int *)ctx;
+    curve_buf_t *c = &s->c;
+
+    s->ok = zmodel_seed(model, c->t, c->y, c->n, s->prm);
+    if (s->ok) {
+        lm_problem_t pb = { c->t, c->y, c->n, 3,
+                            model == ZMODEL_SERIES_RLC ? zmodel_series_rlc : zmodel_l_parasitic,
+                            NULL, c->r, c->J, c->r_try, c->J_try };
+        lm_fit(&pb, s->prm, 200, &s->res);
+        c->r = pb.r; c->J = pb.J; c->r_try = pb.r_try; c->J_try = pb.J_try;
+        s->ok = s->res.ok && s->prm[1] > 0.0 && s->prm[2] > 0.0;
+    }
+}
+
+// RC step-response fits of consecutive curves of per_curve points each, as
+// rc_fit_task() does for a file of curves. Returns the mean fitted tau, or NAN
+// if no curve could be fitted.
+double kernel_rc_fit(const double *t, const double *y, size_t n, size_t per_curve)
+{
+    curve_buf_t c = {0};
+    double tau = 0.0, prm[3];
+    long fitted = 0;
+    lm_result_t res;
+
+    for (size_t k = 0; per_curve > 0 && k + per_curve <= n; k += per_curve) {
+        int ok = 1;
+        c.n = 0;
+        for (size_t j = k; j < k + per_curve && ok; ++j) ok = curve_push(&c, t[j], y[j], 3);
+        if (ok && rc_fit_curve(&c, prm, &res) && res.ok) {
+            tau += prm[2];
+            fitted++;
+        }
+    }
+    curve_free(&c);
+    return fitted ? tau / (double)fitted : NAN;
+}
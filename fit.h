@@ -0,0 +1,69 @@
+// Least-squares curve fitting for the EEE Helper CLI calculator (menus 3, 4).
+// Files of measured curves are fitted one curve at a time by
+// Levenberg-Marquardt, with the curves of a batch fitted in parallel on the
+// worker pool (pool.h) and reported in file order. The RC step response
+// v(t) = offset + amplitude (1 - e^(-t / tau)) is fitted by rc_fit_task()
+// and impedance-versus-frequency sweeps by zfit_task().
+
+#ifndef FIT_H
+#define FIT_H
+
+#include <stddef.h>
+
+#define LM_MAX_P 4
+
+typedef struct {
+    double cost;                     // sum of squared residuals
+    double cov[LM_MAX_P][LM_MAX_P];  // parameter covariance (J^T J)^-1 * cost / (n - np)
+    int iterations;
+    int ok;                          // 0 if the normal equations were singular
+} lm_result_t;
+
+// Growable (x, y) buffer for one curve plus the LM work buffers.
+typedef struct {
+    double *t, *y, *r, *J, *r_try, *J_try;
+    size_t n, cap;
+} curve_buf_t;
+
+// One curve read from a file, and its fit.
+typedef struct {
+    double id;
+    curve_buf_t c;
+    double prm[LM_MAX_P];
+    lm_result_t res;
+    int ok;                             // set by the curve_fit_fn
+} curve_slot_t;
+
+// Fits s->c into s->prm / res / ok. Runs on a worker thread, so it may only
+// read ctx.
+typedef void (*curve_fit_fn)(curve_slot_t *s, const void *ctx);
+
+// Called once per fitted curve, in file order. Returns 0 to stop reading.
+typedef int (*curve_fn)(const curve_slot_t *s, void *ctx);
+
+// Reads a file of "id, x, y1..ym" rows (rows of one curve together) or of
+// "x, y1..ym" rows (a single curve, id 0); each row adds the m points
+// (x, y_j). Every curve of np-parameter model is fitted by fit(slot, fit_ctx)
+// and then passed to fn(slot, ctx). Returns the number of curves passed to
+// fn, or -1 if the file cannot be opened, memory runs out or fn fails.
+long curve_file_each(const char *path, int m, int np, curve_fit_fn fit, const void *fit_ctx,
+                     curve_fn fn, void *ctx);
+
+// curve_fit_fn for RC step responses (m = 1, np = 3, fit_ctx unused):
+// prm = { offset, amplitude, tau }, seeded by a log-linear estimate.
+void rc_fit_task(curve_slot_t *s, const void *ctx);
+
+// Impedance sweep models for zfit_task(): Z = R + j(wL - 1/(wC)) (a
+// capacitor with ESR and ESL) and Z = (R + jwL) || Cp (an inductor with
+// winding resistance and parasitic capacitance).
+enum { ZMODEL_SERIES_RLC = 1, ZMODEL_L_PARASITIC = 2 };
+
+// curve_fit_fn for impedance sweeps (m = 2 for "f, ReZ, ImZ" rows, np = 3,
+// fit_ctx points to the int model): prm = { R, L, C or Cp }.
+void zfit_task(curve_slot_t *s, const void *ctx);
+
+// RC fits of consecutive curves of per_curve points in memory (timed by
+// bench.out). Returns the mean fitted tau, NAN if no curve could be fitted.
+double kernel_rc_fit(const double *t, const double *y, size_t n, size_t per_curve);
+
+#endif
@@ -0,0 +1,114 @@
+// Formula registry for the EEE Helper CLI calculator.
+// Every formula is declared once in FORMULA_LIST below. The solver menu, batch
+// CSV columns, command-line arguments and log records are all generated from
+// it, so a new entry here is immediately usable everywhere.
+//
+// FORMULA(id, name, equation, forward, inverse, vars)
+//   forward: computes vars[0] from the other variables
+//   inverse: closed-form solve for one variable (returns 0 if none), or NULL
+//   vars:    VAR(name, unit, domain) for each variable, result first
+
+#ifndef FORMULAS_H
+#define FORMULAS_H
+
+#include <stddef.h>
+
+#define FORMULA_MAX_VARS 5
+
+// Domain of a variable, used both to validate inputs and to bound the search.
+enum { DOM_ANY, DOM_POS, DOM_NONNEG, DOM_PCT, DOM_ANGLE };
+
+#define FORMULA_LIST(FORMULA, VAR)                                                    \
+    FORMULA(DIVIDER, "divider.vout", "Vout = Vin * R2 / (R1 + R2)",                   \
+            fw_divider, inv_divider,                                                  \
+            VAR("Vout", "V", DOM_ANY) VAR("Vin", "V", DOM_ANY)                        \
+            VAR("R1", "ohm", DOM_NONNEG) VAR("R2", "ohm", DOM_POS))                   \
+    FORMULA(PARALLEL, "parallel.req", "Req = R1 * R2 / (R1 + R2)",                    \
+            fw_parallel, inv_parallel,                                                \
+            VAR("Req", "ohm", DOM_NONNEG) VAR("R1", "ohm", DOM_POS)                   \
+            VAR("R2", "ohm", DOM_POS))                                                \
+    FORMULA(XL, "ac.xl", "XL = 2 pi f L",                                             \
+            fw_xl, NULL,                                                              \
+            VAR("XL", "ohm", DOM_NONNEG) VAR("f", "Hz", DOM_POS) VAR("L", "H", DOM_POS)) \
+    FORMULA(XC, "ac.xc", "XC = 1 / (2 pi f C)",                                       \
+            fw_xc, NULL,                                                              \
+            VAR("XC", "ohm", DOM_POS) VAR("f", "Hz", DOM_POS) VAR("C", "F", DOM_POS)) \
+    FORMULA(F0, "ac.f0", "f0 = 1 / (2 pi sqrt(L C))",                                 \
+            fw_resonance, NULL,                                                       \
+            VAR("f0", "Hz", DOM_POS) VAR("L", "H", DOM_POS) VAR("C", "F", DOM_POS))   \
+    FORMULA(RC_CHARGE, "rc.charge", "charge% = 100 (1 - e^(-t / RC))",                \
+            fw_rc_charge, inv_rc_charge,                                              \
+            VAR("charge", "%", DOM_PCT) VAR("R", "ohm", DOM_POS)                      \
+            VAR("C", "F", DOM_POS) VAR("t", "s", DOM_NONNEG))                         \
+    FORMULA(RC_DISCHARGE, "rc.discharge", "discharge% = 100 e^(-t / RC)",             \
+            fw_rc_dis, NULL,                                                          \
+            VAR("discharge", "%", DOM_PCT) VAR("R", "ohm", DOM_POS)                   \
+            VAR("C", "F", DOM_POS) VAR("t", "s", DOM_NONNEG))                         \
+    FORMULA(POWER, "power.p", "P = V * I",                                            \
+            fw_power, inv_power,                                                      \
+            VAR("P", "W", DOM_ANY) VAR("V", "V", DOM_ANY) VAR("I", "A", DOM_ANY))     \
+    FORMULA(POWER_AC, "power.ac", "P = Vrms Irms cos(phi)",                           \
+            fw_power_ac, NULL,                                                        \
+            VAR("P", "W", DOM_ANY) VAR("Vrms", "V", DOM_NONNEG)                       \
+            VAR("Irms", "A", DOM_NONNEG) VAR("phi", "deg", DOM_ANGLE))                \
+    FORMULA(POWER_AC_Q, "power.ac.q", "Q = Vrms Irms sin(phi)",                       \
+            fw_power_ac_q, NULL,                                                      \
+            VAR("Q", "var", DOM_ANY) VAR("Vrms", "V", DOM_NONNEG)                     \
+            VAR("Irms", "A", DOM_NONNEG) VAR("phi", "deg", DOM_ANGLE))                \
+    FORMULA(POWER_AC_S, "power.ac.s", "S = Vrms Irms",                                \
+            fw_power, inv_power,                                                      \
+            VAR("S", "VA", DOM_NONNEG) VAR("Vrms", "V", DOM_NONNEG)                   \
+            VAR("Irms", "A", DOM_NONNEG))                                             \
+    FORMULA(POWER_AC_PF, "power.ac.pf", "PF = cos(phi)",                              \
+            fw_pf, inv_pf,                                                            \
+            VAR("PF", "pu", DOM_ANY) VAR("phi", "deg", DOM_ANGLE))                    \
+    FORMULA(THREEPHASE_P, "threephase.p", "P = sqrt(3) VL IL cos(phi)",               \
+            fw_threephase_p, NULL,                                                    \
+            VAR("P", "W", DOM_ANY) VAR("VL", "V", DOM_NONNEG)                         \
+            VAR("IL", "A", DOM_NONNEG) VAR("phi", "deg", DOM_ANGLE))                  \
+    FORMULA(STAR_VPHASE, "star.vphase", "Vph = VL / sqrt(3)",                         \
+            fw_line_to_phase, inv_line_to_phase,                                      \
+            VAR("Vph", "V", DOM_NONNEG) VAR("VL", "V", DOM_NONNEG))                   \
+    FORMULA(DELTA_IPHASE, "delta.iphase", "Iph = IL / sqrt(3)",                       \
+            fw_line_to_phase, inv_line_to_phase,                                      \
+            VAR("Iph", "A", DOM_NONNEG) VAR("IL", "A", DOM_NONNEG))
+
+// Formula ids: FORMULA_DIVIDER, FORMULA_PARALLEL, ... and FORMULA_COUNT.
+#define FORMULA_ENUM_ENTRY(id, name, eq, fw, inv, vars) FORMULA_##id,
+#define FORMULA_ENUM_VAR(name, unit, dom)
+enum { FORMULA_LIST(FORMULA_ENUM_ENTRY, FORMULA_ENUM_VAR) FORMULA_COUNT };
+#undef FORMULA_ENUM_ENTRY
+#undef FORMULA_ENUM_VAR
+
+typedef struct {
+    const char *name;
+    const char *unit;
+    int domain;
+} formula_var_t;
+
+typedef struct {
+    const char *name;                          // short id, e.g. "rc.charge"
+    const char *equation;                      // shown in the menu
+    int nvars;
+    formula_var_t vars[FORMULA_MAX_VARS];      // vars[0] is the forward result
+    double (*forward)(const double *v);
+    int (*inverse)(int var, double *v);        // 0 if no closed form for var (may be NULL)
+} formula_t;
+
+extern const formula_t FORMULAS[FORMULA_COUNT];
+
+const formula_t *formula_find(const char *name);
+int    formula_var_index(const formula_t *fm, const char *var);
+int    formula_domain_ok(int dom, double x);
+int    formula_solve(const formula_t *fm, int var, double *v, double hint, int *used_closed_form);
+size_t formula_solve_batch(const formula_t *fm, int var, const double *const *vals,
+                           size_t n, double *out);
+
+// Appends a text line to the log and a fixed-size record to the binary log.
+void formula_log(const formula_t *fm, int var, const double *v);
+
+// Command line: "name var=value ..." solves for the one variable not given.
+// Returns the process exit status.
+int formula_cli(int argc, char **argv);
+
+#endif
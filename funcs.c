@@ -9,13 +9,33 @@
 #include <string.h>
 #include <errno.h>
 #include <math.h>
+#include <ctype.h>
 #include <stdarg.h>   
+#include <limits.h>
+#include <time.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
 #include "funcs.h"
+#include "formulas.h"
+#include "expr.h"
+#include "sweep.h"
+#include "memo.h"
+#include "worksheet.h"
+#include "session.h"
+#include "stats.h"
+#include "pool.h"
+#include "power.h"
+#include "fft.h"
+#include "threephase.h"
+#include "monitor.h"
+#include "fit.h"
 
 static const char *LOG_FILE = "eee_log.txt";
 
 int log_line(const char *line)
 {
+    STATS_SCOPE(STAT_LOG_WRITE);
     FILE *fp = fopen(LOG_FILE, "a");
     if (!fp) return 0;
     fprintf(fp, "%s\n", line);
@@ -76,6 +96,7 @@ static int read_line(const char *prompt, char *buf, size_t size)
 // Rejects trailing junk (allows only trailing spaces/tabs).
 static int parse_long(const char *s, long *out, int base)
 {
+    STATS_SCOPE(STAT_INPUT_PARSE);
     if (!s || !*s) return 0;
 
     errno = 0;
@@ -97,6 +118,7 @@ static int parse_long(const char *s, long *out, int base)
 // Rejects trailing junk (allows only trailing spaces/tabs).
 static int parse_double(const char *s, double *out)
 {
+    STATS_SCOPE(STAT_INPUT_PARSE);
     if (!s || !*s) return 0;
 
     errno = 0;
@@ -114,6 +136,30 @@ static int parse_double(const char *s, double *out)
     return 1;
 }
 
+// Splits a line of comma, semicolon, tab or space separated numbers.
+// Returns the number of fields (up to max), or -1 if a field is not a number.
+int parse_fields(const char *s, double *out, int max)
+{
+    STATS_SCOPE(STAT_INPUT_PARSE);
+    int n = 0;
+
+    for (;;) {
+        while (*s == ' ' || *s == '\t' || *s == ',' || *s == ';') s++;
+        if (*s == '\0' || *s == '\r' || *s == '\n') break;
+        if (n == max) return -1;
+
+        errno = 0;
+        char *end = NULL;
+        double v = strtod(s, &end);
+        if (end == s || errno == ERANGE) return -1;
+        if (*end != '\0' && !strchr(" \t,;\r\n", *end)) return -1;
+
+        out[n++] = v;
+        s = end;
+    }
+    return n;
+}
+
 // Re-prompts until the user enters a valid integer.
 static int read_int(const char *prompt, int *out)
 {
@@ -148,11 +194,19 @@ static int read_double(const char *prompt, double *out)
     }
 }
 
+// Monotonic clock in nanoseconds, for timing jobs and samples.
+long long now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
 // --------------------SAFETY HELPERS--------------------
 
 // Performs safe division and rejects zero/near-zero denominators to avoid Inf/NaN.
 // Returns 1 on success, 0 if denominator is too small.
-static int safe_divide(double num, double den, double *out)
+int safe_divide(double num, double den, double *out)
 {
     const double eps = 1e-12; // treat very small denominators as zero
 
@@ -163,6 +217,467 @@ static int safe_divide(double num, double den, double *out)
     return 1;
 }
 
+// ------------------ FORMULA REGISTRY & SOLVER (used by 4 and 8) ------------------
+// The formulas themselves are declared in formulas.h. Any variable can be
+// solved for: a closed-form inverse is used when the formula provides one,
+// otherwise the root of forward(v) - v[0] is bracketed on a grid and refined
+// with Brent's method.
+
+static double fw_divider(const double *v)       { return v[1] * v[3] / (v[2] + v[3]); }
+static double fw_parallel(const double *v)      { return v[1] * v[2] / (v[1] + v[2]); }
+static double fw_xl(const double *v)            { return 2.0 * PI * v[1] * v[2]; }
+static double fw_xc(const double *v)            { return 1.0 / (2.0 * PI * v[1] * v[2]); }
+static double fw_resonance(const double *v)     { return 1.0 / (2.0 * PI * sqrt(v[1] * v[2])); }
+static double fw_rc_charge(const double *v)     { return 100.0 * (1.0 - exp(-v[3] / (v[1] * v[2]))); }
+static double fw_rc_dis(const double *v)        { return 100.0 * exp(-v[3] / (v[1] * v[2])); }
+static double fw_power(const double *v)         { return v[1] * v[2]; }
+static double fw_power_ac(const double *v)      { return v[1] * v[2] * cos(v[3] * (PI / 180.0)); }
+static double fw_power_ac_q(const double *v)    { return v[1] * v[2] * sin(v[3] * (PI / 180.0)); }
+static double fw_pf(const double *v)            { return cos(v[1] * (PI / 180.0)); }
+static double fw_threephase_p(const double *v)  { return sqrt(3.0) * v[1] * v[2] * cos(v[3] * (PI / 180.0)); }
+static double fw_line_to_phase(const double *v) { return v[1] / sqrt(3.0); }
+
+// Closed forms matching the hand-derived menu modes.
+static int inv_divider(int var, double *v)
+{
+    // v = { Vout, Vin, R1, R2 }
+    if (var == 1) return safe_divide(v[0] * (v[2] + v[3]), v[3], &v[1]);
+    if (var == 2) { double r; if (!safe_divide(v[1], v[0], &r)) return 0; v[2] = v[3] * (r - 1.0); return 1; }
+    if (var == 3) return safe_divide(v[2] * v[0], v[1] - v[0], &v[3]);
+    return 0;
+}
+
+static int inv_parallel(int var, double *v)
+{
+    // v = { Req, R1, R2 }
+    if (var == 1) return safe_divide(v[0] * v[2], v[2] - v[0], &v[1]);
+    if (var == 2) return safe_divide(v[0] * v[1], v[1] - v[0], &v[2]);
+    return 0;
+}
+
+static int inv_rc_charge(int var, double *v)
+{
+    // v = { pct, R, C, t }; only t = -RC ln(1 - p) is hand-derived
+    if (var != 3 || v[0] <= 0.0 || v[0] >= 100.0) return 0;
+    v[3] = -v[1] * v[2] * log(1.0 - v[0] / 100.0);
+    return 1;
+}
+
+static int inv_power(int var, double *v)
+{
+    // v = { P, V, I }
+    if (var == 1) return safe_divide(v[0], v[2], &v[1]);
+    if (var == 2) return safe_divide(v[0], v[1], &v[2]);
+    return 0;
+}
+
+static int inv_pf(int var, double *v)
+{
+    // v = { PF, phi }; phi >= 0 (current lagging), as the menu reports it
+    if (var != 1 || v[0] < -1.0 || v[0] > 1.0) return 0;
+    v[1] = acos(v[0]) * (180.0 / PI);
+    return 1;
+}
+
+static int inv_line_to_phase(int var, double *v)
+{
+    // v = { phase, line }
+    if (var != 1) return 0;
+    v[1] = v[0] * sqrt(3.0);
+    return 1;
+}
+
+#define FORMULA_TABLE_VAR(name, unit, dom) { name, unit, dom },
+#define FORMULA_TABLE_ENTRY(id, name, eq, fw, inv, vars) \
+    { name, eq, (int)(sizeof((formula_var_t[]){ vars }) / sizeof(formula_var_t)), { vars }, fw, inv },
+
+const formula_t FORMULAS[FORMULA_COUNT] = {
+    FORMULA_LIST(FORMULA_TABLE_ENTRY, FORMULA_TABLE_VAR)
+};
+
+#undef FORMULA_TABLE_ENTRY
+#undef FORMULA_TABLE_VAR
+
+int formula_domain_ok(int dom, double x)
+{
+    switch (dom) {
+        case DOM_POS:    return x > 0.0;
+        case DOM_NONNEG: return x >= 0.0;
+        case DOM_PCT:    return x > 0.0 && x < 100.0;
+        case DOM_ANGLE:  return x >= -180.0 && x <= 180.0;
+        default:         return isfinite(x);
+    }
+}
+
+static const char *formula_domain_text(int dom)
+{
+    switch (dom) {
+        case DOM_POS:    return ">0";
+        case DOM_NONNEG: return ">=0";
+        case DOM_PCT:    return "in (0,100)";
+        case DOM_ANGLE:  return "in [-180,180]";
+        default:         return "finite";
+    }
+}
+
+// Residual forward(v) - v[0] with v[var] = x.
+static double formula_residual(const formula_t *fm, int var, double *v, double x)
+{
+    v[var] = x;
+    return fm->forward(v) - v[0];
+}
+
+// Brent's method on [a, b] where the residual changes sign. Stores the
+// residual at the returned point in *fx.
+static double brent(const formula_t *fm, int var, double *v, double a, double b,
+                    double fa, double fb, double *fx)
+{
+    double c = a, fc = fa, d = b - a, e = d;
+
+    for (int it = 0; it < 200; ++it) {
+        if ((fb > 0.0) == (fc > 0.0)) { c = a; fc = fa; d = e = b - a; }
+        if (fabs(fc) < fabs(fb)) { a = b; b = c; c = a; fa = fb; fb = fc; fc = fa; }
+
+        double tol = 2.0 * 2.2e-16 * fabs(b) + 1e-300;
+        double m = 0.5 * (c - b);
+        if (fabs(m) <= tol || fb == 0.0) break;
+
+        if (fabs(e) >= tol && fabs(fa) > fabs(fb)) {
+            // Inverse quadratic interpolation (secant if only two points).
+            double s = fb / fa, p, q;
+            if (a == c) {
+                p = 2.0 * m * s;
+                q = 1.0 - s;
+            }
+            else {
+                double qa = fa / fc, r = fb / fc;
+                p = s * (2.0 * m * qa * (qa - r) - (b - a) * (r - 1.0));
+                q = (qa - 1.0) * (r - 1.0) * (s - 1.0);
+            }
+            if (p > 0.0) q = -q; else p = -p;
+            if (2.0 * p < fmin(3.0 * m * q - fabs(tol * q), fabs(e * q))) { e = d; d = p / q; }
+            else { d = m; e = m; }
+        }
+        else {
+            d = m; e = m;
+        }
+        a = b; fa = fb;
+        b += (fabs(d) > tol) ? d : (m > 0.0 ? tol : -tol);
+        fb = formula_residual(fm, var, v, b);
+    }
+    *fx = fb;
+    return b;
+}
+
+// A sign change also brackets a pole or a jump, where Brent converges just as
+// well. Only a point whose residual is small next to the target (or, for a
+// target of 0, next to the residuals at the ends of the bracket) is a root.
+static int root_ok(double fx, double target, double fa, double fb)
+{
+    double scale = fmax(fabs(target), fmin(fabs(fa), fabs(fb)));
+    return isfinite(fx) && fabs(fx) <= 1e-6 * scale;
+}
+
+// Search grid for a variable's domain: k-th of n points.
+static double grid_point(int dom, int k, int n)
+{
+    double u = (double)k / (double)(n - 1);              // 0..1
+    if (dom == DOM_PCT) return 100.0 * (0.5e-9 + u * (1.0 - 1e-9));
+    if (dom == DOM_ANGLE) return u <= 0.5 ? 360.0 * u : 180.0 - 360.0 * u;   // 0..180, then 0..-180
+    if (dom == DOM_POS || dom == DOM_NONNEG) return pow(10.0, -15.0 + 30.0 * u);
+
+    // DOM_ANY: -1e15 .. -1e-15, then 1e-15 .. 1e15
+    double x = pow(10.0, -15.0 + 30.0 * fabs(2.0 * u - 1.0));
+    return u < 0.5 ? -x : x;
+}
+
+// A forward result must lie in its variable's domain, edges included: a
+// charge of exactly 0% or 100% is a valid answer but cannot be solved from.
+static int formula_result_ok(int dom, double x)
+{
+    if (dom == DOM_PCT) return x >= 0.0 && x <= 100.0;
+    return isfinite(x) && formula_domain_ok(dom, x);
+}
+
+// Solves formula fm for variable var (values of the others in v, which the
+// caller has checked against their domains).
+// hint > 0 (or any value for DOM_ANY) is tried first as [hint/2, 2*hint].
+// Sets *used_closed_form. Returns 1 and stores v[var] on success.
+int formula_solve(const formula_t *fm, int var, double *v, double hint, int *used_closed_form)
+{
+    STATS_SCOPE(STAT_FORMULA_SOLVE);
+    *used_closed_form = 0;
+    if (var == 0) {
+        v[0] = fm->forward(v);
+        *used_closed_form = 1;
+        return formula_result_ok(fm->vars[0].domain, v[0]);
+    }
+    if (fm->inverse && fm->inverse(var, v)) {
+        *used_closed_form = 1;
+        return isfinite(v[var]) && formula_domain_ok(fm->vars[var].domain, v[var]);
+    }
+
+    int dom = fm->vars[var].domain;
+    double w[FORMULA_MAX_VARS];
+    memcpy(w, v, sizeof w);
+
+    // Warm start around the hint (e.g. the previous row of a batch). Every
+    // registry formula is monotonic in its non-angle variables, so the root
+    // found there is the one the grid scan would find. An angle has a root
+    // either side of 0 (cos), and the scan's choice, the positive one, must
+    // not depend on the previous row: angles always scan.
+    if (hint != 0.0 && isfinite(hint) && dom != DOM_ANGLE) {
+        double a = hint * 0.5, b = hint * 2.0;
+        if (a > b) { double t = a; a = b; b = t; }
+        if (dom == DOM_PCT) { a = fmax(a, 1e-9); b = fmin(b, 100.0 - 1e-9); }
+        double fa = formula_residual(fm, var, w, a), fb = formula_residual(fm, var, w, b);
+        if (isfinite(fa) && isfinite(fb) && (fa > 0.0) != (fb > 0.0)) {
+            double fx, x = brent(fm, var, w, a, b, fa, fb, &fx);
+            if (root_ok(fx, v[0], fa, fb)) { v[var] = x; return 1; }
+        }
+    }
+
+    // Grid scan for the first sign change that brackets a root.
+    enum { GRID = 241 };
+    double xp = grid_point(dom, 0, GRID);
+    double fp = formula_residual(fm, var, w, xp);
+    for (int k = 1; k < GRID; ++k) {
+        double x = grid_point(dom, k, GRID);
+        double fx = formula_residual(fm, var, w, x);
+        if (fx == 0.0) { v[var] = x; return 1; }
+        if (isfinite(fp) && isfinite(fx) && (fp > 0.0) != (fx > 0.0)) {
+            double fr, r = brent(fm, var, w, xp, x, fp, fx, &fr);
+            if (root_ok(fr, v[0], fp, fx)) { v[var] = r; return 1; }
+        }
+        xp = x;
+        fp = fx;
+    }
+    return 0;
+}
+
+// Solves a whole column: row k uses vals[j][k] for each known variable j
+// and writes the result to out[k] (NAN where an input is out of its domain
+// or no root was found). Each row
+// starts from the previous row's root, so smooth sweeps need few evaluations;
+// the results are the same as solving each row alone (see formula_solve).
+// Returns the number of rows solved.
+size_t formula_solve_batch(const formula_t *fm, int var, const double *const *vals,
+                           size_t n, double *out)
+{
+    STATS_SCOPE(STAT_FORMULA_BATCH);
+    double v[FORMULA_MAX_VARS] = {0}, hint = 0.0;
+    size_t solved = 0;
+    int cf;
+
+    for (size_t k = 0; k < n; ++k) {
+        int ok = 1;
+        for (int j = 0; j < fm->nvars; ++j)
+            if (j != var) ok &= formula_domain_ok(fm->vars[j].domain, v[j] = vals[j][k]);
+
+        if (ok && formula_solve(fm, var, v, hint, &cf)) {
+            out[k] = v[var];
+            hint = v[var];
+            solved++;
+        }
+        else {
+            out[k] = NAN;
+        }
+    }
+    return solved;
+}
+
+// Solves every row of a CSV of the known variables (in registry order, skipping
+// var) and writes all variables per row to out_path; unsolved rows get "nan".
+// Returns the number of rows read, or -1 if a file cannot be opened.
+static long long formula_solve_file(const formula_t *fm, int var, const char *in_path,
+                                    const char *out_path, long long *unsolved, long *skipped)
+{
+    STATS_SCOPE(STAT_BATCH_FILE);
+    enum { CHUNK = 1024 };
+    static double col[FORMULA_MAX_VARS][CHUNK], res[CHUNK];
+
+    FILE *in = fopen(in_path, "r");
+    if (!in) return -1;
+    FILE *out = fopen(out_path, "w");
+    if (!out) { fclose(in); return -1; }
+
+    for (int j = 0; j < fm->nvars; ++j) fprintf(out, "%s%s", j ? "," : "", fm->vars[j].name);
+    fprintf(out, "\n");
+
+    const double *cols[FORMULA_MAX_VARS];
+    for (int j = 0; j < FORMULA_MAX_VARS; ++j) cols[j] = col[j];
+
+    char line[256];
+    double f[FORMULA_MAX_VARS];
+    size_t n = 0;
+    long long rows = 0;
+    int eof = 0;
+
+    *unsolved = 0;
+    *skipped = 0;
+    while (!eof) {
+        // One chunk at a time: parse, solve, format (separate trace scopes).
+        {
+            STATS_SCOPE(STAT_BATCH_PARSE);
+            while (n < CHUNK) {
+                if (!fgets(line, sizeof line, in)) { eof = 1; break; }
+                if (parse_fields(line, f, fm->nvars - 1) != fm->nvars - 1) { (*skipped)++; continue; }
+                for (int j = 0, c = 0; j < fm->nvars; ++j)
+                    if (j != var) col[j][n] = f[c++];
+                n++;
+            }
+        }
+
+        *unsolved += (long long)(n - formula_solve_batch(fm, var, cols, n, res));
+
+        {
+            STATS_SCOPE(STAT_BATCH_FORMAT);
+            for (size_t k = 0; k < n; ++k) {
+                for (int j = 0; j < fm->nvars; ++j)
+                    fprintf(out, "%s%.9g", j ? "," : "", j == var ? res[k] : col[j][k]);
+                fprintf(out, "\n");
+            }
+        }
+        rows += (long long)n;
+        n = 0;
+    }
+
+    fclose(in);
+    fclose(out);
+    return rows;
+}
+
+// Returns the formula with the given name, or NULL.
+const formula_t *formula_find(const char *name)
+{
+    for (int k = 0; k < FORMULA_COUNT; ++k)
+        if (strcmp(FORMULAS[k].name, name) == 0) return &FORMULAS[k];
+    return NULL;
+}
+
+// Returns the index of variable `var` in fm, or -1.
+int formula_var_index(const formula_t *fm, const char *var)
+{
+    for (int j = 0; j < fm->nvars; ++j)
+        if (strcmp(fm->vars[j].name, var) == 0) return j;
+    return -1;
+}
+
+static const char *LOG_BIN_FILE = "eee_log.bin";
+
+// Binary log record: fixed 64 bytes in host byte order, appended per solve.
+typedef struct {
+    char     magic[4];                   // "EEEL"
+    uint16_t version;                    // 1
+    uint16_t formula;                    // index into FORMULAS
+    uint8_t  var;                        // variable that was solved for
+    uint8_t  nvars;
+    uint8_t  reserved[6];
+    int64_t  time;                       // seconds since the Unix epoch
+    double   v[FORMULA_MAX_VARS];
+} formula_record_t;
+
+void formula_log(const formula_t *fm, int var, const double *v)
+{
+    char line[256];
+    int len = snprintf(line, sizeof line, "Solver %s solve %s:", fm->name, fm->vars[var].name);
+    const char *sep = " ";
+    for (int j = 0; j < fm->nvars && len < (int)sizeof line; ++j) {
+        if (j == var) continue;
+        len += snprintf(line + len, sizeof line - (size_t)len, "%s%s=%.9g %s",
+                        sep, fm->vars[j].name, v[j], fm->vars[j].unit);
+        sep = ", ";
+    }
+    if (len < (int)sizeof line)
+        snprintf(line + len, sizeof line - (size_t)len, " -> %s=%.9g %s",
+                 fm->vars[var].name, v[var], fm->vars[var].unit);
+    log_line(line);
+    session_note(fm, var, v);
+
+    formula_record_t rec;
+    memset(&rec, 0, sizeof rec);
+    memcpy(rec.magic, "EEEL", 4);
+    rec.version = 1;
+    rec.formula = (uint16_t)(fm - FORMULAS);
+    rec.var = (uint8_t)var;
+    rec.nvars = (uint8_t)fm->nvars;
+    rec.time = (int64_t)time(NULL);
+    memcpy(rec.v, v, sizeof(double) * (size_t)fm->nvars);
+
+    STATS_SCOPE(STAT_LOG_WRITE);
+    FILE *fp = fopen(LOG_BIN_FILE, "ab");
+    if (!fp) return;
+    fwrite(&rec, sizeof rec, 1, fp);
+    fclose(fp);
+}
+
+static void formula_print_list(void)
+{
+    for (int k = 0; k < FORMULA_COUNT; ++k) {
+        const formula_t *fm = &FORMULAS[k];
+        printf("%-13s %s  [", fm->name, fm->equation);
+        for (int j = 0; j < fm->nvars; ++j)
+            printf("%s%s (%s, %s)", j ? "; " : "", fm->vars[j].name, fm->vars[j].unit,
+                   formula_domain_text(fm->vars[j].domain));
+        printf("]\n");
+    }
+}
+
+int formula_cli(int argc, char **argv)
+{
+    if (argc < 2 || strcmp(argv[1], "--list") == 0) {
+        printf("Usage: %s <formula> var=value ...   (solves for the variable left out)\n", argv[0]);
+        printf("Formulas:\n");
+        formula_print_list();
+        return argc < 2 ? 1 : 0;
+    }
+
+    const formula_t *fm = formula_find(argv[1]);
+    if (!fm) { printf("Error: unknown formula '%s' (try --list).\n", argv[1]); return 1; }
+
+    double v[FORMULA_MAX_VARS] = {0};
+    int given[FORMULA_MAX_VARS] = {0};
+
+    for (int a = 2; a < argc; ++a) {
+        char name[32];
+        const char *eq = strchr(argv[a], '=');
+        size_t len = eq ? (size_t)(eq - argv[a]) : 0;
+        if (!eq || len == 0 || len >= sizeof name) {
+            printf("Error: expected var=value, got '%s'.\n", argv[a]);
+            return 1;
+        }
+        memcpy(name, argv[a], len);
+        name[len] = '\0';
+
+        int j = formula_var_index(fm, name);
+        if (j < 0) { printf("Error: %s has no variable '%s'.\n", fm->name, name); return 1; }
+        if (!parse_double(eq + 1, &v[j])) { printf("Error: invalid number '%s'.\n", eq + 1); return 1; }
+        if (!formula_domain_ok(fm->vars[j].domain, v[j])) {
+            printf("Error: %s must be %s.\n", name, formula_domain_text(fm->vars[j].domain));
+            return 1;
+        }
+        given[j] = 1;
+    }
+
+    int var = -1, missing = 0;
+    for (int j = 0; j < fm->nvars; ++j)
+        if (!given[j]) { var = j; missing++; }
+    if (missing != 1) {
+        printf("Error: give all but one of the %d variables of %s.\n", fm->nvars, fm->name);
+        return 1;
+    }
+
+    int cf;
+    if (!formula_solve(fm, var, v, 0.0, &cf)) {
+        printf("Error: no %s %s satisfies the equation for these inputs.\n",
+               fm->vars[var].name, formula_domain_text(fm->vars[var].domain));
+        return 1;
+    }
+    printf("%s = %.9g %s\n", fm->vars[var].name, v[var], fm->vars[var].unit);
+    formula_log(fm, var, v);
+    return 0;
+}
+
 // ------------------ 1) VOLTAGE DIVIDER -----------------------
 
 void menu_item_1(void)
@@ -184,12 +699,14 @@ void menu_item_1(void)
         if (!read_double("R1 (ohms): ", &R1)) return;
         if (!read_double("R2 (ohms): ", &R2)) return;
 
+        STATS_SCOPE_AS(math, STAT_MENU_MATH);
         double ratio;
         if (!safe_divide(R2, (R1 + R2), &ratio)) {
             printf("Error: R1 + R2 cannot be zero (or near zero).\n");
             return;
         }
         double Vout = Vin * ratio;
+        STATS_STOP(math);
         printf("Vout = %.6f V\n", Vout);
 
         log_printf("Voltage Divider (Vout): Vin=%.6f V, R1=%.6f ohm, R2=%.6f ohm -> Vout=%.6f V",
@@ -202,12 +719,14 @@ void menu_item_1(void)
         if (!read_double("R1 (ohms): ", &R1)) return;
         if (!read_double("R2 (ohms): ", &R2)) return;
 
+        STATS_SCOPE_AS(math, STAT_MENU_MATH);
         double frac;
         if (!safe_divide((R1 + R2), R2, &frac)) {
             printf("Error: R2 cannot be zero (or near zero).\n");
             return;
         }
         double Vin_ans = Vout * frac;
+        STATS_STOP(math);
         printf("Vin = %.6f V\n", Vin_ans);
 
         log_printf("Voltage Divider (Vin): Vout=%.6f V, R1=%.6f ohm, R2=%.6f ohm -> Vin=%.6f V",
@@ -220,12 +739,14 @@ void menu_item_1(void)
         if (!read_double("Vout (V): ", &Vout)) return;
         if (!read_double("R2 (ohms): ", &R2)) return;
 
+        STATS_SCOPE_AS(math, STAT_MENU_MATH);
         double Vin_over_Vout;
         if (!safe_divide(Vin, Vout, &Vin_over_Vout)) {
             printf("Error: Vout cannot be zero (or near zero).\n");
             return;
         }
         double R1_ans = R2 * (Vin_over_Vout - 1.0);
+        STATS_STOP(math);
         printf("R1 = %.6f ohms\n", R1_ans);
 
         log_printf("Voltage Divider (R1): Vin=%.6f V, Vout=%.6f V, R2=%.6f ohm -> R1=%.6f ohm",
@@ -238,12 +759,14 @@ void menu_item_1(void)
         if (!read_double("Vout (V): ", &Vout)) return;
         if (!read_double("R1 (ohms): ", &R1)) return;
 
+        STATS_SCOPE_AS(math, STAT_MENU_MATH);
         double frac;
         if (!safe_divide(Vout, (Vin - Vout), &frac)) {
             printf("Error: Vin must not equal Vout (denominator near zero).\n");
             return;
         }
         double R2_ans = R1 * frac;
+        STATS_STOP(math);
         printf("R2 = %.6f ohms\n", R2_ans);
 
         log_printf("Voltage Divider (R2): Vin=%.6f V, Vout=%.6f V, R1=%.6f ohm -> R2=%.6f ohm",
@@ -339,11 +862,13 @@ void menu_item_2(void)
                 return;
             }
 
+            STATS_SCOPE_AS(math, STAT_MENU_MATH);
             double Req;
             if (!safe_divide((R1 * R2), (R1 + R2), &Req)) {
                 printf("Error: R1 + R2 cannot be zero (or near zero).\n");
                 return;
             }
+            STATS_STOP(math);
             printf("R_eq(parallel,2) = %.6f ohms\n", Req);
 
             log_printf("Resistors Parallel(2): R1=%.6f ohm, R2=%.6f ohm -> Req=%.6f ohm", R1, R2, Req);
@@ -354,11 +879,13 @@ void menu_item_2(void)
             if (!read_double("Req (ohms): ", &Req)) return;
             if (!read_double("R2  (ohms): ", &R2)) return;
 
+            STATS_SCOPE_AS(math, STAT_MENU_MATH);
             double R1;
             if (!safe_divide((Req * R2), (R2 - Req), &R1)) {
                 printf("Error: R2 must not equal Req (denominator near zero).\n");
                 return;
             }
+            STATS_STOP(math);
             printf("R1 = %.6f ohms\n", R1);
 
             log_printf("Resistors Parallel(2) solve R1: Req=%.6f ohm, R2=%.6f ohm -> R1=%.6f ohm", Req, R2, R1);
@@ -369,11 +896,13 @@ void menu_item_2(void)
             if (!read_double("Req (ohms): ", &Req)) return;
             if (!read_double("R1  (ohms): ", &R1)) return;
 
+            STATS_SCOPE_AS(math, STAT_MENU_MATH);
             double R2;
             if (!safe_divide((Req * R1), (R1 - Req), &R2)) {
                 printf("Error: R1 must not equal Req (denominator near zero).\n");
                 return;
             }
+            STATS_STOP(math);
             printf("R2 = %.6f ohms\n", R2);
 
             log_printf("Resistors Parallel(2) solve R2: Req=%.6f ohm, R1=%.6f ohm -> R2=%.6f ohm", Req, R1, R2);
@@ -389,12 +918,15 @@ void menu_item_2(void)
 
 // ------------------- 3) AC REACTANCE & RESONANCE ------------------
 
+static void zfit_menu(void);   // impedance sweep fits (the models are in fit.c)
+
 void menu_item_3(void)
 {
     printf("\n--- AC Reactance & Resonance ---\n");
     printf("1) Inductive Reactance (X_L)\n");
     printf("2) Capacitive Reactance (X_C)\n");
     printf("3) Resonance (f0)\n");
+    printf("4) Fit R, L, C to impedance sweep file(s)\n");
 
     int group;
     if (!read_int("Select: ", &group)) return;
@@ -415,7 +947,9 @@ void menu_item_3(void)
             if (!read_double("L (H): ", &L)) return;
             if (f <= 0.0 || L < 0.0) { printf("Error: f>0, L>=0.\n"); return; }
 
+            STATS_SCOPE_AS(math, STAT_MENU_MATH);
             double XL = 2.0 * PI * f * L;
+            STATS_STOP(math);
             printf("X_L = %.6f ohms\n", XL);
 
             log_printf("AC Inductive Reactance: f=%.6f Hz, L=%.9f H -> XL=%.6f ohm", f, L, XL);
@@ -427,8 +961,10 @@ void menu_item_3(void)
             if (!read_double("f (Hz): ", &f)) return;
             if (f <= 0.0) { printf("Error: f>0.\n"); return; }
 
+            STATS_SCOPE_AS(math, STAT_MENU_MATH);
             double L;
             if (!safe_divide(XL, (2.0 * PI * f), &L)) { printf("Error: invalid denominator.\n"); return; }
+            STATS_STOP(math);
             printf("L = %.9f H\n", L);
 
             log_printf("AC Inductive Reactance solve L: XL=%.6f ohm, f=%.6f Hz -> L=%.9f H", XL, f, L);
@@ -440,8 +976,10 @@ void menu_item_3(void)
             if (!read_double("L (H): ", &L)) return;
             if (L <= 0.0) { printf("Error: L>0.\n"); return; }
 
+            STATS_SCOPE_AS(math, STAT_MENU_MATH);
             double f;
             if (!safe_divide(XL, (2.0 * PI * L), &f)) { printf("Error: invalid denominator.\n"); return; }
+            STATS_STOP(math);
             printf("f = %.6f Hz\n", f);
 
             log_printf("AC Inductive Reactance solve f: XL=%.6f ohm, L=%.9f H -> f=%.6f Hz", XL, L, f);
@@ -466,8 +1004,10 @@ void menu_item_3(void)
             if (!read_double("C (F): ", &C)) return;
             if (f <= 0.0 || C <= 0.0) { printf("Error: f>0, C>0.\n"); return; }
 
+            STATS_SCOPE_AS(math, STAT_MENU_MATH);
             double XC;
             if (!safe_divide(1.0, (2.0 * PI * f * C), &XC)) { printf("Error: invalid denominator.\n"); return; }
+            STATS_STOP(math);
             printf("X_C = %.6f ohms\n", XC);
 
             log_printf("AC Capacitive Reactance: f=%.6f Hz, C=%.9e F -> XC=%.6f ohm", f, C, XC);
@@ -479,8 +1019,10 @@ void menu_item_3(void)
             if (!read_double("f (Hz): ", &f)) return;
             if (f <= 0.0 || XC <= 0.0) { printf("Error: f>0, X_C>0.\n"); return; }
 
+            STATS_SCOPE_AS(math, STAT_MENU_MATH);
             double C;
             if (!safe_divide(1.0, (2.0 * PI * f * XC), &C)) { printf("Error: invalid denominator.\n"); return; }
+            STATS_STOP(math);
             printf("C = %.9e F\n", C);
 
             log_printf("AC Capacitive Reactance solve C: XC=%.6f ohm, f=%.6f Hz -> C=%.9e F", XC, f, C);
@@ -492,8 +1034,10 @@ void menu_item_3(void)
             if (!read_double("C (F): ", &C)) return;
             if (C <= 0.0 || XC <= 0.0) { printf("Error: C>0, X_C>0.\n"); return; }
 
+            STATS_SCOPE_AS(math, STAT_MENU_MATH);
             double f;
             if (!safe_divide(1.0, (2.0 * PI * C * XC), &f)) { printf("Error: invalid denominator.\n"); return; }
+            STATS_STOP(math);
             printf("f = %.6f Hz\n", f);
 
             log_printf("AC Capacitive Reactance solve f: XC=%.6f ohm, C=%.9e F -> f=%.6f Hz", XC, C, f);
@@ -518,8 +1062,10 @@ void menu_item_3(void)
             if (!read_double("C (F): ", &C)) return;
             if (L <= 0.0 || C <= 0.0) { printf("Error: L>0, C>0.\n"); return; }
 
+            STATS_SCOPE_AS(math, STAT_MENU_MATH);
             double f0;
             if (!safe_divide(1.0, (2.0 * PI * sqrt(L * C)), &f0)) { printf("Error: invalid denominator.\n"); return; }
+            STATS_STOP(math);
             printf("f0 = %.6f Hz\n", f0);
 
             log_printf("Resonance: L=%.9e H, C=%.9e F -> f0=%.6f Hz", L, C, f0);
@@ -531,9 +1077,11 @@ void menu_item_3(void)
             if (!read_double("C (F): ", &C)) return;
             if (f0 <= 0.0 || C <= 0.0) { printf("Error: f0>0, C>0.\n"); return; }
 
+            STATS_SCOPE_AS(math, STAT_MENU_MATH);
             double denom = (2.0 * PI * f0) * (2.0 * PI * f0) * C;
             double L;
             if (!safe_divide(1.0, denom, &L)) { printf("Error: invalid denominator.\n"); return; }
+            STATS_STOP(math);
             printf("L = %.9e H\n", L);
 
             log_printf("Resonance solve L: f0=%.6f Hz, C=%.9e F -> L=%.9e H", f0, C, L);
@@ -545,9 +1093,11 @@ void menu_item_3(void)
             if (!read_double("L (H): ", &L)) return;
             if (f0 <= 0.0 || L <= 0.0) { printf("Error: f0>0, L>0.\n"); return; }
 
+            STATS_SCOPE_AS(math, STAT_MENU_MATH);
             double denom = (2.0 * PI * f0) * (2.0 * PI * f0) * L;
             double C;
             if (!safe_divide(1.0, denom, &C)) { printf("Error: invalid denominator.\n"); return; }
+            STATS_STOP(math);
             printf("C = %.9e F\n", C);
 
             log_printf("Resonance solve C: f0=%.6f Hz, L=%.9e H -> C=%.9e F", f0, L, C);
@@ -556,11 +1106,133 @@ void menu_item_3(void)
             printf("Invalid selection.\n");
         }
     }
+    else if (group == 4) {
+        zfit_menu();
+    }
     else {
         printf("Invalid selection.\n");
     }
 }
 
+// ------------------ CURVE FITTING (used by 3 and 4) ------------------
+
+typedef struct {
+    FILE *out;
+    double R;
+    long shown, show, curves, failed;
+} rc_fit_job_t;
+
+// curve_fn for RC fits: one CSV row per curve, the first `show` printed.
+static int rc_fit_one(const curve_slot_t *s, void *ctx)
+{
+    rc_fit_job_t *job = ctx;
+    const double *prm = s->prm;
+    double id = s->id;
+    size_t n = s->c.n;
+    int print = job->shown < job->show;
+
+    job->curves++;
+    if (print) job->shown++;
+
+    if (!s->ok) {
+        job->failed++;
+        if (job->out) fprintf(job->out, "%.10g,%zu,,,,,,\n", id, n);
+        if (print) printf("Curve %.10g (%zu pts): no fit (curve too flat or short)\n", id, n);
+        return 1;
+    }
+
+    double rms = sqrt(s->res.cost / (double)n);
+    double se = s->res.cov[2][2] > 0.0 ? sqrt(s->res.cov[2][2]) : 0.0;
+    double C = 0.0;
+    if (job->R > 0.0) safe_divide(prm[2], job->R, &C);
+
+    if (job->out)
+        fprintf(job->out, "%.10g,%zu,%.9g,%.9g,%.9g,%.3g,%.3g,%.9g\n",
+                id, n, prm[0], prm[1], prm[2], se, rms, C);
+    if (print) {
+        printf("Curve %.10g (%zu pts): offset = %.6f, amplitude = %.6f, tau = %.6e s (+/- %.2e), rms = %.3e",
+               id, n, prm[0], prm[1], prm[2], 1.96 * se, rms);
+        if (job->R > 0.0) printf(", C = %.9e F", C);
+        printf("\n");
+    }
+    return 1;
+}
+
+typedef struct {
+    int model;
+    FILE *out;
+    long shown, show, curves, failed;
+} zfit_job_t;
+
+// curve_fn for impedance sweeps: parameters with 95% confidence half-widths
+// (1.96 standard errors from the fit covariance).
+static int zfit_one(const curve_slot_t *s, void *ctx)
+{
+    zfit_job_t *job = ctx;
+    int print = job->shown < job->show;
+    const double *prm = s->prm;
+    double id = s->id;
+    size_t n = s->c.n;
+
+    job->curves++;
+    if (print) job->shown++;
+
+    if (!s->ok) {
+        job->failed++;
+        if (job->out) fprintf(job->out, "%.10g,%zu,,,,,,,\n", id, n / 2);
+        if (print) printf("Sweep %.10g (%zu pts): no fit\n", id, n / 2);
+        return 1;
+    }
+
+    double ci[3], rms = sqrt(s->res.cost / (double)n);
+    for (int k = 0; k < 3; ++k) ci[k] = s->res.cov[k][k] > 0.0 ? 1.96 * sqrt(s->res.cov[k][k]) : 0.0;
+
+    if (job->out)
+        fprintf(job->out, "%.10g,%zu,%.9g,%.3g,%.9g,%.3g,%.9g,%.3g,%.3g\n",
+                id, n / 2, prm[0], ci[0], prm[1], ci[1], prm[2], ci[2], rms);
+    if (print) {
+        const char *cname = job->model == ZMODEL_SERIES_RLC ? "C " : "Cp";
+        printf("Sweep %.10g (%zu pts): R = %.6g +/- %.2g ohm, L = %.6g +/- %.2g H, %s = %.6g +/- %.2g F, rms = %.2g%%\n",
+               id, n / 2, prm[0], ci[0], prm[1], ci[1], cname, prm[2], ci[2], 100.0 * rms);
+    }
+    return 1;
+}
+
+// AC option 4: fits one of the two impedance models to every sweep in a file.
+static void zfit_menu(void)
+{
+    printf("\nModel:\n");
+    printf("1) Capacitor: series R-L-C (ESR, ESL, C)\n");
+    printf("2) Inductor: (R + L) in parallel with Cp\n");
+
+    int model;
+    if (!read_int("Select: ", &model)) return;
+    if (model != ZMODEL_SERIES_RLC && model != ZMODEL_L_PARASITIC) { printf("Invalid selection.\n"); return; }
+
+    char path[200], out_path[200];
+    if (!read_line("Sweep file (f, ReZ, ImZ  or  id, f, ReZ, ImZ): ", path, sizeof path)) return;
+    if (!read_line("Results CSV (blank to skip): ", out_path, sizeof out_path)) return;
+
+    zfit_job_t job = { model, NULL, 0, 10, 0, 0 };
+    if (out_path[0] != '\0') {
+        job.out = fopen(out_path, "w");
+        if (!job.out) { printf("Error: cannot create '%s'.\n", out_path); return; }
+        fprintf(job.out, "id,points,R,R_ci95,L,L_ci95,%s,%s_ci95,rms_rel_residual\n",
+                model == ZMODEL_SERIES_RLC ? "C" : "Cp", model == ZMODEL_SERIES_RLC ? "C" : "Cp");
+    }
+
+    long sweeps = curve_file_each(path, 2, 3, zfit_task, &model, zfit_one, &job);
+    if (job.out) fclose(job.out);
+
+    if (sweeps < 0) { printf("Error: cannot open '%s' or out of memory.\n", path); return; }
+    if (sweeps == 0) { printf("Error: no valid points in '%s'.\n", path); return; }
+    if (sweeps > job.show) printf("... (%ld sweeps in total)\n", sweeps);
+    printf("Fitted %ld of %ld sweep(s).\n", sweeps - job.failed, sweeps);
+
+    log_printf("Impedance sweep fit (%s): %s, sweeps=%ld, failed=%ld",
+               model == ZMODEL_SERIES_RLC ? "series RLC" : "L || Cp", path, sweeps, job.failed);
+}
+
 // ------------------------ 4) RC TRANSIENT --------------------
 
 void menu_item_4(void)
@@ -571,6 +1243,8 @@ void menu_item_4(void)
     printf("3) Given tau, t   -> %%charge, %%discharge\n");
     printf("4) Given R, %%charge, t -> C\n");
     printf("5) Given C, %%charge, t -> R\n");
+    printf("6) Fit tau, offset, amplitude to measured curve file(s)\n");
+    printf("7) Given R, C, %%discharge -> t\n");
 
     int mode;
     if (!read_int("Select: ", &mode)) return;
@@ -585,10 +1259,12 @@ void menu_item_4(void)
         if (R <= 0.0 || C <= 0.0) { printf("Error: R>0, C>0.\n"); return; }
         if (t < 0.0) { printf("Error: t>=0.\n"); return; }
 
+        STATS_SCOPE_AS(math, STAT_MENU_MATH);
         double tau = R * C;
         double charge = 100.0 * (1.0 - exp(-t / tau));
         double discharge = 100.0 * exp(-t / tau);
 
+        STATS_STOP(math);
         printf("Tau = %.6f s\n", tau);
         printf("Charge at t: %.2f%%\n", charge);
         printf("Discharge at t: %.2f%%\n", discharge);
@@ -606,8 +1282,10 @@ void menu_item_4(void)
         if (R <= 0.0 || C <= 0.0) { printf("Error: R>0, C>0.\n"); return; }
         if (pct <= 0.0 || pct >= 100.0) { printf("Error: %% must be in (0,100).\n"); return; }
 
+        STATS_SCOPE_AS(math, STAT_MENU_MATH);
         double tau = R * C;
         double t_ans = -tau * log(1.0 - pct / 100.0);
+        STATS_STOP(math);
         printf("t = %.6f s\n", t_ans);
 
         log_printf("RC solve t: R=%.6f ohm, C=%.9e F, charge=%.2f%% -> t=%.6f s", R, C, pct, t_ans);
@@ -621,9 +1299,11 @@ void menu_item_4(void)
         if (tau <= 0.0) { printf("Error: tau>0.\n"); return; }
         if (t < 0.0) { printf("Error: t>=0.\n"); return; }
 
+        STATS_SCOPE_AS(math, STAT_MENU_MATH);
         double charge = 100.0 * (1.0 - exp(-t / tau));
         double discharge = 100.0 * exp(-t / tau);
 
+        STATS_STOP(math);
         printf("Charge at t: %.2f%%\n", charge);
         printf("Discharge at t: %.2f%%\n", discharge);
 
@@ -641,6 +1321,7 @@ void menu_item_4(void)
         if (t < 0.0) { printf("Error: t>=0.\n"); return; }
         if (pct <= 0.0 || pct >= 100.0) { printf("Error: %% must be in (0,100).\n"); return; }
 
+        STATS_SCOPE_AS(math, STAT_MENU_MATH);
         double ln_arg = 1.0 - pct / 100.0;
         if (ln_arg <= 0.0) { printf("Error: invalid ln() domain.\n"); return; }
 
@@ -649,6 +1330,7 @@ void menu_item_4(void)
         double C;
         if (!safe_divide(tau, R, &C)) { printf("Error: division by zero.\n"); return; }
 
+        STATS_STOP(math);
         printf("C = %.9e F (Tau = %.6f s)\n", C, tau);
 
         log_printf("RC solve C: R=%.6f ohm, charge=%.2f%%, t=%.6f s -> C=%.9e F (tau=%.6f s)",
@@ -665,6 +1347,7 @@ void menu_item_4(void)
         if (t < 0.0) { printf("Error: t>=0.\n"); return; }
         if (pct <= 0.0 || pct >= 100.0) { printf("Error: %% must be in (0,100).\n"); return; }
 
+        STATS_SCOPE_AS(math, STAT_MENU_MATH);
         double ln_arg = 1.0 - pct / 100.0;
         if (ln_arg <= 0.0) { printf("Error: invalid ln() domain.\n"); return; }
 
@@ -673,11 +1356,206 @@ void menu_item_4(void)
         double R;
         if (!safe_divide(tau, C, &R)) { printf("Error: division by zero.\n"); return; }
 
+        STATS_STOP(math);
         printf("R = %.6f ohms (Tau = %.6f s)\n", R, tau);
 
         log_printf("RC solve R: C=%.9e F, charge=%.2f%%, t=%.6f s -> R=%.6f ohm (tau=%.6f s)",
                    C, pct, t, R, tau);
     }
+    else if (mode == 6) {
+        // Least squares fit of v(t) = offset + amplitude * (1 - e^(-t/tau))
+        char path[200], out_path[200];
+        if (!read_line("Curve file (t, v  or  id, t, v): ", path, sizeof path)) return;
+        if (!read_line("Results CSV (blank to skip): ", out_path, sizeof out_path)) return;
+
+        double R;
+        if (!read_double("Known R for C = tau/R (ohms, 0 = skip): ", &R)) return;
+        if (R < 0.0) { printf("Error: R>=0.\n"); return; }
+
+        rc_fit_job_t job = { NULL, R, 0, 10, 0, 0 };
+        if (out_path[0] != '\0') {
+            job.out = fopen(out_path, "w");
+            if (!job.out) { printf("Error: cannot create '%s'.\n", out_path); return; }
+            fprintf(job.out, "id,n,offset,amplitude,tau,tau_stderr,rms_residual,C\n");
+        }
+
+        long curves = curve_file_each(path, 1, 3, rc_fit_task, NULL, rc_fit_one, &job);
+        if (job.out) fclose(job.out);
+
+        if (curves < 0) { printf("Error: cannot open '%s' or out of memory.\n", path); return; }
+        if (curves == 0) { printf("Error: no valid samples in '%s'.\n", path); return; }
+        if (curves > job.show) printf("... (%ld curves in total)\n", curves);
+        printf("Fitted %ld of %ld curve(s).\n", curves - job.failed, curves);
+
+        log_printf("RC curve fit: %s, curves=%ld, failed=%ld", path, curves, job.failed);
+    }
+    else if (mode == 7) {
+        // discharge% = 100 e^(-t/RC), solved for t by the formula solver
+        double R, C, pct;
+        if (!read_double("R (ohms): ", &R)) return;
+        if (!read_double("C (F): ", &C)) return;
+        if (!read_double("Target discharge (%): ", &pct)) return;
+
+        if (R <= 0.0 || C <= 0.0) { printf("Error: R>0, C>0.\n"); return; }
+        if (pct <= 0.0 || pct >= 100.0) { printf("Error: %% must be in (0,100).\n"); return; }
+
+        double v[FORMULA_MAX_VARS] = { pct, R, C, 0.0 };
+        int cf;
+        if (!formula_solve(&FORMULAS[FORMULA_RC_DISCHARGE], 3, v, R * C, &cf)) {
+            printf("Error: no solution found.\n");
+            return;
+        }
+        printf("t = %.6f s\n", v[3]);
+
+        log_printf("RC solve t (discharge): R=%.6f ohm, C=%.9e F, discharge=%.2f%% -> t=%.6f s", R, C, pct, v[3]);
+    }
+    else {
+        printf("Invalid selection.\n");
+    }
+}
+
+// timed: as for power_means().
+static void power_report(const power_stats_t *s, int timed)
+{
+    double P, S, Q, pf, Vrms, Irms;
+    ac_from_stats(s, timed, &P, &S, &Q, &pf);
+    power_means(s, timed, &P, &Vrms, &Irms);
+    double E = ksum_value(&s->energy);
+
+    printf("Samples      = %lld\n", s->n);
+    if (timed) printf("Duration     = %.6f s\n", s->t_last - s->t_first);
+    printf("Mean P       = %.6f W\n", P);
+    printf("Vrms         = %.6f V\n", Vrms);
+    printf("Irms         = %.6f A\n", Irms);
+    printf("S (Vrms*Irms)= %.6f VA\n", S);
+    printf("Q (non-act.) = %.6f var\n", Q);
+    printf("PF (P / S)   = %.6f\n", pf);
+    printf("Peak |V|     = %.6f V\n", s->v_peak);
+    printf("Peak |I|     = %.6f A\n", s->i_peak);
+    printf("P max / min  = %.6f / %.6f W\n", s->p_max, s->p_min);
+    printf("Energy       = %.6f J (%.6f Wh)\n", E, E / 3600.0);
+}
+
+// ------------------ THREE-PHASE POWER (used by 5) ------------------
+
+// Reads V, I and phase angle for one phase. Returns 0 on EOF/invalid input.
+static int read_phase(const char *name, const char *vlabel, const char *ilabel, phase_in_t *ph)
+{
+    char prompt[64];
+
+    snprintf(prompt, sizeof prompt, "Phase %s %s (V): ", name, vlabel);
+    if (!read_double(prompt, &ph->v)) return 0;
+    snprintf(prompt, sizeof prompt, "Phase %s %s (A): ", name, ilabel);
+    if (!read_double(prompt, &ph->i)) return 0;
+    snprintf(prompt, sizeof prompt, "Phase %s angle (deg, +ve = lag): ", name);
+    if (!read_double(prompt, &ph->phi)) return 0;
+
+    if (ph->v < 0.0 || ph->i < 0.0) { printf("Error: V>=0, I>=0.\n"); return 0; }
+    return 1;
+}
+
+static void threephase_menu(void)
+{
+    printf("\nThree-phase modes:\n");
+    printf("1) Balanced load (V_line, I_line, PF angle; star or delta)\n");
+    printf("2) Unbalanced star (per-phase V, I, angle; neutral current)\n");
+    printf("3) Unbalanced delta (per-branch V_line, I, angle; line currents)\n");
+    printf("4) Sample file (va, vb, vc, ia, ib, ic; star)\n");
+
+    int mode;
+    if (!read_int("Select: ", &mode)) return;
+
+    if (mode == 1) {
+        // P = sqrt(3) V_L I_L cos(phi); star: V_ph = V_L / sqrt(3), delta: I_ph = I_L / sqrt(3)
+        double VL, IL, phi;
+        int conn;
+        if (!read_double("V_line (V): ", &VL)) return;
+        if (!read_double("I_line (A): ", &IL)) return;
+        if (!read_double("Angle (deg, +ve = current lags): ", &phi)) return;
+        if (!read_int("Connection 1) star  2) delta: ", &conn)) return;
+
+        if (VL < 0.0 || IL < 0.0) { printf("Error: V_line>=0, I_line>=0.\n"); return; }
+        if (conn != 1 && conn != 2) { printf("Invalid selection.\n"); return; }
+
+        double r3 = sqrt(3.0);
+        double Vph = (conn == 1) ? VL / r3 : VL;
+        double Iph = (conn == 1) ? IL : IL / r3;
+        double S = r3 * VL * IL;
+        double P = S * cos(phi * (PI / 180.0));
+        double Q = S * sin(phi * (PI / 180.0));
+
+        printf("V_phase = %.6f V\n", Vph);
+        printf("I_phase = %.6f A\n", Iph);
+        printf("P = %.6f W\n", P);
+        printf("Q = %.6f var\n", Q);
+        printf("S = %.6f VA\n", S);
+        printf("PF = %.6f\n", cos(phi * (PI / 180.0)));
+        if (conn == 1) printf("I_neutral = 0 A (balanced)\n");
+
+        log_printf("Three-phase balanced %s: VL=%.6f V, IL=%.6f A, phi=%.3f deg -> P=%.6f W, Q=%.6f var, S=%.6f VA",
+                   conn == 1 ? "star" : "delta", VL, IL, phi, P, Q, S);
+    }
+    else if (mode == 2 || mode == 3) {
+        // P = sum V_k I_k cos(phi_k), Q = sum V_k I_k sin(phi_k), S = |P + jQ|
+        static const char *star_names[3] = { "a", "b", "c" };
+        static const char *delta_names[3] = { "ab", "bc", "ca" };
+        int star = (mode == 2);
+        phase_in_t ph[3];
+
+        for (int k = 0; k < 3; ++k) {
+            if (star) { if (!read_phase(star_names[k], "V_phase", "I", &ph[k])) return; }
+            else      { if (!read_phase(delta_names[k], "V_line", "I_branch", &ph[k])) return; }
+        }
+
+        double P, Q, S, In, line_i[3];
+        threephase_totals(ph, star, &P, &Q, &S, &In, line_i);
+
+        printf("P = %.6f W\n", P);
+        printf("Q = %.6f var\n", Q);
+        printf("S = %.6f VA\n", S);
+        double pf;
+        if (safe_divide(P, S, &pf)) printf("PF = %.6f\n", pf);
+        if (star) {
+            printf("I_neutral = %.6f A\n", In);
+        }
+        else {
+            printf("Line currents: I_a = %.6f A, I_b = %.6f A, I_c = %.6f A\n",
+                   line_i[0], line_i[1], line_i[2]);
+        }
+
+        log_printf("Three-phase unbalanced %s -> P=%.6f W, Q=%.6f var, S=%.6f VA, In=%.6f A",
+                   star ? "star" : "delta", P, Q, S, In);
+    }
+    else if (mode == 4) {
+        // p(t) = va ia + vb ib + vc ic, i_n(t) = ia + ib + ic
+        char path[200];
+        if (!read_line("Sample file path: ", path, sizeof path)) return;
+
+        tp_stats_t st;
+        long skipped;
+        if (!threephase_file(path, &st, &skipped)) { printf("Error: cannot open '%s'.\n", path); return; }
+        if (st.n == 0) { printf("Error: no valid samples in '%s'.\n", path); return; }
+
+        double n = (double)st.n;
+        double P = ksum_value(&st.p) / n, S = 0.0;
+        printf("Samples      = %lld\n", st.n);
+        for (int ph = 0; ph < 3; ++ph) {
+            double Vr = sqrt(ksum_value(&st.v2[ph]) / n), Ir = sqrt(ksum_value(&st.i2[ph]) / n);
+            printf("Phase %c      : Vrms = %.6f V, Irms = %.6f A\n", 'a' + ph, Vr, Ir);
+            S += Vr * Ir;
+        }
+        double In = sqrt(ksum_value(&st.in2) / n);
+        printf("Mean P       = %.6f W\n", P);
+        printf("S (sum V I)  = %.6f VA\n", S);
+        double pf;
+        if (safe_divide(P, S, &pf)) printf("PF (P / S)   = %.6f\n", pf);
+        printf("I_n (rms)    = %.6f A\n", In);
+        printf("p max / min  = %.6f / %.6f W\n", st.p_max, st.p_min);
+        if (skipped > 0) printf("(%ld line(s) skipped)\n", skipped);
+
+        log_printf("Three-phase sample file: %s, n=%lld -> P=%.6f W, S=%.6f VA, In=%.6f A",
+                   path, st.n, P, S, In);
+    }
     else {
         printf("Invalid selection.\n");
     }
@@ -692,6 +1570,13 @@ void menu_item_5(void)
     printf("1) Power  (P)  given V and I\n");
     printf("2) Voltage (V) given P and I\n");
     printf("3) Current (I) given P and V\n");
+    printf("4) Analyse V/I sample file (mean P, RMS, peaks, energy)\n");
+    printf("5) Align separate V and I logs, then analyse P = V * I\n");
+    printf("6) AC power from phasors (Vrms, Irms, phase angle)\n");
+    printf("7) AC power from phasor file (batch)\n");
+    printf("8) Harmonics / THD from t, v, i capture (FFT)\n");
+    printf("9) Three-phase power (star / delta)\n");
+    printf("10) Live monitor (rolling mean / max P with alarms)\n");
 
     int mode;
     if (!read_int("Select: ", &mode)) return;
@@ -702,7 +1587,9 @@ void menu_item_5(void)
         if (!read_double("V (volts): ", &V)) return;
         if (!read_double("I (amps):  ", &I)) return;
 
+        STATS_SCOPE_AS(math, STAT_MENU_MATH);
         double P = V * I;
+        STATS_STOP(math);
         printf("P = %.6f W\n", P);
 
         log_printf("Power: V=%.6f V, I=%.6f A -> P=%.6f W", V, I, P);
@@ -713,11 +1600,13 @@ void menu_item_5(void)
         if (!read_double("P (watts): ", &P)) return;
         if (!read_double("I (amps):  ", &I)) return;
 
+        STATS_SCOPE_AS(math, STAT_MENU_MATH);
         double V;
         if (!safe_divide(P, I, &V)) {
             printf("Error: I cannot be zero (or near zero).\n");
             return;
         }
+        STATS_STOP(math);
         printf("V = %.6f V\n", V);
 
         log_printf("Power solve V: P=%.6f W, I=%.6f A -> V=%.6f V", P, I, V);
@@ -728,16 +1617,644 @@ void menu_item_5(void)
         if (!read_double("P (watts): ", &P)) return;
         if (!read_double("V (volts): ", &V)) return;
 
+        STATS_SCOPE_AS(math, STAT_MENU_MATH);
         double I;
         if (!safe_divide(P, V, &I)) {
             printf("Error: V cannot be zero (or near zero).\n");
             return;
         }
+        STATS_STOP(math);
         printf("I = %.6f A\n", I);
 
         log_printf("Power solve I: P=%.6f W, V=%.6f V -> I=%.6f A", P, V, I);
     }
+    else if (mode == 4) {
+        // P = V * I per sample, E = sum of trapezoids (t[k+1]-t[k]) * (P[k]+P[k+1]) / 2
+        char path[200];
+        if (!read_line("Sample file path: ", path, sizeof path)) return;
+
+        // A columnar file (--power-pack) says which columns it has.
+        power_stats_t total;
+        long skipped = 0;
+        int timed;
+        int col = power_read_columnar(path, &total, &timed);
+        if (col == 0) {
+            printf("Error: '%s' is a damaged columnar file.\n", path);
+            return;
+        }
+        if (col < 0) {
+            printf("Columns:\n");
+            printf("1) t, V, I\n");
+            printf("2) V, I (fixed sample interval)\n");
+            int cols;
+            if (!read_int("Select: ", &cols)) return;
+            if (cols != 1 && cols != 2) { printf("Invalid selection.\n"); return; }
+
+            double dt = 0.0;
+            if (cols == 2) {
+                if (!read_double("Sample interval dt (s): ", &dt)) return;
+                if (dt <= 0.0) { printf("Error: dt>0.\n"); return; }
+            }
+
+            if (!power_read_file(path, cols == 1, dt, &total, &skipped)) {
+                printf("Error: cannot read '%s'.\n", path);
+                return;
+            }
+            timed = cols == 1;
+        }
+        if (total.n == 0) {
+            printf("Error: no valid samples in '%s'.\n", path);
+            return;
+        }
+
+        power_report(&total, timed);
+        if (skipped > 0) printf("(%ld line(s) skipped)\n", skipped);
+
+        double P, Vrms, Irms;
+        power_means(&total, timed, &P, &Vrms, &Irms);
+        log_printf("Power sample file: %s, n=%lld -> Pavg=%.6f W, Vrms=%.6f V, Irms=%.6f A, E=%.6f J",
+                   path, total.n, P, Vrms, Irms, ksum_value(&total.energy));
+    }
+    else if (mode == 5) {
+        // V and I are resampled onto the union of both logs' timestamps, then P = V * I
+        char vpath[200], ipath[200], opath[200];
+        if (!read_line("Voltage log path (t, V): ", vpath, sizeof vpath)) return;
+        if (!read_line("Current log path (t, I): ", ipath, sizeof ipath)) return;
+
+        printf("Alignment:\n");
+        printf("1) Linear interpolation\n");
+        printf("2) Sample-and-hold\n");
+        int align;
+        if (!read_int("Select: ", &align)) return;
+        if (align != 1 && align != 2) { printf("Invalid selection.\n"); return; }
+
+        if (!read_line("Aligned output CSV (blank to skip): ", opath, sizeof opath)) return;
+
+        FILE *out = NULL;
+        if (opath[0] != '\0') {
+            out = fopen(opath, "w");
+            if (!out) { printf("Error: cannot create '%s'.\n", opath); return; }
+        }
+
+        power_acc_t *acc = power_acc_new();
+        if (!acc) { printf("Error: out of memory.\n"); if (out) fclose(out); return; }
+
+        long skipped;
+        int ok = power_join_files(vpath, ipath, align == 2, out, acc, &skipped);
+        if (out) fclose(out);
+
+        if (!ok) {
+            printf("Error: cannot open '%s' or '%s'.\n", vpath, ipath);
+            free(acc);
+            return;
+        }
+        if (acc->total.n == 0) {
+            printf("Error: the two logs do not overlap in time.\n");
+            free(acc);
+            return;
+        }
+
+        power_report(&acc->total, 1);
+        if (skipped > 0) printf("(%ld line(s) skipped)\n", skipped);
+
+        const power_stats_t *s = &acc->total;
+        double P, Vrms, Irms;
+        power_means(s, 1, &P, &Vrms, &Irms);
+        log_printf("Power aligned logs: V=%s, I=%s (%s), n=%lld -> Pavg=%.6f W, E=%.6f J",
+                   vpath, ipath, align == 2 ? "hold" : "linear", s->n, P, ksum_value(&s->energy));
+        free(acc);
+    }
+    else if (mode == 6) {
+        // P = V I cos(phi), Q = V I sin(phi), S = V I, PF = cos(phi)
+        double V, I, phi;
+        if (!read_double("Vrms (volts): ", &V)) return;
+        if (!read_double("Irms (amps):  ", &I)) return;
+        if (!read_double("Phase angle (deg, +ve = current lags): ", &phi)) return;
+        if (V < 0.0 || I < 0.0) { printf("Error: Vrms>=0, Irms>=0.\n"); return; }
+
+        STATS_SCOPE_AS(math, STAT_MENU_MATH);
+        double P, Q, S, pf;
+        ac_phasor_batch(&V, &I, &phi, 1, &P, &Q, &S, &pf);
+
+        STATS_STOP(math);
+        printf("P  = %.6f W\n", P);
+        printf("Q  = %.6f var\n", Q);
+        printf("S  = %.6f VA\n", S);
+        printf("PF = %.6f (%s)\n", pf, Q > 0.0 ? "lagging" : (Q < 0.0 ? "leading" : "unity"));
+
+        log_printf("AC Power: Vrms=%.6f V, Irms=%.6f A, phi=%.3f deg -> P=%.6f W, Q=%.6f var, S=%.6f VA, PF=%.6f",
+                   V, I, phi, P, Q, S, pf);
+    }
+    else if (mode == 7) {
+        // Same as mode 6, one row per line of Vrms, Irms, phase_deg
+        char in_path[200], out_path[200];
+        if (!read_line("Input file (Vrms, Irms, phase_deg): ", in_path, sizeof in_path)) return;
+        if (!read_line("Output CSV: ", out_path, sizeof out_path)) return;
+
+        long skipped, invalid;
+        long long rows = ac_phasor_file(in_path, out_path, &skipped, &invalid);
+        if (rows < 0) {
+            printf("Error: cannot open '%s' or create '%s'.\n", in_path, out_path);
+            return;
+        }
+        printf("%lld row(s) written to %s\n", rows, out_path);
+        if (skipped > 0) printf("(%ld line(s) skipped)\n", skipped);
+        if (invalid > 0) printf("(%ld row(s) with Vrms < 0 or Irms < 0 skipped)\n", invalid);
+
+        log_printf("AC Power batch: %s -> %s, rows=%lld, invalid=%ld", in_path, out_path, rows, invalid);
+    }
+    else if (mode == 8) {
+        // V_h, I_h from FFT bins at h * f1; P_h = V_h I_h cos(phi_h); THD = sqrt(sum h>=2 X_h^2) / X_1
+        char path[200], csv_path[200];
+        if (!read_line("Capture file path (t, v, i): ", path, sizeof path)) return;
+
+        double f1;
+        int n, hop, H;
+        if (!read_double("Fundamental f1 (Hz): ", &f1)) return;
+        if (!read_int("Window size (samples, power of 2): ", &n)) return;
+        if (!read_int("Hop between windows (samples): ", &hop)) return;
+        if (!read_int("Highest harmonic: ", &H)) return;
+
+        if (f1 <= 0.0) { printf("Error: f1>0.\n"); return; }
+        if (n < 4 || n > (1 << 22) || !fft_is_pow2((size_t)n)) {
+            printf("Error: window must be a power of 2 in [4, 4194304].\n");
+            return;
+        }
+        if (hop < 1 || hop > n) { printf("Error: hop must be in [1, window].\n"); return; }
+        if (H < 1 || H > HARM_MAX) { printf("Error: harmonic must be in [1, %d].\n", HARM_MAX); return; }
+
+        if (!read_line("Per-window CSV (blank to skip): ", csv_path, sizeof csv_path)) return;
+        FILE *csv = NULL;
+        if (csv_path[0] != '\0') {
+            csv = fopen(csv_path, "w");
+            if (!csv) { printf("Error: cannot create '%s'.\n", csv_path); return; }
+        }
+
+        harm_result_t avg;
+        long skipped;
+        long windows = harmonic_file(path, (size_t)n, (size_t)hop, f1, H, csv, &avg, &skipped);
+        if (csv) fclose(csv);
+
+        if (windows < 0) { printf("Error: cannot open '%s' (or out of memory).\n", path); return; }
+        if (windows == 0) {
+            printf("Error: no complete window with f1 below Nyquist in '%s'.\n", path);
+            return;
+        }
+
+        printf("Windows analysed = %ld (averages below)\n", windows);
+        printf("  h        V (rms)        I (rms)          P (W)\n");
+        printf("DC  %14.6f %14.6f %14.6f\n", avg.v[0], avg.i[0], avg.p[0]);
+        for (int h = 1; h <= avg.H; ++h)
+            printf("%2d  %14.6f %14.6f %14.6f\n", h, avg.v[h], avg.i[h], avg.p[h]);
+        printf("THD V        = %.4f%%\n", 100.0 * avg.thd_v);
+        printf("THD I        = %.4f%%\n", 100.0 * avg.thd_i);
+        printf("P (sum h)    = %.6f W\n", avg.p_total);
+        printf("True PF      = %.6f\n", avg.pf_true);
+        printf("Displ. PF    = %.6f\n", avg.pf_disp);
+        if (skipped > 0) printf("(%ld line(s) skipped)\n", skipped);
+
+        log_printf("Power harmonics: %s, f1=%.3f Hz, N=%d, windows=%ld -> THDv=%.4f%%, THDi=%.4f%%, P=%.6f W, PF=%.6f",
+                   path, f1, n, windows, 100.0 * avg.thd_v, 100.0 * avg.thd_i, avg.p_total, avg.pf_true);
+    }
+    else if (mode == 9) {
+        threephase_menu();
+    }
+    else if (mode == 10) {
+        // Rolling mean and max of P = V * I over the last w samples
+        char path[200];
+        if (!read_line("Sample source (FIFO/file path, '-' = stdin): ", path, sizeof path)) return;
+
+        int w, every;
+        double mean_limit, max_limit;
+        if (!read_int("Window (samples): ", &w)) return;
+        if (!read_double("Mean P alarm limit (W, 0 = off): ", &mean_limit)) return;
+        if (!read_double("Max P alarm limit (W, 0 = off): ", &max_limit)) return;
+        if (!read_int("Status line every n samples (0 = off): ", &every)) return;
+        if (w < 1) { printf("Error: window>=1.\n"); return; }
+        if (every < 0) { printf("Error: n>=0.\n"); return; }
+
+        int use_stdin = strcmp(path, "-") == 0;
+        int fd = use_stdin ? STDIN_FILENO : open(path, O_RDONLY);
+        if (fd < 0) { printf("Error: cannot open '%s'.\n", path); return; }
+
+        printf("Monitoring (enter 'q' or close the source to stop)...\n");
+        fflush(stdout);
+
+        lat_hist_t lat;
+        long long n = monitor_run(fd, (size_t)w, mean_limit, max_limit, every, &lat);
+        if (!use_stdin) close(fd);
+        if (n < 0) { printf("Error: out of memory.\n"); return; }
+
+        printf("Samples processed = %lld\n", n);
+        if (lat.n > 0) lat_hist_print(&lat);
+
+        log_printf("Power monitor: %s, window=%d, n=%lld -> p50<=%lld ns, p99<=%lld ns, max=%lld ns",
+                   path, w, n, lat_hist_quantile(&lat, 0.50), lat_hist_quantile(&lat, 0.99), lat.max_ns);
+    }
     else {
         printf("Invalid selection.\n");
     }
 }
+
+// ------------------ 8) FORMULA SOLVER ------------------
+
+// "rc.charge: t = 0.000693 s  (charge=50, R=1000, C=1e-06)"
+static void print_recent(const session_result_t *r)
+{
+    const formula_t *fm = formula_find(r->formula);
+    if (!fm || r->var >= fm->nvars) return;
+    printf("  %s: %s = %.6g %s  (", fm->name, fm->vars[r->var].name, r->v[r->var], fm->vars[r->var].unit);
+    const char *sep = "";
+    for (int j = 0; j < fm->nvars; ++j) {
+        if (j == r->var) continue;
+        printf("%s%s=%.6g", sep, fm->vars[j].name, r->v[j]);
+        sep = ", ";
+    }
+    printf(")\n");
+}
+
+void menu_item_8(void)
+{
+    printf("\n--- Formula Solver ---\n");
+    if (session_recent(0)) {
+        printf("Recent results:\n");
+        for (size_t k = 0; k < 5 && session_recent(k); ++k) print_recent(session_recent(k));
+        printf("\n");
+    }
+    for (int k = 0; k < FORMULA_COUNT; ++k)
+        printf("%d) %-13s %s\n", k + 1, FORMULAS[k].name, FORMULAS[k].equation);
+
+    int sel;
+    if (!read_int("Select: ", &sel)) return;
+    if (sel < 1 || sel > FORMULA_COUNT) { printf("Invalid selection.\n"); return; }
+    const formula_t *fm = &FORMULAS[sel - 1];
+
+    printf("\nSolve for:\n");
+    for (int j = 0; j < fm->nvars; ++j) printf("%d) %s (%s)\n", j + 1, fm->vars[j].name, fm->vars[j].unit);
+
+    int var;
+    if (!read_int("Select: ", &var)) return;
+    if (var < 1 || var > fm->nvars) { printf("Invalid selection.\n"); return; }
+    var--;
+
+    printf("\nInputs:\n");
+    printf("1) Enter values\n");
+    printf("2) CSV file (one row per case)\n");
+    int src;
+    if (!read_int("Select: ", &src)) return;
+
+    if (src == 2) {
+        char in_path[200], out_path[200];
+        printf("Columns:");
+        for (int j = 0; j < fm->nvars; ++j) if (j != var) printf(" %s", fm->vars[j].name);
+        printf("\n");
+        if (!read_line("Input CSV: ", in_path, sizeof in_path)) return;
+        if (!read_line("Output CSV: ", out_path, sizeof out_path)) return;
+
+        long long unsolved;
+        long skipped;
+        long long rows = formula_solve_file(fm, var, in_path, out_path, &unsolved, &skipped);
+        if (rows < 0) { printf("Error: cannot open '%s' or create '%s'.\n", in_path, out_path); return; }
+
+        printf("%lld row(s) written to %s (%lld without a solution)\n", rows, out_path, unsolved);
+        if (skipped > 0) printf("(%ld line(s) skipped)\n", skipped);
+
+        log_printf("Solver %s solve %s batch: %s -> %s, rows=%lld, unsolved=%lld",
+                   fm->name, fm->vars[var].name, in_path, out_path, rows, unsolved);
+        return;
+    }
+    if (src != 1) { printf("Invalid selection.\n"); return; }
+
+    double v[FORMULA_MAX_VARS] = {0};
+    for (int j = 0; j < fm->nvars; ++j) {
+        if (j == var) continue;
+        char prompt[64];
+        snprintf(prompt, sizeof prompt, "%s (%s): ", fm->vars[j].name, fm->vars[j].unit);
+        if (!read_double(prompt, &v[j])) return;
+        if (!formula_domain_ok(fm->vars[j].domain, v[j])) {
+            printf("Error: %s must be %s.\n", fm->vars[j].name, formula_domain_text(fm->vars[j].domain));
+            return;
+        }
+    }
+
+    int bad, cf;
+    if (memo_solve(fm, var, v, 0.0, &bad, &cf) != MEMO_OK) {
+        printf("Error: no %s %s satisfies the equation for these inputs.\n",
+               fm->vars[var].name, formula_domain_text(fm->vars[var].domain));
+        return;
+    }
+    printf("%s = %.9g %s (%s)\n", fm->vars[var].name, v[var], fm->vars[var].unit,
+           cf ? "closed form" : "numeric root");
+
+    formula_log(fm, var, v);
+}
+
+// ------------------ 9) CUSTOM FORMULA ------------------
+
+// Splits a header line into column names. Returns the number of names, or 0
+// if any field looks like a number (i.e. the line is data, not a header).
+static int split_names(const char *s, char names[][32], int max)
+{
+    int n = 0;
+
+    for (;;) {
+        while (*s == ' ' || *s == '\t' || *s == ',' || *s == ';') s++;
+        if (*s == '\0' || *s == '\r' || *s == '\n') break;
+        if (n == max) return 0;
+
+        size_t len = strcspn(s, " \t,;\r\n");
+        if (isdigit((unsigned char)s[0]) || s[0] == '-' || s[0] == '+' || s[0] == '.') return 0;
+        snprintf(names[n], sizeof names[0], "%.*s", (int)(len < 31 ? len : 31), s);
+        n++;
+        s += len;
+    }
+    return n;
+}
+
+// Evaluates e over every row of a CSV and writes the row plus a "result"
+// column. Columns are matched to variables by a header line if present,
+// otherwise they must be in variable order (for an expression without
+// variables, rows are echoed with as many columns as the first). *eval_ns
+// receives the time spent evaluating alone (excluding parsing and
+// formatting).
+// Returns the number of rows, -1 if a file cannot be opened, or -2 if the
+// header does not name every variable.
+static long long expr_eval_file(expr_t *e, const char *in_path, const char *out_path,
+                                long long *eval_ns, long *skipped)
+{
+    STATS_SCOPE(STAT_EXPR_FILE);
+    enum { CHUNK = 4096, MAX_COLS = EXPR_MAX_VARS };
+    static double col[MAX_COLS][CHUNK], res[CHUNK];
+
+    FILE *in = fopen(in_path, "r");
+    if (!in) return -1;
+
+    int nv = expr_nvars(e), ncols = nv, map[EXPR_MAX_VARS];
+    char names[MAX_COLS][32], line[512];
+    long long rows = 0;
+    int pending = 0;   // first line was data and is still in `line`
+
+    // Without a header (or without any line) the columns are the variables.
+    for (int i = 0; i < nv; ++i) {
+        map[i] = i;
+        snprintf(names[i], sizeof names[0], "%s", expr_var_name(e, i));
+    }
+    if (fgets(line, sizeof line, in)) {
+        int nn = split_names(line, names, MAX_COLS);
+        if (nn > 0) {
+            ncols = nn;
+            for (int i = 0; i < nv; ++i) {
+                map[i] = -1;
+                for (int c = 0; c < nn; ++c)
+                    if (strcmp(names[c], expr_var_name(e, i)) == 0) map[i] = c;
+                if (map[i] < 0) { fclose(in); return -2; }
+            }
+        }
+        else {
+            pending = 1;
+            // No variables: rows keep whatever columns the first one has.
+            if (nv == 0) {
+                double f[MAX_COLS];
+                ncols = parse_fields(line, f, MAX_COLS);
+                if (ncols < 0) ncols = 0;
+                for (int c = 0; c < ncols; ++c) snprintf(names[c], sizeof names[0], "c%d", c + 1);
+            }
+        }
+    }
+
+    FILE *out = fopen(out_path, "w");
+    if (!out) { fclose(in); return -1; }
+    for (int c = 0; c < ncols; ++c) fprintf(out, "%s,", names[c]);
+    fprintf(out, "result\n");
+
+    const double *cols[EXPR_MAX_VARS];
+    for (int i = 0; i < nv; ++i) cols[i] = col[map[i]];
+
+    double f[MAX_COLS];
+    size_t n = 0;
+    int eof = 0;
+
+    *eval_ns = 0;
+    *skipped = 0;
+    while (!eof) {
+        {
+            STATS_SCOPE(STAT_BATCH_PARSE);
+            while (n < CHUNK) {
+                if (!pending && !fgets(line, sizeof line, in)) { eof = 1; break; }
+                pending = 0;
+                if (parse_fields(line, f, ncols) != ncols) { (*skipped)++; continue; }
+                for (int c = 0; c < ncols; ++c) col[c][n] = f[c];
+                n++;
+            }
+        }
+
+        long long t0 = now_ns();
+        expr_eval(e, cols, n, res);
+        *eval_ns += now_ns() - t0;
+
+        {
+            STATS_SCOPE(STAT_BATCH_FORMAT);
+            for (size_t k = 0; k < n; ++k) {
+                for (int c = 0; c < ncols; ++c) fprintf(out, "%.9g,", col[c][k]);
+                fprintf(out, "%.9g\n", res[k]);
+            }
+        }
+        rows += (long long)n;
+        n = 0;
+    }
+
+    fclose(in);
+    fclose(out);
+    return rows;
+}
+
+void menu_item_9(void)
+{
+    printf("\n--- Custom Formula ---\n");
+    printf("Operators + - * / ^, functions exp log sqrt sin cos tan abs, constant PI.\n");
+
+    char src[256], err[128];
+    if (!read_line("Expression: ", src, sizeof src)) return;
+
+    expr_t *e = expr_compile(src, err, sizeof err);
+    if (!e) { printf("Error: %s.\n", err); return; }
+
+    printf("Variables:");
+    for (int i = 0; i < expr_nvars(e); ++i) printf(" %s", expr_var_name(e, i));
+    printf("%s\n", expr_nvars(e) ? "" : " (none)");
+
+    printf("1) Evaluate once\n");
+    printf("2) Evaluate every row of a CSV file\n");
+    int mode;
+    if (!read_int("Select: ", &mode)) { expr_free(e); return; }
+
+    if (mode == 1) {
+        double vals[EXPR_MAX_VARS];
+        for (int i = 0; i < expr_nvars(e); ++i) {
+            char prompt[48];
+            snprintf(prompt, sizeof prompt, "%s: ", expr_var_name(e, i));
+            if (!read_double(prompt, &vals[i])) { expr_free(e); return; }
+        }
+        double r = expr_eval1(e, vals);
+        printf("Result = %.9g\n", r);
+
+        log_printf("Custom formula: %s -> %.9g", src, r);
+    }
+    else if (mode == 2) {
+        char in_path[200], out_path[200];
+        if (!read_line("Input CSV (header names the variables): ", in_path, sizeof in_path) ||
+            !read_line("Output CSV: ", out_path, sizeof out_path)) {
+            expr_free(e);
+            return;
+        }
+
+        long long eval_ns = 0;
+        long skipped = 0;
+        long long rows = expr_eval_file(e, in_path, out_path, &eval_ns, &skipped);
+        if (rows == -2) printf("Error: the header of '%s' does not name every variable.\n", in_path);
+        else if (rows < 0) printf("Error: cannot open '%s' or create '%s'.\n", in_path, out_path);
+        else {
+            printf("%lld row(s) written to %s\n", rows, out_path);
+            if (rows > 0)
+                printf("Evaluation: %.3f ms (%.2f ns/row, %s)\n", eval_ns / 1e6, (double)eval_ns / (double)rows,
+                       expr_jit_active(e) ? "native code" : "interpreter");
+            if (skipped > 0) printf("(%ld line(s) skipped)\n", skipped);
+
+            log_printf("Custom formula batch: %s over %s -> %s, rows=%lld", src, in_path, out_path, rows);
+        }
+    }
+    else {
+        printf("Invalid selection.\n");
+    }
+    expr_free(e);
+}
+
+// ------------------ 10) SWEEP SCRIPT ------------------
+
+void menu_item_10(void)
+{
+    printf("\n--- Sweep Script ---\n");
+    printf("Example: sweep R in 1k..100k log 1000; sweep C in E12(1n..1u); eval rc.charge(t=1ms)\n");
+    printf("Ranges: A..B lin N, A..B log N, A..B step S, E3..E96(A..B), or a list A, B, C.\n");
+
+    char script[1024], out_path[200], err[200];
+    if (!read_line("Script (or @file): ", script, sizeof script)) return;
+
+    sweep_t *s = sweep_open(script, err, sizeof err);
+    if (!s) { printf("Error: %s.\n", err); return; }
+
+    unsigned long long points = sweep_points(s);
+    if (points == ULLONG_MAX) printf("Points: more than %llu\n", ULLONG_MAX - 1);
+    else printf("Points: %llu\n", points);
+
+    if (!read_line("Output CSV: ", out_path, sizeof out_path)) { sweep_free(s); return; }
+    FILE *out = fopen(out_path, "w");
+    if (!out) { printf("Error: cannot create '%s'.\n", out_path); sweep_free(s); return; }
+
+    struct timespec t0, t1;
+    unsigned long long unsolved;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    unsigned long long rows = sweep_run(s, out, &unsolved);
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    fclose(out);
+    sweep_free(s);
+
+    double secs = (double)(t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) * 1e-9;
+    printf("%llu row(s) written to %s in %.3f s (%llu result(s) without a solution)\n",
+           rows, out_path, secs, unsolved);
+
+    log_printf("Sweep: %.120s -> %s, rows=%llu, unsolved=%llu", script, out_path, rows, unsolved);
+}
+
+// ------------------ 11) WORKSHEET ------------------
+
+static double elapsed_us(const struct timespec *t0, const struct timespec *t1)
+{
+    return (double)(t1->tv_sec - t0->tv_sec) * 1e6 + (t1->tv_nsec - t0->tv_nsec) * 1e-3;
+}
+
+static void ws_print_cell(const worksheet_t *ws, int c)
+{
+    if (ws_kind(ws, c) == WS_FORMULA) printf("%s = %.9g   (= %s)\n", ws_name(ws, c), ws_value(ws, c), ws_text(ws, c));
+    else if (ws_kind(ws, c) == WS_VALUE) printf("%s = %.9g\n", ws_name(ws, c), ws_value(ws, c));
+    else printf("%s is not defined yet\n", ws_name(ws, c));
+}
+
+void menu_item_11(void)
+{
+    printf("\n--- Worksheet ---\n");
+    printf("Cells hold a value or a formula over other cells, e.g.\n");
+    printf("  Vin = 12    R1 = 10k    R2 = 4.7k    Vout = Vin * R2 / (R1 + R2)\n");
+    printf("Changing a cell updates every cell that depends on it.\n");
+    printf("Commands: NAME = VALUE | FORMULA, NAME (show), list, load FILE,\n");
+    printf("          save FILE / open FILE (whole workspace), empty line to finish.\n");
+
+    // One worksheet per session, kept between visits to the menu.
+    worksheet_t *ws = session_worksheet();
+    if (!ws) { printf("Error: out of memory.\n"); return; }
+
+    char line[1024], err[200];
+    for (;;) {
+        if (!read_line("ws> ", line, sizeof line)) return;
+        char *cmd = line;
+        while (*cmd == ' ' || *cmd == '\t') cmd++;
+        if (*cmd == '\0') return;
+
+        if (strcmp(cmd, "list") == 0) {
+            int n = ws_count(ws);
+            if (n == 0) printf("The worksheet is empty.\n");
+            for (int c = 0; c < n && c < 200; ++c) ws_print_cell(ws, c);
+            if (n > 200) printf("... and %d more cell(s)\n", n - 200);
+            continue;
+        }
+        if (strncmp(cmd, "load ", 5) == 0) {
+            const char *path = cmd + 5;
+            while (*path == ' ') path++;
+            struct timespec t0, t1;
+            clock_gettime(CLOCK_MONOTONIC, &t0);
+            long defined = ws_load(ws, path, err, sizeof err);
+            clock_gettime(CLOCK_MONOTONIC, &t1);
+            if (defined < 0) { printf("Error: %s.\n", err); continue; }
+            printf("%ld cell(s) defined in %.3f ms (%d in the worksheet)\n",
+                   defined, elapsed_us(&t0, &t1) * 1e-3, ws_count(ws));
+            log_printf("Worksheet load: %s, cells=%ld", path, defined);
+            continue;
+        }
+        if (strncmp(cmd, "save ", 5) == 0 || strncmp(cmd, "open ", 5) == 0) {
+            const char *path = cmd + 5;
+            while (*path == ' ') path++;
+            struct timespec t0, t1;
+            clock_gettime(CLOCK_MONOTONIC, &t0);
+            int rc = cmd[0] == 's' ? session_save(path, err, sizeof err) : session_load(path, err, sizeof err);
+            clock_gettime(CLOCK_MONOTONIC, &t1);
+            if (rc != 0) { printf("Error: %s.\n", err); continue; }
+            ws = session_worksheet();
+            printf("Workspace %s %s: %d cell(s) in %.3f ms\n", cmd[0] == 's' ? "saved to" : "opened from",
+                   path, ws_count(ws), elapsed_us(&t0, &t1) * 1e-3);
+            log_printf("Worksheet %.4s: %s, cells=%d", cmd, path, ws_count(ws));
+            continue;
+        }
+        if (!strchr(cmd, '=')) {
+            int c = ws_find(ws, cmd);
+            if (c < 0) printf("No cell named '%s'.\n", cmd);
+            else ws_print_cell(ws, c);
+            continue;
+        }
+
+        struct timespec t0, t1;
+        clock_gettime(CLOCK_MONOTONIC, &t0);
+        long updated = ws_assign(ws, cmd, err, sizeof err);
+        clock_gettime(CLOCK_MONOTONIC, &t1);
+        if (updated < 0) { printf("Error: %s.\n", err); continue; }
+
+        size_t n;
+        const int *cells = ws_last_update(ws, &n);
+        ws_print_cell(ws, cells[0]);
+        for (size_t k = 1; k < n && k <= 8; ++k)
+            printf("  -> %s = %.9g\n", ws_name(ws, cells[k]), ws_value(ws, cells[k]));
+        if (n > 9) printf("  -> ... %zu more\n", n - 9);
+        printf("(%ld cell(s) updated in %.1f us)\n", updated, elapsed_us(&t0, &t1));
+
+        log_printf("Worksheet: %.150s -> %.9g, updated=%ld", cmd, ws_value(ws, cells[0]), updated);
+    }
+}
@@ -4,14 +4,29 @@
 #ifndef FUNCS_H
 #define FUNCS_H
 
+#include <stddef.h>
+
 void menu_item_1(void); // Voltage Divider
 void menu_item_2(void); // Resistors (Series / Parallel-2)
 void menu_item_3(void); // AC Reactance & Resonance
 void menu_item_4(void); // RC Transient
 void menu_item_5(void); // Power (P = V * I)
+void menu_item_8(void); // Formula solver (any variable)
+void menu_item_9(void); // Custom formula (expression)
+void menu_item_10(void); // Sweep script
+void menu_item_11(void); // Worksheet
 
 // Data logging 
 int  log_line(const char *line);
 void view_log(void);
 
+// Shared helpers (also used by the sample-file modules)
+// Splits a line of comma, semicolon, tab or space separated numbers.
+// Returns the number of fields (up to max), or -1 if a field is not a number.
+int parse_fields(const char *s, double *out, int max);
+// num / den, rejecting zero/near-zero denominators. Returns 0 if rejected.
+int safe_divide(double num, double den, double *out);
+// Monotonic clock in nanoseconds.
+long long now_ns(void);
+
 #endif
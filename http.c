@@ -0,0 +1,682 @@
+// Embedded HTTP/1.1 JSON server.
+// Design notes:
+// Each worker thread runs the event loop of daemon.c over the connections it
+// accepted: epoll, non-blocking sockets, a fixed input and output buffer per
+// connection. A connection stays on one thread, so nothing in it is shared.
+// Requests are parsed in place: the method, path, query and body are spans
+// into the input buffer and the JSON bodies (flat objects of numbers) are
+// read the same way, so parsing never allocates. Every complete request in the input is answered
+// before the output is flushed, which makes pipelined requests cheap.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <stdarg.h>
+#include <ctype.h>
+#include <signal.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include "http.h"
+#include "formulas.h"
+#include "sweep.h"
+#include "funcs.h"
+#include "memo.h"
+#include "stats.h"
+#include "pool.h"
+
+#define HTTP_IN_BUF    (64 * 1024)
+#define HTTP_OUT_BUF   (512 * 1024)
+#define HTTP_MIN_ROOM  (64 * 1024)      // output space needed to take a request
+#define HTTP_HDR_ROOM  160              // reserved in front of a body for the header
+#define HTTP_MAX_KEYS  (FORMULA_MAX_VARS + 1)
+#define MAX_EVENTS     64
+
+typedef struct {
+    const char *p;
+    size_t n;
+} span_t;
+
+typedef struct {
+    span_t method, path, query, body;
+    int keep_alive;
+} http_req_t;
+
+typedef struct {
+    int fd;
+    unsigned events;
+    int closing;                        // close once the output is sent
+    int eof;                            // client stopped sending: answer, then close
+    size_t inlen;
+    size_t outpos, outlen;
+    char in[HTTP_IN_BUF];
+    char out[HTTP_OUT_BUF];
+} hconn_t;
+
+typedef struct {
+    span_t name;
+    double value;
+} kv_t;
+
+static volatile sig_atomic_t http_stop;
+
+static void http_signal(int sig)
+{
+    (void)sig;
+    http_stop = 1;
+}
+
+static int span_eq(span_t s, const char *lit)
+{
+    size_t n = strlen(lit);
+    return s.n == n && memcmp(s.p, lit, n) == 0;
+}
+
+static int span_ieq(span_t s, const char *lit)
+{
+    size_t n = strlen(lit);
+    if (s.n != n) return 0;
+    for (size_t k = 0; k < n; ++k)
+        if (tolower((unsigned char)s.p[k]) != lit[k]) return 0;
+    return 1;
+}
+
+// Parses a whole span as a number ("1000", "1e-6", "4.7k").
+static int span_number(span_t s, double *out)
+{
+    char buf[64];
+    const char *end;
+    if (s.n == 0 || s.n >= sizeof buf) return 0;
+    memcpy(buf, s.p, s.n);
+    buf[s.n] = '\0';
+    return sweep_parse_value(buf, out, &end) && *end == '\0';
+}
+
+// ----------------------------- JSON OUTPUT -----------------------------
+
+typedef struct {
+    char *buf;
+    size_t len, cap;
+    int full;
+} jw_t;
+
+static void jw_printf(jw_t *w, const char *fmt, ...)
+{
+    if (w->full) return;
+    va_list ap;
+    va_start(ap, fmt);
+    int n = vsnprintf(w->buf + w->len, w->cap - w->len, fmt, ap);
+    va_end(ap);
+    if (n < 0 || (size_t)n >= w->cap - w->len) { w->full = 1; return; }
+    w->len += (size_t)n;
+}
+
+// Writes a JSON string, escaping quotes, backslashes and control bytes.
+static void jw_string(jw_t *w, const char *s, size_t n)
+{
+    jw_printf(w, "\"");
+    for (size_t k = 0; k < n; ++k) {
+        unsigned char ch = (unsigned char)s[k];
+        if (ch == '"' || ch == '\\') jw_printf(w, "\\%c", ch);
+        else if (ch < 0x20) jw_printf(w, "\\u%04x", ch);
+        else jw_printf(w, "%c", ch);
+    }
+    jw_printf(w, "\"");
+}
+
+static int jw_error(jw_t *w, int status, const char *msg)
+{
+    jw_printf(w, "{\"error\":");
+    jw_string(w, msg, strlen(msg));
+    jw_printf(w, "}");
+    return status;
+}
+
+// ----------------------------- JSON INPUT -----------------------------
+
+static const char *json_ws(const char *p, const char *end)
+{
+    while (p < end && (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n')) p++;
+    return p;
+}
+
+// A string without escapes. Returns the position after it, or NULL.
+static const char *json_str(const char *p, const char *end, span_t *out)
+{
+    if (p >= end || *p != '"') return NULL;
+    const char *s = ++p;
+    while (p < end && *p != '"') {
+        if (*p == '\\') return NULL;
+        p++;
+    }
+    if (p >= end) return NULL;
+    out->p = s;
+    out->n = (size_t)(p - s);
+    return p + 1;
+}
+
+// A flat object of numbers, plus an optional "formula" string.
+// Returns the position after the closing brace, or NULL on a syntax error.
+static const char *json_object(const char *p, const char *end, kv_t *kv, int *n, span_t *formula)
+{
+    *n = 0;
+    formula->n = 0;
+    p = json_ws(p, end);
+    if (p >= end || *p != '{') return NULL;
+    p = json_ws(p + 1, end);
+    if (p < end && *p == '}') return p + 1;
+
+    for (;;) {
+        span_t key, val;
+        if (!(p = json_str(p, end, &key))) return NULL;
+        p = json_ws(p, end);
+        if (p >= end || *p != ':') return NULL;
+        p = json_ws(p + 1, end);
+
+        if (p < end && *p == '"') {
+            if (!span_eq(key, "formula") || !(p = json_str(p, end, formula))) return NULL;
+        }
+        else {
+            val.p = p;
+            while (p < end && !strchr(",} \t\r\n", *p)) p++;
+            val.n = (size_t)(p - val.p);
+            if (*n == HTTP_MAX_KEYS) return NULL;
+            kv[*n].name = key;
+            if (!span_number(val, &kv[*n].value)) return NULL;
+            (*n)++;
+        }
+
+        p = json_ws(p, end);
+        if (p < end && *p == ',') { p = json_ws(p + 1, end); continue; }
+        if (p < end && *p == '}') return p + 1;
+        return NULL;
+    }
+}
+
+// name=value&name=value
+static int parse_query(span_t q, kv_t *kv, int *n)
+{
+    const char *p = q.p, *end = q.p + q.n;
+    *n = 0;
+    while (p < end) {
+        const char *amp = memchr(p, '&', (size_t)(end - p));
+        if (!amp) amp = end;
+        const char *eq = memchr(p, '=', (size_t)(amp - p));
+        if (!eq || *n == HTTP_MAX_KEYS) return 0;
+        kv[*n].name.p = p;
+        kv[*n].name.n = (size_t)(eq - p);
+        span_t val = { eq + 1, (size_t)(amp - eq - 1) };
+        if (!span_number(val, &kv[*n].value)) return 0;
+        (*n)++;
+        p = amp + 1;
+    }
+    return 1;
+}
+
+// ----------------------------- HANDLERS -----------------------------
+
+// Solves one formula from named values and writes the result object.
+// Returns the HTTP status.
+static int solve_one(jw_t *w, span_t name, const kv_t *kv, int n)
+{
+    const formula_t *fm = NULL;
+    for (int k = 0; k < FORMULA_COUNT; ++k)
+        if (span_eq(name, FORMULAS[k].name)) fm = &FORMULAS[k];
+    if (!fm) return jw_error(w, 404, "unknown formula");
+
+    double v[FORMULA_MAX_VARS] = {0};
+    int given[FORMULA_MAX_VARS] = {0};
+    for (int k = 0; k < n; ++k) {
+        int j = -1;
+        for (int i = 0; i < fm->nvars; ++i)
+            if (span_eq(kv[k].name, fm->vars[i].name)) j = i;
+        if (j < 0) return jw_error(w, 400, "unknown variable for this formula");
+        v[j] = kv[k].value;
+        given[j] = 1;
+    }
+
+    int var = -1, missing = 0;
+    for (int j = 0; j < fm->nvars; ++j)
+        if (!given[j]) { var = j; missing++; }
+    if (missing != 1) return jw_error(w, 400, "give all but one variable");
+
+    int bad, cf;
+    int st = memo_solve(fm, var, v, 0.0, &bad, &cf);
+    if (st == MEMO_DOMAIN) return jw_error(w, 422, "value out of range");
+    if (st != MEMO_OK) return jw_error(w, 422, "no solution for these inputs");
+
+    jw_printf(w, "{\"formula\":\"%s\",\"solved\":\"%s\",\"unit\":\"%s\",\"values\":{",
+              fm->name, fm->vars[var].name, fm->vars[var].unit);
+    for (int j = 0; j < fm->nvars; ++j)
+        jw_printf(w, "%s\"%s\":%.17g", j ? "," : "", fm->vars[j].name, v[j]);
+    jw_printf(w, "}}");
+    return 200;
+}
+
+static int handle_list(jw_t *w)
+{
+    jw_printf(w, "[");
+    for (int k = 0; k < FORMULA_COUNT; ++k) {
+        const formula_t *fm = &FORMULAS[k];
+        jw_printf(w, "%s{\"name\":\"%s\",\"equation\":", k ? "," : "", fm->name);
+        jw_string(w, fm->equation, strlen(fm->equation));
+        jw_printf(w, ",\"vars\":[");
+        for (int j = 0; j < fm->nvars; ++j)
+            jw_printf(w, "%s{\"name\":\"%s\",\"unit\":\"%s\"}", j ? "," : "", fm->vars[j].name, fm->vars[j].unit);
+        jw_printf(w, "]}");
+    }
+    jw_printf(w, "]");
+    return 200;
+}
+
+static int handle_batch(jw_t *w, span_t body, unsigned long long *solves)
+{
+    const char *p = body.p, *end = body.p + body.n;
+    p = json_ws(p, end);
+    if (p >= end || *p != '[') return jw_error(w, 400, "expected a JSON array");
+    p = json_ws(p + 1, end);
+
+    jw_printf(w, "[");
+    int first = 1;
+    if (p < end && *p == ']') p++;
+    else {
+        for (;;) {
+            kv_t kv[HTTP_MAX_KEYS];
+            span_t formula;
+            int n;
+            const char *next = json_object(p, end, kv, &n, &formula);
+            if (!next) { w->len = 0; w->full = 0; return jw_error(w, 400, "invalid batch item"); }
+
+            jw_printf(w, first ? "" : ",");
+            first = 0;
+            if (formula.n == 0) jw_error(w, 400, "missing \"formula\"");
+            else solve_one(w, formula, kv, n);
+            (*solves)++;
+
+            p = json_ws(next, end);
+            if (p < end && *p == ',') { p = json_ws(p + 1, end); continue; }
+            if (p < end && *p == ']') { p++; break; }
+            w->len = 0;
+            w->full = 0;
+            return jw_error(w, 400, "expected ',' or ']'");
+        }
+    }
+    if (json_ws(p, end) != end) { w->len = 0; w->full = 0; return jw_error(w, 400, "trailing data"); }
+    jw_printf(w, "]");
+    return 200;
+}
+
+static int route(jw_t *w, const http_req_t *rq, unsigned long long *solves)
+{
+    STATS_SCOPE(STAT_HTTP_ROUTE);
+    int get = span_eq(rq->method, "GET"), post = span_eq(rq->method, "POST");
+    if (!get && !post) return jw_error(w, 405, "use GET or POST");
+    if (rq->path.n < 2 || rq->path.p[0] != '/') return jw_error(w, 404, "not found");
+    span_t name = { rq->path.p + 1, rq->path.n - 1 };
+
+    if (span_eq(name, "formulas")) return handle_list(w);
+    if (span_eq(name, "batch")) {
+        if (!post) return jw_error(w, 405, "batch needs POST");
+        return handle_batch(w, rq->body, solves);
+    }
+
+    kv_t kv[HTTP_MAX_KEYS];
+    int n = 0;
+    if (post && rq->body.n > 0) {
+        span_t formula;
+        const char *end = rq->body.p + rq->body.n;
+        const char *p = json_object(rq->body.p, end, kv, &n, &formula);
+        if (!p || json_ws(p, end) != end || formula.n) return jw_error(w, 400, "expected a JSON object of numbers");
+    }
+    else if (!parse_query(rq->query, kv, &n)) {
+        return jw_error(w, 400, "expected name=number query parameters");
+    }
+    (*solves)++;
+    return solve_one(w, name, kv, n);
+}
+
+// ----------------------------- HTTP -----------------------------
+
+static const char *status_text(int status)
+{
+    switch (status) {
+        case 200: return "OK";
+        case 400: return "Bad Request";
+        case 404: return "Not Found";
+        case 405: return "Method Not Allowed";
+        case 413: return "Payload Too Large";
+        case 422: return "Unprocessable Entity";
+        case 431: return "Request Header Fields Too Large";
+        case 501: return "Not Implemented";
+        default:  return "Internal Server Error";
+    }
+}
+
+// Parses one request from buf. Returns its total length, 0 if incomplete,
+// or minus an HTTP status for a request that cannot be handled.
+static long http_parse(const char *buf, size_t len, http_req_t *rq)
+{
+    STATS_SCOPE(STAT_HTTP_PARSE);
+    size_t head = 0;
+    for (size_t k = 0; k + 3 < len; ++k)
+        if (buf[k] == '\r' && buf[k + 1] == '\n' && buf[k + 2] == '\r' && buf[k + 3] == '\n') { head = k + 4; break; }
+    if (head == 0) return len >= HTTP_IN_BUF ? -431 : 0;
+
+    const char *p = buf, *end = buf + head;
+    const char *sp = memchr(p, ' ', (size_t)(end - p));
+    if (!sp) return -400;
+    rq->method = (span_t){ p, (size_t)(sp - p) };
+
+    p = sp + 1;
+    sp = memchr(p, ' ', (size_t)(end - p));
+    if (!sp) return -400;
+    const char *q = memchr(p, '?', (size_t)(sp - p));
+    rq->path = (span_t){ p, (size_t)((q ? q : sp) - p) };
+    rq->query = q ? (span_t){ q + 1, (size_t)(sp - q - 1) } : (span_t){ sp, 0 };
+
+    p = sp + 1;
+    if (end - p < 10 || memcmp(p, "HTTP/1.", 7) != 0 || (p[7] != '0' && p[7] != '1')) return -400;
+    rq->keep_alive = p[7] == '1';
+    p = memchr(p, '\n', (size_t)(end - p)) + 1;
+
+    size_t clen = 0;
+    while (p < end - 2) {
+        const char *eol = memchr(p, '\r', (size_t)(end - p));
+        const char *colon = memchr(p, ':', (size_t)(eol - p));
+        if (!colon) return -400;
+        span_t name = { p, (size_t)(colon - p) };
+        const char *v = colon + 1;
+        while (v < eol && (*v == ' ' || *v == '\t')) v++;
+        span_t val = { v, (size_t)(eol - v) };
+        while (val.n && (val.p[val.n - 1] == ' ' || val.p[val.n - 1] == '\t')) val.n--;
+
+        if (span_ieq(name, "content-length")) {
+            clen = 0;
+            if (val.n == 0 || val.n > 9) return val.n ? -413 : -400;
+            for (size_t k = 0; k < val.n; ++k) {
+                if (!isdigit((unsigned char)val.p[k])) return -400;
+                clen = clen * 10 + (size_t)(val.p[k] - '0');
+            }
+        }
+        else if (span_ieq(name, "connection")) {
+            if (span_ieq(val, "close")) rq->keep_alive = 0;
+            else if (span_ieq(val, "keep-alive")) rq->keep_alive = 1;
+        }
+        else if (span_ieq(name, "transfer-encoding")) {
+            return -501;
+        }
+        p = eol + 2;
+    }
+
+    if (clen > HTTP_IN_BUF - head) return -413;
+    if (len < head + clen) return 0;
+    rq->body = (span_t){ buf + head, clen };
+    return (long)(head + clen);
+}
+
+// Appends a response whose body was written HTTP_HDR_ROOM bytes past the
+// end of the pending output, then slides the body up behind the header.
+static void http_respond(hconn_t *c, int status, size_t body_len, int keep_alive)
+{
+    char hdr[HTTP_HDR_ROOM];
+    int n = snprintf(hdr, sizeof hdr,
+                     "HTTP/1.1 %d %s\r\nContent-Type: application/json\r\nContent-Length: %zu\r\n%s\r\n",
+                     status, status_text(status), body_len, keep_alive ? "" : "Connection: close\r\n");
+    char *dst = c->out + c->outlen;
+    memcpy(dst, hdr, (size_t)n);
+    memmove(dst + n, dst + HTTP_HDR_ROOM, body_len);
+    c->outlen += (size_t)n + body_len;
+}
+
+// Answers every complete request while there is output space.
+static void http_process(hconn_t *c, unsigned long long *requests, unsigned long long *solves)
+{
+    size_t pos = 0;
+
+    if (c->outpos > 0) {
+        memmove(c->out, c->out + c->outpos, c->outlen - c->outpos);
+        c->outlen -= c->outpos;
+        c->outpos = 0;
+    }
+    while (!c->closing && HTTP_OUT_BUF - c->outlen >= HTTP_MIN_ROOM) {
+        http_req_t rq = {0};
+        long used = http_parse(c->in + pos, c->inlen - pos, &rq);
+        if (used == 0) break;
+
+        jw_t w = { c->out + c->outlen + HTTP_HDR_ROOM, 0, HTTP_OUT_BUF - c->outlen - HTTP_HDR_ROOM, 0 };
+        if (used < 0) {
+            int status = jw_error(&w, (int)-used, status_text((int)-used));
+            http_respond(c, status, w.len, 0);
+            c->closing = 1;
+            break;
+        }
+
+        int status = route(&w, &rq, solves);
+        if (w.full) {
+            w.len = 0;
+            w.full = 0;
+            status = jw_error(&w, 413, "response too large");
+        }
+        http_respond(c, status, w.len, rq.keep_alive);
+        if (!rq.keep_alive) c->closing = 1;
+        pos += (size_t)used;
+        (*requests)++;
+    }
+    memmove(c->in, c->in + pos, c->inlen - pos);
+    c->inlen -= pos;
+}
+
+static int http_flush(hconn_t *c)
+{
+    while (c->outpos < c->outlen) {
+        ssize_t n = send(c->fd, c->out + c->outpos, c->outlen - c->outpos, MSG_NOSIGNAL);
+        if (n < 0) return (errno == EAGAIN || errno == EWOULDBLOCK) ? 0 : -1;
+        c->outpos += (size_t)n;
+    }
+    c->outpos = c->outlen = 0;
+    return 0;
+}
+
+static void http_update(int ep, hconn_t *c)
+{
+    unsigned want = 0;
+    if (!c->closing && !c->eof && c->inlen < HTTP_IN_BUF && HTTP_OUT_BUF - c->outlen >= HTTP_MIN_ROOM) want |= EPOLLIN;
+    if (c->outpos < c->outlen) want |= EPOLLOUT;
+    if (want == c->events) return;
+
+    struct epoll_event ev = { .events = want, .data.ptr = c };
+    epoll_ctl(ep, EPOLL_CTL_MOD, c->fd, &ev);
+    c->events = want;
+}
+
+int http_listen(int port, int *bound)
+{
+    int lfd = socket(AF_INET, SOCK_STREAM, 0);
+    if (lfd < 0) { printf("Error: socket: %s.\n", strerror(errno)); return -1; }
+
+    int one = 1;
+    setsockopt(lfd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof one);
+
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof addr);
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons((unsigned short)port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    socklen_t alen = sizeof addr;
+    if (bind(lfd, (struct sockaddr *)&addr, sizeof addr) != 0 || listen(lfd, 128) != 0 ||
+        getsockname(lfd, (struct sockaddr *)&addr, &alen) != 0) {
+        printf("Error: cannot listen on 127.0.0.1:%d: %s.\n", port, strerror(errno));
+        close(lfd);
+        return -1;
+    }
+    int flags = fcntl(lfd, F_GETFL, 0);
+    fcntl(lfd, F_SETFL, flags | O_NONBLOCK);
+
+    if (bound) *bound = ntohs(addr.sin_port);
+    return lfd;
+}
+
+// What the workers share, and what each one counted.
+typedef struct {
+    int lfd;
+    int wake[2];                        // pipe: readable once the server stops
+    unsigned long long requests[POOL_MAX_THREADS], solves[POOL_MAX_THREADS];
+    unsigned long long connections[POOL_MAX_THREADS];
+} http_server_t;
+
+static char http_wake_tag;              // epoll data of the wake pipe
+
+// pool task: one worker's event loop, until the server stops. Every worker
+// waits on the listening socket (EPOLLEXCLUSIVE wakes one of them per
+// connection) and serves the connections it accepted.
+static void http_worker(size_t k, int worker, void *ctx)
+{
+    http_server_t *srv = ctx;
+    unsigned long long requests = 0, solves = 0, connections = 0;
+    (void)k;
+
+    int ep = epoll_create1(0);
+    struct epoll_event ev = { .events = EPOLLIN | EPOLLEXCLUSIVE, .data.ptr = NULL };   // NULL = listener
+    epoll_ctl(ep, EPOLL_CTL_ADD, srv->lfd, &ev);
+    struct epoll_event wev = { .events = EPOLLIN, .data.ptr = &http_wake_tag };
+    epoll_ctl(ep, EPOLL_CTL_ADD, srv->wake[0], &wev);
+
+    struct epoll_event evs[MAX_EVENTS];
+
+    for (;;) {
+        if (http_stop) {
+            // The signal reached one thread; the pipe wakes the others.
+            ssize_t w = write(srv->wake[1], "", 1);
+            (void)w;
+            break;
+        }
+        int n;
+        {
+            STATS_SCOPE(STAT_QUEUE_WAIT);
+            n = epoll_wait(ep, evs, MAX_EVENTS, -1);
+        }
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            printf("Error: epoll_wait: %s.\n", strerror(errno));
+            http_stop = 1;
+            continue;
+        }
+
+        for (int e = 0; e < n; ++e) {
+            hconn_t *c = evs[e].data.ptr;
+
+            if (c == (hconn_t *)(void *)&http_wake_tag) continue;
+            if (!c) {
+                // One connection per wake-up, so the others take their share.
+                int fd = accept(srv->lfd, NULL, NULL);
+                if (fd < 0) continue;
+                hconn_t *nc = malloc(sizeof *nc);
+                int flags = fcntl(fd, F_GETFL, 0);
+                if (!nc || fcntl(fd, F_SETFL, flags | O_NONBLOCK) != 0) { free(nc); close(fd); continue; }
+                nc->fd = fd;
+                nc->events = EPOLLIN;
+                nc->closing = nc->eof = 0;
+                nc->inlen = nc->outpos = nc->outlen = 0;
+                struct epoll_event cev = { .events = EPOLLIN, .data.ptr = nc };
+                if (epoll_ctl(ep, EPOLL_CTL_ADD, fd, &cev) != 0) { free(nc); close(fd); continue; }
+                connections++;
+                continue;
+            }
+
+            int dead = (evs[e].events & (EPOLLERR | EPOLLHUP)) && !(evs[e].events & EPOLLIN);
+            if (!dead && (evs[e].events & EPOLLIN)) {
+                ssize_t got = read(c->fd, c->in + c->inlen, HTTP_IN_BUF - c->inlen);
+                if (got > 0) c->inlen += (size_t)got;
+                else if (got == 0) c->eof = 1;
+                else if (errno != EAGAIN && errno != EINTR) dead = 1;
+            }
+            // Answer and send until the socket is full or no whole request
+            // is left; after the client's FIN, close once every answer is out.
+            while (!dead) {
+                size_t had = c->inlen;
+                http_process(c, &requests, &solves);
+                dead = http_flush(c) != 0;
+                if (c->outlen > 0 || c->inlen == had || c->closing) break;
+            }
+            if (!dead) dead = (c->closing || c->eof) && c->outpos == c->outlen;
+
+            if (dead) {
+                close(c->fd);
+                free(c);
+            }
+            else {
+                http_update(ep, c);
+            }
+        }
+    }
+
+    close(ep);
+    srv->requests[worker] = requests;
+    srv->solves[worker] = solves;
+    srv->connections[worker] = connections;
+}
+
+int http_serve(int lfd)
+{
+    http_server_t *srv = calloc(1, sizeof *srv);
+    if (!srv || pipe(srv->wake) != 0) {
+        printf("Error: cannot start the server: %s.\n", strerror(errno));
+        free(srv);
+        close(lfd);
+        return 0;
+    }
+    srv->lfd = lfd;
+
+    struct sigaction sa;
+    memset(&sa, 0, sizeof sa);
+    sa.sa_handler = http_signal;
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+    http_stop = 0;
+
+    int threads = pool_threads();
+    pool_run((size_t)threads, http_worker, srv);
+
+    unsigned long long requests = 0, solves = 0, connections = 0;
+    for (int w = 0; w < threads; ++w) {
+        requests += srv->requests[w];
+        solves += srv->solves[w];
+        connections += srv->connections[w];
+    }
+    close(srv->wake[0]);
+    close(srv->wake[1]);
+    free(srv);
+    close(lfd);
+    printf("\nStopped: %llu connection(s), %llu request(s), %llu solve(s), %d thread(s)\n",
+           connections, requests, solves, threads);
+    memo_print();
+
+    char line[256];
+    snprintf(line, sizeof line, "HTTP server: connections=%llu, requests=%llu, solves=%llu, threads=%d",
+             connections, requests, solves, threads);
+    log_line(line);
+    return 0;
+}
+
+int http_cli(int argc, char **argv)
+{
+    long port = -1;
+    char *end = NULL;
+    if (argc == 3) port = strtol(argv[2], &end, 10);
+    if (argc != 3 || *end != '\0' || port < 0 || port > 65535) {
+        printf("Usage: %s --http PORT\n", argv[0]);
+        return 1;
+    }
+
+    int bound;
+    int lfd = http_listen((int)port, &bound);
+    if (lfd < 0) return 1;
+    printf("Listening on http://127.0.0.1:%d/ (Ctrl+C to stop)\n", bound);
+    fflush(stdout);
+    return http_serve(lfd);
+}
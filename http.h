@@ -0,0 +1,28 @@
+// Embedded HTTP/1.1 JSON server for the EEE Helper CLI calculator.
+// "main.out --http PORT" listens on 127.0.0.1 and answers registry solves
+// (formulas.h) for tools that can only speak HTTP. Connections are kept
+// alive and requests may be pipelined.
+//
+//   GET  /formulas             every formula with its variables and units
+//   GET  /<formula>?R=1k&C=1u  solve for the one variable left out
+//   POST /<formula>            the same with a JSON object body {"R": 1000, ...}
+//   POST /batch                a JSON array of objects, each with a "formula"
+//                              key; answers an array in the same order
+//
+// A solve answers {"formula": ..., "solved": ..., "unit": ..., "values": {...}}
+// or {"error": "..."} with status 400, 404, 413 or 422.
+
+#ifndef HTTP_H
+#define HTTP_H
+
+// Opens a listening socket on 127.0.0.1:port (0 picks a free port, see
+// *bound). Returns the socket, or -1 with a message printed.
+int http_listen(int port, int *bound);
+
+// Serves on a listening socket until SIGINT or SIGTERM. Returns 0.
+int http_serve(int lfd);
+
+// Command line: "main.out --http PORT".
+int http_cli(int argc, char **argv);
+
+#endif
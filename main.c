@@ -1,39 +1,104 @@
 // ELEC2645 Unit 2 Project - main.c
 // Menu-driven CLI calculator.
-// Main menu selection uses fgets + strtol to reject invalid input (e.g. "2abc").
+// Main menu selection uses fgets + strtol to reject invalid input (e.g. "2abc");
+// end of input, at the menu or at the 'b' prompt, quits as option 7 does.
+// Options 1-5 are the calculators, 6 views the log, 7 quits and 8-12 are the
+// solver, custom formulas, sweeps, the worksheet and statistics.
+// With arguments ("main.out rc.charge R=1000 C=1e-6 t=1e-3") it runs a single
+// registry calculation instead (see formulas.h), and "main.out --sweep SCRIPT"
+// runs a sweep script (see sweep.h). "main.out --daemon PATH" serves
+// calculations on a Unix socket (see daemon.h), "main.out --http PORT" over
+// HTTP/JSON (see http.h) and "main.out --shm NAME" over shared memory
+// (see shm.h). "main.out --watch FORMULA VAR in.csv out.csv" keeps a batch
+// output up to date as its input changes (see watch.h), and "main.out
+// --power-pack in.csv out.eeep [dt]" packs a sample file into the columnar
+// form menu 5 maps directly (see power.h). "--stats" in front
+// of any of these (or alone, for the menu) prints call counts and latencies
+// at exit (see stats.h), and "--trace FILE" writes a timeline of the same
+// scopes as Chrome trace JSON (see trace.h).
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <errno.h>
 #include "funcs.h"
+#include "formulas.h"
+#include "sweep.h"
+#include "daemon.h"
+#include "http.h"
+#include "shm.h"
+#include "watch.h"
+#include "power.h"
+#include "session.h"
+#include "stats.h"
+#include "trace.h"
 
 static void print_menu(void);
 static int  get_choice(void);
-static void wait_back(void);
+static int  wait_back(void);
+static void show_stats(void);
+static void run_item(void (*item)(void));
 
-int main(void)
+int main(int argc, char **argv)
 {
+    // Leading "--stats" and "--trace FILE", in either order.
+    int print_stats = 0;
+    const char *trace_path = NULL;
+    for (;;) {
+        int shift = 0;
+        if (argc > 1 && strcmp(argv[1], "--stats") == 0) {
+            print_stats = 1;
+            shift = 1;
+        }
+        else if (argc > 2 && strcmp(argv[1], "--trace") == 0) {
+            trace_path = argv[2];
+            shift = 2;
+        }
+        if (!shift) break;
+        argv[shift] = argv[0];
+        argv += shift;
+        argc -= shift;
+    }
+    stats_init(print_stats);
+    if (trace_path && trace_start(trace_path) != 0) return 1;
+
+    // Any arguments: one calculation from the command line, no menu.
+    if (argc > 1 && strcmp(argv[1], "--sweep") == 0) return sweep_cli(argc, argv);
+    if (argc > 1 && strcmp(argv[1], "--daemon") == 0) return daemon_cli(argc, argv);
+    if (argc > 1 && strcmp(argv[1], "--http") == 0) return http_cli(argc, argv);
+    if (argc > 1 && strcmp(argv[1], "--shm") == 0) return shm_cli(argc, argv);
+    if (argc > 1 && strcmp(argv[1], "--watch") == 0) return watch_cli(argc, argv);
+    if (argc > 1 && strcmp(argv[1], "--power-pack") == 0) return power_pack_cli(argc, argv);
+    if (argc > 1) return formula_cli(argc, argv);
+
+    session_start();                    // EEE_WORKSPACE, if set
     for (;;) {
         print_menu();
 
-        switch (get_choice()) {
-            case 1: menu_item_1(); break; // Voltage Divider
-            case 2: menu_item_2(); break; // Resistor Tools
-            case 3: menu_item_3(); break; // AC Reactance & Resonance
-            case 4: menu_item_4(); break; // RC Transient
-            case 5: menu_item_5(); break; // Power (P = V * I)
+        int choice = get_choice();
+        switch (choice) {
+            case 1: run_item(menu_item_1); break; // Voltage Divider
+            case 2: run_item(menu_item_2); break; // Resistor Tools
+            case 3: run_item(menu_item_3); break; // AC Reactance & Resonance
+            case 4: run_item(menu_item_4); break; // RC Transient
+            case 5: run_item(menu_item_5); break; // Power (P = V * I)
             case 6: view_log(); break;    // View saved log
-            case 7:
-                printf("Bye!\n");
-                return 0;
+            case 7: break;                // Quit
+            case 8: run_item(menu_item_8); break; // Formula Solver
+            case 9: run_item(menu_item_9); break; // Custom Formula
+            case 10: run_item(menu_item_10); break; // Sweep Script
+            case 11: run_item(menu_item_11); break; // Worksheet
+            case 12: show_stats(); break; // Stats
             default:
                 printf("Invalid choice.\n");
                 continue;
         }
 
-        wait_back();
+        if (choice == 7 || wait_back() != 0) break;
     }
+    session_finish();
+    printf("Bye!\n");
+    return 0;
 }
 
 static void print_menu(void)
@@ -46,6 +111,11 @@ static void print_menu(void)
     printf("5) Power (P = V * I)\n");
     printf("6) View saved log\n");
     printf("7) Quit\n");
+    printf("8) Formula solver (any variable)\n");
+    printf("9) Custom formula (expression)\n");
+    printf("10) Sweep script (parameter study)\n");
+    printf("11) Worksheet (linked calculations)\n");
+    printf("12) Stats (time per calculation path)\n");
     printf("Select: ");
 }
 
@@ -55,7 +125,8 @@ static int get_choice(void)
     long v;
     char *end = NULL;
 
-    if (!fgets(buf, sizeof buf, stdin)) return -1;
+    if (!fgets(buf, sizeof buf, stdin)) return 7;    // end of input: Quit
+    STATS_SCOPE(STAT_INPUT_PARSE);
 
     errno = 0;
     v = strtol(buf, &end, 10);
@@ -68,7 +139,15 @@ static int get_choice(void)
     return (int)v;
 }
 
-static void wait_back(void)
+// One calculation menu, from its title to its last output (not wait_back).
+static void run_item(void (*item)(void))
+{
+    STATS_SCOPE(STAT_MENU_CALC);
+    item();
+}
+
+// 0 once the user enters 'b'; -1 at end of input, which quits like option 7.
+static int wait_back(void)
 {
     char buf[64];
 
@@ -76,13 +155,22 @@ static void wait_back(void)
         printf("\nEnter 'b' to go back to the main menu: ");
 
         if (!fgets(buf, sizeof buf, stdin)) {
-            printf("Input error. Exiting.\n");
-            exit(1);
+            printf("\n");
+            return -1;
         }
 
         buf[strcspn(buf, "\r\n")] = '\0';
 
         if ((buf[0] == 'b' || buf[0] == 'B') && buf[1] == '\0')
-            return;
+            return 0;
     }
 }
+
+static void show_stats(void)
+{
+    stats_print();
+    const char *path = getenv("EEE_METRICS");
+    if (!path || !*path) return;
+    if (stats_write_metrics(path) == 0) printf("Metrics written to %s\n", path);
+    else printf("Error: cannot write metrics to '%s'.\n", path);
+}
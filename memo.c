@@ -0,0 +1,187 @@
+// Memoisation cache for registry solves.
+// Design notes:
+// One flat open-addressing table of 64-byte entries (one cache line each).
+// A key hashes to a home slot and may live in any of the MEMO_WINDOW slots
+// after it, so a lookup touches at most a few adjacent lines. Entries are
+// only ever overwritten, never deleted, so a lookup can stop at the first
+// empty slot. When the window is full, CLOCK picks the victim: a hit sets
+// the entry's reference bit, and the hand clears bits until it finds an
+// entry that was not used since it last passed.
+// Several threads may solve at once (the HTTP server's workers): lookups and
+// inserts take one mutex, the solve on a miss runs outside it. Two threads
+// that miss on the same key at the same time may both store it; lookups find
+// the first copy and CLOCK retires the other.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <pthread.h>
+#include "memo.h"
+
+#define MEMO_WINDOW 8
+#define MEMO_EMPTY  0xFF
+
+typedef struct {
+    uint64_t bits[FORMULA_MAX_VARS];    // inputs; bits[var] holds the hint
+    double result;
+    uint8_t formula, var;               // formula == MEMO_EMPTY: free slot
+    uint8_t status, bad, cf, ref;
+} __attribute__((aligned(64))) memo_entry_t;
+
+static memo_entry_t *memo_table;
+static size_t memo_mask;
+static unsigned memo_hand;
+static int memo_ready;
+static memo_stats_t memo_st;
+static pthread_mutex_t memo_mu = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t memo_once = PTHREAD_ONCE_INIT;
+
+int memo_configure(size_t entries)
+{
+    free(memo_table);
+    memo_table = NULL;
+    memset(&memo_st, 0, sizeof memo_st);
+    memo_ready = 1;
+    if (entries == 0) return 0;
+
+    if (entries > MEMO_MAX_ENTRIES) entries = MEMO_MAX_ENTRIES;
+    size_t slots = MEMO_WINDOW;
+    while (slots < entries) slots <<= 1;    // at most MEMO_MAX_ENTRIES: no overflow
+    memo_table = aligned_alloc(64, slots * sizeof *memo_table);
+    if (!memo_table) return -1;
+    for (size_t k = 0; k < slots; ++k) memo_table[k].formula = MEMO_EMPTY;
+    memo_mask = slots - 1;
+    memo_st.capacity = slots;
+    return 0;
+}
+
+void memo_stats(memo_stats_t *st)
+{
+    *st = memo_st;
+}
+
+void memo_print(void)
+{
+    if (!memo_table) return;
+    unsigned long long total = memo_st.hits + memo_st.misses;
+    printf("Memo cache: %zu/%zu entries, hits=%llu, misses=%llu, evictions=%llu (%.1f%% hits)\n",
+           memo_st.used, memo_st.capacity, memo_st.hits, memo_st.misses, memo_st.evictions,
+           total ? 100.0 * (double)memo_st.hits / (double)total : 0.0);
+}
+
+static int solve_checked(const formula_t *fm, int var, double *v, double hint, int *bad, int *cf)
+{
+    for (int j = 0; j < fm->nvars; ++j)
+        if (j != var && !formula_domain_ok(fm->vars[j].domain, v[j])) { *bad = j; return MEMO_DOMAIN; }
+    return formula_solve(fm, var, v, hint, cf) ? MEMO_OK : MEMO_NOSOLUTION;
+}
+
+static uint64_t memo_hash(int formula, int var, const uint64_t *bits)
+{
+    uint64_t h = (uint64_t)(formula * 8 + var + 1) * 0x9E3779B97F4A7C15ull;
+    for (int j = 0; j < FORMULA_MAX_VARS; ++j) {
+        h = (h ^ bits[j]) * 0xFF51AFD7ED558CCDull;
+        h ^= h >> 32;
+    }
+    return h;
+}
+
+// Victim slot for a new key in the window starting at home.
+static memo_entry_t *memo_victim(size_t home)
+{
+    for (size_t k = 0; k < MEMO_WINDOW; ++k) {
+        memo_entry_t *e = &memo_table[(home + k) & memo_mask];
+        if (e->formula == MEMO_EMPTY) { memo_st.used++; return e; }
+    }
+    memo_st.evictions++;
+    for (;;) {
+        memo_entry_t *e = &memo_table[(home + (memo_hand++ % MEMO_WINDOW)) & memo_mask];
+        if (!e->ref) return e;
+        e->ref = 0;
+    }
+}
+
+// EEE_MEMO: a plain decimal count; anything else leaves the cache off.
+static size_t memo_env_entries(void)
+{
+    const char *env = getenv("EEE_MEMO");
+    if (!env || !*env) return 0;
+
+    char *end = NULL;
+    errno = 0;
+    unsigned long long n = strtoull(env, &end, 10);
+    if (*env < '0' || *env > '9' || *end != '\0') {
+        printf("Error: EEE_MEMO must be a number of entries, not '%s' (cache off).\n", env);
+        return 0;
+    }
+    if (errno == ERANGE || n > MEMO_MAX_ENTRIES) {
+        printf("EEE_MEMO=%s is more than %u entries; using %u.\n", env, MEMO_MAX_ENTRIES, MEMO_MAX_ENTRIES);
+        return MEMO_MAX_ENTRIES;
+    }
+    return (size_t)n;
+}
+
+static void memo_env_configure(void)
+{
+    if (!memo_ready && memo_configure(memo_env_entries()) != 0)
+        printf("Error: no memory for the memo cache (cache off).\n");
+}
+
+int memo_solve(const formula_t *fm, int var, double *v, double hint, int *bad, int *cf)
+{
+    pthread_once(&memo_once, memo_env_configure);
+
+    double w[FORMULA_MAX_VARS];
+    memcpy(w, v, sizeof w);
+    if (!memo_table) {
+        int st = solve_checked(fm, var, w, hint, bad, cf);
+        if (st == MEMO_OK) v[var] = w[var];
+        return st;
+    }
+
+    int formula = (int)(fm - FORMULAS);
+    uint64_t bits[FORMULA_MAX_VARS] = {0};
+    memcpy(bits, v, (size_t)fm->nvars * sizeof *v);
+    memcpy(&bits[var], &hint, sizeof hint);
+
+    size_t home = memo_hash(formula, var, bits) & memo_mask;
+    pthread_mutex_lock(&memo_mu);
+    for (size_t k = 0; k < MEMO_WINDOW; ++k) {
+        memo_entry_t *e = &memo_table[(home + k) & memo_mask];
+        if (e->formula == MEMO_EMPTY) break;
+        if (e->formula != formula || e->var != var || memcmp(e->bits, bits, sizeof bits) != 0) continue;
+
+        e->ref = 1;
+        memo_st.hits++;
+        if (e->status == MEMO_OK) v[var] = e->result;
+        *bad = e->bad;
+        *cf = e->cf;
+        int st = e->status;
+        pthread_mutex_unlock(&memo_mu);
+        return st;
+    }
+    memo_st.misses++;
+    pthread_mutex_unlock(&memo_mu);
+
+    int b = 0, c = 0;
+    int st = solve_checked(fm, var, w, hint, &b, &c);
+
+    pthread_mutex_lock(&memo_mu);
+    memo_entry_t *e = memo_victim(home);
+    memcpy(e->bits, bits, sizeof bits);
+    e->result = w[var];
+    e->formula = (uint8_t)formula;
+    e->var = (uint8_t)var;
+    e->status = (uint8_t)st;
+    e->bad = (uint8_t)b;
+    e->cf = (uint8_t)c;
+    e->ref = 0;
+    pthread_mutex_unlock(&memo_mu);
+
+    if (st == MEMO_OK) v[var] = w[var];
+    *bad = b;
+    *cf = c;
+    return st;
+}
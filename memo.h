@@ -0,0 +1,48 @@
+// Memoised registry solves for the EEE Helper CLI calculator.
+// memo_solve() checks the inputs of a registry formula (formulas.h) and
+// solves it, like the socket daemon does for each request. When the cache is
+// on, every answer - including "out of range" and "no solution" - is kept,
+// keyed on the formula, the variable solved for and the exact bit patterns of
+// all inputs. A repeated query then skips both the domain checks and the
+// math.
+//
+// The cache is off by default. Set EEE_MEMO=<entries> in the environment
+// (at most MEMO_MAX_ENTRIES; or call memo_configure) to turn it on. The size
+// is rounded up to a power of two (at least 8); the table never grows past
+// that and evicts with the CLOCK (second chance) policy.
+// memo_solve() may be called from several threads at once; memo_configure()
+// may not.
+
+#ifndef MEMO_H
+#define MEMO_H
+
+#include <stddef.h>
+#include "formulas.h"
+
+enum { MEMO_OK, MEMO_DOMAIN, MEMO_NOSOLUTION };
+
+typedef struct {
+    size_t capacity;                    // 0 = cache off
+    size_t used;
+    unsigned long long hits, misses, evictions;
+} memo_stats_t;
+
+// Checks every variable except var, then solves for var (hint as for
+// formula_solve). Returns MEMO_OK with v[var] set, MEMO_DOMAIN with *bad set
+// to the first variable out of range, or MEMO_NOSOLUTION. *cf is set as by
+// formula_solve on success.
+int memo_solve(const formula_t *fm, int var, double *v, double hint, int *bad, int *cf);
+
+#define MEMO_MAX_ENTRIES (1u << 26)     // 4 GB of 64-byte entries
+
+// Drops the cache and starts a new one with room for `entries` answers
+// (0 turns it off; more than MEMO_MAX_ENTRIES get that many). Returns 0, or
+// -1 if the table cannot be allocated.
+int  memo_configure(size_t entries);
+void memo_stats(memo_stats_t *st);
+
+// One line such as "Memo cache: 812/4096 entries, hits=..., misses=...",
+// printed only when the cache is on.
+void memo_print(void);
+
+#endif
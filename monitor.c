@@ -0,0 +1,226 @@
+// Live sliding-window power monitor.
+// Design notes:
+// Samples are read line by line from a FIFO, file or stdin. Every sample is an
+// O(1) update: the rolling mean uses a compensated (Neumaier) running sum over
+// a ring buffer, so adding and removing samples never drifts and no periodic
+// re-sum is needed, and the rolling maximum uses a monotonic deque of sample
+// indices. Latency runs from the moment a line can be read (after any wait
+// for the source) to the end of its output, so it includes reading and parsing.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <math.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "monitor.h"
+#include "power.h"
+#include "funcs.h"
+#include "stats.h"
+
+static void lat_hist_add(lat_hist_t *h, long long ns)
+{
+    int b = 0;
+    while (b < 63 && (ns >> (b + 1)) > 0) b++;
+    h->count[b]++;
+    h->n++;
+    if (ns > h->max_ns) h->max_ns = ns;
+}
+
+// Upper bound of the bucket containing quantile q (0..1).
+long long lat_hist_quantile(const lat_hist_t *h, double q)
+{
+    long long target = (long long)ceil(q * (double)h->n), seen = 0;
+    for (int b = 0; b < 64; ++b) {
+        seen += h->count[b];
+        if (seen >= target && h->count[b] > 0) return (2LL << b) - 1;
+    }
+    return h->max_ns;
+}
+
+void lat_hist_print(const lat_hist_t *h)
+{
+    printf("Latency sample-in -> output (ns, log2 buckets):\n");
+    for (int b = 0; b < 64; ++b)
+        if (h->count[b] > 0)
+            printf("  [%lld, %lld): %lld\n", 1LL << b, 2LL << b, h->count[b]);
+    printf("p50 <= %lld ns, p99 <= %lld ns, max = %lld ns\n",
+           lat_hist_quantile(h, 0.50), lat_hist_quantile(h, 0.99), h->max_ns);
+}
+
+typedef struct {
+    double *p;          // ring buffer of the last w powers
+    long long *dq;      // monotonic deque of sample indices (powers decreasing)
+    size_t w;
+    size_t dq_head, dq_len;
+    long long k;        // samples seen
+    ksum_t sum;         // running sum of the ring
+} monitor_t;
+
+static int monitor_init(monitor_t *m, size_t w)
+{
+    memset(m, 0, sizeof *m);
+    m->p = malloc(w * sizeof *m->p);
+    m->dq = malloc(w * sizeof *m->dq);
+    if (!m->p || !m->dq) { free(m->p); free(m->dq); return 0; }
+    m->w = w;
+    return 1;
+}
+
+static void monitor_free(monitor_t *m)
+{
+    free(m->p);
+    free(m->dq);
+}
+
+// Adds one sample; returns the window mean and sets *max to the window maximum.
+static double monitor_push(monitor_t *m, double p, double *max)
+{
+    STATS_SCOPE(STAT_MONITOR_PUSH);
+    size_t slot = (size_t)(m->k % (long long)m->w);
+
+    if (m->k >= (long long)m->w) ksum_add(&m->sum, -m->p[slot]);
+    m->p[slot] = p;
+    ksum_add(&m->sum, p);
+
+    // Drop indices that left the window, then smaller values from the back.
+    if (m->dq_len > 0 && m->dq[m->dq_head] <= m->k - (long long)m->w) {
+        m->dq_head = (m->dq_head + 1) % m->w;
+        m->dq_len--;
+    }
+    while (m->dq_len > 0) {
+        size_t back = (m->dq_head + m->dq_len - 1) % m->w;
+        if (m->p[(size_t)(m->dq[back] % (long long)m->w)] > p) break;
+        m->dq_len--;
+    }
+    m->dq[(m->dq_head + m->dq_len) % m->w] = m->k;
+    m->dq_len++;
+
+    m->k++;
+
+    size_t n = m->k < (long long)m->w ? (size_t)m->k : m->w;
+    *max = m->p[(size_t)(m->dq[m->dq_head] % (long long)m->w)];
+    return ksum_value(&m->sum) / (double)n;
+}
+
+// Line reader over a non-blocking descriptor, so the monitor knows when the
+// next line is not there yet and can wait for it with poll(). A FIFO or file
+// is read() in blocks. Stdin is read through stdio one character at a time:
+// the menus have already buffered some of it there, and whatever follows the
+// "q" line must stay there for them.
+typedef struct {
+    int fd;
+    FILE *fp;           // stdin, or NULL to read() the descriptor
+    char buf[4096];
+    size_t pos, len;    // unread bytes are buf[pos..len)
+    int eof;
+} monitor_src_t;
+
+// Copies the next line (without waiting) into line[size], cut to fit.
+// Returns 1, 0 if the source has no complete line yet, or -1 at the end.
+static int monitor_next(monitor_src_t *s, char *line, size_t size)
+{
+    for (;;) {
+        char *nl = memchr(s->buf + s->pos, '\n', s->len - s->pos);
+        if (nl || s->len == sizeof s->buf || (s->eof && s->len > s->pos)) {
+            size_t end = nl ? (size_t)(nl - s->buf) + 1 : s->len, n = end - s->pos;
+            if (n > size - 1) n = size - 1;
+            memcpy(line, s->buf + s->pos, n);
+            line[n] = '\0';
+            s->pos = end;
+            return 1;
+        }
+        if (s->eof) return -1;
+
+        memmove(s->buf, s->buf + s->pos, s->len - s->pos);
+        s->len -= s->pos;
+        s->pos = 0;
+
+        if (s->fp) {
+            int c = 0;
+            while (s->len < sizeof s->buf && (c = getc(s->fp)) != EOF) {
+                s->buf[s->len++] = (char)c;
+                if (c == '\n') break;
+            }
+            if (c != EOF) continue;
+            if (ferror(s->fp) && (errno == EAGAIN || errno == EWOULDBLOCK)) { clearerr(s->fp); return 0; }
+            if (ferror(s->fp) && errno == EINTR) { clearerr(s->fp); continue; }
+            s->eof = 1;
+        }
+        else {
+            ssize_t n = read(s->fd, s->buf + s->len, sizeof s->buf - s->len);
+            if (n > 0) s->len += (size_t)n;
+            else if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) return 0;
+            else if (n == 0 || errno != EINTR) s->eof = 1;
+        }
+    }
+}
+
+// Runs the monitor until EOF or a line "q". Lines are "V,I" or "t,V,I".
+// An alarm line is printed whenever the mean or maximum crosses its limit
+// (a limit <= 0 disables it), and a status line every `every` samples.
+// Returns the number of samples processed.
+long long monitor_run(int fd, size_t w, double mean_limit, double max_limit,
+                      long long every, lat_hist_t *lat)
+{
+    monitor_t m;
+    if (!monitor_init(&m, w)) return -1;
+
+    monitor_src_t src = { .fd = fd, .fp = fd == STDIN_FILENO ? stdin : NULL };
+    int flags = fcntl(fd, F_GETFL);
+    if (flags >= 0) fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+
+    char line[256];
+    double f[3];
+    int mean_alarm = 0, max_alarm = 0;
+
+    memset(lat, 0, sizeof *lat);
+    for (;;) {
+        long long t_in = now_ns();
+        int got = monitor_next(&src, line, sizeof line);
+        if (got < 0) break;
+        if (got == 0) {
+            // Wait for the source here, so idle time is not counted as latency.
+            struct pollfd pfd = { fd, POLLIN, 0 };
+            while (poll(&pfd, 1, -1) < 0 && errno == EINTR) {}
+            continue;
+        }
+        if (line[0] == 'q' && (line[1] == '\n' || line[1] == '\r' || line[1] == '\0')) break;
+
+        int nf = parse_fields(line, f, 3);
+        if (nf != 2 && nf != 3) continue;
+
+        double V = f[nf - 2], I = f[nf - 1];
+        double pmax, mean = monitor_push(&m, V * I, &pmax);
+        int out = 0;
+
+        int a = mean_limit > 0.0 && mean > mean_limit;
+        if (a != mean_alarm) {
+            printf("%s: sample %lld, mean P = %.6f W (limit %.6f W)\n",
+                   a ? "ALARM mean" : "clear mean", m.k, mean, mean_limit);
+            mean_alarm = a;
+            out = 1;
+        }
+        a = max_limit > 0.0 && pmax > max_limit;
+        if (a != max_alarm) {
+            printf("%s: sample %lld, max P = %.6f W (limit %.6f W)\n",
+                   a ? "ALARM max" : "clear max", m.k, pmax, max_limit);
+            max_alarm = a;
+            out = 1;
+        }
+        if (every > 0 && m.k % every == 0) {
+            printf("sample %lld: mean P = %.6f W, max P = %.6f W\n", m.k, mean, pmax);
+            out = 1;
+        }
+        if (out) fflush(stdout);
+
+        lat_hist_add(lat, now_ns() - t_in);
+    }
+
+    if (flags >= 0) fcntl(fd, F_SETFL, flags);
+    long long n = m.k;
+    monitor_free(&m);
+    return n;
+}
@@ -0,0 +1,29 @@
+// Live power monitor for the EEE Helper CLI calculator (menu 5).
+// "V,I" or "t,V,I" lines from a FIFO, file or stdin update a rolling mean
+// and maximum of P = V * I over the last w samples in O(1) each, with alarm
+// lines when either crosses its limit and a histogram of per-sample latency.
+
+#ifndef MONITOR_H
+#define MONITOR_H
+
+#include <stddef.h>
+
+// Log2 latency histogram: bucket b counts latencies in [2^b, 2^(b+1)) ns.
+typedef struct {
+    long long count[64];
+    long long n, max_ns;
+} lat_hist_t;
+
+// Upper bound of the bucket containing quantile q (0..1).
+long long lat_hist_quantile(const lat_hist_t *h, double q);
+void      lat_hist_print(const lat_hist_t *h);
+
+// Runs the monitor on fd until the end of the source or a line "q". An alarm
+// line is printed whenever the mean or maximum crosses its limit (a limit
+// <= 0 disables it), and a status line every `every` samples (0 = never).
+// On stdin, whatever follows the "q" line is left for the menus.
+// Returns the number of samples processed, or -1 if memory runs out.
+long long monitor_run(int fd, size_t w, double mean_limit, double max_limit,
+                      long long every, lat_hist_t *lat);
+
+#endif
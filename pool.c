@@ -0,0 +1,111 @@
+// Worker pool for jobs split into independent tasks.
+// Design notes:
+// The workers sleep on a condition variable between jobs. A job is published
+// under the mutex with a new generation number; each thread then claims task
+// numbers with an atomic fetch-and-add until they run out, so one slow task
+// does not hold up the rest. The last thread to finish wakes the caller.
+// Jobs are run one at a time (a second caller waits for the first), and a
+// job that starts another from inside a task runs it on its own thread.
+// If a worker cannot be started, the pool keeps the ones it has.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <unistd.h>
+#include "pool.h"
+
+static pthread_mutex_t pool_mu = PTHREAD_MUTEX_INITIALIZER;
+static pthread_mutex_t pool_job_mu = PTHREAD_MUTEX_INITIALIZER;   // one job at a time
+static pthread_cond_t pool_go = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t pool_done = PTHREAD_COND_INITIALIZER;
+
+static int pool_nthreads;              // 0 until the first call
+static int pool_started;               // workers running (not counting callers)
+static unsigned long pool_gen;         // bumped for every job
+static int pool_busy;                  // threads still working on the job
+
+static pool_task_fn pool_task;
+static void *pool_ctx;
+static size_t pool_ntasks, pool_next;
+
+static __thread int pool_inside;       // this thread is running a task
+
+int pool_threads(void)
+{
+    if (pool_nthreads) return pool_nthreads;
+
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    const char *env = getenv("EEE_THREADS");
+    if (env && *env) {
+        char *end;
+        long v = strtol(env, &end, 10);
+        if (*end == '\0' && v >= 1) n = v;
+    }
+    if (n < 1) n = 1;
+    if (n > POOL_MAX_THREADS) n = POOL_MAX_THREADS;
+    pool_nthreads = (int)n;
+    return pool_nthreads;
+}
+
+static void pool_work(int worker)
+{
+    pool_inside = 1;
+    for (;;) {
+        size_t k = __atomic_fetch_add(&pool_next, 1, __ATOMIC_RELAXED);
+        if (k >= pool_ntasks) break;
+        pool_task(k, worker, pool_ctx);
+    }
+    pool_inside = 0;
+
+    pthread_mutex_lock(&pool_mu);
+    if (--pool_busy == 0) pthread_cond_signal(&pool_done);
+    pthread_mutex_unlock(&pool_mu);
+}
+
+static void *pool_main(void *arg)
+{
+    int worker = (int)(size_t)arg;
+    unsigned long seen = 0;
+
+    for (;;) {
+        pthread_mutex_lock(&pool_mu);
+        while (pool_gen == seen) pthread_cond_wait(&pool_go, &pool_mu);
+        seen = pool_gen;
+        pthread_mutex_unlock(&pool_mu);
+        pool_work(worker);
+    }
+    return NULL;
+}
+
+void pool_run(size_t ntasks, pool_task_fn task, void *ctx)
+{
+    if (ntasks == 0) return;
+    if (ntasks == 1 || pool_inside || pool_threads() == 1) {
+        for (size_t k = 0; k < ntasks; ++k) task(k, 0, ctx);
+        return;
+    }
+
+    pthread_mutex_lock(&pool_job_mu);
+    pthread_mutex_lock(&pool_mu);
+    while (pool_started < pool_nthreads - 1) {
+        pthread_t th;
+        if (pthread_create(&th, NULL, pool_main, (void *)(size_t)(pool_started + 1)) != 0) break;
+        pthread_detach(th);
+        pool_started++;
+    }
+    pool_task = task;
+    pool_ctx = ctx;
+    pool_ntasks = ntasks;
+    pool_next = 0;
+    pool_busy = pool_started + 1;
+    pool_gen++;
+    pthread_cond_broadcast(&pool_go);
+    pthread_mutex_unlock(&pool_mu);
+
+    pool_work(0);
+
+    pthread_mutex_lock(&pool_mu);
+    while (pool_busy > 0) pthread_cond_wait(&pool_done, &pool_mu);
+    pthread_mutex_unlock(&pool_mu);
+    pthread_mutex_unlock(&pool_job_mu);
+}
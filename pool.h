@@ -0,0 +1,28 @@
+// Worker threads for the EEE Helper CLI calculator.
+// pool_run() splits a job into numbered tasks and runs them on a fixed set of
+// worker threads, started on first use and kept until the program exits. The
+// calling thread works on the tasks too and returns once all are done, so a
+// caller sees the same sequence of events as a plain loop over the tasks.
+//
+// The number of threads is the number of CPUs online, or EEE_THREADS=<n>
+// (1 runs every task on the calling thread, as before the pool existed).
+// Callers that merge per-task results do so in task order, so results do not
+// depend on how many threads ran.
+
+#ifndef POOL_H
+#define POOL_H
+
+#include <stddef.h>
+
+#define POOL_MAX_THREADS 64
+
+// Runs task(k, worker, ctx) for k = 0..ntasks-1. worker is 0 for the
+// calling thread and 1..pool_threads()-1 for the others, so it can index
+// per-thread scratch space. Tasks are handed out in order, one at a time.
+typedef void (*pool_task_fn)(size_t k, int worker, void *ctx);
+
+// Threads a job may use (including the caller): 1..POOL_MAX_THREADS.
+int  pool_threads(void);
+void pool_run(size_t ntasks, pool_task_fn task, void *ctx);
+
+#endif
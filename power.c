@@ -0,0 +1,696 @@
+// Power sample analytics: chunked reductions, V/I log join and AC power.
+// Design notes:
+// Sample files are reduced in fixed-size chunks, so memory use does not depend
+// on the file size. Each chunk is reduced to a partial result which is merged
+// into the running total. The merge is associative, so chunks can be reduced
+// independently and combined afterwards without changing the result.
+// Columnar files are mapped rather than read, and their columns are reduced
+// where they lie: no parsing and no copy, only the page cache.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "power.h"
+#include "funcs.h"
+#include "stats.h"
+#include "pool.h"
+#include "vec4.h"
+
+#define PI 3.14159265358979323846
+
+static void ksum_merge(ksum_t *a, const ksum_t *b)
+{
+    ksum_add(a, b->s);
+    ksum_add(a, b->c);
+}
+
+static void power_stats_init(power_stats_t *s)
+{
+    memset(s, 0, sizeof *s);
+    s->p_max = -HUGE_VAL;
+    s->p_min = HUGE_VAL;
+}
+
+// Merges run b (which directly follows run a in time) into a.
+static void power_stats_merge(power_stats_t *a, const power_stats_t *b)
+{
+    if (b->n == 0) return;
+    if (a->n == 0) { *a = *b; return; }
+
+    // Trapezoids spanning the boundary between the two runs.
+    double h = 0.5 * (b->t_first - a->t_last);
+    ksum_add(&a->energy, h * (a->v_last * a->i_last + b->v_first * b->i_first));
+    ksum_add(&a->v2t, h * (a->v_last * a->v_last + b->v_first * b->v_first));
+    ksum_add(&a->i2t, h * (a->i_last * a->i_last + b->i_first * b->i_first));
+
+    ksum_merge(&a->p, &b->p);
+    ksum_merge(&a->v2, &b->v2);
+    ksum_merge(&a->i2, &b->i2);
+    ksum_merge(&a->energy, &b->energy);
+    ksum_merge(&a->v2t, &b->v2t);
+    ksum_merge(&a->i2t, &b->i2t);
+
+    if (b->v_peak > a->v_peak) a->v_peak = b->v_peak;
+    if (b->i_peak > a->i_peak) a->i_peak = b->i_peak;
+    if (b->p_max > a->p_max) a->p_max = b->p_max;
+    if (b->p_min < a->p_min) a->p_min = b->p_min;
+
+    a->n += b->n;
+    a->t_last = b->t_last;
+    a->v_last = b->v_last;
+    a->i_last = b->i_last;
+}
+
+// Reduces one chunk of n >= 1 samples into a partial result.
+static void power_chunk(const double *t, const double *v, const double *i, size_t n,
+                        power_stats_t *out)
+{
+    v4d sp = {0}, sv2 = {0}, si2 = {0}, se = {0}, sv2t = {0}, si2t = {0};
+    v4d vpk = {0}, ipk = {0};
+    v4d pmax = { -HUGE_VAL, -HUGE_VAL, -HUGE_VAL, -HUGE_VAL };
+    v4d pmin = {  HUGE_VAL,  HUGE_VAL,  HUGE_VAL,  HUGE_VAL };
+    size_t k = 0;
+
+    for (; k + 4 <= n; k += 4) {
+        v4d vv, ii, av, ai;
+        V4_LOAD(vv, v + k);
+        V4_LOAD(ii, i + k);
+        v4d pp = vv * ii;
+        sp += pp;
+        sv2 += vv * vv;
+        si2 += ii * ii;
+        av = V4_ABS(vv);
+        ai = V4_ABS(ii);
+        vpk = V4_SELECT(av > vpk, av, vpk);
+        ipk = V4_SELECT(ai > ipk, ai, ipk);
+        pmax = V4_SELECT(pp > pmax, pp, pmax);
+        pmin = V4_SELECT(pp < pmin, pp, pmin);
+    }
+    // Trapezoids between samples m and m+1 (needs one sample of look-ahead).
+    size_t m = 0;
+    for (; m + 5 <= n; m += 4) {
+        v4d t0, t1, v0, v1, i0, i1;
+        V4_LOAD(t0, t + m);
+        V4_LOAD(t1, t + m + 1);
+        V4_LOAD(v0, v + m);
+        V4_LOAD(v1, v + m + 1);
+        V4_LOAD(i0, i + m);
+        V4_LOAD(i1, i + m + 1);
+        v4d dt = t1 - t0;
+        se += dt * (v0 * i0 + v1 * i1);
+        sv2t += dt * (v0 * v0 + v1 * v1);
+        si2t += dt * (i0 * i0 + i1 * i1);
+    }
+
+    double s_p = v4_hsum(&sp), s_v2 = v4_hsum(&sv2), s_i2 = v4_hsum(&si2);
+    double s_e = v4_hsum(&se), s_v2t = v4_hsum(&sv2t), s_i2t = v4_hsum(&si2t);
+    double v_pk = v4_hmax(&vpk), i_pk = v4_hmax(&ipk);
+    double p_mx = v4_hmax(&pmax), p_mn = v4_hmin(&pmin);
+
+    for (; k < n; ++k) {
+        double p = v[k] * i[k];
+        s_p += p;
+        s_v2 += v[k] * v[k];
+        s_i2 += i[k] * i[k];
+        if (fabs(v[k]) > v_pk) v_pk = fabs(v[k]);
+        if (fabs(i[k]) > i_pk) i_pk = fabs(i[k]);
+        if (p > p_mx) p_mx = p;
+        if (p < p_mn) p_mn = p;
+    }
+    for (; m + 1 < n; ++m) {
+        double dt = t[m + 1] - t[m];
+        s_e += dt * (v[m] * i[m] + v[m + 1] * i[m + 1]);
+        s_v2t += dt * (v[m] * v[m] + v[m + 1] * v[m + 1]);
+        s_i2t += dt * (i[m] * i[m] + i[m + 1] * i[m + 1]);
+    }
+
+    power_stats_init(out);
+    out->n = (long long)n;
+    ksum_add(&out->p, s_p);
+    ksum_add(&out->v2, s_v2);
+    ksum_add(&out->i2, s_i2);
+    ksum_add(&out->energy, 0.5 * s_e);
+    ksum_add(&out->v2t, 0.5 * s_v2t);
+    ksum_add(&out->i2t, 0.5 * s_i2t);
+    out->v_peak = v_pk;
+    out->i_peak = i_pk;
+    out->p_max = p_mx;
+    out->p_min = p_mn;
+    out->t_first = t[0];
+    out->v_first = v[0];
+    out->i_first = i[0];
+    out->t_last = t[n - 1];
+    out->v_last = v[n - 1];
+    out->i_last = i[n - 1];
+}
+
+power_acc_t *power_acc_new(void)
+{
+    power_acc_t *a = malloc(sizeof *a);
+    if (!a) return NULL;
+    a->n = 0;
+    power_stats_init(&a->total);
+    return a;
+}
+
+static void power_acc_flush(power_acc_t *a)
+{
+    if (a->n == 0) return;
+
+    power_stats_t part;
+    power_chunk(a->t, a->v, a->i, a->n, &part);
+    power_stats_merge(&a->total, &part);
+    a->n = 0;
+}
+
+static void power_acc_push(power_acc_t *a, double t, double v, double i)
+{
+    a->t[a->n] = t;
+    a->v[a->n] = v;
+    a->i[a->n] = i;
+    if (++a->n == POWER_CHUNK) power_acc_flush(a);
+}
+
+// Sample files are read POWER_BATCH pieces of about POWER_PIECE bytes at a
+// time. Each piece holds whole lines and is parsed and reduced by one pool
+// task; the pieces' partial results are then merged in file order, so the
+// result is the same however many threads run.
+#define POWER_PIECE (1 << 16)
+#define POWER_BATCH 64
+
+typedef struct {
+    char *text;                         // POWER_BATCH * POWER_PIECE + 1 bytes
+    size_t begin[POWER_BATCH], end[POWER_BATCH];
+    int has_time;
+    double dt;
+    power_acc_t *acc[POOL_MAX_THREADS]; // chunk buffer of each worker
+    power_stats_t part[POWER_BATCH];
+    long long rows[POWER_BATCH];
+    long skipped[POWER_BATCH];
+} power_batch_t;
+
+// pool task: reduces piece k. Without timestamps, sample times count from
+// the start of the piece and are moved into place by the merge.
+static void power_piece(size_t k, int worker, void *ctx)
+{
+    power_batch_t *b = ctx;
+    power_acc_t *acc = b->acc[worker];
+    char *p = b->text + b->begin[k], *end = b->text + b->end[k];
+    int want = b->has_time ? 3 : 2;
+    double f[3];
+    long long rows = 0;
+    long skipped = 0;
+
+    acc->n = 0;
+    power_stats_init(&acc->total);
+    while (p < end) {
+        char *nl = memchr(p, '\n', (size_t)(end - p));
+        char *stop = nl ? nl : end;
+        *stop = '\0';
+        if (parse_fields(p, f, 3) != want) skipped++;
+        else {
+            if (b->has_time) power_acc_push(acc, f[0], f[1], f[2]);
+            else             power_acc_push(acc, (double)rows * b->dt, f[0], f[1]);
+            rows++;
+        }
+        p = stop + 1;
+    }
+    power_acc_flush(acc);
+
+    b->part[k] = acc->total;
+    b->rows[k] = rows;
+    b->skipped[k] = skipped;
+}
+
+// Reads a sample file into *total.
+// has_time = 1: columns are t,V,I. Otherwise columns are V,I spaced dt apart.
+// Lines that do not parse (e.g. a header) are skipped and counted in *skipped.
+// Returns 1 on success, 0 if the file cannot be opened or memory runs out.
+int power_read_file(const char *path, int has_time, double dt,
+                    power_stats_t *total, long *skipped)
+{
+    STATS_SCOPE(STAT_POWER_FILE);
+    FILE *fp = fopen(path, "r");
+    if (!fp) return 0;
+
+    int threads = pool_threads(), ok = 1;
+    size_t cap = (size_t)POWER_BATCH * POWER_PIECE;
+    power_batch_t *b = calloc(1, sizeof *b);
+    if (b) b->text = malloc(cap + 1);
+    ok = b && b->text;
+    for (int w = 0; ok && w < threads; ++w) ok = (b->acc[w] = power_acc_new()) != NULL;
+
+    power_stats_init(total);
+    *skipped = 0;
+    long long base = 0;
+    size_t have = 0;               // start of a line carried over from the last batch
+
+    while (ok) {
+        size_t len = have + fread(b->text + have, 1, cap - have, fp);
+        int eof = len < cap;
+        if (len == 0) break;
+
+        // Whole lines only, unless this is the end of the file (or one line
+        // fills the buffer).
+        size_t cut = len;
+        if (!eof) {
+            while (cut > 0 && b->text[cut - 1] != '\n') cut--;
+            if (cut == 0) cut = len;
+        }
+
+        size_t np = 0;
+        for (size_t at = 0; at < cut; ++np) {
+            size_t e = at + POWER_PIECE;
+            if (e >= cut) e = cut;
+            else {
+                char *nl = memchr(b->text + e, '\n', cut - e);
+                e = nl ? (size_t)(nl - b->text) + 1 : cut;
+            }
+            b->begin[np] = at;
+            b->end[np] = e;
+            at = e;
+        }
+        b->has_time = has_time;
+        b->dt = dt;
+        pool_run(np, power_piece, b);
+
+        for (size_t k = 0; k < np; ++k) {
+            if (!has_time && b->part[k].n > 0) {
+                b->part[k].t_first += (double)base * dt;
+                b->part[k].t_last += (double)base * dt;
+            }
+            power_stats_merge(total, &b->part[k]);
+            base += b->rows[k];
+            *skipped += b->skipped[k];
+        }
+
+        have = len - cut;
+        memmove(b->text, b->text + cut, have);
+        if (eof) break;
+    }
+    fclose(fp);
+
+    if (b) {
+        for (int w = 0; w < threads; ++w) free(b->acc[w]);
+        free(b->text);
+        free(b);
+    }
+    return ok;
+}
+
+// Columnar sample files: the header, then each column as n consecutive
+// doubles in the byte order of the machine that wrote it: t (if ncols is 3),
+// V, I. The columns start 8-byte aligned, right after the header.
+#define POWER_COL_VERSION 1
+
+typedef struct {
+    char magic[4];                      // "EEEP"
+    uint32_t version;
+    uint32_t ncols;                     // 3: t, V, I   2: V, I spaced dt apart
+    uint32_t reserved;
+    uint64_t n;                         // samples (length of each column)
+    double dt;                          // if ncols is 2
+} power_col_hdr_t;
+
+// Samples of a columnar file per pool task, and the pieces of one pool_run.
+#define POWER_COL_PIECE (1 << 16)
+
+typedef struct {
+    const double *t, *v, *i;            // t is NULL when the samples are dt apart
+    double dt;
+    size_t n, first;                    // samples in the file; first piece of this batch
+    power_stats_t part[POWER_BATCH];
+} power_col_batch_t;
+
+// pool task: reduces piece first + k, POWER_CHUNK samples at a time.
+static void power_col_piece(size_t k, int worker, void *ctx)
+{
+    power_col_batch_t *b = ctx;
+    size_t at = (b->first + k) * POWER_COL_PIECE, end = at + POWER_COL_PIECE;
+    double tt[POWER_CHUNK];
+    (void)worker;
+
+    if (end > b->n) end = b->n;
+    power_stats_init(&b->part[k]);
+    for (size_t c = at; c < end; c += POWER_CHUNK) {
+        size_t len = end - c < POWER_CHUNK ? end - c : POWER_CHUNK;
+        if (!b->t)
+            for (size_t j = 0; j < len; ++j) tt[j] = (double)(c + j) * b->dt;
+
+        power_stats_t part;
+        power_chunk(b->t ? b->t + c : tt, b->v + c, b->i + c, len, &part);
+        power_stats_merge(&b->part[k], &part);
+    }
+}
+
+int power_read_columnar(const char *path, power_stats_t *total, int *timed)
+{
+    STATS_SCOPE(STAT_POWER_FILE);
+    power_col_hdr_t h;
+    struct stat st;
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return -1;
+    if (read(fd, &h, sizeof h) != (ssize_t)sizeof h || memcmp(h.magic, "EEEP", 4) != 0) {
+        close(fd);
+        return -1;
+    }
+    int ok = fstat(fd, &st) == 0 && h.version == POWER_COL_VERSION &&
+             (h.ncols == 3 || (h.ncols == 2 && h.dt > 0.0)) &&
+             h.n <= (SIZE_MAX - sizeof h) / (h.ncols * sizeof(double)) &&
+             (uint64_t)st.st_size == sizeof h + h.n * h.ncols * sizeof(double);
+    size_t size = ok ? (size_t)st.st_size : 0;
+    void *map = ok ? mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0) : MAP_FAILED;
+    close(fd);
+    if (map == MAP_FAILED) return 0;
+    madvise(map, size, MADV_SEQUENTIAL);
+
+    const double *col = (const double *)((const char *)map + sizeof h);
+    power_col_batch_t b = { 0 };
+    b.n = (size_t)h.n;
+    b.t = h.ncols == 3 ? col : NULL;
+    b.v = col + (h.ncols - 2) * b.n;
+    b.i = b.v + b.n;
+    b.dt = h.dt;
+
+    power_stats_init(total);
+    size_t pieces = (b.n + POWER_COL_PIECE - 1) / POWER_COL_PIECE;
+    for (b.first = 0; b.first < pieces; b.first += POWER_BATCH) {
+        size_t np = pieces - b.first < POWER_BATCH ? pieces - b.first : POWER_BATCH;
+        pool_run(np, power_col_piece, &b);
+        for (size_t k = 0; k < np; ++k) power_stats_merge(total, &b.part[k]);
+    }
+
+    munmap(map, size);
+    *timed = h.ncols == 3;
+    return 1;
+}
+
+// Fills the columns from a CSV: a first pass counts the rows, the output is
+// sized and mapped, and a second pass stores each row straight into place.
+long long power_pack_file(const char *in_path, double dt, const char *out_path, long *skipped)
+{
+    STATS_SCOPE(STAT_POWER_FILE);
+    int want = dt > 0.0 ? 2 : 3;
+    char line[256];
+    double f[3];
+    uint64_t n = 0;
+
+    FILE *in = fopen(in_path, "r");
+    if (!in) return -1;
+    *skipped = 0;
+    while (fgets(line, sizeof line, in)) {
+        if (parse_fields(line, f, 3) == want) n++;
+        else (*skipped)++;
+    }
+
+    power_col_hdr_t h = { { 'E', 'E', 'E', 'P' }, POWER_COL_VERSION, (uint32_t)want, 0, n, want == 2 ? dt : 0.0 };
+    size_t size = sizeof h + (size_t)n * h.ncols * sizeof(double);
+
+    int fd = open(out_path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    void *map = MAP_FAILED;
+    if (fd >= 0 && ftruncate(fd, (off_t)size) == 0)
+        map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (fd >= 0) close(fd);
+    if (map == MAP_FAILED) {
+        fclose(in);
+        if (fd >= 0) unlink(out_path);
+        return -1;
+    }
+
+    memcpy(map, &h, sizeof h);
+    double *col = (double *)((char *)map + sizeof h);
+    uint64_t k = 0;
+    rewind(in);
+    while (k < n && fgets(line, sizeof line, in)) {
+        if (parse_fields(line, f, 3) != want) continue;
+        for (int c = 0; c < want; ++c) col[(size_t)c * n + k] = f[c];
+        k++;
+    }
+    fclose(in);
+
+    // The input changed between the passes: keep what was stored.
+    if (k < n) {
+        h.n = k;
+        for (int c = 1; c < want; ++c) memmove(col + (size_t)c * k, col + (size_t)c * n, k * sizeof(double));
+        memcpy(map, &h, sizeof h);
+    }
+    int err = msync(map, size, MS_SYNC);
+    munmap(map, size);
+    if (k < n && truncate(out_path, (off_t)(sizeof h + (size_t)k * h.ncols * sizeof(double))) != 0) err = -1;
+    if (err != 0) { unlink(out_path); return -1; }
+    return (long long)k;
+}
+
+int power_pack_cli(int argc, char **argv)
+{
+    double dt = 0.0;
+    if (argc == 5) {
+        char *end;
+        dt = strtod(argv[4], &end);
+        if (end == argv[4] || *end != '\0' || !(dt > 0.0)) { printf("Error: dt must be a number > 0.\n"); return 1; }
+    }
+    if (argc < 4 || argc > 5) {
+        printf("Usage: %s --power-pack in.csv out.eeep [dt]\n", argv[0]);
+        printf("  in.csv rows are t,V,I, or V,I spaced dt seconds apart if dt is given.\n");
+        return 1;
+    }
+
+    long skipped;
+    long long n = power_pack_file(argv[2], dt, argv[3], &skipped);
+    if (n < 0) { printf("Error: cannot read '%s' or write '%s'.\n", argv[2], argv[3]); return 1; }
+    printf("%lld sample(s) written to %s\n", n, argv[3]);
+    if (skipped > 0) printf("(%ld line(s) skipped)\n", skipped);
+
+    char line[256];
+    snprintf(line, sizeof line, "Power pack: %.100s -> %.100s, n=%lld", argv[2], argv[3], n);
+    log_line(line);
+    return 0;
+}
+
+// Sequential reader for a two-column (t, x) log. Only the current and previous
+// samples are kept, so memory use is constant whatever the file size.
+typedef struct {
+    FILE *fp;
+    double t_prev, x_prev;  // last consumed sample (valid if has_prev)
+    double t, x;            // next unconsumed sample (valid if has_next)
+    int has_prev, has_next;
+    long skipped;           // unparsable or out-of-order lines
+} ts_reader_t;
+
+// Loads the next valid sample into r->t / r->x. Timestamps must not go backwards.
+static void ts_advance(ts_reader_t *r)
+{
+    char line[256];
+    double f[2];
+
+    r->has_next = 0;
+    while (fgets(line, sizeof line, r->fp)) {
+        if (parse_fields(line, f, 2) != 2) { r->skipped++; continue; }
+        if (r->has_prev && f[0] < r->t_prev) { r->skipped++; continue; }
+
+        r->t = f[0];
+        r->x = f[1];
+        r->has_next = 1;
+        return;
+    }
+}
+
+static int ts_open(ts_reader_t *r, const char *path)
+{
+    memset(r, 0, sizeof *r);
+    r->fp = fopen(path, "r");
+    if (!r->fp) return 0;
+    ts_advance(r);
+    return 1;
+}
+
+static void ts_consume(ts_reader_t *r)
+{
+    r->t_prev = r->t;
+    r->x_prev = r->x;
+    r->has_prev = 1;
+    ts_advance(r);
+}
+
+// Value of stream r at time t, where t lies in [t_prev, t_next].
+// hold = 1: sample-and-hold (previous value). Otherwise linear interpolation.
+static double ts_value_at(const ts_reader_t *r, double t, int hold)
+{
+    if (t >= r->t) return r->x;
+    if (hold) return r->x_prev;
+
+    double span = r->t - r->t_prev;
+    double w;
+    if (!safe_divide(t - r->t_prev, span, &w)) return r->x;
+    return r->x_prev + w * (r->x - r->x_prev);
+}
+
+// Merge-joins a (t, V) log with a (t, I) log on the union of their timestamps.
+// Each output time takes the stream that owns it directly and resamples the
+// other one. Output stops where the two logs stop overlapping.
+// Aligned samples go to acc and, if out != NULL, to a t,V,I,P CSV file.
+// Returns 1 on success, 0 if either file cannot be opened.
+int power_join_files(const char *vpath, const char *ipath, int hold,
+                     FILE *out, power_acc_t *acc, long *skipped)
+{
+    STATS_SCOPE(STAT_POWER_FILE);
+    ts_reader_t rv, ri;
+
+    if (!ts_open(&rv, vpath)) return 0;
+    if (!ts_open(&ri, ipath)) { fclose(rv.fp); return 0; }
+
+    if (out) fprintf(out, "t,V,I,P\n");
+
+    while (rv.has_next && ri.has_next) {
+        double t, v, i;
+
+        if (rv.t <= ri.t) {
+            t = rv.t;
+            v = rv.x;
+            if (ri.t == t)        { i = ri.x; ts_consume(&ri); }
+            else if (ri.has_prev) i = ts_value_at(&ri, t, hold);
+            else                  { ts_consume(&rv); continue; }  // before first I sample
+            ts_consume(&rv);
+        }
+        else {
+            t = ri.t;
+            i = ri.x;
+            if (rv.has_prev) v = ts_value_at(&rv, t, hold);
+            else             { ts_consume(&ri); continue; }       // before first V sample
+            ts_consume(&ri);
+        }
+
+        power_acc_push(acc, t, v, i);
+        if (out) fprintf(out, "%.9g,%.9g,%.9g,%.9g\n", t, v, i, v * i);
+    }
+
+    *skipped = rv.skipped + ri.skipped;
+    fclose(rv.fp);
+    fclose(ri.fp);
+
+    power_acc_flush(acc);
+    return 1;
+}
+
+// Mean power and RMS values. timed = 1 (samples carry their own, possibly
+// irregular, timestamps): averages over time, P = E / T and
+// Vrms = sqrt(integral V^2 dt / T), so a burst of closely spaced samples does
+// not outweigh the rest. Otherwise, or if the samples span no time: plain
+// per-sample means.
+void power_means(const power_stats_t *s, int timed, double *P, double *Vrms, double *Irms)
+{
+    double T = s->t_last - s->t_first;
+    if (timed && T > 0.0) {
+        *P = ksum_value(&s->energy) / T;
+        *Vrms = sqrt(ksum_value(&s->v2t) / T);
+        *Irms = sqrt(ksum_value(&s->i2t) / T);
+        return;
+    }
+    double n = (double)s->n;
+    *P = ksum_value(&s->p) / n;
+    *Vrms = sqrt(ksum_value(&s->v2) / n);
+    *Irms = sqrt(ksum_value(&s->i2) / n);
+}
+
+// AC quantities from a sampled waveform: P = mean(v*i), S = Vrms * Irms,
+// Q = sqrt(S^2 - P^2) (non-active power, includes harmonic distortion), PF = P / S.
+void ac_from_stats(const power_stats_t *s, int timed, double *P, double *S, double *Q, double *pf)
+{
+    double Vrms, Irms;
+    power_means(s, timed, P, &Vrms, &Irms);
+    *S = Vrms * Irms;
+
+    double q2 = (*S) * (*S) - (*P) * (*P);
+    *Q = q2 > 0.0 ? sqrt(q2) : 0.0;
+    if (!safe_divide(*P, *S, pf)) *pf = 0.0;
+}
+
+// Phasor form, one row per element: P = V I cos(phi), Q = V I sin(phi),
+// S = V I, PF = cos(phi). phi is in degrees, positive when current lags voltage.
+void ac_phasor_batch(const double *V, const double *I, const double *phi_deg, size_t n,
+                     double *P, double *Q, double *S, double *pf)
+{
+    for (size_t k = 0; k < n; ++k) {
+        double phi = phi_deg[k] * (PI / 180.0);
+        double c = cos(phi), sn = sin(phi);
+        S[k] = V[k] * I[k];
+        P[k] = S[k] * c;
+        Q[k] = S[k] * sn;
+        pf[k] = c;
+    }
+}
+
+// Streams a Vrms, Irms, phase_deg file through ac_phasor_batch() a chunk at a
+// time and writes one result row per input row. Lines that do not parse are
+// counted in *skipped, rows with Vrms < 0 or Irms < 0 (rejected by the single
+// phasor calculation too) in *invalid; neither gets an output row.
+// Returns the number of rows written, or -1 if a file cannot be opened.
+long long ac_phasor_file(const char *in_path, const char *out_path, long *skipped, long *invalid)
+{
+    STATS_SCOPE(STAT_PHASOR_FILE);
+    static double V[POWER_CHUNK], I[POWER_CHUNK], phi[POWER_CHUNK];
+    static double P[POWER_CHUNK], Q[POWER_CHUNK], S[POWER_CHUNK], pf[POWER_CHUNK];
+
+    FILE *in = fopen(in_path, "r");
+    if (!in) return -1;
+    FILE *out = fopen(out_path, "w");
+    if (!out) { fclose(in); return -1; }
+
+    fprintf(out, "Vrms,Irms,phi_deg,P,Q,S,PF\n");
+
+    char line[256];
+    double f[3];
+    size_t n = 0;
+    long long rows = 0;
+    int eof = 0;
+
+    *skipped = 0;
+    *invalid = 0;
+    while (!eof) {
+        if (fgets(line, sizeof line, in)) {
+            if (parse_fields(line, f, 3) != 3) { (*skipped)++; continue; }
+            if (f[0] < 0.0 || f[1] < 0.0) { (*invalid)++; continue; }
+            V[n] = f[0];
+            I[n] = f[1];
+            phi[n] = f[2];
+            if (++n < POWER_CHUNK) continue;
+        }
+        else {
+            eof = 1;
+        }
+
+        ac_phasor_batch(V, I, phi, n, P, Q, S, pf);
+        for (size_t k = 0; k < n; ++k)
+            fprintf(out, "%.9g,%.9g,%.9g,%.9g,%.9g,%.9g,%.6f\n",
+                    V[k], I[k], phi[k], P[k], Q[k], S[k], pf[k]);
+        rows += (long long)n;
+        n = 0;
+    }
+
+    fclose(in);
+    fclose(out);
+    return rows;
+}
+
+// Power statistics of t, v, i samples, reduced POWER_CHUNK at a time as
+// power_read_file() does. Returns the time-weighted mean power.
+double kernel_power(const double *t, const double *v, const double *i, size_t n)
+{
+    power_stats_t total, part;
+    power_stats_init(&total);
+    for (size_t k = 0; k < n; k += POWER_CHUNK) {
+        power_chunk(t + k, v + k, i + k, n - k < POWER_CHUNK ? n - k : POWER_CHUNK, &part);
+        power_stats_merge(&total, &part);
+    }
+    double P, Vrms, Irms;
+    if (total.n == 0) return NAN;
+    power_means(&total, 1, &P, &Vrms, &Irms);
+    return P;
+}
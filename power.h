@@ -0,0 +1,105 @@
+// Power sample analytics for the EEE Helper CLI calculator (menu 5).
+// Sample files of t,V,I (or V,I at a fixed interval) are reduced to mean
+// power, RMS values, peaks and trapezoidal energy; separate V and I logs are
+// merge-joined on their timestamps first; AC quantities come from the same
+// totals or from phasors. Files are streamed, so memory use does not depend
+// on their size. Columnar files ("EEEP": a header, then each column as
+// native doubles) written by --power-pack are mapped and reduced in place.
+
+#ifndef POWER_H
+#define POWER_H
+
+#include <stdio.h>
+#include <math.h>
+
+// Samples reduced at once by the chunk kernels (here and in threephase.c).
+#define POWER_CHUNK 4096
+
+// Neumaier compensated sum: c holds the rounding error lost from s.
+typedef struct { double s, c; } ksum_t;
+
+static inline void ksum_add(ksum_t *k, double x)
+{
+    double t = k->s + x;
+    if (fabs(k->s) >= fabs(x)) k->c += (k->s - t) + x;
+    else                       k->c += (x - t) + k->s;
+    k->s = t;
+}
+
+static inline double ksum_value(const ksum_t *k)
+{
+    return k->s + k->c;
+}
+
+// Partial (or total) result for a run of consecutive samples.
+typedef struct {
+    long long n;
+    ksum_t p, v2, i2;                  // sum P, sum V^2, sum I^2 (per sample)
+    ksum_t energy, v2t, i2t;           // trapezoid integrals of P, V^2, I^2 over t
+    double v_peak, i_peak, p_max, p_min;
+    double t_first, v_first, i_first;  // first and last sample, so the integrals
+    double t_last, v_last, i_last;     // can be bridged when two runs are merged
+} power_stats_t;
+
+// Chunk buffer: samples are pushed one at a time and reduced POWER_CHUNK at once.
+typedef struct {
+    double t[POWER_CHUNK], v[POWER_CHUNK], i[POWER_CHUNK];
+    size_t n;
+    power_stats_t total;
+} power_acc_t;
+
+// Returns an empty accumulator (free() it), or NULL if memory runs out.
+power_acc_t *power_acc_new(void);
+
+// Reads a sample file into *total.
+// has_time = 1: columns are t,V,I. Otherwise columns are V,I spaced dt apart.
+// Lines that do not parse (e.g. a header) are skipped and counted in *skipped.
+// Returns 1 on success, 0 if the file cannot be opened or memory runs out.
+int power_read_file(const char *path, int has_time, double dt, power_stats_t *total, long *skipped);
+
+// Reads a columnar file written by power_pack_file() into *total; *timed is
+// 1 if it has a t column, 0 if its samples are spaced a fixed dt apart.
+// Returns 1 on success, 0 if the file is columnar but damaged (wrong version
+// or size), -1 if it cannot be opened or is not columnar (e.g. a CSV).
+int power_read_columnar(const char *path, power_stats_t *total, int *timed);
+
+// Packs a CSV of t,V,I rows (dt <= 0) or V,I rows spaced dt apart into a
+// columnar file. Lines that do not parse are counted in *skipped.
+// Returns the number of samples written, or -1 if a file cannot be opened.
+long long power_pack_file(const char *in_path, double dt, const char *out_path, long *skipped);
+
+// "main.out --power-pack in.csv out.eeep [dt]": power_pack_file() from the
+// command line. Returns the process exit status.
+int power_pack_cli(int argc, char **argv);
+
+// Merge-joins a (t, V) log with a (t, I) log on the union of their timestamps,
+// resampling each stream linearly (hold = 0) or by sample-and-hold (hold = 1).
+// Aligned samples go to acc and, if out != NULL, to a t,V,I,P CSV file.
+// Returns 1 on success, 0 if either file cannot be opened.
+int power_join_files(const char *vpath, const char *ipath, int hold,
+                     FILE *out, power_acc_t *acc, long *skipped);
+
+// Mean power and RMS values. timed = 1 averages over time (for samples with
+// their own, possibly irregular, timestamps); otherwise per sample.
+void power_means(const power_stats_t *s, int timed, double *P, double *Vrms, double *Irms);
+
+// AC quantities of a sampled waveform: P = mean(v*i), S = Vrms * Irms,
+// Q = sqrt(S^2 - P^2) (non-active power), PF = P / S. timed: as above.
+void ac_from_stats(const power_stats_t *s, int timed, double *P, double *S, double *Q, double *pf);
+
+// Phasor form, one row per element: P = V I cos(phi), Q = V I sin(phi),
+// S = V I, PF = cos(phi). phi is in degrees, positive when current lags voltage.
+void ac_phasor_batch(const double *V, const double *I, const double *phi_deg, size_t n,
+                     double *P, double *Q, double *S, double *pf);
+
+// Streams a Vrms, Irms, phase_deg file through ac_phasor_batch() into a CSV.
+// Lines that do not parse are counted in *skipped, rows with Vrms < 0 or
+// Irms < 0 in *invalid. Returns the number of rows written, or -1 if a file
+// cannot be opened.
+long long ac_phasor_file(const char *in_path, const char *out_path, long *skipped, long *invalid);
+
+// Power statistics of t, v, i samples in memory (timed by bench.out), reduced
+// as power_read_file() does. Returns the time-weighted mean power, NAN if n = 0.
+double kernel_power(const double *t, const double *v, const double *i, size_t n);
+
+#endif
@@ -0,0 +1,223 @@
+// Workspace snapshots.
+// Design notes:
+// A snapshot is a header, the ring of recent results, the worksheet image
+// (ws_image_write) and, last, every defined cell as "name = text". Loading
+// maps the whole file copy-on-write at the address the image was laid out
+// for (SESSION_BASE, with MAP_FIXED_NOREPLACE) and points the session at it:
+// the worksheet and the ring are used where they lie, and pages are only
+// read in as they are touched. If that address is taken the file is mapped
+// anywhere and ws_image_open moves the pointers, one pass over the cells.
+// The image holds raw structs and compiled formulas, so it is only trusted
+// from a build of the same sources (the header carries the checksum the
+// Makefile passes as EEE_SOURCE_HASH, as disk cache entries do). Other
+// builds, and builds without the checksum, re-enter the cells from their
+// text instead. SESSION_VERSION covers the header and the ring, which every
+// build reads.
+// Saving writes a temporary file and renames it over the old one, so a
+// mapping of the old snapshot (the live session, maybe) stays valid.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "session.h"
+#include "stats.h"
+
+#ifndef MAP_FIXED_NOREPLACE
+#define MAP_FIXED_NOREPLACE 0           // then the address is only a hint
+#endif
+
+#define SESSION_VERSION 1
+#define SESSION_BASE    0x5eee00000000ull
+
+#ifdef EEE_SOURCE_HASH
+static const char SESSION_BUILD[32] = EEE_SOURCE_HASH;
+#else
+static const char SESSION_BUILD[32] = "";    // never trusts an image
+#endif
+
+typedef struct {
+    char magic[4];                      // "EEEW"
+    uint32_t version;
+    char build[32];
+    uint64_t base;                      // address the image was laid out for
+    uint64_t size;                      // of the whole file
+    uint64_t ring_off;
+    uint64_t sheet_off, sheet_len;
+    uint64_t text_off, text_len;
+} session_hdr_t;
+
+typedef struct {
+    uint32_t n, head;                   // head = next slot to write
+    session_result_t r[SESSION_RECENT];
+} session_ring_t;
+
+static worksheet_t *sheet;
+static session_ring_t own_ring, *ring = &own_ring;
+static void *map;                       // snapshot in use, if any
+static size_t maplen;
+
+worksheet_t *session_worksheet(void)
+{
+    if (!sheet) sheet = ws_new();
+    return sheet;
+}
+
+void session_note(const formula_t *fm, int var, const double *v)
+{
+    session_result_t *r = &ring->r[ring->head];
+    memset(r, 0, sizeof *r);
+    snprintf(r->formula, sizeof r->formula, "%s", fm->name);
+    r->var = (uint8_t)var;
+    r->nvars = (uint8_t)fm->nvars;
+    r->time = (int64_t)time(NULL);
+    memcpy(r->v, v, sizeof(double) * (size_t)fm->nvars);
+    ring->head = (ring->head + 1) % SESSION_RECENT;
+    if (ring->n < SESSION_RECENT) ring->n++;
+}
+
+const session_result_t *session_recent(size_t k)
+{
+    if (k >= ring->n) return NULL;
+    return &ring->r[(ring->head + SESSION_RECENT - 1 - k) % SESSION_RECENT];
+}
+
+int session_save(const char *path, char *err, size_t errlen)
+{
+    STATS_SCOPE(STAT_SESSION_SAVE);
+    worksheet_t *ws = session_worksheet();
+    if (!ws) { snprintf(err, errlen, "out of memory"); return -1; }
+
+    char tmp[600];
+    snprintf(tmp, sizeof tmp, "%.500s.tmp-%ld", path, (long)getpid());
+    FILE *fp = fopen(tmp, "wb");
+    if (!fp) { snprintf(err, errlen, "cannot create '%s': %s", tmp, strerror(errno)); return -1; }
+
+    session_hdr_t h;
+    memset(&h, 0, sizeof h);
+    memcpy(h.magic, "EEEW", 4);
+    h.version = SESSION_VERSION;
+    memcpy(h.build, SESSION_BUILD, sizeof h.build);
+    h.base = SESSION_BASE;
+    h.ring_off = (sizeof h + 7) & ~(uint64_t)7;
+    h.sheet_off = h.ring_off + sizeof *ring;
+
+    static const char pad[8];
+    int ok = fwrite(&h, sizeof h, 1, fp) == 1 &&
+             fwrite(pad, 1, h.ring_off - sizeof h, fp) == h.ring_off - sizeof h &&
+             fwrite(ring, sizeof *ring, 1, fp) == 1;
+    h.sheet_len = ok ? ws_image_write(ws, fp, h.base + h.sheet_off) : 0;
+    ok = h.sheet_len > 0;
+
+    h.text_off = h.sheet_off + h.sheet_len;
+    for (int c = 0; c < ws_count(ws) && ok; ++c) {
+        if (ws_kind(ws, c) == WS_UNDEFINED) continue;
+        int len = fprintf(fp, "%s = %s", ws_name(ws, c), ws_text(ws, c));
+        ok = len > 0 && fputc('\0', fp) != EOF;
+        h.text_len += (uint64_t)len + 1;
+    }
+    h.size = h.text_off + h.text_len;
+    ok = ok && fseek(fp, 0, SEEK_SET) == 0 && fwrite(&h, sizeof h, 1, fp) == 1;
+    if (fclose(fp) != 0) ok = 0;
+    if (!ok || rename(tmp, path) != 0) {
+        snprintf(err, errlen, "cannot write '%s'", path);
+        unlink(tmp);
+        return -1;
+    }
+    return 0;
+}
+
+int session_load(const char *path, char *err, size_t errlen)
+{
+    STATS_SCOPE(STAT_SESSION_LOAD);
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) { snprintf(err, errlen, "cannot open '%s': %s", path, strerror(errno)); return -1; }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(session_hdr_t)) {
+        close(fd);
+        snprintf(err, errlen, "'%s' is not a workspace snapshot", path);
+        return -1;
+    }
+
+    size_t len = (size_t)st.st_size;
+    char *m = mmap((void *)(uintptr_t)SESSION_BASE, len, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_FIXED_NOREPLACE, fd, 0);
+    if (m == MAP_FAILED) m = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (m == MAP_FAILED) { snprintf(err, errlen, "cannot map '%s': %s", path, strerror(errno)); return -1; }
+
+    const session_hdr_t *h = (const session_hdr_t *)m;
+    session_ring_t *r = (session_ring_t *)(m + h->ring_off);
+    if (memcmp(h->magic, "EEEW", 4) != 0 || h->version != SESSION_VERSION || h->size != len ||
+        h->ring_off < sizeof *h || h->ring_off % 8 || h->sheet_off < h->ring_off + sizeof *ring ||
+        h->sheet_off % 8 || h->text_off != h->sheet_off + h->sheet_len || h->text_off + h->text_len != len ||
+        r->n > SESSION_RECENT || r->head >= SESSION_RECENT) {
+        munmap(m, len);
+        snprintf(err, errlen, "'%s' is not a workspace snapshot (or is damaged)", path);
+        return -1;
+    }
+
+    worksheet_t *ws;
+    int in_place = SESSION_BUILD[0] && memcmp(h->build, SESSION_BUILD, sizeof h->build) == 0;
+    if (in_place) {
+        ws = ws_image_open(m + h->sheet_off, (size_t)h->sheet_len, err, errlen);
+    }
+    else {
+        // Another build: same cells, compiled again.
+        ws = ws_new();
+        if (!ws) snprintf(err, errlen, "out of memory");
+        for (const char *p = m + h->text_off, *end = m + len; ws && p < end; p += strlen(p) + 1) {
+            if (!memchr(p, '\0', (size_t)(end - p)) || ws_assign(ws, p, err, errlen) < 0) {
+                ws_free(ws);
+                ws = NULL;
+            }
+        }
+    }
+    if (!ws) { munmap(m, len); return -1; }
+
+    ws_free(sheet);
+    if (map) munmap(map, maplen);
+    sheet = ws;
+    ring = r;
+    map = m;
+    maplen = len;
+    if (!in_place) {
+        own_ring = *r;                  // the text was copied: nothing points into m
+        ring = &own_ring;
+        munmap(map, maplen);
+        map = NULL;
+    }
+    return 0;
+}
+
+// ------------------------------ EEE_WORKSPACE ------------------------------
+
+void session_start(void)
+{
+    const char *path = getenv("EEE_WORKSPACE");
+    if (!path || !*path || access(path, F_OK) != 0) return;
+
+    struct timespec t0, t1;
+    char err[200];
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    if (session_load(path, err, sizeof err) != 0) { printf("Error: %s.\n", err); return; }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    printf("Workspace %s: %d cell(s), %u recent result(s), loaded in %.2f ms\n", path,
+           ws_count(sheet), (unsigned)ring->n,
+           (double)(t1.tv_sec - t0.tv_sec) * 1e3 + (t1.tv_nsec - t0.tv_nsec) * 1e-6);
+}
+
+void session_finish(void)
+{
+    const char *path = getenv("EEE_WORKSPACE");
+    if (!path || !*path) return;
+
+    char err[200];
+    if (session_save(path, err, sizeof err) != 0) printf("Error: %s.\n", err);
+    else printf("Workspace saved to %s\n", path);
+}
@@ -0,0 +1,49 @@
+// Workspace snapshots for the EEE Helper CLI calculator.
+// The session is what the menus keep between calculations: the worksheet of
+// menu 11 (its value cells are the session's variables) and the latest
+// formula solver results. session_save writes all of it to one binary file;
+// session_load maps that file and uses it as it is, so even a worksheet of
+// 10^5 cells is back in a few milliseconds.
+//
+// With EEE_WORKSPACE=path set, the menu program loads path at start-up (if
+// it exists) and saves it again on Quit. Menu 11 also has "save FILE" and
+// "open FILE". A snapshot from a different build of the program still
+// loads, by re-entering the worksheet's cells from their text (slower).
+
+#ifndef SESSION_H
+#define SESSION_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "formulas.h"
+#include "worksheet.h"
+
+#define SESSION_RECENT 32               // results kept
+
+typedef struct {
+    char formula[16];                   // registry name, e.g. "rc.charge"
+    uint8_t var, nvars;
+    uint8_t reserved[6];
+    int64_t time;                       // seconds since the Unix epoch
+    double v[FORMULA_MAX_VARS];
+} session_result_t;
+
+// The session worksheet, created on first use (NULL if out of memory).
+worksheet_t *session_worksheet(void);
+
+// Records a solver result (formula_log does this for every solve).
+void session_note(const formula_t *fm, int var, const double *v);
+
+// The k-th newest result (k = 0 is the latest), or NULL.
+const session_result_t *session_recent(size_t k);
+
+// Both return 0, or -1 with a message in err. A failed load leaves the
+// session as it was.
+int session_save(const char *path, char *err, size_t errlen);
+int session_load(const char *path, char *err, size_t errlen);
+
+// EEE_WORKSPACE: load at start-up, save on Quit. Both print what they did.
+void session_start(void);
+void session_finish(void);
+
+#endif
@@ -0,0 +1,248 @@
+// Shared-memory ring transport.
+// Design notes:
+// Every slot has a 32-bit sequence word that says who owns it for ring
+// position pos:  pos = free for a producer, pos + 1 = request ready,
+// pos + 2 = response ready, then pos + SHM_SLOTS = free again on the next
+// lap. Producers claim positions with one atomic add on `tail`; the server
+// consumes them in order. Only sequence words and two flags are shared
+// between writers, and each slot sits on its own cache lines.
+// Sleeping is opt-in: a side that stops spinning sets a flag before
+// futex_wait, and the other side only pays for futex_wake when it sees it.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <signal.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#include "shm.h"
+#include "funcs.h"
+#include "memo.h"
+#include "stats.h"
+
+#define SHM_MAGIC   0x4C4D4845u        // "EHML"
+#define SHM_VERSION 1
+#define SHM_SLOTS   256                 // power of two
+
+typedef struct {
+    _Atomic uint32_t seq;
+    _Atomic uint32_t waiting;           // client is asleep on seq
+    eee_msg_t msg;
+} __attribute__((aligned(64))) shm_slot_t;
+
+typedef struct {
+    _Atomic uint32_t magic;             // set last, once the ring is ready
+    uint32_t version, nslots;
+    _Atomic uint32_t tail __attribute__((aligned(64)));     // next position to claim
+    _Atomic uint32_t sleeping __attribute__((aligned(64))); // server is asleep on wake
+    _Atomic uint32_t wake;
+    shm_slot_t slots[SHM_SLOTS];
+} shm_ring_t;
+
+struct shm_client {
+    shm_ring_t *ring;
+    int spin;
+};
+
+static volatile sig_atomic_t shm_stop;
+
+static void shm_signal(int sig)
+{
+    (void)sig;
+    shm_stop = 1;
+}
+
+static void futex_wait(_Atomic uint32_t *addr, uint32_t val, const struct timespec *timeout)
+{
+    syscall(SYS_futex, addr, FUTEX_WAIT, val, timeout, NULL, 0);
+}
+
+static void futex_wake(_Atomic uint32_t *addr)
+{
+    syscall(SYS_futex, addr, FUTEX_WAKE, 1, NULL, NULL, 0);
+}
+
+static inline void cpu_relax(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#endif
+}
+
+// Spinning only pays when the other side runs on another core.
+static int default_spin(void)
+{
+    return sysconf(_SC_NPROCESSORS_ONLN) > 1 ? 20000 : 0;
+}
+
+// Spins until *addr != val or the budget runs out. Returns the last value.
+static uint32_t spin_while(_Atomic uint32_t *addr, uint32_t val, int spin)
+{
+    uint32_t v = atomic_load_explicit(addr, memory_order_acquire);
+    for (int k = 0; v == val && k < spin; ++k) {
+        cpu_relax();
+        v = atomic_load_explicit(addr, memory_order_acquire);
+    }
+    return v;
+}
+
+int shm_serve(const char *name, int spin)
+{
+    char path[128];
+    snprintf(path, sizeof path, "/%s", name);
+    if (spin < 0) spin = default_spin();
+
+    // Never reuse a segment: it may be the ring of a server still running.
+    int fd = shm_open(path, O_CREAT | O_EXCL | O_RDWR, 0600);
+    if (fd < 0 && errno == EEXIST) {
+        printf("Error: shared memory '%s' is in use (if no server is running, remove /dev/shm%s).\n", path, path);
+        return -1;
+    }
+    if (fd < 0 || ftruncate(fd, sizeof(shm_ring_t)) != 0) {
+        printf("Error: cannot create shared memory '%s': %s.\n", path, strerror(errno));
+        if (fd >= 0) { close(fd); shm_unlink(path); }
+        return -1;
+    }
+    shm_ring_t *ring = mmap(NULL, sizeof *ring, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (ring == MAP_FAILED) { printf("Error: mmap: %s.\n", strerror(errno)); shm_unlink(path); return -1; }
+
+    ring->version = SHM_VERSION;
+    ring->nslots = SHM_SLOTS;
+    for (uint32_t k = 0; k < SHM_SLOTS; ++k) atomic_store(&ring->slots[k].seq, k);
+    atomic_store_explicit(&ring->magic, SHM_MAGIC, memory_order_release);
+
+    struct sigaction sa;
+    memset(&sa, 0, sizeof sa);
+    sa.sa_handler = shm_signal;
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+    shm_stop = 0;
+
+    printf("Serving on shared memory %s, spin %d (Ctrl+C to stop)\n", path, spin);
+    fflush(stdout);
+
+    const struct timespec nap = { 0, 100 * 1000 * 1000 };   // recheck shm_stop
+    unsigned long long requests = 0;
+    uint32_t pos = 0;
+
+    while (!shm_stop) {
+        shm_slot_t *s = &ring->slots[pos & (SHM_SLOTS - 1)];
+
+        if (spin_while(&s->seq, pos, spin) != pos + 1) {
+            // Nothing to do: sleep until a client bumps `wake`.
+            atomic_store(&ring->sleeping, 1);
+            uint32_t w = atomic_load(&ring->wake);
+            if (atomic_load(&s->seq) != pos + 1) {
+                STATS_SCOPE(STAT_QUEUE_WAIT);
+                futex_wait(&ring->wake, w, &nap);
+            }
+            atomic_store(&ring->sleeping, 0);
+            continue;
+        }
+
+        daemon_handle(&s->msg);
+        atomic_store(&s->seq, pos + 2);
+        if (atomic_load(&s->waiting)) futex_wake(&s->seq);
+        pos++;
+        requests++;
+    }
+
+    munmap(ring, sizeof *ring);
+    shm_unlink(path);
+    printf("\nStopped: %llu request(s)\n", requests);
+    memo_print();
+
+    char line[256];
+    snprintf(line, sizeof line, "Shared memory server: %.100s, requests=%llu", path, requests);
+    log_line(line);
+    return 0;
+}
+
+shm_client_t *shm_connect(const char *name, int spin, char *err, size_t errlen)
+{
+    char path[128];
+    snprintf(path, sizeof path, "/%s", name);
+
+    int fd = shm_open(path, O_RDWR, 0);
+    if (fd < 0) { snprintf(err, errlen, "cannot open shared memory '%s': %s", path, strerror(errno)); return NULL; }
+    struct stat st;
+    shm_ring_t *ring = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && (size_t)st.st_size >= sizeof(shm_ring_t))
+        ring = mmap(NULL, sizeof *ring, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (ring == MAP_FAILED) { snprintf(err, errlen, "'%s' is not a calculator segment", path); return NULL; }
+
+    if (atomic_load_explicit(&ring->magic, memory_order_acquire) != SHM_MAGIC ||
+        ring->version != SHM_VERSION || ring->nslots != SHM_SLOTS) {
+        snprintf(err, errlen, "'%s' is not a calculator segment", path);
+        munmap(ring, sizeof *ring);
+        return NULL;
+    }
+
+    shm_client_t *c = malloc(sizeof *c);
+    if (!c) { snprintf(err, errlen, "out of memory"); munmap(ring, sizeof *ring); return NULL; }
+    c->ring = ring;
+    c->spin = spin < 0 ? default_spin() : spin;
+    return c;
+}
+
+void shm_disconnect(shm_client_t *c)
+{
+    if (!c) return;
+    munmap(c->ring, sizeof *c->ring);
+    free(c);
+}
+
+void shm_call(shm_client_t *c, eee_msg_t *msg)
+{
+    shm_ring_t *ring = c->ring;
+    uint32_t pos = atomic_fetch_add(&ring->tail, 1);
+    shm_slot_t *s = &ring->slots[pos & (SHM_SLOTS - 1)];
+
+    // The slot is free unless the ring is full of other clients' requests.
+    while (atomic_load_explicit(&s->seq, memory_order_acquire) != pos) sched_yield();
+
+    memcpy(&s->msg, msg, sizeof *msg);
+    atomic_store(&s->seq, pos + 1);
+    if (atomic_load(&ring->sleeping)) {
+        atomic_fetch_add(&ring->wake, 1);
+        futex_wake(&ring->wake);
+    }
+
+    if (spin_while(&s->seq, pos + 1, c->spin) == pos + 1) {
+        atomic_store(&s->waiting, 1);
+        while (atomic_load(&s->seq) == pos + 1) futex_wait(&s->seq, pos + 1, NULL);
+        atomic_store(&s->waiting, 0);
+    }
+
+    memcpy(msg, &s->msg, sizeof *msg);
+    atomic_store_explicit(&s->seq, pos + SHM_SLOTS, memory_order_release);
+}
+
+int shm_cli(int argc, char **argv)
+{
+    if (argc < 3 || argc > 4) {
+        printf("Usage: %s --shm NAME [spin]\n", argv[0]);
+        return 1;
+    }
+    long spin = -1;
+    if (argc == 4) {
+        char *end = NULL;
+        spin = strtol(argv[3], &end, 10);
+        if (end == argv[3] || *end != '\0' || spin < 0 || spin > INT_MAX) {
+            printf("Error: spin must be a whole number from 0 to %d, not '%s'.\n", INT_MAX, argv[3]);
+            return 1;
+        }
+    }
+    return shm_serve(argv[2], (int)spin) == 0 ? 0 : 1;
+}
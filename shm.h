@@ -0,0 +1,37 @@
+// Shared-memory calculation transport for the EEE Helper CLI calculator.
+// "main.out --shm NAME [spin]" creates a POSIX shared-memory segment
+// (/dev/shm/NAME) and answers the same requests as the socket daemon
+// (daemon.h) without any system call on the fast path.
+//
+// The segment holds a ring of slots that any number of client processes
+// share (multi-producer, single consumer). A client claims the next slot,
+// writes an eee_msg_t request into it and publishes it; the server answers
+// in place and the client copies the response out and frees the slot.
+// Both sides busy-poll for `spin` iterations before sleeping on a futex,
+// so with spare cores a round trip never enters the kernel.
+
+#ifndef SHM_H
+#define SHM_H
+
+#include <stddef.h>
+#include "daemon.h"
+
+typedef struct shm_client shm_client_t;
+
+// Serves on segment `name` until SIGINT or SIGTERM; spin < 0 picks a
+// default for the number of online CPUs. Returns 0, or -1 on setup errors,
+// including a segment of that name that already exists.
+int shm_serve(const char *name, int spin);
+
+// Attaches to a running server. Returns NULL and writes a message to err
+// if the segment does not exist (yet) or is not a calculator segment.
+shm_client_t *shm_connect(const char *name, int spin, char *err, size_t errlen);
+void          shm_disconnect(shm_client_t *c);
+
+// One round trip: msg is replaced by the response.
+void shm_call(shm_client_t *c, eee_msg_t *msg);
+
+// Command line: "main.out --shm NAME [spin]".
+int shm_cli(int argc, char **argv);
+
+#endif
@@ -0,0 +1,250 @@
+// Call counts and latency histograms.
+// Design notes:
+// Each thread records into its own block, allocated on its first call and
+// pushed on a global list with a compare-and-swap; nothing is shared on
+// the recording path, so there are no locks and no contended cache lines.
+// The owner updates its counters with relaxed atomic loads and stores
+// (plain moves on x86-64, no lock prefix) and readers merge every block with
+// relaxed loads, so a report taken while other threads run is at worst a
+// few calls behind. Blocks are never freed: a thread's counts outlive it.
+// The histogram is log-linear in the manner of HdrHistogram: the top bit of
+// the duration picks a power of two and the next four bits one of 16 equal
+// sub-buckets, so one shift and one mask find the bucket. Everything is kept
+// in ticks; the tick rate is measured once, when a report needs it.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "stats.h"
+#include "trace.h"
+
+static uint64_t mono_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+// Start of the measurement of the tick rate (set by stats_init).
+static uint64_t base_ticks, base_ns;
+
+double stats_ticks_per_ns(void)
+{
+#if defined(__x86_64__)
+    static double rate;
+    if (rate > 0.0) return rate;
+    if (base_ns == 0 || mono_ns() - base_ns < 2000000) {
+        if (base_ns == 0) {
+            base_ticks = stats_ticks();
+            base_ns = mono_ns();
+        }
+        while (mono_ns() - base_ns < 2000000) { }
+    }
+    uint64_t t = stats_ticks(), ns = mono_ns();
+    rate = (double)(t - base_ticks) / (double)(ns - base_ns);
+    return rate;
+#else
+    return 1.0;
+#endif
+}
+
+// Lower bound of bucket b, in ticks.
+static uint64_t bucket_low(int b)
+{
+    if (b < 16) return (uint64_t)b;
+    int e = (b >> 4) + 3;
+    return (uint64_t)(16 | (b & 15)) << (e - 4);
+}
+
+static uint64_t bucket_high(int b)
+{
+    return b < 16 ? (uint64_t)b + 1 : bucket_low(b) + ((uint64_t)1 << ((b >> 4) - 1));
+}
+
+uint64_t stats_quantile(const stats_probe_t *p, double q)
+{
+    uint64_t target = (uint64_t)(q * (double)p->calls + 0.999999), seen = 0;
+    if (target == 0) target = 1;
+    for (int b = 0; b < STATS_BUCKETS; ++b) {
+        seen += p->hist[b];
+        if (seen >= target) {
+            uint64_t high = bucket_high(b) - 1;
+            return high < p->max ? high : p->max;
+        }
+    }
+    return p->max;
+}
+
+#ifndef EEE_NO_STATS
+
+typedef struct stats_block {
+    struct stats_block *next;
+    stats_probe_t p[STAT_COUNT];
+} stats_block_t;
+
+static const char *const STATS_NAMES[STAT_COUNT] = {
+#define STATS_NAME(id, name, cat) name,
+    STATS_PROBES(STATS_NAME)
+#undef STATS_NAME
+};
+
+static stats_block_t *stats_all;
+static __thread stats_block_t *stats_mine;
+
+static inline void bump(uint64_t *x, uint64_t by)
+{
+    __atomic_store_n(x, __atomic_load_n(x, __ATOMIC_RELAXED) + by, __ATOMIC_RELAXED);
+}
+
+void stats_record(int probe, uint64_t t0, uint64_t t1)
+{
+    uint64_t ticks = t1 - t0;
+    if (trace_enabled) trace_add(probe, t0, t1);
+
+    stats_block_t *b = stats_mine;
+    if (!b) {
+        if (!(b = calloc(1, sizeof *b))) return;
+        b->next = __atomic_load_n(&stats_all, __ATOMIC_RELAXED);
+        while (!__atomic_compare_exchange_n(&stats_all, &b->next, b, 1, __ATOMIC_RELEASE, __ATOMIC_RELAXED)) { }
+        stats_mine = b;
+    }
+
+    int bucket;
+    if (ticks < 16) bucket = (int)ticks;
+    else {
+        uint64_t v = ticks < ((uint64_t)1 << 41) ? ticks : ((uint64_t)1 << 41) - 1;
+        int e = 63 - __builtin_clzll(v);
+        bucket = ((e - 3) << 4) | (int)((v >> (e - 4)) & 15);
+    }
+
+    stats_probe_t *p = &b->p[probe];
+    bump(&p->calls, 1);
+    bump(&p->total, ticks);
+    bump(&p->hist[bucket], 1);
+    if (ticks > __atomic_load_n(&p->max, __ATOMIC_RELAXED)) __atomic_store_n(&p->max, ticks, __ATOMIC_RELAXED);
+}
+
+void stats_read(stats_probe_t *out)
+{
+    memset(out, 0, STAT_COUNT * sizeof *out);
+    for (stats_block_t *b = __atomic_load_n(&stats_all, __ATOMIC_ACQUIRE); b; b = b->next) {
+        for (int k = 0; k < STAT_COUNT; ++k) {
+            const stats_probe_t *p = &b->p[k];
+            if (!__atomic_load_n(&p->calls, __ATOMIC_RELAXED)) continue;
+            out[k].calls += __atomic_load_n(&p->calls, __ATOMIC_RELAXED);
+            out[k].total += __atomic_load_n(&p->total, __ATOMIC_RELAXED);
+            uint64_t mx = __atomic_load_n(&p->max, __ATOMIC_RELAXED);
+            if (mx > out[k].max) out[k].max = mx;
+            for (int h = 0; h < STATS_BUCKETS; ++h) out[k].hist[h] += __atomic_load_n(&p->hist[h], __ATOMIC_RELAXED);
+        }
+    }
+}
+
+void stats_print(void)
+{
+    stats_probe_t *all = malloc(STAT_COUNT * sizeof *all);
+    if (!all) { printf("Error: out of memory.\n"); return; }
+    stats_read(all);
+    double us = 1e-3 / stats_ticks_per_ns();
+
+    printf("\n--- Stats ---\n");
+    printf("%-20s %10s %12s %10s %10s %10s %10s\n", "path", "calls", "total ms", "mean us", "p50 us", "p99 us", "max us");
+    int any = 0;
+    for (int k = 0; k < STAT_COUNT; ++k) {
+        const stats_probe_t *p = &all[k];
+        if (p->calls == 0) continue;
+        any = 1;
+        printf("%-20s %10llu %12.3f %10.3f %10.3f %10.3f %10.3f\n", STATS_NAMES[k],
+               (unsigned long long)p->calls, p->total * us * 1e-3, p->total * us / (double)p->calls,
+               stats_quantile(p, 0.50) * us, stats_quantile(p, 0.99) * us, p->max * us);
+    }
+    if (!any) printf("(nothing measured yet)\n");
+    free(all);
+}
+
+int stats_write_metrics(const char *path)
+{
+    stats_probe_t *all = malloc(STAT_COUNT * sizeof *all);
+    if (!all) return -1;
+    stats_read(all);
+    double rate = stats_ticks_per_ns(), sec = 1e-9 / rate;
+
+    // Written aside and renamed, so a collector never reads half a file.
+    char tmp[600];
+    snprintf(tmp, sizeof tmp, "%.500s.tmp-%ld", path, (long)getpid());
+    FILE *fp = fopen(tmp, "w");
+    if (!fp) { free(all); return -1; }
+
+    fprintf(fp, "# HELP eee_latency_seconds Time spent per call, by instrumented path.\n");
+    fprintf(fp, "# TYPE eee_latency_seconds histogram\n");
+    for (int k = 0; k < STAT_COUNT; ++k) {
+        const stats_probe_t *p = &all[k];
+        if (p->calls == 0) continue;
+        // Powers of two from 64 ns to 2^34 ns (17 s). A bucket that straddles
+        // a bound counts below it only if it ends there (off by at most 6%).
+        uint64_t cum = 0;
+        int b = 0;
+        for (int e = 6; e <= 34; ++e) {
+            uint64_t le = (uint64_t)1 << e;
+            while (b < STATS_BUCKETS && bucket_high(b) <= (double)le * rate) cum += p->hist[b++];
+            fprintf(fp, "eee_latency_seconds_bucket{path=\"%s\",le=\"%.9g\"} %llu\n",
+                    STATS_NAMES[k], (double)le * 1e-9, (unsigned long long)cum);
+        }
+        fprintf(fp, "eee_latency_seconds_bucket{path=\"%s\",le=\"+Inf\"} %llu\n", STATS_NAMES[k],
+                (unsigned long long)p->calls);
+        fprintf(fp, "eee_latency_seconds_sum{path=\"%s\"} %.9f\n", STATS_NAMES[k], p->total * sec);
+        fprintf(fp, "eee_latency_seconds_count{path=\"%s\"} %llu\n", STATS_NAMES[k], (unsigned long long)p->calls);
+    }
+    fprintf(fp, "# HELP eee_latency_max_seconds Longest single call, by instrumented path.\n");
+    fprintf(fp, "# TYPE eee_latency_max_seconds gauge\n");
+    for (int k = 0; k < STAT_COUNT; ++k)
+        if (all[k].calls)
+            fprintf(fp, "eee_latency_max_seconds{path=\"%s\"} %.9f\n", STATS_NAMES[k], all[k].max * sec);
+    free(all);
+
+    int ok = !ferror(fp);
+    if (fclose(fp) != 0) ok = 0;
+    if (!ok || rename(tmp, path) != 0) { unlink(tmp); return -1; }
+    return 0;
+}
+
+static void stats_exit_metrics(void)
+{
+    const char *path = getenv("EEE_METRICS");
+    if (stats_write_metrics(path) != 0) printf("Error: cannot write metrics to '%s'.\n", path);
+}
+
+void stats_init(int print_at_exit)
+{
+    base_ticks = stats_ticks();
+    base_ns = mono_ns();
+    const char *path = getenv("EEE_METRICS");
+    if (path && *path) atexit(stats_exit_metrics);
+    if (print_at_exit) atexit(stats_print);   // runs first: handlers run in reverse
+}
+
+#else
+
+void stats_read(stats_probe_t *out)
+{
+    memset(out, 0, STAT_COUNT * sizeof *out);
+}
+
+void stats_print(void)
+{
+    printf("\n--- Stats ---\nStatistics were compiled out (built with -DEEE_NO_STATS).\n");
+}
+
+int stats_write_metrics(const char *path)
+{
+    (void)path;
+    return -1;
+}
+
+void stats_init(int print_at_exit)
+{
+    if (print_at_exit) atexit(stats_print);
+}
+
+#endif
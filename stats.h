@@ -0,0 +1,141 @@
+// Call counts and latency histograms for the EEE Helper CLI calculator.
+// Every compute path, log write and input parse starts with
+// STATS_SCOPE(STAT_x); when the enclosing block ends, however it ends, the
+// call is counted and its duration goes into that probe's histogram.
+// Results are shown by the main menu's Stats option, printed at exit by
+// "main.out --stats ..." and written in Prometheus text format to the file
+// named by EEE_METRICS at exit (and whenever the Stats menu is shown).
+// The same scopes feed the timeline of "main.out --trace FILE ..." (trace.h).
+//
+// Durations are taken in ticks of the CPU's time-stamp counter on x86-64
+// (about 20 ns to read, half the cost of clock_gettime) and converted to ns
+// only when read; elsewhere a tick is a CLOCK_MONOTONIC nanosecond.
+//
+// Build with -DEEE_NO_STATS to compile all of it out: STATS_SCOPE expands to
+// nothing and the report functions only say that statistics are disabled.
+
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <time.h>
+#if defined(__x86_64__)
+#include <x86intrin.h>
+#endif
+
+// Probe, name, and trace category ("" = not traced: called once per row).
+#define STATS_PROBES(X)                                              \
+    X(FORMULA_SOLVE,   "formula_solve",       "")                    \
+    X(FORMULA_BATCH,   "formula_solve_batch", "compute")             \
+    X(BATCH_FILE,      "batch_file",          "job")                 \
+    X(BATCH_PARSE,     "batch_parse",         "parse")               \
+    X(BATCH_FORMAT,    "batch_format",        "format")              \
+    X(EXPR_COMPILE,    "expr_compile",        "parse")               \
+    X(EXPR_EVAL,       "expr_eval",           "compute")             \
+    X(EXPR_FILE,       "expr_file",           "job")                 \
+    X(SWEEP_RUN,       "sweep_run",           "job")                 \
+    X(WORKSHEET_SET,   "worksheet_set",       "compute")             \
+    X(CURVE_FIT,       "curve_fit",           "compute")             \
+    X(POWER_FILE,      "power_file",          "job")                 \
+    X(PHASOR_FILE,     "phasor_file",         "job")                 \
+    X(FFT_WINDOW,      "fft_window",          "compute")             \
+    X(THREEPHASE_FILE, "threephase_file",     "job")                 \
+    X(REQUEST,         "server_request",      "compute")             \
+    X(HTTP_PARSE,      "http_parse",          "parse")               \
+    X(HTTP_ROUTE,      "http_route",          "compute")             \
+    X(QUEUE_WAIT,      "queue_wait",          "queue-wait")          \
+    X(MENU_CALC,       "menu_calc",           "job")                 \
+    X(MENU_MATH,       "menu_math",           "")                    \
+    X(MONITOR_PUSH,    "monitor_push",        "")                    \
+    X(DCACHE_GET,      "dcache_get",          "cache")               \
+    X(DCACHE_PUT,      "dcache_put",          "cache")               \
+    X(INPUT_PARSE,     "input_parse",         "")                    \
+    X(LOG_WRITE,       "log_write",           "log-write")           \
+    X(SESSION_LOAD,    "session_load",        "job")                 \
+    X(SESSION_SAVE,    "session_save",        "job")
+
+#define STATS_ID(id, name, cat) STAT_##id,
+enum { STATS_PROBES(STATS_ID) STAT_COUNT };
+#undef STATS_ID
+
+// Latency buckets: exact below 16 ticks, then 16 per power of two (at
+// most 1/16 = 6% wide) up to 2^41 ticks (over ten minutes; longer calls
+// land in the last bucket).
+#define STATS_BUCKETS 608
+
+typedef struct {
+    uint64_t calls, total, max;         // ticks
+    uint64_t hist[STATS_BUCKETS];
+} stats_probe_t;
+
+static inline uint64_t stats_ticks(void)
+{
+#if defined(__x86_64__)
+    return __rdtsc();
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+#endif
+}
+
+// Ticks per nanosecond, measured against CLOCK_MONOTONIC since start-up
+// (the first call may take 2 ms to measure it).
+double stats_ticks_per_ns(void);
+
+// Merges the counts of every thread into out[STAT_COUNT].
+void stats_read(stats_probe_t *out);
+
+// Smallest bucket bound with at least q (0..1) of the calls at or below it,
+// in ticks.
+uint64_t stats_quantile(const stats_probe_t *p, double q);
+
+void stats_print(void);                 // table of every probe that was hit
+int  stats_write_metrics(const char *path);    // Prometheus text; 0 or -1
+
+// Arranges the exit-time report: the table if print_at_exit, and the
+// EEE_METRICS file if that is set.
+void stats_init(int print_at_exit);
+
+#ifndef EEE_NO_STATS
+
+typedef struct {
+    int probe;
+    uint64_t t0;
+} stats_scope_t;
+
+// Also adds a trace event while tracing (trace.h).
+void stats_record(int probe, uint64_t t0, uint64_t t1);
+
+static inline void stats_scope_end(stats_scope_t *s)
+{
+    if (s->probe >= 0) stats_record(s->probe, s->t0, stats_ticks());
+}
+
+static inline void stats_scope_stop(stats_scope_t *s)
+{
+    stats_scope_end(s);
+    s->probe = -1;
+}
+
+#define STATS_CAT2(a, b) a##b
+#define STATS_CAT(a, b)  STATS_CAT2(a, b)
+#define STATS_SCOPE(probe) \
+    stats_scope_t STATS_CAT(stats_scope_, __LINE__) __attribute__((cleanup(stats_scope_end))) = { (probe), stats_ticks() }
+
+// A scope that STATS_STOP(name) can end before its block does, e.g. after the
+// arithmetic of a menu mode and before its output.
+#define STATS_SCOPE_AS(name, probe) \
+    stats_scope_t name __attribute__((cleanup(stats_scope_end))) = { (probe), stats_ticks() }
+#define STATS_STOP(name) stats_scope_stop(&(name))
+
+#else
+
+#define STATS_SCOPE(probe) do { } while (0)
+#define STATS_SCOPE_AS(name, probe) do { } while (0)
+#define STATS_STOP(name) do { } while (0)
+
+#endif
+
+#endif
@@ -0,0 +1,644 @@
+// Sweep script parser and lazy Cartesian-product evaluator.
+// Design notes:
+// Each sweep is an axis that can produce its i-th value on demand (ranges are
+// computed, lists and E-series are small tables). An odometer of indices
+// walks the product; only the axes whose index changed are recomputed.
+// Points are gathered SWEEP_CHUNK at a time into columns. The chunk is split
+// into blocks of SWEEP_BLOCK rows, and pool tasks solve each eval over a
+// block with formula_solve_batch() (so consecutive rows warm-start the
+// numeric solver) and format its CSV lines; the blocks are written in order.
+// Blocks do not depend on the thread count, so neither does the output. With
+// the disk cache on (diskcache.h), a repeated sweep is answered from its
+// stored output.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <math.h>
+#include <ctype.h>
+#include <limits.h>
+#include "sweep.h"
+#include "formulas.h"
+#include "funcs.h"
+#include "diskcache.h"
+#include "stats.h"
+#include "pool.h"
+
+#define SWEEP_MAX_AXES  8
+#define SWEEP_MAX_EVALS 8
+#define SWEEP_MAX_LIST  64
+#define SWEEP_CHUNK     4096
+#define SWEEP_MAX_SCRIPT 65536
+#define SWEEP_BLOCK     128             // rows per pool task
+#define SWEEP_BLOCKS    (SWEEP_CHUNK / SWEEP_BLOCK)
+#define SWEEP_BLOCK_TEXT (SWEEP_BLOCK * (SWEEP_MAX_AXES + SWEEP_MAX_EVALS) * 24)   // ",%.9g" <= 24 bytes
+
+enum { AXIS_LIN, AXIS_LOG, AXIS_STEP, AXIS_TABLE };
+
+typedef struct {
+    char name[32];
+    int kind;
+    double a, b, step;
+    unsigned long long n;
+    double *table;                      // AXIS_TABLE: lists and E-series
+} axis_t;
+
+typedef struct {
+    const formula_t *fm;
+    int var;                            // variable solved for
+    int axis[FORMULA_MAX_VARS];         // swept variable: axis index, else -1
+    double fixed[FORMULA_MAX_VARS];     // value of a given variable
+    char column[48];
+} eval_t;
+
+struct sweep {
+    axis_t axes[SWEEP_MAX_AXES];
+    int naxes;
+    eval_t evals[SWEEP_MAX_EVALS];
+    int nevals;
+};
+
+// ----------------------------- VALUES -----------------------------
+
+int sweep_parse_value(const char *s, double *out, const char **end)
+{
+    // Copy the numeric part so "1..10" is not read as "1." followed by ".10".
+    char buf[64];
+    size_t n = 0;
+    while (n + 1 < sizeof buf && s[n] && strchr("0123456789.eE+-", s[n])) {
+        if (s[n] == '.' && s[n + 1] == '.') break;
+        buf[n] = s[n];
+        n++;
+    }
+    buf[n] = '\0';
+
+    errno = 0;
+    char *e = NULL;
+    double v = strtod(buf, &e);
+    if (e == buf || errno == ERANGE) return 0;
+    const char *p = s + (e - buf);
+
+    static const struct { char c; double scale; } prefixes[] = {
+        { 'f', 1e-15 }, { 'p', 1e-12 }, { 'n', 1e-9 }, { 'u', 1e-6 }, { 'm', 1e-3 },
+        { 'k', 1e3 }, { 'K', 1e3 }, { 'M', 1e6 }, { 'G', 1e9 }, { 'T', 1e12 },
+    };
+    if (strncmp(p, "meg", 3) == 0) { v *= 1e6; p += 3; }
+    else if (strncmp(p, "\xC2\xB5", 2) == 0) { v *= 1e-6; p += 2; }   // UTF-8 micro sign
+    else {
+        for (size_t k = 0; k < sizeof prefixes / sizeof prefixes[0]; ++k)
+            if (*p == prefixes[k].c) { v *= prefixes[k].scale; p++; break; }
+    }
+    while (isalpha((unsigned char)*p)) p++;                 // unit, e.g. "F", "Hz"
+
+    *out = v;
+    *end = p;
+    return 1;
+}
+
+int sweep_eseries(const char *name, double *out)
+{
+    static const int E24[24] = { 10, 11, 12, 13, 15, 16, 18, 20, 22, 24, 27, 30,
+                                 33, 36, 39, 43, 47, 51, 56, 62, 68, 75, 82, 91 };
+    static const int E96[96] = {
+        100, 102, 105, 107, 110, 113, 115, 118, 121, 124, 127, 130, 133, 137, 140, 143,
+        147, 150, 154, 158, 162, 165, 169, 174, 178, 182, 187, 191, 196, 200, 205, 210,
+        215, 221, 226, 232, 237, 243, 249, 255, 261, 267, 274, 280, 287, 294, 301, 309,
+        316, 324, 332, 340, 348, 357, 365, 374, 383, 392, 402, 412, 422, 432, 442, 453,
+        464, 475, 487, 499, 511, 523, 536, 549, 562, 576, 590, 604, 619, 634, 649, 665,
+        681, 698, 715, 732, 750, 768, 787, 806, 825, 845, 866, 887, 909, 931, 953, 976 };
+
+    // E3..E24 are every 8th..1st value of E24, E48 every 2nd of E96.
+    static const struct { const char *name; const int *table; int size, stride; double scale; } series[] = {
+        { "E3", E24, 24, 8, 10.0 }, { "E6", E24, 24, 4, 10.0 }, { "E12", E24, 24, 2, 10.0 },
+        { "E24", E24, 24, 1, 10.0 }, { "E48", E96, 96, 2, 100.0 }, { "E96", E96, 96, 1, 100.0 },
+    };
+
+    for (size_t k = 0; k < sizeof series / sizeof series[0]; ++k) {
+        if (strcmp(name, series[k].name) != 0) continue;
+        int n = 0;
+        for (int i = 0; i < series[k].size; i += series[k].stride)
+            out[n++] = series[k].table[i] / series[k].scale;
+        return n;
+    }
+    return 0;
+}
+
+static double axis_value(const axis_t *ax, unsigned long long i)
+{
+    double t = ax->n > 1 ? (double)i / (double)(ax->n - 1) : 0.0;
+    switch (ax->kind) {
+        case AXIS_LIN:  return ax->a + (ax->b - ax->a) * t;
+        case AXIS_LOG:  return ax->a * pow(ax->b / ax->a, t);
+        case AXIS_STEP: return ax->a + ax->step * (double)i;
+        default:        return ax->table[i];
+    }
+}
+
+// ----------------------------- PARSER -----------------------------
+
+typedef struct {
+    const char *p;
+    int stmt;                           // statement number, for messages
+    char *err;
+    size_t errlen;
+    int failed;
+} sparser_t;
+
+static void sfail(sparser_t *ps, const char *fmt, const char *arg)
+{
+    if (ps->failed) return;
+    char msg[160];
+    snprintf(msg, sizeof msg, fmt, arg);
+    snprintf(ps->err, ps->errlen, "statement %d: %s", ps->stmt, msg);
+    ps->failed = 1;
+}
+
+static void sskip(sparser_t *ps)
+{
+    while (*ps->p == ' ' || *ps->p == '\t' || *ps->p == '\r') ps->p++;
+}
+
+// Reads a name (letters, digits, '_' and '.') into buf. Returns 0 if none.
+static int sname(sparser_t *ps, char *buf, size_t size)
+{
+    sskip(ps);
+    size_t n = 0;
+    if (!isalpha((unsigned char)*ps->p) && *ps->p != '_') return 0;
+    while (isalnum((unsigned char)*ps->p) || *ps->p == '_' ||
+           (*ps->p == '.' && isalpha((unsigned char)ps->p[1]))) {
+        if (n + 1 < size) buf[n++] = *ps->p;
+        ps->p++;
+    }
+    buf[n] = '\0';
+    return 1;
+}
+
+static int sexpect(sparser_t *ps, const char *tok)
+{
+    sskip(ps);
+    size_t n = strlen(tok);
+    if (strncmp(ps->p, tok, n) != 0) { sfail(ps, "expected '%s'", tok); return 0; }
+    ps->p += n;
+    return 1;
+}
+
+static int svalue(sparser_t *ps, double *v)
+{
+    sskip(ps);
+    const char *end;
+    int neg = 0;
+    if (*ps->p == '-') { neg = 1; ps->p++; }
+    if (!sweep_parse_value(ps->p, v, &end)) { sfail(ps, "expected a number at '%.12s'", ps->p); return 0; }
+    if (neg) *v = -*v;
+    ps->p = end;
+    return 1;
+}
+
+static int scount(sparser_t *ps, unsigned long long *n)
+{
+    double v;
+    if (!svalue(ps, &v)) return 0;
+    if (v < 1.0 || v > 1e15 || v != floor(v)) { sfail(ps, "%s", "point count must be a whole number >= 1"); return 0; }
+    *n = (unsigned long long)v;
+    return 1;
+}
+
+// sweep NAME in RANGE
+static void parse_sweep(sparser_t *ps, sweep_t *s)
+{
+    if (s->naxes == SWEEP_MAX_AXES) { sfail(ps, "%s", "too many sweeps"); return; }
+    axis_t *ax = &s->axes[s->naxes];
+    memset(ax, 0, sizeof *ax);
+
+    if (!sname(ps, ax->name, sizeof ax->name)) { sfail(ps, "%s", "expected a variable name"); return; }
+    for (int k = 0; k < s->naxes; ++k)
+        if (strcmp(s->axes[k].name, ax->name) == 0) { sfail(ps, "%s is swept twice", ax->name); return; }
+    char word[32];
+    if (!sname(ps, word, sizeof word) || strcmp(word, "in") != 0) { sfail(ps, "%s", "expected 'in'"); return; }
+
+    sskip(ps);
+    const char *save = ps->p;
+    double base[96];
+    int nbase = 0;
+    if (sname(ps, word, sizeof word) && (nbase = sweep_eseries(word, base)) > 0) {
+        // E-series: every preferred value between the bounds.
+        double a, b;
+        if (!sexpect(ps, "(") || !svalue(ps, &a) || !sexpect(ps, "..") || !svalue(ps, &b) || !sexpect(ps, ")")) return;
+        if (a <= 0.0 || b < a) { sfail(ps, "%s", "E-series bounds must be positive and increasing"); return; }
+
+        ax->kind = AXIS_TABLE;
+        int d0 = (int)floor(log10(a)), d1 = (int)floor(log10(b));
+        ax->table = malloc((size_t)(d1 - d0 + 1) * (size_t)nbase * sizeof(double));
+        if (!ax->table) { sfail(ps, "%s", "out of memory"); return; }
+        for (int d = d0; d <= d1; ++d)
+            for (int k = 0; k < nbase; ++k) {
+                // Round to 3 significant figures so 4.7 * 1e-9 prints as 4.7e-09.
+                snprintf(word, sizeof word, "%.3g", base[k] * pow(10.0, d));
+                double v = strtod(word, NULL);
+                if (v >= a * (1.0 - 1e-9) && v <= b * (1.0 + 1e-9)) ax->table[ax->n++] = v;
+            }
+        if (ax->n == 0) { sfail(ps, "%s", "no preferred values in that range"); return; }
+        s->naxes++;
+        return;
+    }
+    ps->p = save;
+
+    double a, b;
+    if (!svalue(ps, &a)) return;
+    sskip(ps);
+    if (strncmp(ps->p, "..", 2) == 0) {
+        ps->p += 2;
+        if (!svalue(ps, &b)) return;
+        ax->a = a;
+        ax->b = b;
+        if (!sname(ps, word, sizeof word)) { sfail(ps, "%s", "expected 'lin N', 'log N' or 'step S'"); return; }
+        if (strcmp(word, "lin") == 0) {
+            ax->kind = AXIS_LIN;
+            if (!scount(ps, &ax->n)) return;
+        }
+        else if (strcmp(word, "log") == 0) {
+            ax->kind = AXIS_LOG;
+            if (!scount(ps, &ax->n)) return;
+            if (a <= 0.0 || b <= 0.0) { sfail(ps, "%s", "log sweeps need positive bounds"); return; }
+        }
+        else if (strcmp(word, "step") == 0) {
+            ax->kind = AXIS_STEP;
+            if (!svalue(ps, &ax->step)) return;
+            double span = (b - a) / ax->step;
+            if (ax->step == 0.0 || span < 0.0 || span > 1e15) { sfail(ps, "%s", "step must move from the first bound towards the second"); return; }
+            ax->n = (unsigned long long)floor(span + 1e-9) + 1;
+        }
+        else {
+            sfail(ps, "unknown spacing '%s'", word);
+            return;
+        }
+    }
+    else {
+        // List: A, B, C
+        ax->kind = AXIS_TABLE;
+        ax->table = malloc(SWEEP_MAX_LIST * sizeof(double));
+        if (!ax->table) { sfail(ps, "%s", "out of memory"); return; }
+        ax->table[ax->n++] = a;
+        for (sskip(ps); *ps->p == ','; sskip(ps)) {
+            ps->p++;
+            if (ax->n == SWEEP_MAX_LIST) { sfail(ps, "%s", "list too long"); return; }
+            if (!svalue(ps, &ax->table[ax->n++])) return;
+        }
+    }
+    s->naxes++;
+}
+
+// Domain check on a swept variable. Ranges are monotonic and domains are
+// intervals, so checking the bounds covers every point.
+static int axis_domain_ok(const axis_t *ax, int dom)
+{
+    if (ax->kind != AXIS_TABLE)
+        return formula_domain_ok(dom, axis_value(ax, 0)) && formula_domain_ok(dom, axis_value(ax, ax->n - 1));
+    for (unsigned long long i = 0; i < ax->n; ++i)
+        if (!formula_domain_ok(dom, ax->table[i])) return 0;
+    return 1;
+}
+
+// eval FORMULA(VAR=VALUE, ...)
+static void parse_eval(sparser_t *ps, sweep_t *s)
+{
+    if (s->nevals == SWEEP_MAX_EVALS) { sfail(ps, "%s", "too many evals"); return; }
+    eval_t *ev = &s->evals[s->nevals];
+    memset(ev, 0, sizeof *ev);
+
+    char name[32];
+    if (!sname(ps, name, sizeof name)) { sfail(ps, "%s", "expected a formula name"); return; }
+    ev->fm = formula_find(name);
+    if (!ev->fm) { sfail(ps, "unknown formula '%s'", name); return; }
+    const formula_t *fm = ev->fm;
+
+    int given[FORMULA_MAX_VARS] = {0};
+    for (int j = 0; j < FORMULA_MAX_VARS; ++j) ev->axis[j] = -1;
+
+    sskip(ps);
+    if (*ps->p == '(') {
+        ps->p++;
+        sskip(ps);
+        while (!ps->failed && *ps->p != ')') {
+            if (!sname(ps, name, sizeof name)) { sfail(ps, "%s", "expected VAR=VALUE"); return; }
+            int j = formula_var_index(fm, name);
+            if (j < 0) { sfail(ps, "no variable '%s' in this formula", name); return; }
+            if (!sexpect(ps, "=") || !svalue(ps, &ev->fixed[j])) return;
+            if (!formula_domain_ok(fm->vars[j].domain, ev->fixed[j])) { sfail(ps, "%s is out of range", name); return; }
+            given[j] = 1;
+            sskip(ps);
+            if (*ps->p == ',') { ps->p++; sskip(ps); }
+            else if (*ps->p != ')') { sfail(ps, "%s", "expected ',' or ')'"); return; }
+        }
+        if (!sexpect(ps, ")")) return;
+    }
+
+    // Swept variables fill whatever was not given explicitly.
+    int missing = 0;
+    for (int j = 0; j < fm->nvars; ++j) {
+        if (given[j]) continue;
+        for (int k = 0; k < s->naxes; ++k)
+            if (strcmp(s->axes[k].name, fm->vars[j].name) == 0) ev->axis[j] = k;
+        if (ev->axis[j] >= 0) {
+            if (!axis_domain_ok(&s->axes[ev->axis[j]], fm->vars[j].domain)) {
+                sfail(ps, "swept %s is out of range for this formula", fm->vars[j].name);
+                return;
+            }
+        }
+        else {
+            ev->var = j;
+            missing++;
+        }
+    }
+    if (missing != 1) {
+        snprintf(name, sizeof name, "%d", fm->nvars);
+        sfail(ps, "give or sweep all but one of the %s variables", name);
+        return;
+    }
+
+    // Column name: the variable, qualified by the formula if already used.
+    snprintf(ev->column, sizeof ev->column, "%s", fm->vars[ev->var].name);
+    for (int k = 0; k < s->naxes + s->nevals; ++k) {
+        const char *other = k < s->naxes ? s->axes[k].name : s->evals[k - s->naxes].column;
+        if (strcmp(other, ev->column) == 0)
+            snprintf(ev->column, sizeof ev->column, "%s.%s", fm->name, fm->vars[ev->var].name);
+    }
+    s->nevals++;
+}
+
+static sweep_t *sweep_parse(const char *script, char *err, size_t errlen)
+{
+    sweep_t *s = calloc(1, sizeof *s);
+    if (!s) { snprintf(err, errlen, "out of memory"); return NULL; }
+
+    sparser_t ps = { script, 0, err, errlen, 0 };
+    while (!ps.failed) {
+        // Skip separators and comments between statements.
+        for (;;) {
+            sskip(&ps);
+            if (*ps.p == ';' || *ps.p == '\n') ps.p++;
+            else if (*ps.p == '#') ps.p += strcspn(ps.p, "\n");
+            else break;
+        }
+        if (*ps.p == '\0') break;
+
+        ps.stmt++;
+        char word[32];
+        if (!sname(&ps, word, sizeof word)) { sfail(&ps, "unexpected '%.12s'", ps.p); break; }
+        if (strcmp(word, "sweep") == 0) parse_sweep(&ps, s);
+        else if (strcmp(word, "eval") == 0) parse_eval(&ps, s);
+        else { sfail(&ps, "unknown statement '%s'", word); break; }
+
+        sskip(&ps);
+        if (!ps.failed && *ps.p && *ps.p != ';' && *ps.p != '\n' && *ps.p != '#')
+            sfail(&ps, "unexpected '%.12s'", ps.p);
+    }
+    if (!ps.failed && s->nevals == 0) { snprintf(err, errlen, "the script has no eval statement"); ps.failed = 1; }
+
+    if (ps.failed) { sweep_free(s); return NULL; }
+    return s;
+}
+
+sweep_t *sweep_open(const char *arg, char *err, size_t errlen)
+{
+    if (arg[0] != '@') return sweep_parse(arg, err, errlen);
+
+    FILE *fp = fopen(arg + 1, "r");
+    if (!fp) { snprintf(err, errlen, "cannot open '%s'", arg + 1); return NULL; }
+    char *buf = malloc(SWEEP_MAX_SCRIPT);
+    if (!buf) { fclose(fp); snprintf(err, errlen, "out of memory"); return NULL; }
+    size_t n = fread(buf, 1, SWEEP_MAX_SCRIPT - 1, fp);
+    int too_long = !feof(fp);
+    fclose(fp);
+    buf[n] = '\0';
+
+    sweep_t *s = NULL;
+    if (too_long) snprintf(err, errlen, "script file is too long");
+    else s = sweep_parse(buf, err, errlen);
+    free(buf);
+    return s;
+}
+
+void sweep_free(sweep_t *s)
+{
+    if (!s) return;
+    // Includes the axis a failed statement was building (zeroed otherwise).
+    for (int k = 0; k <= s->naxes && k < SWEEP_MAX_AXES; ++k) free(s->axes[k].table);
+    free(s);
+}
+
+// ---------------------------- EVALUATION ----------------------------
+
+unsigned long long sweep_points(const sweep_t *s)
+{
+    unsigned long long total = 1;
+    for (int k = 0; k < s->naxes; ++k) {
+        if (total > ULLONG_MAX / s->axes[k].n) return ULLONG_MAX;
+        total *= s->axes[k].n;
+    }
+    return total;
+}
+
+// A chunk is solved and formatted SWEEP_BLOCK rows per pool task; the
+// blocks' text is then written in order.
+typedef struct {
+    const sweep_t *s;
+    const double *(*vals)[FORMULA_MAX_VARS];
+    const double (*col)[SWEEP_CHUNK];
+    double (*res)[SWEEP_CHUNK];
+    size_t n;
+    char *text;                         // SWEEP_BLOCK_TEXT bytes per block
+    size_t len[SWEEP_BLOCKS];
+    unsigned long long unsolved[SWEEP_BLOCKS];
+} sweep_chunk_t;
+
+static void sweep_block(size_t b, int worker, void *ctx)
+{
+    sweep_chunk_t *c = ctx;
+    const sweep_t *s = c->s;
+    size_t lo = b * SWEEP_BLOCK, hi = lo + SWEEP_BLOCK < c->n ? lo + SWEEP_BLOCK : c->n;
+    (void)worker;
+
+    c->unsolved[b] = 0;
+    for (int e = 0; e < s->nevals; ++e) {
+        const double *v[FORMULA_MAX_VARS];
+        for (int j = 0; j < s->evals[e].fm->nvars; ++j) v[j] = c->vals[e][j] + lo;
+        c->unsolved[b] += hi - lo - formula_solve_batch(s->evals[e].fm, s->evals[e].var, v, hi - lo, c->res[e] + lo);
+    }
+
+    STATS_SCOPE(STAT_BATCH_FORMAT);
+    char *text = c->text + b * SWEEP_BLOCK_TEXT, *p = text;
+    for (size_t r = lo; r < hi; ++r) {
+        for (int k = 0; k < s->naxes; ++k) p += sprintf(p, "%s%.9g", k ? "," : "", c->col[k][r]);
+        for (int e = 0; e < s->nevals; ++e) p += sprintf(p, "%s%.9g", s->naxes || e ? "," : "", c->res[e][r]);
+        *p++ = '\n';
+    }
+    c->len[b] = (size_t)(p - text);
+}
+
+static unsigned long long sweep_run_direct(sweep_t *s, FILE *out, unsigned long long *unsolved)
+{
+    static double col[SWEEP_MAX_AXES][SWEEP_CHUNK];
+    static double fixed[SWEEP_MAX_EVALS][FORMULA_MAX_VARS][SWEEP_CHUNK];
+    static double res[SWEEP_MAX_EVALS][SWEEP_CHUNK];
+    static char text[SWEEP_BLOCKS * SWEEP_BLOCK_TEXT];
+
+    // Column pointers per eval: swept variables read an axis column, given
+    // ones a constant column.
+    const double *vals[SWEEP_MAX_EVALS][FORMULA_MAX_VARS];
+    for (int e = 0; e < s->nevals; ++e) {
+        const eval_t *ev = &s->evals[e];
+        for (int j = 0; j < ev->fm->nvars; ++j) {
+            if (ev->axis[j] >= 0) { vals[e][j] = col[ev->axis[j]]; continue; }
+            for (int k = 0; k < SWEEP_CHUNK; ++k) fixed[e][j][k] = ev->fixed[j];
+            vals[e][j] = fixed[e][j];
+        }
+    }
+    sweep_chunk_t chunk = { s, vals, (const double (*)[SWEEP_CHUNK])col, res, 0, text, {0}, {0} };
+
+    for (int k = 0; k < s->naxes; ++k) fprintf(out, "%s%s", k ? "," : "", s->axes[k].name);
+    for (int e = 0; e < s->nevals; ++e) fprintf(out, "%s%s", s->naxes || e ? "," : "", s->evals[e].column);
+    fprintf(out, "\n");
+
+    unsigned long long idx[SWEEP_MAX_AXES] = {0}, rows = 0;
+    double cur[SWEEP_MAX_AXES];
+    for (int k = 0; k < s->naxes; ++k) cur[k] = axis_value(&s->axes[k], 0);
+
+    *unsolved = 0;
+    int done = 0;
+    while (!done) {
+        // Fill a chunk by turning the odometer.
+        size_t n = 0;
+        while (n < SWEEP_CHUNK && !done) {
+            for (int k = 0; k < s->naxes; ++k) col[k][n] = cur[k];
+            n++;
+
+            int k = s->naxes - 1;
+            for (; k >= 0; --k) {
+                if (++idx[k] < s->axes[k].n) { cur[k] = axis_value(&s->axes[k], idx[k]); break; }
+                idx[k] = 0;
+                cur[k] = axis_value(&s->axes[k], 0);
+            }
+            if (k < 0) done = 1;
+        }
+
+        size_t blocks = (n + SWEEP_BLOCK - 1) / SWEEP_BLOCK;
+        chunk.n = n;
+        pool_run(blocks, sweep_block, &chunk);
+        for (size_t b = 0; b < blocks; ++b) {
+            *unsolved += chunk.unsolved[b];
+            fwrite(text + b * SWEEP_BLOCK_TEXT, 1, chunk.len[b], out);
+        }
+        rows += n;
+    }
+    return rows;
+}
+
+// The job as the disk cache sees it: every parsed axis and eval, so the same
+// sweep written differently ("1k" or "1000", inline or @file) shares a key.
+static char *sweep_key(const sweep_t *s, size_t *len)
+{
+    char *buf = NULL;
+    FILE *k = open_memstream(&buf, len);
+    if (!k) return NULL;
+    for (int a = 0; a < s->naxes; ++a) {
+        const axis_t *ax = &s->axes[a];
+        fwrite(ax->name, sizeof ax->name, 1, k);
+        fwrite(&ax->kind, sizeof ax->kind, 1, k);
+        fwrite(&ax->n, sizeof ax->n, 1, k);
+        if (ax->kind == AXIS_TABLE) fwrite(ax->table, sizeof *ax->table, ax->n, k);
+        else { fwrite(&ax->a, sizeof ax->a, 1, k); fwrite(&ax->b, sizeof ax->b, 1, k); fwrite(&ax->step, sizeof ax->step, 1, k); }
+    }
+    for (int e = 0; e < s->nevals; ++e) {
+        const eval_t *ev = &s->evals[e];
+        int id = (int)(ev->fm - FORMULAS);
+        fwrite(&id, sizeof id, 1, k);
+        fwrite(&ev->var, sizeof ev->var, 1, k);
+        for (int j = 0; j < ev->fm->nvars; ++j) {
+            fwrite(&ev->axis[j], sizeof ev->axis[j], 1, k);
+            if (j != ev->var && ev->axis[j] < 0) fwrite(&ev->fixed[j], sizeof ev->fixed[j], 1, k);
+        }
+        fwrite(ev->column, sizeof ev->column, 1, k);
+    }
+    if (fclose(k) != 0) { free(buf); return NULL; }
+    return buf;
+}
+
+// With the disk cache on, a sweep that ran before is copied from the cache,
+// and one whose output fits in a cache entry is run into memory and stored.
+// Cache entries hold the row and unsolved counts, then the CSV text.
+unsigned long long sweep_run(sweep_t *s, FILE *out, unsigned long long *unsolved)
+{
+    STATS_SCOPE(STAT_SWEEP_RUN);
+    size_t max_entry, keylen;
+    if (!dcache_enabled(&max_entry)) return sweep_run_direct(s, out, unsolved);
+
+    // At most 16 characters and a separator per column, plus the header.
+    unsigned long long points = sweep_points(s);
+    unsigned long long row_bytes = 17ull * (unsigned long long)(s->naxes + s->nevals) + 1;
+    if (points > (max_entry - 4096) / row_bytes) return sweep_run_direct(s, out, unsolved);
+
+    char *key = sweep_key(s, &keylen);
+    if (!key) return sweep_run_direct(s, out, unsolved);
+
+    unsigned long long counts[2] = {0};
+    dcache_blob_t b;
+    if (dcache_get("sweep", key, keylen, &b) && b.len >= sizeof counts) {
+        memcpy(counts, b.data, sizeof counts);
+        fwrite((const char *)b.data + sizeof counts, 1, b.len - sizeof counts, out);
+        dcache_release(&b);
+        free(key);
+        *unsolved = counts[1];
+        return counts[0];
+    }
+    dcache_release(&b);
+
+    char *text = NULL;
+    size_t len = 0;
+    FILE *mem = open_memstream(&text, &len);
+    if (!mem) { free(key); return sweep_run_direct(s, out, unsolved); }
+    fwrite(counts, sizeof counts, 1, mem);      // placeholder for the counts
+    counts[0] = sweep_run_direct(s, mem, &counts[1]);
+    if (fclose(mem) != 0) { free(text); free(key); return sweep_run_direct(s, out, unsolved); }
+
+    memcpy(text, counts, sizeof counts);
+    fwrite(text + sizeof counts, 1, len - sizeof counts, out);
+    dcache_put("sweep", key, keylen, text, len);
+    free(text);
+    free(key);
+    *unsolved = counts[1];
+    return counts[0];
+}
+
+int sweep_cli(int argc, char **argv)
+{
+    if (argc < 3 || argc > 4) {
+        printf("Usage: %s --sweep \"SCRIPT\" | @script.txt [out.csv]\n", argv[0]);
+        return 1;
+    }
+
+    char err[200];
+    sweep_t *s = sweep_open(argv[2], err, sizeof err);
+    if (!s) { printf("Error: %s.\n", err); return 1; }
+
+    FILE *out = stdout;
+    if (argc == 4 && !(out = fopen(argv[3], "w"))) {
+        printf("Error: cannot create '%s'.\n", argv[3]);
+        sweep_free(s);
+        return 1;
+    }
+
+    unsigned long long unsolved;
+    unsigned long long rows = sweep_run(s, out, &unsolved);
+    if (out != stdout) {
+        fclose(out);
+        printf("%llu row(s) written to %s (%llu result(s) without a solution)\n", rows, argv[3], unsolved);
+
+        char line[256];
+        snprintf(line, sizeof line, "Sweep: %.120s -> %s, rows=%llu, unsolved=%llu", argv[2], argv[3], rows, unsolved);
+        log_line(line);
+    }
+    sweep_free(s);
+    return 0;
+}
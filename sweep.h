@@ -0,0 +1,51 @@
+// Parameter sweep scripts for the EEE Helper CLI calculator.
+// A script declares ranges and the registry formulas to evaluate over them:
+//
+//     sweep R in 1k..100k log 1000; sweep C in E12(1n..1u); eval rc.charge(t=1ms)
+//
+// Statements are separated by ';' or new lines, '#' starts a comment.
+//   sweep NAME in A..B lin N     N evenly spaced points (also "log N", "step S")
+//   sweep NAME in E12(A..B)      preferred values E3, E6, E12, E24, E48 or E96
+//   sweep NAME in A, B, C        an explicit list
+//   eval FORMULA(VAR=VALUE, ...) solves for the one variable neither given
+//                                here nor swept
+// Numbers take SI prefixes and units: 4.7k, 100nF, 1ms, 2meg.
+//
+// The Cartesian product of all sweeps is walked lazily (the last sweep varies
+// fastest) a chunk at a time, so memory use does not depend on its size.
+
+#ifndef SWEEP_H
+#define SWEEP_H
+
+#include <stdio.h>
+#include <stddef.h>
+
+typedef struct sweep sweep_t;
+
+// Parses a script, or reads it from a file if arg is "@path".
+// Returns NULL on error and writes a message to err.
+sweep_t *sweep_open(const char *arg, char *err, size_t errlen);
+void     sweep_free(sweep_t *s);
+
+// Number of points in the product (saturates at ULLONG_MAX).
+unsigned long long sweep_points(const sweep_t *s);
+
+// Writes a CSV header and one row per point to out: the swept values, then
+// each eval's result ("nan" where no solution exists).
+// Returns the number of rows; *unsolved counts results without a solution.
+// With EEE_CACHE_DIR set, a sweep that ran before (in any process) is
+// copied from the disk cache instead (see diskcache.h).
+unsigned long long sweep_run(sweep_t *s, FILE *out, unsigned long long *unsolved);
+
+// Parses a number with an optional SI prefix and unit ("4.7k", "100nF").
+// Returns 1 and sets *end past the number, or 0 if s is not a number.
+int sweep_parse_value(const char *s, double *out, const char **end);
+
+// Preferred-number series "E3" .. "E96": writes the values of one decade in
+// [1, 10) to out (room for 96) and returns how many, or 0 if name is unknown.
+int sweep_eseries(const char *name, double *out);
+
+// Command line: "main.out --sweep SCRIPT [out.csv]" (stdout if no file).
+int sweep_cli(int argc, char **argv);
+
+#endif
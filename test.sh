@@ -26,8 +26,13 @@ if [ ! -x ./main.out ]; then
 fi
 
 echo
-echo "Just checking the file compiled successfully, no further tests of functionality"
-echo "This is the only automated check, the rest of your project will be marked manually."
+echo "Running the behaviour tests..."
+if [ ! -x ./check.out ]; then
+  echo "Fail: ./check.out not found"
+  failed=1
+elif ! ./check.out; then
+  failed=1
+fi
 
 
 echo
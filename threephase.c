@@ -0,0 +1,158 @@
+// Three-phase power: phasor totals and streamed per-sample analysis.
+// Design notes:
+// Phasor totals sum the per-phase complex powers, and line or neutral
+// currents come from the current phasors placed at their phase's voltage
+// angle. Sample files are read POWER_CHUNK rows at a time into six columns
+// and reduced with 4-lane vectors into compensated running sums.
+
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include "threephase.h"
+#include "funcs.h"
+#include "stats.h"
+#include "vec4.h"
+
+#define PI 3.14159265358979323846
+
+// Totals for three phases. Phase voltages are assumed 120 degrees apart
+// (a = 0, b = -120, c = +120). star = 1: v is the phase (line-to-neutral)
+// voltage and the neutral current is the phasor sum of the three currents.
+// star = 0 (delta): v is the line voltage across each branch, i the branch
+// current; line currents are the differences of adjacent branch currents.
+void threephase_totals(const phase_in_t ph[3], int star,
+                       double *P, double *Q, double *S, double *In,
+                       double line_i[3])
+{
+    const double v_ang[3] = { 0.0, -120.0, 120.0 };
+    double ir[3], ii[3];
+
+    *P = *Q = 0.0;
+    for (int k = 0; k < 3; ++k) {
+        double phi = ph[k].phi * (PI / 180.0);
+        *P += ph[k].v * ph[k].i * cos(phi);
+        *Q += ph[k].v * ph[k].i * sin(phi);
+
+        double a = (v_ang[k] - ph[k].phi) * (PI / 180.0);
+        ir[k] = ph[k].i * cos(a);
+        ii[k] = ph[k].i * sin(a);
+    }
+    *S = hypot(*P, *Q);
+
+    if (star) {
+        *In = hypot(ir[0] + ir[1] + ir[2], ii[0] + ii[1] + ii[2]);
+        for (int k = 0; k < 3; ++k) line_i[k] = ph[k].i;
+    }
+    else {
+        // Branches ab, bc, ca: I_a = I_ab - I_ca, I_b = I_bc - I_ab, I_c = I_ca - I_bc
+        *In = 0.0;
+        for (int k = 0; k < 3; ++k) {
+            int prev = (k + 2) % 3;
+            line_i[k] = hypot(ir[k] - ir[prev], ii[k] - ii[prev]);
+        }
+    }
+}
+
+// Reduces one chunk: p = va ia + vb ib + vc ic, i_n = ia + ib + ic.
+// col[0..2] are the phase voltages, col[3..5] the phase currents.
+static void threephase_chunk(const double *const col[6], size_t n, tp_stats_t *acc)
+{
+    v4d sp = {0}, sin2 = {0}, sv2[3] = {{0}}, si2[3] = {{0}};
+    v4d pmax = { -HUGE_VAL, -HUGE_VAL, -HUGE_VAL, -HUGE_VAL };
+    v4d pmin = {  HUGE_VAL,  HUGE_VAL,  HUGE_VAL,  HUGE_VAL };
+    size_t k = 0;
+
+    for (; k + 4 <= n; k += 4) {
+        v4d v[3], i[3];
+        for (int ph = 0; ph < 3; ++ph) {
+            V4_LOAD(v[ph], col[ph] + k);
+            V4_LOAD(i[ph], col[3 + ph] + k);
+            sv2[ph] += v[ph] * v[ph];
+            si2[ph] += i[ph] * i[ph];
+        }
+        v4d p = v[0] * i[0] + v[1] * i[1] + v[2] * i[2];
+        v4d in = i[0] + i[1] + i[2];
+        sp += p;
+        sin2 += in * in;
+        pmax = V4_SELECT(p > pmax, p, pmax);
+        pmin = V4_SELECT(p < pmin, p, pmin);
+    }
+
+    double s_p = v4_hsum(&sp), s_in2 = v4_hsum(&sin2), s_v2[3], s_i2[3];
+    double p_mx = v4_hmax(&pmax), p_mn = v4_hmin(&pmin);
+    for (int ph = 0; ph < 3; ++ph) {
+        s_v2[ph] = v4_hsum(&sv2[ph]);
+        s_i2[ph] = v4_hsum(&si2[ph]);
+    }
+
+    for (; k < n; ++k) {
+        double p = 0.0, in = 0.0;
+        for (int ph = 0; ph < 3; ++ph) {
+            p += col[ph][k] * col[3 + ph][k];
+            in += col[3 + ph][k];
+            s_v2[ph] += col[ph][k] * col[ph][k];
+            s_i2[ph] += col[3 + ph][k] * col[3 + ph][k];
+        }
+        s_p += p;
+        s_in2 += in * in;
+        if (p > p_mx) p_mx = p;
+        if (p < p_mn) p_mn = p;
+    }
+
+    ksum_add(&acc->p, s_p);
+    ksum_add(&acc->in2, s_in2);
+    for (int ph = 0; ph < 3; ++ph) {
+        ksum_add(&acc->v2[ph], s_v2[ph]);
+        ksum_add(&acc->i2[ph], s_i2[ph]);
+    }
+    if (acc->n == 0 || p_mx > acc->p_max) acc->p_max = p_mx;
+    if (acc->n == 0 || p_mn < acc->p_min) acc->p_min = p_mn;
+    acc->n += (long long)n;
+}
+
+// Streams a va,vb,vc,ia,ib,ic sample file (an optional leading t column is
+// ignored) through threephase_chunk().
+// Returns 1 on success, 0 if the file cannot be opened.
+int threephase_file(const char *path, tp_stats_t *acc, long *skipped)
+{
+    STATS_SCOPE(STAT_THREEPHASE_FILE);
+    static double col[6][POWER_CHUNK];
+    const double *const cols[6] = { col[0], col[1], col[2], col[3], col[4], col[5] };
+
+    FILE *fp = fopen(path, "r");
+    if (!fp) return 0;
+
+    char line[256];
+    double f[7];
+    size_t n = 0;
+
+    memset(acc, 0, sizeof *acc);
+    *skipped = 0;
+    while (fgets(line, sizeof line, fp)) {
+        int nf = parse_fields(line, f, 7);
+        if (nf != 6 && nf != 7) { (*skipped)++; continue; }
+
+        for (int c = 0; c < 6; ++c) col[c][n] = f[nf - 6 + c];
+        if (++n == POWER_CHUNK) {
+            threephase_chunk(cols, n, acc);
+            n = 0;
+        }
+    }
+    if (n > 0) threephase_chunk(cols, n, acc);
+
+    fclose(fp);
+    return 1;
+}
+
+// Three-phase totals of va, vb, vc, ia, ib, ic samples (col[0..5]), a chunk
+// at a time as threephase_file() does. Returns the mean total power.
+double kernel_threephase(const double *const col[6], size_t n)
+{
+    tp_stats_t acc;
+    memset(&acc, 0, sizeof acc);
+    for (size_t k = 0; k < n; k += POWER_CHUNK) {
+        const double *const part[6] = { col[0] + k, col[1] + k, col[2] + k, col[3] + k, col[4] + k, col[5] + k };
+        threephase_chunk(part, n - k < POWER_CHUNK ? n - k : POWER_CHUNK, &acc);
+    }
+    return acc.n ? ksum_value(&acc.p) / (double)acc.n : NAN;
+}
@@ -0,0 +1,40 @@
+// Three-phase power for the EEE Helper CLI calculator (menu 5).
+// Star and delta totals from per-phase phasors (P, Q, S, neutral or line
+// currents), and the same quantities streamed from va..vc, ia..ic samples.
+
+#ifndef THREEPHASE_H
+#define THREEPHASE_H
+
+#include <stddef.h>
+#include "power.h"
+
+// Per-phase phasor inputs: rms voltage, rms current and the angle phi by which
+// the current lags the voltage (degrees).
+typedef struct {
+    double v, i, phi;
+} phase_in_t;
+
+// Totals for three phases 120 degrees apart. star = 1: v is the phase voltage
+// and *In the neutral current. star = 0 (delta): v is the line voltage across
+// each branch, i the branch current, and line_i the line currents.
+void threephase_totals(const phase_in_t ph[3], int star,
+                       double *P, double *Q, double *S, double *In,
+                       double line_i[3]);
+
+// Running totals for instantaneous star-connected samples (va..vc, ia..ic).
+typedef struct {
+    long long n;
+    ksum_t p, v2[3], i2[3], in2;
+    double p_max, p_min;
+} tp_stats_t;
+
+// Streams a va,vb,vc,ia,ib,ic sample file (an optional leading t column is
+// ignored) into *acc. Lines that do not parse are counted in *skipped.
+// Returns 1 on success, 0 if the file cannot be opened.
+int threephase_file(const char *path, tp_stats_t *acc, long *skipped);
+
+// Three-phase totals of samples in memory (col[0..5] = va..vc, ia..ic; timed
+// by bench.out). Returns the mean total power, NAN if n = 0.
+double kernel_threephase(const double *const col[6], size_t n);
+
+#endif
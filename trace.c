@@ -0,0 +1,158 @@
+// Chrome trace export.
+// Design notes:
+// Every thread appends events (probe, start and end tick: 24 bytes) to its
+// own list of fixed-size blocks, so recording never locks and never moves
+// what is already recorded; a thread's list is published on a global list
+// with a compare-and-swap when it records its first event. At most
+// TRACE_MAX_BLOCKS blocks per thread are kept; later events are counted as
+// dropped, and the count is written into the trace.
+// At exit the events become "complete" (ph "X") events, timestamps in
+// microseconds since trace_start, converted from ticks with the rate that
+// the statistics measure.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include "trace.h"
+#include "stats.h"
+
+#define TRACE_BLOCK      65536          // events per block
+#define TRACE_MAX_BLOCKS 64             // per thread: 4M events, 96 MB
+
+int trace_enabled;
+
+#ifndef EEE_NO_STATS
+
+typedef struct {
+    uint64_t t0, t1;
+    uint32_t probe;
+} trace_ev_t;
+
+typedef struct trace_block {
+    struct trace_block *next;
+    size_t n;
+    trace_ev_t ev[TRACE_BLOCK];
+} trace_block_t;
+
+typedef struct trace_thread {
+    struct trace_thread *next;
+    long tid;
+    trace_block_t *first, *last;
+    int nblocks;
+    unsigned long long dropped;
+} trace_thread_t;
+
+static const char *const TRACE_NAMES[STAT_COUNT] = {
+#define TRACE_NAME(id, name, cat) name,
+    STATS_PROBES(TRACE_NAME)
+#undef TRACE_NAME
+};
+
+static const char *const TRACE_CATS[STAT_COUNT] = {
+#define TRACE_CAT(id, name, cat) cat,
+    STATS_PROBES(TRACE_CAT)
+#undef TRACE_CAT
+};
+
+static trace_thread_t *trace_all;
+static __thread trace_thread_t *trace_mine;
+static FILE *trace_fp;
+static char trace_path[512];
+static uint64_t trace_t0;
+
+void trace_add(int probe, uint64_t t0, uint64_t t1)
+{
+    if (!TRACE_CATS[probe][0]) return;
+
+    trace_thread_t *th = trace_mine;
+    if (!th) {
+        if (!(th = calloc(1, sizeof *th))) return;
+        th->tid = (long)syscall(SYS_gettid);
+        th->next = __atomic_load_n(&trace_all, __ATOMIC_RELAXED);
+        while (!__atomic_compare_exchange_n(&trace_all, &th->next, th, 1, __ATOMIC_RELEASE, __ATOMIC_RELAXED)) { }
+        trace_mine = th;
+    }
+
+    trace_block_t *b = th->last;
+    if (!b || b->n == TRACE_BLOCK) {
+        if (th->nblocks == TRACE_MAX_BLOCKS || !(b = malloc(sizeof *b))) { th->dropped++; return; }
+        b->next = NULL;
+        b->n = 0;
+        if (th->last) th->last->next = b;
+        else th->first = b;
+        th->last = b;
+        th->nblocks++;
+    }
+    b->ev[b->n++] = (trace_ev_t){ t0, t1, (uint32_t)probe };
+}
+
+static void trace_write(void)
+{
+    trace_enabled = 0;
+    double us = 1e-3 / stats_ticks_per_ns();
+    long pid = (long)getpid();
+    unsigned long long events = 0, dropped = 0;
+    FILE *fp = trace_fp;
+
+    fprintf(fp, "{\"traceEvents\":[\n");
+    fprintf(fp, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%ld,\"tid\":%ld,\"args\":{\"name\":\"eee\"}}",
+            pid, pid);
+    for (trace_thread_t *th = __atomic_load_n(&trace_all, __ATOMIC_ACQUIRE); th; th = th->next) {
+        fprintf(fp, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%ld,\"tid\":%ld,\"args\":{\"name\":\"%s\"}}",
+                pid, th->tid, th->tid == pid ? "main" : "worker");
+        for (trace_block_t *b = th->first, *next; b; b = next) {
+            for (size_t k = 0; k < b->n; ++k) {
+                const trace_ev_t *e = &b->ev[k];
+                // Events from before trace_start (none, normally) start at 0.
+                double ts = e->t0 > trace_t0 ? (double)(e->t0 - trace_t0) * us : 0.0;
+                fprintf(fp, ",\n{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,"
+                            "\"pid\":%ld,\"tid\":%ld}",
+                        TRACE_NAMES[e->probe], TRACE_CATS[e->probe], ts, (double)(e->t1 - e->t0) * us,
+                        pid, th->tid);
+            }
+            events += b->n;
+            next = b->next;
+            free(b);
+        }
+        dropped += th->dropped;
+    }
+    fprintf(fp, "\n],\"displayTimeUnit\":\"ns\",\"otherData\":{\"events\":%llu,\"dropped\":%llu}}\n",
+            events, dropped);
+    if (fclose(fp) != 0) printf("Error: cannot write trace '%s'.\n", trace_path);
+    else printf("Trace: %llu event(s) written to %s%s\n", events, trace_path, dropped ? " (some dropped: buffers full)" : "");
+    trace_fp = NULL;
+}
+
+int trace_start(const char *path)
+{
+    if (trace_fp) return 0;
+    if (!(trace_fp = fopen(path, "w"))) {
+        printf("Error: cannot create trace '%s'.\n", path);
+        return -1;
+    }
+    snprintf(trace_path, sizeof trace_path, "%s", path);
+    trace_t0 = stats_ticks();
+    trace_enabled = 1;
+    atexit(trace_write);
+    return 0;
+}
+
+#else
+
+void trace_add(int probe, uint64_t t0, uint64_t t1)
+{
+    (void)probe;
+    (void)t0;
+    (void)t1;
+}
+
+int trace_start(const char *path)
+{
+    (void)path;
+    printf("Error: tracing was compiled out (built with -DEEE_NO_STATS).\n");
+    return -1;
+}
+
+#endif
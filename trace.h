@@ -0,0 +1,28 @@
+// Timeline traces for the EEE Helper CLI calculator.
+// "main.out --trace FILE ..." (in front of any other arguments, or alone
+// for the menu) records every instrumented scope (stats.h) as it ends, with
+// its start and end time, and at exit writes them as Chrome trace JSON.
+// Open the file in Perfetto (ui.perfetto.dev) or chrome://tracing to see,
+// per thread, where a batch or server run spends its time: parse, compute,
+// format, log writes, and servers waiting for work (queue-wait).
+//
+// Scopes that run once per row (single solves, field parsing) are counted
+// but not traced, so a 10^7-row batch file gives a few thousand events per
+// phase rather than tens of millions. Tracing is part of the statistics
+// and compiles out with them (-DEEE_NO_STATS).
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdint.h>
+
+extern int trace_enabled;
+
+// Starts recording; the file is created now and written at exit.
+// Returns 0, or -1 (with a message printed) if it cannot be.
+int trace_start(const char *path);
+
+// One finished scope, in stats_ticks() (called by stats_record).
+void trace_add(int probe, uint64_t t0, uint64_t t1);
+
+#endif
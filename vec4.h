@@ -0,0 +1,59 @@
+// 4-lane double vectors for the sample-file kernels of the EEE Helper CLI
+// calculator (power.c, fft.c, threephase.c, fit.c).
+// GCC/Clang vector extensions: the compiler maps these onto SSE2/AVX
+// registers where available and plain scalar code otherwise. Helpers are
+// macros / pointer-taking functions so no vector is passed by value.
+
+#ifndef VEC4_H
+#define VEC4_H
+
+#include <string.h>
+#include <limits.h>
+#include <math.h>
+
+typedef double    v4d __attribute__((vector_size(32)));
+typedef long long v4i __attribute__((vector_size(32)));
+
+#define V4_LOAD(dst, p)        memcpy(&(dst), (p), sizeof(v4d))
+#define V4_STORE(p, src)       memcpy((p), &(src), sizeof(v4d))
+#define V4_ABS(x)              ((v4d)((v4i)(x) & (v4i){ LLONG_MAX, LLONG_MAX, LLONG_MAX, LLONG_MAX }))
+#define V4_SELECT(m, a, b)     ((v4d)(((v4i)(a) & (m)) | ((v4i)(b) & ~(m))))
+
+static inline double v4_hsum(const v4d *x) { return ((*x)[0] + (*x)[1]) + ((*x)[2] + (*x)[3]); }
+static inline double v4_hmax(const v4d *x) { return fmax(fmax((*x)[0], (*x)[1]), fmax((*x)[2], (*x)[3])); }
+static inline double v4_hmin(const v4d *x) { return fmin(fmin((*x)[0], (*x)[1]), fmin((*x)[2], (*x)[3])); }
+
+// e^x in each lane: x = k ln2 + r with |r| <= ln2 / 2, e^r from its Taylor
+// series to r^12 (within 3 ulp of exp()) and 2^k written straight into the
+// exponent bits. Lanes below -708 give 0; lanes above 709 are clamped.
+static inline void v4_exp(v4d *out, const v4d *x)
+{
+    const v4d lo = { -708.0, -708.0, -708.0, -708.0 }, hi = { 709.0, 709.0, 709.0, 709.0 };
+    v4d xc = V4_SELECT(*x > hi, hi, *x);
+    v4i under = xc < lo;
+    xc = V4_SELECT(under, lo, xc);
+
+    // Adding 1.5 * 2^52 rounds x / ln2 to an integer k held in the low bits.
+    v4d kb = xc * 1.4426950408889634 + 0x1.8p52;
+    v4d kd = kb - 0x1.8p52;
+    v4d r = (xc - kd * 6.93147180369123816490e-01) - kd * 1.90821492927058770002e-10;
+
+    v4d p = r * (1.0 / 479001600.0) + 1.0 / 39916800.0;
+    p = p * r + 1.0 / 3628800.0;
+    p = p * r + 1.0 / 362880.0;
+    p = p * r + 1.0 / 40320.0;
+    p = p * r + 1.0 / 5040.0;
+    p = p * r + 1.0 / 720.0;
+    p = p * r + 1.0 / 120.0;
+    p = p * r + 1.0 / 24.0;
+    p = p * r + 1.0 / 6.0;
+    p = p * r + 0.5;
+    p = p * r + 1.0;
+    p = p * r + 1.0;
+
+    v4d scale = (v4d)(((v4i)kb + 1023) << 52);
+    v4d e = p * scale;
+    *out = V4_SELECT(under, (v4d){0}, e);
+}
+
+#endif
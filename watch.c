@@ -0,0 +1,420 @@
+// Incremental batch solves driven by inotify.
+// Design notes:
+// The previous version of the input is remembered as a copy of its text and,
+// per data row, its offset, length, 64-bit hash and result. On a change the
+// new input is mapped and hashed line by line (8 bytes per step); a row whose
+// hash and text match the row at the same position is done (the hash only
+// decides which rows are worth comparing). Any other row is parsed, and its
+// result is taken from the previous version if the same text was anywhere in
+// it (rows that moved because a line was inserted above them), or solved
+// otherwise. Changed rows are formatted into fixed-width lines and written
+// with pwrite() at their own offset, runs of adjacent rows in one call; the
+// file is truncated if rows were removed. After a failed update the output
+// is cut back to its header, and the next update writes every row.
+// The directory is watched rather than the file, so editors that save by
+// writing a new file and renaming it over the old one are followed too.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <math.h>
+#include <time.h>
+#include <signal.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/inotify.h>
+#include "watch.h"
+#include "funcs.h"
+#include "memo.h"
+
+#define WATCH_FIELD 16                  // "%16.9g"
+#define WATCH_BUF   (256 * 1024)
+
+typedef struct {
+    const formula_t *fm;
+    int var;
+    int fd;                             // output file
+    off_t hdr;                          // header length
+    size_t width;                       // bytes per output row
+
+    char *text;                         // the current version's input
+    size_t tlen, tcap;
+
+    uint64_t *hash;                     // per data row of the current version
+    double *res;
+    size_t *off, *len;                  // where the row is in text
+    size_t n, cap;
+
+    uint64_t *nhash;                    // the version being built
+    double *nres;
+    size_t *noff, *nlen;
+    size_t ncap;
+
+    uint64_t *mkey;                     // previous version by row text (0 = empty)
+    size_t *mrow;                       // the row with that text
+    size_t mcap;
+
+    char *buf;                          // pending run of adjacent rows
+    size_t blen;
+    off_t boff;
+} watch_t;
+
+typedef struct {
+    size_t rows, changed, solved, reused, skipped;
+} watch_stats_t;
+
+static volatile sig_atomic_t watch_stop;
+
+static void watch_signal(int sig)
+{
+    (void)sig;
+    watch_stop = 1;
+}
+
+static uint64_t row_hash(const char *p, size_t n)
+{
+    uint64_t h = 0x9E3779B97F4A7C15ull ^ n, w;
+    for (; n >= 8; p += 8, n -= 8) {
+        memcpy(&w, p, 8);
+        h = (h ^ w) * 0xFF51AFD7ED558CCDull;
+        h ^= h >> 29;
+    }
+    w = 0;
+    memcpy(&w, p, n);
+    h = (h ^ w) * 0xC4CEB9FE1A85EC53ull;
+    h ^= h >> 32;
+    return h ? h : 1;
+}
+
+// Exactly fm->nvars - 1 numbers separated by commas, semicolons or blanks.
+static int parse_row(const char *p, const char *end, double *out, int want)
+{
+    char tmp[64];
+    int n = 0;
+    for (;;) {
+        while (p < end && strchr(" \t,;\r", *p)) p++;
+        if (p == end) break;
+        const char *q = p;
+        while (q < end && !strchr(" \t,;\r", *q)) q++;
+        if (n == want || (size_t)(q - p) >= sizeof tmp) return 0;
+        memcpy(tmp, p, (size_t)(q - p));
+        tmp[q - p] = '\0';
+
+        errno = 0;
+        char *e = NULL;
+        out[n] = strtod(tmp, &e);
+        if (e == tmp || *e != '\0' || errno == ERANGE) return 0;
+        n++;
+        p = q;
+    }
+    return n == want;
+}
+
+static int watch_flush(watch_t *w)
+{
+    if (w->blen == 0) return 0;
+    ssize_t got = pwrite(w->fd, w->buf, w->blen, w->boff);
+    w->blen = 0;
+    return got < 0 ? -1 : 0;
+}
+
+static void watch_put_row(watch_t *w, size_t k, const double *v)
+{
+    off_t off = w->hdr + (off_t)(k * w->width);
+    if (w->blen > 0 && (w->boff + (off_t)w->blen != off || w->blen + w->width > WATCH_BUF)) watch_flush(w);
+    if (w->blen == 0) w->boff = off;
+
+    char *p = w->buf + w->blen;
+    for (int j = 0; j < w->fm->nvars; ++j) {
+        char field[32];
+        snprintf(field, sizeof field, "%*.9g", WATCH_FIELD, v[j]);
+        memcpy(p, field, WATCH_FIELD);
+        p[WATCH_FIELD] = j + 1 < w->fm->nvars ? ',' : '\n';
+        p += WATCH_FIELD + 1;
+    }
+    w->blen += w->width;
+}
+
+// 1 if row k of the current version has hash h and text p[0..n).
+static int watch_same(const watch_t *w, size_t k, uint64_t h, const char *p, size_t n)
+{
+    return w->hash[k] == h && w->len[k] == n && memcmp(w->text + w->off[k], p, n) == 0;
+}
+
+// Indexes the current version by row text.
+static int watch_index(watch_t *w)
+{
+    size_t cap = 64;
+    while (cap < 2 * w->n) cap <<= 1;
+    if (cap > w->mcap) {
+        uint64_t *key = realloc(w->mkey, cap * sizeof *key);
+        if (key) w->mkey = key;
+        size_t *row = realloc(w->mrow, cap * sizeof *row);
+        if (row) w->mrow = row;
+        if (!key || !row) return -1;
+        w->mcap = cap;
+    }
+    memset(w->mkey, 0, w->mcap * sizeof *w->mkey);
+    for (size_t k = 0; k < w->n; ++k) {
+        size_t i = w->hash[k] & (w->mcap - 1);
+        while (w->mkey[i] && !watch_same(w, w->mrow[i], w->hash[k], w->text + w->off[k], w->len[k]))
+            i = (i + 1) & (w->mcap - 1);
+        w->mkey[i] = w->hash[k];
+        w->mrow[i] = k;
+    }
+    return 0;
+}
+
+static int watch_lookup(const watch_t *w, uint64_t h, const char *p, size_t n, double *res)
+{
+    for (size_t i = h & (w->mcap - 1); w->mkey[i]; i = (i + 1) & (w->mcap - 1))
+        if (w->mkey[i] == h && watch_same(w, w->mrow[i], h, p, n)) { *res = w->res[w->mrow[i]]; return 1; }
+    return 0;
+}
+
+// Grows the arrays of the version being built. Returns 0, or -1 if out of memory.
+static int watch_grow(watch_t *w)
+{
+    size_t cap = w->ncap ? 2 * w->ncap : 4096;
+    uint64_t *nh = realloc(w->nhash, cap * sizeof *nh);
+    if (nh) w->nhash = nh;
+    double *nr = realloc(w->nres, cap * sizeof *nr);
+    if (nr) w->nres = nr;
+    size_t *no = realloc(w->noff, cap * sizeof *no);
+    if (no) w->noff = no;
+    size_t *nl = realloc(w->nlen, cap * sizeof *nl);
+    if (nl) w->nlen = nl;
+    if (!nh || !nr || !no || !nl) return -1;
+    w->ncap = cap;
+    return 0;
+}
+
+// Brings the output up to date with the input. Returns 0, or -1 on errors.
+static int watch_update(watch_t *w, const char *in_path, watch_stats_t *st)
+{
+    memset(st, 0, sizeof *st);
+    int fd = open(in_path, O_RDONLY);
+    if (fd < 0) return -1;
+    struct stat sb;
+    if (fstat(fd, &sb) != 0) { close(fd); return -1; }
+    size_t size = (size_t)sb.st_size;
+    const char *map = size ? mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0) : NULL;
+    close(fd);
+    if (map == MAP_FAILED) return -1;
+
+    const formula_t *fm = w->fm;
+    int indexed = 0, failed = 0;
+    size_t k = 0;
+    for (const char *p = map, *end = map + size; p < end && !failed;) {
+        const char *nl = memchr(p, '\n', (size_t)(end - p));
+        const char *eol = nl ? nl : end;
+        const char *next = nl ? nl + 1 : end;
+        size_t rl = (size_t)(eol - p);
+        uint64_t h = row_hash(p, rl);
+
+        if (k == w->ncap && watch_grow(w) != 0) { failed = 1; break; }
+        w->noff[k] = (size_t)(p - map);
+        w->nlen[k] = rl;
+
+        if (k < w->n && watch_same(w, k, h, p, rl)) {
+            w->nhash[k] = h;
+            w->nres[k] = w->res[k];
+            k++;
+            p = next;
+            continue;
+        }
+
+        double f[FORMULA_MAX_VARS], v[FORMULA_MAX_VARS] = {0};
+        if (!parse_row(p, eol, f, fm->nvars - 1)) { st->skipped++; p = next; continue; }
+        for (int j = 0, c = 0; j < fm->nvars; ++j)
+            if (j != w->var) v[j] = f[c++];
+
+        if (!indexed) { failed = watch_index(w) != 0; indexed = 1; }
+        double r;
+        if (!failed && watch_lookup(w, h, p, rl, &r)) {
+            v[w->var] = r;
+            st->reused++;
+        }
+        else {
+            int cf, bad;
+            if (memo_solve(fm, w->var, v, 0.0, &bad, &cf) != MEMO_OK) v[w->var] = NAN;
+            st->solved++;
+        }
+        w->nhash[k] = h;
+        w->nres[k] = v[w->var];
+        watch_put_row(w, k++, v);
+        st->changed++;
+        p = next;
+    }
+    // Keep this version's text for the next comparison.
+    if (!failed && size > w->tcap) {
+        char *t = realloc(w->text, size);
+        if (t) { w->text = t; w->tcap = size; }
+        else failed = 1;
+    }
+    if (!failed && size) memcpy(w->text, map, size);
+    if (map) munmap((void *)map, size);
+
+    if (watch_flush(w) != 0 || failed ||
+        (k < w->n && ftruncate(w->fd, w->hdr + (off_t)(k * w->width)) != 0)) {
+        // Output state unknown: keep only the header and rewrite every row next time.
+        int cut = ftruncate(w->fd, w->hdr);    // best effort, the update has failed anyway
+        (void)cut;
+        w->n = 0;
+        return -1;
+    }
+
+    w->tlen = size;
+    uint64_t *th = w->hash; w->hash = w->nhash; w->nhash = th;
+    double *tr = w->res; w->res = w->nres; w->nres = tr;
+    size_t *to = w->off; w->off = w->noff; w->noff = to;
+    size_t *tl = w->len; w->len = w->nlen; w->nlen = tl;
+    size_t tc = w->cap; w->cap = w->ncap; w->ncap = tc;
+    st->changed += w->n > k ? w->n - k : 0;    // removed rows count as changes
+    w->n = k;
+    st->rows = k;
+    return 0;
+}
+
+static double since_ms(const struct timespec *t0)
+{
+    struct timespec t1;
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    return (double)(t1.tv_sec - t0->tv_sec) * 1e3 + (t1.tv_nsec - t0->tv_nsec) * 1e-6;
+}
+
+int watch_run(const formula_t *fm, int var, const char *in_path, const char *out_path)
+{
+    watch_t w;
+    memset(&w, 0, sizeof w);
+    w.fm = fm;
+    w.var = var;
+    w.width = (size_t)fm->nvars * (WATCH_FIELD + 1);
+    w.buf = malloc(WATCH_BUF);
+    w.fd = open(out_path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (!w.buf || w.fd < 0) {
+        printf("Error: cannot create '%s'.\n", out_path);
+        free(w.buf);
+        if (w.fd >= 0) close(w.fd);
+        return -1;
+    }
+
+    char hdr[FORMULA_MAX_VARS * (WATCH_FIELD + 1) + 1];
+    size_t hl = 0;
+    for (int j = 0; j < fm->nvars; ++j)
+        hl += (size_t)snprintf(hdr + hl, sizeof hdr - hl, "%*s%c", WATCH_FIELD, fm->vars[j].name,
+                               j + 1 < fm->nvars ? ',' : '\n');
+    w.hdr = (off_t)hl;
+    int ok = pwrite(w.fd, hdr, hl, 0) == (ssize_t)hl;
+
+    // Watch the directory: saving may replace the file rather than rewrite it.
+    char dir[512];
+    const char *slash = strrchr(in_path, '/');
+    const char *base = slash ? slash + 1 : in_path;
+    snprintf(dir, sizeof dir, "%.*s", slash ? (int)(slash - in_path) + (slash == in_path) : 1, slash ? in_path : ".");
+    int ifd = inotify_init1(IN_CLOEXEC);
+    if (!ok || ifd < 0 || inotify_add_watch(ifd, dir, IN_CLOSE_WRITE | IN_MOVED_TO) < 0) {
+        printf("Error: cannot watch '%s': %s.\n", dir, strerror(errno));
+        if (ifd >= 0) close(ifd);
+        close(w.fd);
+        free(w.buf);
+        return -1;
+    }
+
+    struct sigaction sa;
+    memset(&sa, 0, sizeof sa);
+    sa.sa_handler = watch_signal;       // no SA_RESTART: interrupts read()
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+    watch_stop = 0;
+
+    watch_stats_t st;
+    struct timespec t0;
+    unsigned long long updates = 0, solved = 0;
+    int rc = 0;
+
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    if (watch_update(&w, in_path, &st) != 0) {
+        printf("Error: cannot read '%s' or write '%s'.\n", in_path, out_path);
+        rc = -1;
+        watch_stop = 1;
+    }
+    else {
+        printf("%zu row(s) solved into %s in %.1f ms", st.rows, out_path, since_ms(&t0));
+        if (st.skipped) printf(" (%zu line(s) skipped)", st.skipped);
+        printf("\nWatching %s for changes (Ctrl+C to stop)\n", in_path);
+        solved += st.solved;
+    }
+    fflush(stdout);
+
+    char ev[64 * (sizeof(struct inotify_event) + 256)] __attribute__((aligned(8)));
+    while (!watch_stop) {
+        ssize_t len = read(ifd, ev, sizeof ev);
+        if (len < 0) {
+            if (errno == EINTR) continue;
+            printf("Error: inotify: %s.\n", strerror(errno));
+            rc = -1;
+            break;
+        }
+
+        int hit = 0;
+        for (char *p = ev; p < ev + len;) {
+            const struct inotify_event *e = (const struct inotify_event *)p;
+            if (e->len && strcmp(e->name, base) == 0) hit = 1;
+            p += sizeof *e + e->len;
+        }
+        if (!hit) continue;
+
+        clock_gettime(CLOCK_MONOTONIC, &t0);
+        if (watch_update(&w, in_path, &st) != 0) {
+            printf("Error: cannot read '%s' or update '%s'.\n", in_path, out_path);
+            fflush(stdout);
+            continue;
+        }
+        updates++;
+        solved += st.solved;
+        printf("Update: %zu row(s), %zu changed, %zu solved, %zu reused, in %.2f ms",
+               st.rows, st.changed, st.solved, st.reused, since_ms(&t0));
+        if (st.skipped) printf(" (%zu line(s) skipped)", st.skipped);
+        printf("\n");
+        fflush(stdout);
+    }
+
+    close(ifd);
+    close(w.fd);
+    free(w.buf);
+    free(w.text);
+    free(w.hash);
+    free(w.res);
+    free(w.off);
+    free(w.len);
+    free(w.nhash);
+    free(w.nres);
+    free(w.noff);
+    free(w.nlen);
+    free(w.mkey);
+    free(w.mrow);
+
+    char line[256];
+    snprintf(line, sizeof line, "Watch: %s %s, %.80s -> %.80s, updates=%llu, solved=%llu",
+             fm->name, fm->vars[var].name, in_path, out_path, updates, solved);
+    log_line(line);
+    return rc;
+}
+
+int watch_cli(int argc, char **argv)
+{
+    if (argc != 6) {
+        printf("Usage: %s --watch FORMULA VAR in.csv out.csv\n", argv[0]);
+        return 1;
+    }
+    const formula_t *fm = formula_find(argv[2]);
+    if (!fm) { printf("Error: unknown formula '%s' (try --list).\n", argv[2]); return 1; }
+    int var = formula_var_index(fm, argv[3]);
+    if (var < 0) { printf("Error: %s has no variable '%s'.\n", fm->name, argv[3]); return 1; }
+    return watch_run(fm, var, argv[4], argv[5]) == 0 ? 0 : 1;
+}
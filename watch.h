@@ -0,0 +1,24 @@
+// Watch mode for batch solves in the EEE Helper CLI calculator.
+// "main.out --watch FORMULA VAR in.csv out.csv" solves a CSV of cases like
+// the formula solver's batch mode (menu 8), then keeps running. Whenever
+// in.csv is saved again, only rows whose text changed are solved again,
+// and only their lines in out.csv are rewritten, in place.
+//
+// To make that possible every output line has the same width: each value
+// is right-aligned in a 16-character field ("%16.9g"). Rows are solved
+// independently (no warm start from the previous row), so a row's result
+// depends only on its own text.
+
+#ifndef WATCH_H
+#define WATCH_H
+
+#include "formulas.h"
+
+// Solves in_path into out_path, then follows changes to in_path until
+// SIGINT or SIGTERM. Returns 0, or -1 if a file cannot be used.
+int watch_run(const formula_t *fm, int var, const char *in_path, const char *out_path);
+
+// Command line: "main.out --watch FORMULA VAR in.csv out.csv".
+int watch_cli(int argc, char **argv);
+
+#endif
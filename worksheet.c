@@ -0,0 +1,643 @@
+// Worksheet cells and incremental recomputation.
+// Design notes:
+// Cells live in one growable array and are referred to by index; their
+// values sit in a separate array that compiled formulas (expr_scalar_t)
+// read directly. Each formula keeps the cells it reads (in) and each cell
+// the formulas that read it (out), so the dependency graph is walked
+// forwards from an edited cell without ever scanning the whole sheet.
+// Every cell has a level above all the cells it reads, so recomputing in
+// level order is a topological order. An edit computes the cell; a cell
+// whose value changed (bit for bit) marks its readers dirty and pushes them
+// on a min-heap by level, and dirty cells are recomputed as they come off
+// it. So every affected cell is computed once, after all its inputs, and an
+// unchanged result stops the update: an edit touches only the cells whose
+// inputs actually changed, never the rest of the sheet.
+// A new formula can only close a cycle through an input above the cell, and
+// the search for it never climbs above that input's level. Levels are only
+// ever raised, when a formula gains a higher input.
+// Walks are iterative, so a chain of 10^5 cells does not grow the C stack.
+// An image (ws_image_write) is the cell array, values, name index, texts,
+// compiled formulas and edge lists, with every pointer already set for the
+// address the image will be mapped at; ws_image_open uses it in place, after
+// one relocation pass only if it landed somewhere else. Memory inside the
+// image is never freed or realloc'd: the first change that needs to grow an
+// array copies it out.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <ctype.h>
+#include <math.h>
+#include "worksheet.h"
+#include "expr.h"
+#include "sweep.h"
+#include "stats.h"
+
+#define WS_MAX_NAME 32
+#define WS_MAX_PENDING 32               // new names one formula may introduce
+
+typedef struct {
+    char name[WS_MAX_NAME];
+    int kind;
+    char *text;
+    expr_scalar_t *expr;
+    int *in, nin;                       // cells this formula reads
+    int *out, nout, capout;             // formulas that read this cell
+    int level;                          // above every cell it reads
+    unsigned mark;                      // walk that last reached this cell
+    int dirty;                          // waiting in the heap
+} ws_cell_t;
+
+struct worksheet {
+    ws_cell_t *cells;
+    double *val;
+    int n, cap;
+    int *index;                         // name hash table: cell + 1, 0 = empty
+    size_t index_cap;
+    unsigned epoch;
+    int *stack, *next;                  // walk state
+    int *heap, nheap;                   // dirty cells
+    int *update;                        // cells computed by the last edit
+    size_t nupdate;
+    const char *image;                  // mapped image in use, if any
+    size_t image_len;
+};
+
+// Compile-time name lookup for one edit. Names that are not cells yet (the
+// cell being defined, then any others the formula mentions) get the next
+// free indices and are only created once the edit is accepted.
+typedef struct {
+    worksheet_t *ws;
+    const char *name;                   // cell being defined
+    int self;                           // its index (ws->n if it is new)
+    int base;                           // index of the first pending name
+    char pending[WS_MAX_PENDING][WS_MAX_NAME];
+    int npending;
+    int deps[EXPR_MAX_VARS];
+    int ndeps;
+} ws_resolve_t;
+
+worksheet_t *ws_new(void)
+{
+    return calloc(1, sizeof(worksheet_t));
+}
+
+static int in_image(const worksheet_t *ws, const void *p)
+{
+    return (uintptr_t)p - (uintptr_t)ws->image < ws->image_len;
+}
+
+static void ws_release(const worksheet_t *ws, void *p)
+{
+    if (!in_image(ws, p)) free(p);
+}
+
+// realloc() for arrays that may still be in the image (`used` bytes kept).
+static void *ws_realloc(const worksheet_t *ws, void *p, size_t used, size_t size)
+{
+    if (!in_image(ws, p)) return realloc(p, size);
+    void *q = malloc(size);
+    if (q) memcpy(q, p, used);
+    return q;
+}
+
+void ws_free(worksheet_t *ws)
+{
+    if (!ws) return;
+    for (int c = 0; c < ws->n; ++c) {
+        ws_release(ws, ws->cells[c].text);
+        ws_release(ws, ws->cells[c].expr);
+        ws_release(ws, ws->cells[c].in);
+        ws_release(ws, ws->cells[c].out);
+    }
+    ws_release(ws, ws->cells);
+    ws_release(ws, ws->val);
+    ws_release(ws, ws->index);
+    free(ws->heap);
+    free(ws->stack);
+    free(ws->next);
+    free(ws->update);
+    free(ws);
+}
+
+// ------------------------------ NAMES ------------------------------
+
+static size_t name_hash(const char *s)
+{
+    size_t h = 2166136261u;
+    while (*s) h = (h ^ (unsigned char)*s++) * 16777619u;
+    return h;
+}
+
+int ws_find(const worksheet_t *ws, const char *name)
+{
+    if (!ws->index_cap) return -1;
+    for (size_t i = name_hash(name) & (ws->index_cap - 1);; i = (i + 1) & (ws->index_cap - 1)) {
+        int c = ws->index[i] - 1;
+        if (c < 0) return -1;
+        if (strcmp(ws->cells[c].name, name) == 0) return c;
+    }
+}
+
+static void index_put(worksheet_t *ws, int c)
+{
+    size_t i = name_hash(ws->cells[c].name) & (ws->index_cap - 1);
+    while (ws->index[i]) i = (i + 1) & (ws->index_cap - 1);
+    ws->index[i] = c + 1;
+}
+
+static int valid_name(const char *s)
+{
+    size_t n = strlen(s);
+    if (n == 0 || n >= WS_MAX_NAME || !(isalpha((unsigned char)s[0]) || s[0] == '_')) return 0;
+    for (size_t k = 1; k < n; ++k)
+        if (!isalnum((unsigned char)s[k]) && s[k] != '_') return 0;
+    return strcmp(s, "PI") != 0 && strcmp(s, "pi") != 0;
+}
+
+// Makes room for `more` more cells. Returns 0, or -1 if out of memory.
+static int ws_reserve(worksheet_t *ws, int more)
+{
+    if (ws->n + more <= ws->cap) return 0;
+    // Not 2 * ws->cap: a loaded snapshot's cap is its cell count, and the
+    // name index needs a power-of-two size.
+    int cap = 64;
+    while (cap < ws->n + more) cap *= 2;
+
+    ws_cell_t *cells = ws_realloc(ws, ws->cells, (size_t)ws->n * sizeof *cells, (size_t)cap * sizeof *cells);
+    if (cells) ws->cells = cells;
+    double *val = ws_realloc(ws, ws->val, (size_t)ws->n * sizeof *val, (size_t)cap * sizeof *val);
+    if (val) ws->val = val;
+    int *heap = realloc(ws->heap, (size_t)cap * sizeof *heap);
+    if (heap) ws->heap = heap;
+    int *stack = realloc(ws->stack, (size_t)cap * sizeof *stack);
+    if (stack) ws->stack = stack;
+    int *next = realloc(ws->next, (size_t)cap * sizeof *next);
+    if (next) ws->next = next;
+    int *update = realloc(ws->update, (size_t)cap * sizeof *update);
+    if (update) ws->update = update;
+    int *index = calloc((size_t)cap * 2, sizeof *index);
+    if (!cells || !val || !heap || !stack || !next || !update || !index) { free(index); return -1; }
+
+    ws_release(ws, ws->index);
+    ws->index = index;
+    ws->index_cap = (size_t)cap * 2;
+    ws->cap = cap;
+    for (int c = 0; c < ws->n; ++c) index_put(ws, c);
+    return 0;
+}
+
+// Adds an undefined cell; ws_reserve must have made room for it.
+static int ws_add(worksheet_t *ws, const char *name)
+{
+    int c = ws->n++;
+    ws_cell_t *cell = &ws->cells[c];
+    memset(cell, 0, sizeof *cell);
+    snprintf(cell->name, sizeof cell->name, "%s", name);
+    cell->kind = WS_UNDEFINED;
+    ws->val[c] = NAN;
+    index_put(ws, c);
+    return c;
+}
+
+static int ws_resolve(void *ctx, const char *name)
+{
+    ws_resolve_t *r = ctx;
+    if (!valid_name(name) || r->ndeps == EXPR_MAX_VARS) return -1;
+
+    int c = ws_find(r->ws, name);
+    if (c < 0 && strcmp(name, r->name) == 0) c = r->self;
+    if (c < 0) {
+        int k = 0;
+        while (k < r->npending && strcmp(r->pending[k], name) != 0) k++;
+        if (k == WS_MAX_PENDING) return -1;
+        if (k == r->npending) snprintf(r->pending[r->npending++], WS_MAX_NAME, "%s", name);
+        c = r->base + k;
+    }
+    r->deps[r->ndeps++] = c;
+    return c;
+}
+
+// ------------------------------ UPDATES ------------------------------
+
+// Depth-first walk over the dependents of c that sit no higher than
+// max_level (nothing above it can lead back down to a cell at max_level).
+// Marks every cell reached with a new epoch.
+static void ws_walk(worksheet_t *ws, int c, int max_level)
+{
+    int sp = 0;
+    unsigned epoch = ++ws->epoch;
+
+    ws->cells[c].mark = epoch;
+    ws->stack[sp] = c;
+    ws->next[sp++] = 0;
+    while (sp > 0) {
+        ws_cell_t *top = &ws->cells[ws->stack[sp - 1]];
+        if (ws->next[sp - 1] == top->nout) { sp--; continue; }
+        int d = top->out[ws->next[sp - 1]++];
+        if (ws->cells[d].mark != epoch && ws->cells[d].level <= max_level) {
+            ws->cells[d].mark = epoch;
+            ws->stack[sp] = d;
+            ws->next[sp++] = 0;
+        }
+    }
+}
+
+// Restores level(reader) > level(input) below c after c was raised.
+// Levels are never lowered: too high still gives a valid order.
+static void ws_raise(worksheet_t *ws, int c)
+{
+    int sp = 0;
+    unsigned epoch = ++ws->epoch;       // mark = on the stack, so at most once
+
+    ws->stack[sp++] = c;
+    while (sp > 0) {
+        ws_cell_t *x = &ws->cells[ws->stack[--sp]];
+        x->mark = 0;
+        for (int j = 0; j < x->nout; ++j) {
+            ws_cell_t *r = &ws->cells[x->out[j]];
+            if (r->level > x->level) continue;
+            r->level = x->level + 1;
+            if (r->mark != epoch) { r->mark = epoch; ws->stack[sp++] = x->out[j]; }
+        }
+    }
+}
+
+// Dirty cells waiting to be recomputed, as a binary min-heap on level.
+static void heap_push(worksheet_t *ws, int c)
+{
+    int k = ws->nheap++, lv = ws->cells[c].level;
+    while (k > 0 && ws->cells[ws->heap[(k - 1) / 2]].level > lv) {
+        ws->heap[k] = ws->heap[(k - 1) / 2];
+        k = (k - 1) / 2;
+    }
+    ws->heap[k] = c;
+}
+
+static int heap_pop(worksheet_t *ws)
+{
+    int top = ws->heap[0], last = ws->heap[--ws->nheap], n = ws->nheap, k = 0;
+    int lv = ws->cells[last].level;
+    for (;;) {
+        int ch = 2 * k + 1;
+        if (ch >= n) break;
+        if (ch + 1 < n && ws->cells[ws->heap[ch + 1]].level < ws->cells[ws->heap[ch]].level) ch++;
+        if (ws->cells[ws->heap[ch]].level >= lv) break;
+        ws->heap[k] = ws->heap[ch];
+        k = ch;
+    }
+    if (n > 0) ws->heap[k] = last;
+    return top;
+}
+
+// Makes room for one more reader of cell. Returns 0, or -1 if out of memory.
+static int reserve_reader(worksheet_t *ws, ws_cell_t *cell)
+{
+    if (cell->nout < cell->capout) return 0;
+    int cap = cell->capout ? 2 * cell->capout : 4;
+    int *out = ws_realloc(ws, cell->out, (size_t)cell->nout * sizeof *out, (size_t)cap * sizeof *out);
+    if (!out) return -1;
+    cell->out = out;
+    cell->capout = cap;
+    return 0;
+}
+
+static void remove_reader(ws_cell_t *cell, int reader)
+{
+    for (int k = 0; k < cell->nout; ++k)
+        if (cell->out[k] == reader) { cell->out[k] = cell->out[--cell->nout]; return; }
+}
+
+// Stores c's new value and recomputes, lowest level first, every reader
+// of a cell whose value changed.
+static void ws_propagate(worksheet_t *ws, int c, double value)
+{
+    ws->nupdate = 0;
+    ws->nheap = 0;
+    for (int x = c;;) {
+        ws_cell_t *cell = &ws->cells[x];
+        double v = x == c ? value : expr_scalar_eval(cell->expr, ws->val);
+        cell->dirty = 0;
+        ws->update[ws->nupdate++] = x;
+        if (memcmp(&v, &ws->val[x], sizeof v) != 0) {
+            ws->val[x] = v;
+            for (int j = 0; j < cell->nout; ++j) {
+                int r = cell->out[j];
+                if (!ws->cells[r].dirty) { ws->cells[r].dirty = 1; heap_push(ws, r); }
+            }
+        }
+        if (ws->nheap == 0) break;
+        x = heap_pop(ws);
+    }
+}
+
+long ws_set(worksheet_t *ws, const char *name, const char *text, char *err, size_t errlen)
+{
+    STATS_SCOPE(STAT_WORKSHEET_SET);
+    while (*text == ' ' || *text == '\t') text++;
+    size_t len = strlen(text);
+    while (len > 0 && strchr(" \t\r\n", text[len - 1])) len--;
+
+    if (!valid_name(name)) { snprintf(err, errlen, "'%s' is not a valid cell name", name); return -1; }
+    if (len == 0) { snprintf(err, errlen, "%s needs a value or a formula", name); return -1; }
+
+    char *src = malloc(len + 1);
+    if (!src) { snprintf(err, errlen, "out of memory"); return -1; }
+    memcpy(src, text, len);
+    src[len] = '\0';
+
+    int c = ws_find(ws, name), is_new = c < 0;
+    ws_resolve_t r = { .ws = ws, .name = name, .self = is_new ? ws->n : c, .base = ws->n + is_new };
+
+    double value = NAN;
+    const char *end;
+    expr_scalar_t *e = NULL;
+    if (!(sweep_parse_value(src, &value, &end) && *end == '\0') &&
+        !(e = expr_compile_scalar(src, ws_resolve, &r, err, errlen))) {
+        free(src);
+        return -1;
+    }
+
+    // A cycle: the formula reads this cell, or a cell that depends on it.
+    // Only inputs above the cell can depend on it.
+    int max_level = -1;
+    for (int k = 0; k < r.ndeps; ++k) {
+        int lv = r.deps[k] < ws->n ? ws->cells[r.deps[k]].level : 0;     // new cells start at 0
+        if (lv > max_level) max_level = lv;
+    }
+    if (!is_new && max_level > ws->cells[c].level) ws_walk(ws, c, max_level);
+    for (int k = 0; k < r.ndeps; ++k) {
+        int d = r.deps[k];
+        if (d == r.self || (!is_new && d < ws->n && ws->cells[d].level > ws->cells[c].level &&
+                            ws->cells[d].mark == ws->epoch)) {
+            snprintf(err, errlen, "circular reference: %s would depend on itself through %s",
+                     name, d == r.self ? name : ws->cells[d].name);
+            free(e);
+            free(src);
+            return -1;
+        }
+    }
+
+    // Accepted. Allocate everything first (room for the new cells, the
+    // input list, a reader slot on each input), so that running out of
+    // memory leaves the worksheet as it was.
+    int *in = NULL, *pending_out[WS_MAX_PENDING] = {0};
+    if (ws_reserve(ws, is_new + r.npending) != 0) goto oom;
+    if (r.ndeps > 0 && !(in = malloc((size_t)r.ndeps * sizeof *in))) goto oom;
+    for (int k = 0; k < r.npending; ++k)
+        if (!(pending_out[k] = malloc(4 * sizeof *pending_out[k]))) goto oom;
+    for (int k = 0; k < r.ndeps; ++k)
+        if (r.deps[k] < ws->n && reserve_reader(ws, &ws->cells[r.deps[k]]) != 0) goto oom;
+
+    // Nothing below can fail: create the new cells, then rewire the inputs.
+    if (is_new) ws_add(ws, name);
+    for (int k = 0; k < r.npending; ++k) {
+        ws_cell_t *p = &ws->cells[ws_add(ws, r.pending[k])];
+        p->out = pending_out[k];
+        p->capout = 4;
+    }
+
+    ws_cell_t *cell = &ws->cells[c = r.self];
+    for (int k = 0; k < cell->nin; ++k) remove_reader(&ws->cells[cell->in[k]], c);
+    ws_release(ws, cell->in);
+    cell->in = in;
+    cell->nin = r.ndeps;
+    for (int k = 0; k < r.ndeps; ++k) {
+        ws_cell_t *d = &ws->cells[r.deps[k]];
+        d->out[d->nout++] = c;
+        in[k] = r.deps[k];
+    }
+
+    ws_release(ws, cell->text);
+    ws_release(ws, cell->expr);
+    cell->text = src;
+    cell->expr = e;
+    cell->kind = e ? WS_FORMULA : WS_VALUE;
+    if (e) value = expr_scalar_eval(e, ws->val);
+    if (max_level >= cell->level) {
+        cell->level = max_level + 1;
+        ws_raise(ws, c);
+    }
+
+    ws_propagate(ws, c, value);
+    return (long)ws->nupdate;
+
+oom:
+    for (int k = 0; k < r.npending; ++k) free(pending_out[k]);
+    free(in);
+    free(e);
+    free(src);
+    snprintf(err, errlen, "out of memory");
+    return -1;
+}
+
+long ws_assign(worksheet_t *ws, const char *line, char *err, size_t errlen)
+{
+    while (*line == ' ' || *line == '\t') line++;
+    if (*line == '\0' || *line == '#' || *line == '\r' || *line == '\n') return 0;
+
+    const char *eq = strchr(line, '=');
+    if (!eq) { snprintf(err, errlen, "expected NAME = VALUE or NAME = FORMULA"); return -1; }
+
+    char name[WS_MAX_NAME];
+    size_t n = (size_t)(eq - line);
+    while (n > 0 && (line[n - 1] == ' ' || line[n - 1] == '\t')) n--;
+    if (n == 0 || n >= sizeof name) { snprintf(err, errlen, "expected a cell name before '='"); return -1; }
+    memcpy(name, line, n);
+    name[n] = '\0';
+    return ws_set(ws, name, eq + 1, err, errlen);
+}
+
+long ws_load(worksheet_t *ws, const char *path, char *err, size_t errlen)
+{
+    FILE *fp = fopen(path, "r");
+    if (!fp) { snprintf(err, errlen, "cannot open '%s'", path); return -1; }
+
+    char line[4096], msg[200];
+    long lineno = 0, defined = 0;
+    while (fgets(line, sizeof line, fp)) {
+        lineno++;
+        long got = ws_assign(ws, line, msg, sizeof msg);
+        if (got < 0) {
+            snprintf(err, errlen, "line %ld: %s", lineno, msg);
+            fclose(fp);
+            return -1;
+        }
+        if (got > 0) defined++;
+    }
+    fclose(fp);
+    return defined;
+}
+
+// ------------------------------ ACCESS ------------------------------
+
+int ws_count(const worksheet_t *ws)
+{
+    return ws->n;
+}
+
+const char *ws_name(const worksheet_t *ws, int cell)
+{
+    return ws->cells[cell].name;
+}
+
+const char *ws_text(const worksheet_t *ws, int cell)
+{
+    return ws->cells[cell].text ? ws->cells[cell].text : "";
+}
+
+int ws_kind(const worksheet_t *ws, int cell)
+{
+    return ws->cells[cell].kind;
+}
+
+double ws_value(const worksheet_t *ws, int cell)
+{
+    return ws->val[cell];
+}
+
+const int *ws_last_update(const worksheet_t *ws, size_t *n)
+{
+    *n = ws->nupdate;
+    return ws->update;
+}
+
+// ------------------------------ IMAGES ------------------------------
+
+#define WS_IMAGE_MAGIC 0x4d495357u      // "WSIM"
+
+typedef struct {
+    uint32_t magic, cell_size;
+    int32_t n;
+    uint32_t epoch;
+    uint64_t at;                        // address the pointers were written for
+    uint64_t index_cap;
+    uint64_t cells, val, index, blob;   // offsets from the image start
+    uint64_t size;
+} ws_image_hdr_t;
+
+static uint64_t align8(uint64_t x)
+{
+    return (x + 7) & ~(uint64_t)7;
+}
+
+static int write_padded(FILE *fp, const void *p, size_t len)
+{
+    static const char pad[8];
+    size_t extra = (size_t)(align8(len) - len);
+    if (len == 0) return 1;
+    return fwrite(p, 1, len, fp) == len && fwrite(pad, 1, extra, fp) == extra;
+}
+
+size_t ws_image_write(const worksheet_t *ws, FILE *fp, uint64_t at)
+{
+    ws_image_hdr_t h;
+    memset(&h, 0, sizeof h);
+    h.magic = WS_IMAGE_MAGIC;
+    h.cell_size = sizeof(ws_cell_t);
+    h.n = ws->n;
+    h.epoch = ws->epoch;
+    h.at = at;
+    h.index_cap = ws->index_cap;
+    h.cells = align8(sizeof h);
+    h.val = h.cells + (uint64_t)ws->n * sizeof(ws_cell_t);
+    h.index = align8(h.val + (uint64_t)ws->n * sizeof(double));
+    h.blob = align8(h.index + ws->index_cap * sizeof(int));
+
+    // The cells as they will be in memory: each pointer aims at its copy in
+    // the blob that follows, in the same order.
+    uint64_t off = h.blob;
+    for (int c = 0; c < ws->n; ++c) {
+        const ws_cell_t *x = &ws->cells[c];
+        if (x->text) off += align8(strlen(x->text) + 1);
+        if (x->expr) off += align8(expr_scalar_size(x->expr));
+        off += align8((uint64_t)x->nin * sizeof(int)) + align8((uint64_t)x->nout * sizeof(int));
+    }
+    h.size = off;
+
+    int ok = write_padded(fp, &h, sizeof h);
+    off = h.blob;
+    for (int c = 0; c < ws->n && ok; ++c) {
+        ws_cell_t x = ws->cells[c];
+        uint64_t text = x.text ? align8(strlen(x.text) + 1) : 0;
+        uint64_t expr = x.expr ? align8(expr_scalar_size(x.expr)) : 0;
+        x.text = x.text ? (char *)(uintptr_t)(at + off) : NULL;
+        off += text;
+        x.expr = x.expr ? (expr_scalar_t *)(uintptr_t)(at + off) : NULL;
+        off += expr;
+        x.in = x.nin ? (int *)(uintptr_t)(at + off) : NULL;
+        off += align8((uint64_t)x.nin * sizeof(int));
+        x.out = x.nout ? (int *)(uintptr_t)(at + off) : NULL;
+        off += align8((uint64_t)x.nout * sizeof(int));
+        x.capout = x.nout;
+        x.dirty = 0;
+        ok = fwrite(&x, sizeof x, 1, fp) == 1;
+    }
+    ok = ok && write_padded(fp, ws->val, (size_t)ws->n * sizeof(double)) &&
+         write_padded(fp, ws->index, ws->index_cap * sizeof(int));
+    for (int c = 0; c < ws->n && ok; ++c) {
+        const ws_cell_t *x = &ws->cells[c];
+        if (x->text) ok = write_padded(fp, x->text, strlen(x->text) + 1);
+        if (ok && x->expr) ok = write_padded(fp, x->expr, expr_scalar_size(x->expr));
+        if (ok) ok = write_padded(fp, x->in, (size_t)x->nin * sizeof(int)) &&
+                     write_padded(fp, x->out, (size_t)x->nout * sizeof(int));
+    }
+    return ok ? (size_t)h.size : 0;
+}
+
+worksheet_t *ws_image_open(void *image, size_t len, char *err, size_t errlen)
+{
+    const ws_image_hdr_t *h = image;
+    if (len < sizeof *h || h->magic != WS_IMAGE_MAGIC || h->cell_size != sizeof(ws_cell_t) ||
+        h->size > len || h->n < 0 || h->blob > h->size ||
+        h->cells + (uint64_t)h->n * sizeof(ws_cell_t) > h->val ||
+        h->index + h->index_cap * sizeof(int) > h->blob ||
+        (h->index_cap & (h->index_cap - 1)) || h->index_cap < 2 * (uint64_t)h->n) {
+        snprintf(err, errlen, "worksheet image is damaged");
+        return NULL;
+    }
+
+    if (h->n == 0) {                    // nothing to map (and no arrays to point at)
+        worksheet_t *ws = ws_new();
+        if (!ws) snprintf(err, errlen, "out of memory");
+        return ws;
+    }
+
+    worksheet_t *ws = calloc(1, sizeof *ws);
+    size_t cap = (size_t)h->n;
+    if (ws) {
+        ws->heap = malloc(cap * sizeof *ws->heap);
+        ws->stack = malloc(cap * sizeof *ws->stack);
+        ws->next = malloc(cap * sizeof *ws->next);
+        ws->update = malloc(cap * sizeof *ws->update);
+    }
+    if (!ws || !ws->heap || !ws->stack || !ws->next || !ws->update) {
+        ws_free(ws);
+        snprintf(err, errlen, "out of memory");
+        return NULL;
+    }
+
+    char *base = image;
+    ws->image = base;
+    ws->image_len = (size_t)h->size;
+    ws->cells = (ws_cell_t *)(base + h->cells);
+    ws->val = (double *)(base + h->val);
+    ws->index = (int *)(base + h->index);
+    ws->index_cap = (size_t)h->index_cap;
+    ws->n = ws->cap = h->n;
+    ws->epoch = h->epoch;
+
+    // Mapped somewhere else: move every pointer by the same distance.
+    uintptr_t delta = (uintptr_t)base - (uintptr_t)h->at;
+    if (delta != 0) {
+        for (int c = 0; c < ws->n; ++c) {
+            ws_cell_t *x = &ws->cells[c];
+            if (x->text) x->text = (char *)((uintptr_t)x->text + delta);
+            if (x->expr) x->expr = (expr_scalar_t *)((uintptr_t)x->expr + delta);
+            if (x->in) x->in = (int *)((uintptr_t)x->in + delta);
+            if (x->out) x->out = (int *)((uintptr_t)x->out + delta);
+        }
+    }
+    return ws;
+}
@@ -0,0 +1,60 @@
+// Worksheet of linked calculations for the EEE Helper CLI calculator.
+// A worksheet is a set of named cells. A cell holds either a value
+// ("Vin = 12", SI prefixes allowed: "R1 = 4.7k") or a formula in the user
+// formula language (expr.h) over other cells ("Vout = Vin * R2 / (R1 + R2)").
+// Formulas may name cells that are defined later; until then those read as
+// nan. Cycles are rejected.
+//
+// Changing a cell recomputes only the cells that depend on it, each once and
+// after everything it reads, so an edit costs time in proportion to what it
+// affects rather than to the size of the worksheet.
+
+#ifndef WORKSHEET_H
+#define WORKSHEET_H
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdint.h>
+
+typedef struct worksheet worksheet_t;
+
+enum { WS_UNDEFINED, WS_VALUE, WS_FORMULA };
+
+worksheet_t *ws_new(void);
+void         ws_free(worksheet_t *ws);
+
+// Defines or redefines cell `name` from text (a number or a formula).
+// Returns the number of cells recomputed (at least 1), or -1 with a message
+// in err; a rejected edit (bad syntax, a cycle) leaves the worksheet as it was.
+long ws_set(worksheet_t *ws, const char *name, const char *text, char *err, size_t errlen);
+
+// Applies "name = text" (leading spaces and '#' comment lines are skipped:
+// returns 0). Same results as ws_set.
+long ws_assign(worksheet_t *ws, const char *line, char *err, size_t errlen);
+
+// Reads "name = text" lines from a file. Returns the number of cells
+// defined, or -1 with a message naming the first bad line.
+long ws_load(worksheet_t *ws, const char *path, char *err, size_t errlen);
+
+int         ws_count(const worksheet_t *ws);
+int         ws_find(const worksheet_t *ws, const char *name);    // -1 if none
+const char *ws_name(const worksheet_t *ws, int cell);
+const char *ws_text(const worksheet_t *ws, int cell);            // as entered ("" if undefined)
+int         ws_kind(const worksheet_t *ws, int cell);
+double      ws_value(const worksheet_t *ws, int cell);
+
+// Cells recomputed by the last successful ws_set, in the order they were
+// computed (the edited cell first). Valid until the next edit.
+const int *ws_last_update(const worksheet_t *ws, size_t *n);
+
+// Images, for workspace snapshots (session.h). ws_image_write writes the
+// worksheet as one block laid out for use at address `at`, and returns its
+// size (a multiple of 8), or 0 if writing failed. ws_image_open uses such a
+// block in place, wherever it was mapped: no parsing, no compiling, no
+// per-cell allocation. The block must stay mapped, writable (MAP_PRIVATE
+// will do) and 8-byte aligned until ws_free. Images are only valid for the
+// build that wrote them.
+size_t       ws_image_write(const worksheet_t *ws, FILE *fp, uint64_t at);
+worksheet_t *ws_image_open(void *image, size_t len, char *err, size_t errlen);
+
+#endif